@@ -0,0 +1,47 @@
+#!/bin/bash
+# Compare rtcp_bbr2 against rtcp_bbr over an emulated token-bucket policer.
+#
+# Each run sends a fixed amount of data with iperf3 over the policer of
+# netns.sh and reports goodput, retransmissions and the sender's mean
+# smoothed RTT (queueing).
+#
+# Usage: sudo bash bench/bbr2_vs_bbr.sh [runs]
+# Needs iperf3 and python3, and rtcp_bbr/rtcp_bbr2 loaded (command.sh).
+
+RUNS=${1:-3}
+CCS=${CCS:-"rtcp_bbr rtcp_bbr2"}
+SIZE=${SIZE:-200M}
+# "rate burst" pairs for tc police
+POLICERS=${POLICERS:-"10mbit 1mb
+20mbit 4mb
+50mbit 10mb"}
+
+. "$(dirname "$0")/netns.sh"
+
+# goodput(Mbit/s) retransmits mean_rtt(ms) from iperf3 -J on stdin
+summarize() {
+	python3 -c '
+import json, sys
+r = json.load(sys.stdin)["end"]
+s = r["streams"][0]["sender"]
+print("%.2f %d %.2f" % (r["sum_received"]["bits_per_second"] / 1e6,
+			s.get("retransmits", 0), s.get("mean_rtt", 0) / 1000.0))'
+}
+
+trap cleanup EXIT
+setup
+
+printf "%-10s %-8s %-10s %4s %12s %8s %12s\n" \
+	rate burst cc run goodput_mbps retrans mean_rtt_ms
+echo "$POLICERS" | while read rate burst; do
+	police $rate $burst
+	for cc in $CCS; do
+		for run in $(seq 1 $RUNS); do
+			ip netns exec $RCV iperf3 -s -D -1 >/dev/null 2>&1
+			sleep 0.5
+			res=$(ip netns exec $SND iperf3 -c 10.77.0.2 -C $cc -n $SIZE -J | summarize)
+			printf "%-10s %-8s %-10s %4s %12s %8s %12s\n" \
+				$rate $burst $cc $run $res
+		done
+	done
+done
@@ -0,0 +1,67 @@
+#!/bin/bash
+# Differential check of the BPF port's engine (bpf/rtcp_bpf_engine.h)
+# against the module's.
+#
+# Both builds are driven from the same recorded sample stream: every capture
+# is replayed by user/rtcp_replay -B through librtcp, which is rtcp_core.c
+# as rtcp.ko builds it, and through the engine as bpf/rtcp_bbr.bpf.c builds
+# it. After every record the events raised and the whole engine state
+# (struct rtcp_state) must be identical; the first record where a flow
+# differs is printed. Packet timing does not enter, so there is no
+# tolerance.
+#
+# The captures are written by user/rtcp_sim -w for the SCENARIOS below,
+# "name<TAB>rtcp_sim arguments" lines, and any captures given as arguments
+# are checked as well, e.g. one taken from rtcp.ko's debugfs rtcp/trace.
+# What the BPF host does outside the engine (filling the sample from
+# tcp_sock, the BBR model) is not covered.
+#
+# Usage: bash bench/diff_bpf.sh [capture...]    (needs make -C user)
+# Exits non-zero if any flow differs.
+
+DIR="$(dirname "$0")/../user"
+SIM=${SIM:-"$DIR/rtcp_sim"}
+REPLAY=${REPLAY:-"$DIR/rtcp_replay"}
+DURATION=${DURATION:-60}
+
+SCENARIOS=${SCENARIOS:-"policed	-r 5,10,20 -b 200,1000,5000 -t 20,80
+empty-bucket	-r 5,10,20 -b 200,1000,5000 -t 20,80 -f 0
+dual-bucket	-r 5,10 -b 1000,5000 -t 20,80 -D 20,1000
+on-off	-r 5,10,20 -b 1000,5000 -t 20,80 -o 4000,2000
+ack-trains	-r 10 -b 1000 -t 20,80 -a 10
+low-rate	-r 0.064,0.256 -b 16,64 -t 500
+lossy-unpoliced	-r 0 -c 20 -l 3 -t 30
+codel-unpoliced	-r 0 -c 20 -A codel -x 2 -t 40"}
+
+for t in "$SIM" "$REPLAY"; do
+	if [ ! -x "$t" ]; then
+		echo "$t not built (make -C user)" >&2
+		exit 2
+	fi
+done
+
+TMP=$(mktemp -d)
+trap 'rm -rf $TMP' EXIT
+
+fail=0
+check() {
+	printf "%-20s " "$1"
+	if "$REPLAY" -B "$2" > $TMP/out 2> $TMP/err; then
+		tail -n 1 $TMP/err
+	else
+		fail=1
+		tail -n 1 $TMP/err
+		grep 'BPF build differs' $TMP/out
+	fi
+}
+
+while IFS=$'\t' read name args; do
+	[ -n "$name" ] || continue
+	"$SIM" -d $DURATION $args -w $TMP/$name.bin > /dev/null || exit 2
+	check $name $TMP/$name.bin
+done <<< "$SCENARIOS"
+
+for c in "$@"; do
+	check "$(basename "$c")" "$c"
+done
+exit $fail
@@ -0,0 +1,98 @@
+#!/bin/bash
+# False positives of the policer classifier on links that are not policed.
+#
+# Every scenario is a link with no policer that still shows the loss and
+# goodput drops the classifier looks for: bursty Gilbert-Elliott radio loss,
+# CoDel and FQ-CoDel bottlenecks, competing CUBIC flows, and sudden drops of
+# the link rate as on a handover. Each runs in user/rtcp_sim once per seed
+# in SEEDS, as rtcp_bbr and as stock BBR (-n); the seed only changes the
+# random loss, so scenarios without -G or -l give the same result for every
+# seed. Per scenario the script reports:
+#
+#   fp_rate           share of the runs classified as policed
+#   capped_s          mean time the cap was in force, over those runs
+#   goodput_bbr/rtcp  mean goodput, Mbit/s, all runs
+#   lost_pct          goodput rtcp_bbr lost against bbr, % over the false
+#                     positive runs
+#   lost_mbps         the same loss per second of cap, Mbit/s: what a
+#                     wrongly capped flow gives up while capped
+#
+# and the totals over the library. Every run also goes to OUT, tab
+# separated. SCENARIOS holds the library as "name<TAB>rtcp_sim arguments"
+# lines and can be replaced from the environment.
+#
+# Usage: bash bench/false_positive.sh    (needs make -C user)
+
+SIM=${SIM:-"$(dirname "$0")/../user/rtcp_sim"}
+OUT=${OUT:-false_positive.tsv}
+DURATION=${DURATION:-60}
+SEEDS=${SEEDS:-$(seq 1 10)}
+
+# name rtcp_sim arguments; -r 0 (no policer) is added to all
+SCENARIOS=${SCENARIOS:-"ge-short	-c 20 -q 100 -G 1,20,30
+ge-medium	-c 20 -q 100 -G 2,10,50
+ge-long	-c 20 -q 100 -G 0.05,0.1,100
+ge-outage	-c 20 -q 100 -G 1,1,100
+codel	-c 20 -A codel
+codel-4cubic	-c 20 -A codel -x 4
+fq_codel-2cubic	-c 20 -A fq_codel -x 2
+fifo-1cubic	-c 20 -q 50 -x 1
+fifo-4cubic	-c 20 -q 100 -x 4
+handover-50to5	-c 50 -q 100 -B 20,5
+handover-50to2	-c 50 -q 100 -B 5,2
+handover-dip	-c 20 -q 50 -B 15,2,30,20
+handover-fq_codel	-c 50 -q 100 -A fq_codel -x 4 -B 10,10
+handover-ge	-c 50 -q 100 -B 10,5 -G 1,10,50"}
+
+if [ ! -x "$SIM" ]; then
+	echo "$SIM not built (make -C user)" >&2
+	exit 2
+fi
+
+# rtcp_sim's line: rate bucket rtt classify detect_s B_err R_err goodput
+# loss rtt_ms capped_s
+printf "scenario\tseed\tgoodput_bbr\tgoodput_rtcp\tretrans_bbr\tretrans_rtcp\tclassify\tcapped_s\n" > $OUT
+while IFS=$'\t' read name args; do
+	[ -n "$name" ] || continue
+	for seed in $SEEDS; do
+		base=$("$SIM" -H -n -r 0 -d $DURATION -s $seed $args) || exit 2
+		rtcp=$("$SIM" -H -r 0 -d $DURATION -s $seed $args) || exit 2
+		echo "$base $rtcp" | awk -v n=$name -v s=$seed '{
+			m = NF / 2
+			printf "%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\n", n, s, $8, $(m + 8),
+			       $9, $(m + 9), $(m + 4), $(m + 11)
+		}' >> $OUT
+	done
+done <<< "$SCENARIOS"
+
+awk -F'\t' -v d=$DURATION '
+function row(name, k) {
+	printf "%-20s %5d %8.2f %9.2f %12.2f %12.2f %9.1f %10.2f\n", name, n[k],
+	       fp[k] / n[k], fp[k] ? cap[k] / fp[k] : 0, gb[k] / n[k],
+	       gr[k] / n[k], fp[k] ? lost[k] / fp[k] : 0,
+	       cap[k] ? lmb[k] / cap[k] : 0
+}
+NR > 1 {
+	for (i = 0; i < 2; i++) {
+		k = i ? "all" : $1
+		if (!i && !(k in n))
+			order[++keys] = k
+		n[k]++
+		gb[k] += $3
+		gr[k] += $4
+		if ($7 == 1) {
+			fp[k]++
+			cap[k] += $8
+			lost[k] += $3 > 0 ? 100 * ($3 - $4) / $3 : 0
+			lmb[k] += ($3 - $4) * d
+		}
+	}
+}
+END {
+	printf "%-20s %5s %8s %9s %12s %12s %9s %10s\n", "scenario", "runs",
+	       "fp_rate", "capped_s", "goodput_bbr", "goodput_rtcp", "lost_pct",
+	       "lost_mbps"
+	for (j = 1; j <= keys; j++)
+		row(order[j], order[j])
+	row("all", "all")
+}' $OUT
@@ -0,0 +1,119 @@
+#!/usr/bin/env python3
+# Many-connection load generator for bench/scale.sh.
+#
+#   flows.py sink PORT NPORTS
+#       accept on PORT..PORT+NPORTS-1 and discard everything received
+#   flows.py source HOST PORT PER N CC SECONDS
+#       open N connections with congestion control CC, connection i from
+#       source port 20000 + i % PER to HOST port PORT + i // PER, keep every
+#       send buffer full for SECONDS once all are up, then close them
+#
+# The fixed port pairs let scale.sh install one policer per connection. The
+# source prints "up <n>" when the connections are established, then
+# "done <bytes>". One process drives all sockets with epoll; the kernel
+# paces each flow, so the loop only refills buffers.
+
+import errno
+import select
+import socket
+import sys
+import time
+
+CHUNK = b"\0" * 65536
+SPORT = 20000
+
+
+def sink(port, nports):
+    ep = select.epoll()
+    listeners = {}
+    for p in range(port, port + nports):
+        s = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        s.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+        s.bind(("0.0.0.0", p))
+        s.listen(65535)
+        s.setblocking(False)
+        ep.register(s.fileno(), select.EPOLLIN)
+        listeners[s.fileno()] = s
+    conns = {}
+    while True:
+        for fd, ev in ep.poll(1.0, 4096):
+            if fd in listeners:
+                while True:
+                    try:
+                        c, _ = listeners[fd].accept()
+                    except BlockingIOError:
+                        break
+                    c.setblocking(False)
+                    ep.register(c.fileno(), select.EPOLLIN | select.EPOLLET)
+                    conns[c.fileno()] = c
+                continue
+            c = conns[fd]
+            while True:
+                try:
+                    if not c.recv(1 << 20):
+                        ep.unregister(fd)
+                        c.close()
+                        del conns[fd]
+                        break
+                except BlockingIOError:
+                    break
+                except OSError:
+                    ep.unregister(fd)
+                    c.close()
+                    del conns[fd]
+                    break
+
+
+def source(host, port, per, n, cc, seconds):
+    ep = select.epoll()
+    socks = {}
+    for i in range(n):
+        s = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        s.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+        s.setsockopt(socket.IPPROTO_TCP, socket.TCP_CONGESTION, cc.encode())
+        s.bind(("0.0.0.0", SPORT + i % per))
+        s.setblocking(False)
+        err = s.connect_ex((host, port + i // per))
+        if err not in (0, errno.EINPROGRESS):
+            sys.exit("connection %d: %s" % (i, errno.errorcode.get(err, err)))
+        ep.register(s.fileno(), select.EPOLLOUT | select.EPOLLET)
+        socks[s.fileno()] = s
+
+    up = set()
+    sent = 0
+    end = None
+    while end is None or time.monotonic() < end:
+        for fd, ev in ep.poll(1.0, 4096):
+            s = socks.get(fd)
+            if s is None:
+                continue
+            if ev & (select.EPOLLERR | select.EPOLLHUP):
+                sys.exit("connection on port %d failed" % s.getsockname()[1])
+            if fd not in up:
+                up.add(fd)
+                if len(up) == n:
+                    print("up %d" % n, flush=True)
+                    end = time.monotonic() + seconds
+            while True:
+                try:
+                    sent += s.send(CHUNK)
+                except BlockingIOError:
+                    break
+    for s in socks.values():
+        s.close()
+    print("done %d" % sent, flush=True)
+
+
+def main():
+    if len(sys.argv) == 4 and sys.argv[1] == "sink":
+        sink(int(sys.argv[2]), int(sys.argv[3]))
+    elif len(sys.argv) == 8 and sys.argv[1] == "source":
+        source(sys.argv[2], int(sys.argv[3]), int(sys.argv[4]),
+               int(sys.argv[5]), sys.argv[6], float(sys.argv[7]))
+    else:
+        sys.exit("usage: flows.py sink PORT NPORTS | "
+                 "source HOST PORT PER N CC SECONDS")
+
+
+if __name__ == "__main__":
+    main()
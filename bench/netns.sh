@@ -0,0 +1,59 @@
+# Emulated token-bucket policer shared by the bench scripts; source it.
+#
+# Two network namespaces joined by a veth pair: the sender side adds the
+# base RTT (and optional jitter) with netem, the receiver side limits
+# ingress with a token bucket. police() drops everything above the bucket,
+# like a carrier policer; shape() queues it in a tbf first, like a carrier
+# shaper. tbf cannot sit on ingress, so shape() redirects it through an ifb.
+
+RTT=${RTT:-40ms}
+JITTER=${JITTER:-}
+
+SND=rtcp_snd
+RCV=rtcp_rcv
+
+cleanup() {
+	ip netns del $SND 2>/dev/null
+	ip netns del $RCV 2>/dev/null
+}
+
+setup() {
+	cleanup
+	ip netns add $SND
+	ip netns add $RCV
+	ip link add veth_snd netns $SND type veth peer name veth_rcv netns $RCV
+	ip -n $SND addr add 10.77.0.1/24 dev veth_snd
+	ip -n $RCV addr add 10.77.0.2/24 dev veth_rcv
+	ip -n $SND link set veth_snd up
+	ip -n $RCV link set veth_rcv up
+	ip netns exec $SND tc qdisc add dev veth_snd root netem delay $RTT $JITTER limit 100000
+	ip netns exec $SND sysctl -q net.ipv4.tcp_no_metrics_save=1
+}
+
+# delay rtt [jitter]: change the base RTT of a running setup
+delay() {
+	ip netns exec $SND tc qdisc change dev veth_snd root netem delay $1 $2 limit 100000
+}
+
+unlimit() {
+	ip netns exec $RCV tc qdisc del dev veth_rcv ingress 2>/dev/null
+	ip -n $RCV link del ifb_rcv 2>/dev/null
+}
+
+police() {
+	unlimit
+	ip netns exec $RCV tc qdisc add dev veth_rcv handle ffff: ingress
+	ip netns exec $RCV tc filter add dev veth_rcv parent ffff: protocol ip \
+		u32 match u32 0 0 police rate $1 burst $2 drop flowid :1
+}
+
+# shape rate burst [limit]: tbf with a queue of limit bytes (default burst)
+shape() {
+	unlimit
+	ip -n $RCV link add ifb_rcv type ifb
+	ip -n $RCV link set ifb_rcv up
+	ip netns exec $RCV tc qdisc add dev ifb_rcv root tbf rate $1 burst $2 limit ${3:-$2}
+	ip netns exec $RCV tc qdisc add dev veth_rcv handle ffff: ingress
+	ip netns exec $RCV tc filter add dev veth_rcv parent ffff: protocol ip \
+		u32 match u32 0 0 action mirred egress redirect dev ifb_rcv
+}
@@ -0,0 +1,102 @@
+#!/bin/bash
+# Regression check of R-TCP against stock BBR in the userspace simulator.
+#
+# Every scenario runs twice in user/rtcp_sim: once as rtcp_bbr, and once with
+# -n, where the same host ignores the engine (stock BBR). The runs are
+# deterministic, so results only change when the code does. Scenarios cover
+# policed, shaped, unlimited and lossy-but-unpoliced (radio) links; each has
+# an expectation:
+#
+#   policed   detected within MAX_DETECT_S, B and R estimates within
+#             B_ERR_MAX and R_ERR_MAX percent, at most CAP_LOSS_MAX percent
+#             loss while capped, no more loss than bbr, goodput at least
+#             POLICED_GOODPUT_MIN of bbr's (the cap trades some goodput for
+#             loss)
+#   clean     not detected (a false positive), goodput at least GOODPUT_MIN
+#             of bbr's, RTT at most RTT_MAX of bbr's
+#   any       goodput at least GOODPUT_MIN of bbr's
+#
+# Output is tab separated, one row per scenario and congestion control, with
+# the verdict on the rtcp_bbr row; the engine's columns are "-" on the bbr
+# row, which runs without it. It also goes to OUT, by default
+# user/regress.tsv next to the build. Exits non-zero if any scenario fails.
+#
+# Usage: bash bench/regress.sh    (or make bench)
+
+SIM=${SIM:-"$(dirname "$0")/../user/rtcp_sim"}
+OUT=${OUT:-"$(dirname "$0")/../user/regress.tsv"}
+DURATION=${DURATION:-60}
+MAX_DETECT_S=${MAX_DETECT_S:-30}
+GOODPUT_MIN=${GOODPUT_MIN:-0.95}
+POLICED_GOODPUT_MIN=${POLICED_GOODPUT_MIN:-0.90}
+RTT_MAX=${RTT_MAX:-1.10}
+B_ERR_MAX=${B_ERR_MAX:-20}
+R_ERR_MAX=${R_ERR_MAX:-5}
+CAP_LOSS_MAX=${CAP_LOSS_MAX:-1}
+
+# name expectation rtcp_sim arguments
+SCENARIOS=${SCENARIOS:-"policed-2m	policed	-r 2 -b 500 -t 80
+policed-10m	policed	-r 10 -b 1000 -t 40
+policed-10m-deep	policed	-r 10 -b 10000 -t 40
+policed-50m	policed	-r 50 -b 10000 -t 20
+shaped-10m	any	-r 10 -b 100 -S 200 -t 40
+unlimited-20m	clean	-r 0 -c 20 -t 40
+unlimited-100m	clean	-r 0 -c 100 -t 20
+radio-1pct	clean	-r 0 -c 20 -l 1 -t 30
+radio-3pct	clean	-r 0 -c 20 -l 3 -t 30
+radio-5pct-long	clean	-r 0 -c 50 -l 5 -t 120"}
+
+if [ ! -x "$SIM" ]; then
+	echo "$SIM not built (make -C user)" >&2
+	exit 2
+fi
+
+# rtcp_sim's line: rate bucket rtt classify detect_s B_err R_err goodput loss
+# rtt_ms capped_s cap_loss model
+run() {
+	"$SIM" -H -d $DURATION "$@"
+}
+
+printf "scenario\tcc\tgoodput_mbps\tretrans_pct\trtt_ms\tclassify\tdetect_s\tB_err_pct\tR_err_pct\tcap_loss_pct\tverdict\n" | tee $OUT
+fail=0
+total=0
+while IFS=$'\t' read name expect args; do
+	[ -n "$name" ] || continue
+	base=$(run -n $args) || exit 2
+	rtcp=$(run $args) || exit 2
+	echo "$base" | awk -v n=$name '{ printf "%s\tbbr\t%s\t%s\t%s\t-\t-\t-\t-\t-\t-\n", n, $8, $9, $10 }' | tee -a $OUT
+	verdict=$(echo "$base $rtcp" | awk -v e=$expect -v d=$MAX_DETECT_S \
+		-v g=$GOODPUT_MIN -v gp=$POLICED_GOODPUT_MIN -v r=$RTT_MAX \
+		-v be=$B_ERR_MAX -v re=$R_ERR_MAX -v cl=$CAP_LOSS_MAX '{
+		# bbr first, then rtcp_bbr from $(m + 1)
+		m = NF / 2
+		why = ""
+		if ($(m + 8) < (e == "policed" ? gp : g) * $8)
+			why = why ",goodput"
+		if (e == "policed") {
+			if ($(m + 4) != 1 || $(m + 5) < 0 || $(m + 5) > d)
+				why = why ",detect"
+			if ($(m + 6) > be || $(m + 6) < -be)
+				why = why ",B_err"
+			if ($(m + 7) > re || $(m + 7) < -re)
+				why = why ",R_err"
+			if ($(m + 12) > cl)
+				why = why ",cap_loss"
+			if ($(m + 9) > $9)
+				why = why ",loss"
+		}
+		if (e == "clean") {
+			if ($(m + 4) == 1)
+				why = why ",false_positive"
+			if ($(m + 10) > r * $10)
+				why = why ",rtt"
+		}
+		print why == "" ? "pass" : "FAIL" why
+	}')
+	echo "$rtcp" | awk -v n=$name -v v=$verdict '{ printf "%s\trtcp_bbr\t%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\n", n, $8, $9, $10, $4, $5, $6, $7, $12, v }' | tee -a $OUT
+	total=$((total + 1))
+	case $verdict in pass) ;; *) fail=$((fail + 1)) ;; esac
+done <<< "$SCENARIOS"
+
+echo "$((total - fail))/$total scenarios passed" >&2
+[ $fail -eq 0 ]
@@ -0,0 +1,195 @@
+#!/bin/bash
+# Host cost of many concurrent flows, each behind its own policer.
+#
+# For every flow count and congestion control, bench/flows.py opens that
+# many paced connections across the namespaces of netns.sh, every one
+# policed at FLOW_RATE with a FLOW_BURST bucket (one tc flower filter per
+# connection). After WARMUP seconds the script measures DURATION seconds
+# and reports:
+#
+#   goodput_mbps    IP bytes into the receiver, all flows
+#   retrans%        retransmitted share of the segments sent
+#   acks/s          segments into the sender
+#   ns/ack          system, irq and softirq CPU time per segment into the
+#                   sender, host wide (both ends and the policers)
+#   softirq%        softirq share of all CPU time
+#   slab_kb/flow    kernel slab growth per flow since before the connections
+#                   opened: sockets, policers and congestion control state
+#                   (PMODRL and its history buffer for rtcp_bbr)
+#   tcp_kb/flow     TCP buffer memory per flow (sockstat)
+#
+# ns/ack and slab_kb/flow include the load generator's and the policers'
+# share, so compare rtcp_bbr against bbr at the same flow count rather than
+# reading them in isolation.
+#
+# Usage: sudo bash bench/scale.sh [runs]
+# Needs python3 and rtcp_bbr loaded (command.sh). The aggregate rate is
+# flows * FLOW_RATE and must fit the host; lower FLOW_RATE for the large
+# counts, e.g. FLOWS=100000 FLOW_RATE=50kbit.
+
+RUNS=${1:-1}
+CCS=${CCS:-"bbr rtcp_bbr"}
+FLOWS=${FLOWS:-"10000 30000 100000"}
+FLOW_RATE=${FLOW_RATE:-200kbit}
+FLOW_BURST=${FLOW_BURST:-64kb}
+WARMUP=${WARMUP:-10}
+DURATION=${DURATION:-30}
+OUT=${OUT:-scale.txt}
+
+PORT=5201
+PER=40000	# connections per server port, source ports 20000-59999
+FLOWS_PY="$(dirname "$0")/flows.py"
+
+. "$(dirname "$0")/netns.sh"
+
+TMP=$(mktemp -d)
+
+# "user nice system idle iowait irq softirq steal" jiffies, all CPUs
+cpu_jiffies() {
+	awk '$1 == "cpu" { print $2, $3, $4, $5, $6, $7, $8, $9 }' /proc/stat
+}
+
+# value of field in the "Proto: names" / "Proto: values" pairs of a netns
+snmp() {
+	ip netns exec $1 cat /proc/net/snmp /proc/net/netstat | awk -v p="$2:" -v f="$3" '
+		$1 == p && !h { for (i = 2; i <= NF; i++) if ($i == f) c = i; h = 1; next }
+		$1 == p && h { print $c; exit }'
+}
+
+slab_kb() {
+	awk '$1 == "Slab:" { print $2 }' /proc/meminfo
+}
+
+tcp_pages() {
+	awk '$1 == "TCP:" { for (i = 2; i < NF; i++) if ($i == "mem") print $(i + 1) }' /proc/net/sockstat
+}
+
+snapshot() {
+	echo $(cpu_jiffies) $(snmp $SND Tcp InSegs) $(snmp $SND Tcp OutSegs) \
+		$(snmp $SND Tcp RetransSegs) $(snmp $RCV IpExt InOctets) \
+		$(slab_kb) $(tcp_pages)
+}
+
+# One tc flower policer per connection, matched on its port pair
+policers() {
+	unlimit
+	ip netns exec $RCV tc qdisc add dev veth_rcv handle ffff: ingress
+	awk -v n=$1 -v per=$PER -v port=$PORT -v rate=$FLOW_RATE -v burst=$FLOW_BURST 'BEGIN {
+		for (i = 0; i < n; i++)
+			printf "filter add dev veth_rcv parent ffff: protocol ip prio 1 flower skip_hw ip_proto tcp src_port %d dst_port %d action police rate %s burst %s conform-exceed drop\n",
+			       20000 + i % per, port + int(i / per), rate, burst
+	}' > $TMP/filters
+	ip netns exec $RCV tc -batch $TMP/filters
+}
+
+row() {
+	printf "%7s %-9s %4s %12s %8s %10s %7s %8s %12s %11s\n" "$@"
+}
+
+stop() {
+	[ -n "$SINK" ] && kill $SINK 2>/dev/null
+	[ -n "$SOURCE" ] && kill $SOURCE 2>/dev/null
+	wait 2>/dev/null
+	SINK= SOURCE=
+}
+
+finish() {
+	stop
+	cleanup
+	rm -rf $TMP
+}
+
+for cc in $CCS; do
+	grep -qw $cc /proc/sys/net/ipv4/tcp_available_congestion_control ||
+		modprobe tcp_$cc 2>/dev/null ||
+		echo "warning: $cc is not available" >&2
+done
+
+max=$(echo $FLOWS | tr ' ' '\n' | sort -n | tail -1)
+[ $(cat /proc/sys/fs/nr_open) -ge $((max + 1024)) ] ||
+	sysctl -q fs.nr_open=$((max + 1024))
+ulimit -n $((max + 1024)) || exit 1
+
+trap finish EXIT
+setup
+for ns in $SND $RCV; do
+	ip netns exec $ns sysctl -q net.core.somaxconn=65535
+	ip netns exec $ns sysctl -q net.ipv4.tcp_max_syn_backlog=65535
+done
+ip netns exec $SND sysctl -q net.ipv4.ip_local_port_range="60000 65000"
+
+row flows cc run goodput_mbps retrans% acks/s ns/ack softirq% slab_kb/flow tcp_kb/flow | tee $OUT
+for n in $FLOWS; do
+	policers $n || exit 1
+	for cc in $CCS; do
+		for run in $(seq 1 $RUNS); do
+			ip netns exec $RCV python3 $FLOWS_PY sink $PORT $(((n + PER - 1) / PER)) &
+			SINK=$!
+			sleep 1
+			slab0=$(slab_kb)
+			ip netns exec $SND python3 $FLOWS_PY source 10.77.0.2 $PORT $PER $n $cc \
+				$((WARMUP + DURATION + 2)) > $TMP/source &
+			SOURCE=$!
+			for i in $(seq 1 600); do
+				grep -q "^up" $TMP/source && break
+				kill -0 $SOURCE 2>/dev/null || break
+				sleep 1
+			done
+			if ! grep -q "^up" $TMP/source; then
+				echo "$n $cc flows did not come up" >&2
+				row $n $cc $run - - - - - - - | tee -a $OUT
+				stop
+				continue
+			fi
+			sleep $WARMUP
+			a=$(snapshot)
+			sleep $DURATION
+			b=$(snapshot)
+			wait $SOURCE
+			SOURCE=
+			stop
+
+			echo $a $b | awk -v n=$n -v d=$DURATION -v hz=$(getconf CLK_TCK) \
+				-v slab0=$slab0 -v page=$(getconf PAGESIZE) '{
+				# 1-8 cpu, 9 insegs, 10 outsegs, 11 retrans, 12 octets,
+				# 13 slab, 14 tcp pages; the second snapshot follows
+				m = 14
+				for (i = 1; i <= 8; i++) {
+					dc[i] = $(m + i) - $i
+					total += dc[i]
+				}
+				acks = $(m + 9) - $9
+				out = $(m + 10) - $10
+				printf "%.2f %.2f %.0f %.0f %.2f %.2f %.2f\n",
+					($(m + 12) - $12) * 8 / d / 1e6,
+					out ? 100 * ($(m + 11) - $11) / out : 0,
+					acks / d,
+					acks ? (dc[3] + dc[6] + dc[7]) * 1e9 / hz / acks : 0,
+					total ? 100 * dc[7] / total : 0,
+					($13 - slab0) / n,
+					$14 * page / 1024 / n
+			}' > $TMP/res
+			row $n $cc $run $(cat $TMP/res) | tee -a $OUT
+		done
+	done
+done
+unlimit
+
+echo
+echo "mean over $RUNS run(s):"
+printf "%7s %-9s %12s %8s %10s %7s %8s %12s %11s\n" flows cc goodput_mbps retrans% acks/s ns/ack softirq% slab_kb/flow tcp_kb/flow
+awk 'NR > 1 && $4 != "-" {
+	k = $1 " " $2
+	if (!(k in n)) order[++keys] = k
+	n[k]++
+	for (i = 4; i <= 10; i++) s[k, i] += $i
+}
+END {
+	for (j = 1; j <= keys; j++) {
+		k = order[j]
+		split(k, f, " ")
+		printf "%7s %-9s %12.2f %8.2f %10.0f %7.0f %8.2f %12.2f %11.2f\n", f[1], f[2],
+		       s[k, 4] / n[k], s[k, 5] / n[k], s[k, 6] / n[k], s[k, 7] / n[k],
+		       s[k, 8] / n[k], s[k, 9] / n[k], s[k, 10] / n[k]
+	}
+}' $OUT
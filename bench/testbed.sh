@@ -0,0 +1,97 @@
+#!/bin/bash
+# Benchmark matrix of congestion controls over emulated carrier policers.
+#
+# For every combination of limiter (tc police or tbf), rate, bucket and
+# RTT, each congestion control downloads enough data to drain the bucket
+# and then run DURATION seconds at the token rate, over the namespaces of
+# netns.sh. Each run reports goodput, loss (retransmitted share of the bytes
+# sent) and completion time; a summary of the means per setting and
+# congestion control follows.
+#
+# Usage: sudo bash bench/testbed.sh [runs]
+# Needs iperf3 and python3, and rtcp_bbr loaded (command.sh). Rates are in
+# Mbit/s, buckets in KB, so the defaults span 0.5-50 Mbit/s and
+# 100 KB-50 MB. The full default matrix takes several hours; narrow it
+# from the environment, e.g. RATES="10" BUCKETS="1000 10000".
+
+RUNS=${1:-1}
+CCS=${CCS:-"cubic bbr rtcp_bbr"}
+LIMITERS=${LIMITERS:-"police tbf"}
+RATES=${RATES:-"0.5 2 10 50"}
+BUCKETS=${BUCKETS:-"100 1000 10000 50000"}
+RTTS=${RTTS:-"20ms 80ms"}
+JITTER=${JITTER:-}
+DURATION=${DURATION:-30}
+OUT=${OUT:-testbed.txt}
+
+. "$(dirname "$0")/netns.sh"
+
+# goodput(Mbit/s) loss(%) completion(s) from iperf3 -J on stdin
+summarize() {
+	python3 -c '
+import json, sys
+r = json.load(sys.stdin)
+mss = r["start"].get("tcp_mss_default", 1448)
+e = r["end"]
+s = e["sum_sent"]
+loss = 100.0 * e["streams"][0]["sender"].get("retransmits", 0) * mss / max(s["bytes"], 1)
+print("%.2f %.2f %.2f" % (e["sum_received"]["bits_per_second"] / 1e6,
+			  loss, s["seconds"]))'
+}
+
+row() {
+	printf "%-7s %6s %7s %6s %-9s %4s %12s %7s %12s\n" "$@"
+}
+
+for cc in $CCS; do
+	grep -qw $cc /proc/sys/net/ipv4/tcp_available_congestion_control ||
+		modprobe tcp_$cc 2>/dev/null ||
+		echo "warning: $cc is not available" >&2
+done
+
+trap cleanup EXIT
+setup
+
+row limiter rate bucket rtt cc run goodput_mbps loss% completion_s | tee $OUT
+for rtt in $RTTS; do
+	delay $rtt $JITTER
+	for limiter in $LIMITERS; do
+		for rate in $RATES; do
+			for bucket in $BUCKETS; do
+				if ! $limiter ${rate}mbit ${bucket}kb 2>/dev/null; then
+					echo "$limiter ${rate}mbit ${bucket}kb rejected by tc, skipped" >&2
+					continue
+				fi
+				size=$(awk "BEGIN { printf \"%d\", $bucket * 1000 + $rate * 1e6 / 8 * $DURATION }")
+				for cc in $CCS; do
+					for run in $(seq 1 $RUNS); do
+						ip netns exec $RCV iperf3 -s -D -1 >/dev/null 2>&1
+						sleep 0.5
+						res=$(timeout $((DURATION * 4 + 60)) \
+							ip netns exec $SND iperf3 -c 10.77.0.2 -C $cc -n $size -J | summarize 2>/dev/null)
+						[ -n "$res" ] || res="- - -"
+						row $limiter $rate $bucket $rtt $cc $run $res | tee -a $OUT
+					done
+				done
+			done
+		done
+	done
+done
+unlimit
+
+echo
+echo "mean over $RUNS run(s):"
+printf "%-7s %6s %7s %6s %-9s %12s %7s %12s\n" limiter rate bucket rtt cc goodput_mbps loss% completion_s
+awk 'NR > 1 && $7 != "-" {
+	k = $1 " " $2 " " $3 " " $4 " " $5
+	if (!(k in n)) order[++keys] = k
+	n[k]++; g[k] += $7; l[k] += $8; t[k] += $9
+}
+END {
+	for (i = 1; i <= keys; i++) {
+		k = order[i]
+		split(k, f, " ")
+		printf "%-7s %6s %7s %6s %-9s %12.2f %7.2f %12.2f\n", f[1], f[2], f[3], f[4], f[5],
+		       g[k] / n[k], l[k] / n[k], t[k] / n[k]
+	}
+}' $OUT
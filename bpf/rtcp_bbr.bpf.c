@@ -0,0 +1,1273 @@
+/*
+ * R-TCP-BBRv1 as a BPF struct_ops congestion control
+ *
+ * The same algorithm as rtcp_bbr.c, loaded with bpftool instead of modprobe,
+ * so that a new build can be registered while sockets still run the old one.
+ * The R-TCP engine is rtcp_core.c, compiled into this program through
+ * rtcp_bpf_engine.h, which rtcp_replay -B also builds so that the two can be
+ * compared on the same capture; only the environment differs from the
+ * kernel module:
+ *
+ *   - struct bbr stays in icsk_ca_priv; the engine state (struct PMODRL) is
+ *     in a BPF_MAP_TYPE_SK_STORAGE map, created in init() and freed with the
+ *     socket. The slot that holds the PMODRL pointer in the module holds
+ *     cycle_mstamp here.
+ *   - Engine events are collected during rtcp_ack() and handled right after
+ *     it, instead of through struct rtcp_ops callbacks.
+ *   - The engine parameters are global variables in the .data map, the
+ *     counterpart of /sys/module/rtcp/parameters. So are deterministic and
+ *     rand_seed: the engine clock and the random cycle phase follow the
+ *     module's deterministic mode, draw for draw.
+ *   - get_info() is not available to BPF, and printk output goes to the
+ *     trace pipe with fewer fields.
+ *
+ * Needs a kernel with BTF and struct_ops support for tcp_congestion_ops that
+ * lets BPF write tp->app_limited (6.3 or later). See the Makefile in this
+ * directory.
+ *
+ * The R-TCP module was designed and implemented by
+ * Shengtong Zhu, Yan Liu, Lingfeng Guo and Jack Y. B. Lee,
+ *  "R-TCP: A Framework to Optimize TCP Performance Over Rate-Limiting Networks", NSDI, 2026.
+ *
+ * Contact  : zs021@ie.cuhk.edu.hk
+ */
+#include "vmlinux.h"
+#include <bpf/bpf_helpers.h>
+#include <bpf/bpf_tracing.h>
+#include <bpf/bpf_core_read.h>
+#include <bpf/bpf_endian.h>
+
+#ifndef RTCP_BPF_NAME
+#define RTCP_BPF_NAME "rtcp_bbr_bpf"
+#endif
+
+/* Kernel helpers and constants that vmlinux.h does not carry */
+extern unsigned int CONFIG_HZ __kconfig;
+#define HZ CONFIG_HZ
+
+#define AF_INET6		10
+#define TCP_INFINITE_SSTHRESH	0x7fffffff
+#define TCP_INIT_CWND		10
+#define RTCP_GSO_MAX_SIZE	65536	/* legacy limit, see rtcp_compat.h */
+
+/* The cache line of the target, as <asm/cache.h> has it */
+#if defined(__TARGET_ARCH_x86)
+extern int CONFIG_X86_L1_CACHE_SHIFT __kconfig;
+#define L1_CACHE_SHIFT		CONFIG_X86_L1_CACHE_SHIFT
+#elif defined(__TARGET_ARCH_arm64)
+#define L1_CACHE_SHIFT		6
+#else
+#error "L1_CACHE_SHIFT is not known for this target, see MAX_TCP_HEADER"
+#endif
+#define L1_CACHE_BYTES		(1U << L1_CACHE_SHIFT)
+#define L1_CACHE_ALIGN(x)	(((x) + L1_CACHE_BYTES - 1) & ~(L1_CACHE_BYTES - 1))
+#define SMP_CACHE_BYTES		L1_CACHE_BYTES
+
+/* MAX_TCP_HEADER is L1_CACHE_ALIGN(128 + MAX_HEADER), and MAX_HEADER depends
+ * on the link layers and tunnels the kernel is built with: worked out from
+ * its config as <linux/netdevice.h> does.
+ */
+extern bool CONFIG_WLAN __kconfig __weak;
+extern bool CONFIG_MAC80211_MESH __kconfig __weak;
+extern enum libbpf_tristate CONFIG_HYPERV_NET __kconfig __weak;
+extern enum libbpf_tristate CONFIG_AX25 __kconfig __weak;
+extern enum libbpf_tristate CONFIG_NET_IPIP __kconfig __weak;
+extern enum libbpf_tristate CONFIG_NET_IPGRE __kconfig __weak;
+extern enum libbpf_tristate CONFIG_IPV6_SIT __kconfig __weak;
+extern enum libbpf_tristate CONFIG_IPV6_TUNNEL __kconfig __weak;
+
+static __always_inline u32 rtcp_max_tcp_header(void)
+{
+	u32 max_header = 32;	/* LL_MAX_HEADER */
+
+	if (CONFIG_HYPERV_NET == TRI_YES)
+		max_header = 128;
+	else if (CONFIG_WLAN || CONFIG_AX25 != TRI_NO)
+		max_header = CONFIG_MAC80211_MESH ? 128 : 96;
+	if (CONFIG_NET_IPIP != TRI_NO || CONFIG_NET_IPGRE != TRI_NO ||
+	    CONFIG_IPV6_SIT != TRI_NO || CONFIG_IPV6_TUNNEL != TRI_NO)
+		max_header += 48;
+	return L1_CACHE_ALIGN(128 + max_header);
+}
+#define MAX_TCP_HEADER		rtcp_max_tcp_header()
+#define SKB_DATA_ALIGN(x)	(((x) + (SMP_CACHE_BYTES - 1)) & ~(SMP_CACHE_BYTES - 1))
+#define SKB_TRUESIZE(x)		((x) + SKB_DATA_ALIGN(bpf_core_type_size(struct sk_buff)) + \
+				 SKB_DATA_ALIGN(bpf_core_type_size(struct skb_shared_info)))
+
+/* The engine, and the helpers it shares with the code below */
+#include "rtcp_bpf_engine.h"
+
+#define tcp_jiffies32	((u32)bpf_jiffies64())
+
+static __always_inline u32 jiffies_to_usecs(u32 j)
+{
+	return (USEC_PER_SEC / HZ) * j;
+}
+
+static __always_inline u32 msecs_to_jiffies(u32 m)
+{
+	return (m + (MSEC_PER_SEC / HZ) - 1) / (MSEC_PER_SEC / HZ);
+}
+
+static __always_inline struct tcp_sock *tcp_sk(const struct sock *sk)
+{
+	return (struct tcp_sock *)sk;
+}
+
+static __always_inline struct inet_connection_sock *inet_csk(const struct sock *sk)
+{
+	return (struct inet_connection_sock *)sk;
+}
+
+static __always_inline void *inet_csk_ca(const struct sock *sk)
+{
+	return (void *)inet_csk(sk)->icsk_ca_priv;
+}
+
+static __always_inline u32 tcp_packets_in_flight(const struct tcp_sock *tp)
+{
+	return tp->packets_out - (tp->sacked_out + tp->lost_out) +
+	       tp->retrans_out;
+}
+
+static __always_inline u32 tcp_min_rtt(const struct tcp_sock *tp)
+{
+	return tp->rtt_min.s[0].v;
+}
+
+static __always_inline s64 tcp_stamp_us_delta(u64 t1, u64 t0)
+{
+	return max_t(s64, t1 - t0, 0);
+}
+
+/* lib/win_minmax.c, for the max bw filter */
+static u32 minmax_subwin_update(struct minmax *m, u32 win,
+				const struct minmax_sample *val)
+{
+	u32 dt = val->t - m->s[0].t;
+
+	if (unlikely(dt > win)) {
+		/*
+		 * Passed entire window without a new val so make 2nd
+		 * choice the new val & 3rd choice the new 2nd choice.
+		 * we may have to iterate this since our 2nd choice
+		 * may also be outside the window (we checked on entry
+		 * that the third choice was in the window).
+		 */
+		m->s[0] = m->s[1];
+		m->s[1] = m->s[2];
+		m->s[2] = *val;
+		if (unlikely(val->t - m->s[0].t > win)) {
+			m->s[0] = m->s[1];
+			m->s[1] = m->s[2];
+			m->s[2] = *val;
+		}
+	} else if (unlikely(m->s[1].t == m->s[0].t) && dt > win/4) {
+		/*
+		 * We've passed a quarter of the window without a new val
+		 * so take a 2nd choice from the 2nd quarter of the window.
+		 */
+		m->s[2] = m->s[1] = *val;
+	} else if (unlikely(m->s[2].t == m->s[1].t) && dt > win/2) {
+		/*
+		 * We've passed half the window without finding a new val
+		 * so take a 3rd choice from the last half of the window
+		 */
+		m->s[2] = *val;
+	}
+	return m->s[0].v;
+}
+
+static u32 minmax_reset(struct minmax *m, u32 t, u32 meas)
+{
+	struct minmax_sample val = { .t = t, .v = meas };
+
+	m->s[2] = m->s[1] = m->s[0] = val;
+	return m->s[0].v;
+}
+
+static u32 minmax_running_max(struct minmax *m, u32 win, u32 t, u32 meas)
+{
+	struct minmax_sample val = { .t = t, .v = meas };
+
+	if (unlikely(val.v >= m->s[0].v) ||	  /* found new max? */
+	    unlikely(val.t - m->s[2].t > win))	  /* nothing left in window? */
+		return minmax_reset(m, t, meas);  /* forget earlier samples */
+
+	if (unlikely(val.v >= m->s[1].v))
+		m->s[2] = m->s[1] = val;
+	else if (unlikely(val.v >= m->s[2].v))
+		m->s[2] = val;
+
+	return minmax_subwin_update(m, win, &val);
+}
+
+static __always_inline u32 minmax_get(const struct minmax *m)
+{
+	return m->s[0].v;
+}
+
+int enable_printk = 1;
+
+/* Deterministic mode, the deterministic and rand_seed parameters of rtcp.ko
+ * (see rtcp.h). A flow keeps the mode it started with.
+ */
+int deterministic = 0;
+u32 rand_seed = 0;
+
+/* Deterministic time of the first ACK; not 0, which the engine reads as unset */
+#define RTCP_CLOCK_ORIGIN_US	USEC_PER_SEC
+
+/* Per-socket engine state, struct rtcp_bpf_state of rtcp_bpf_engine.h */
+struct {
+	__uint(type, BPF_MAP_TYPE_SK_STORAGE);
+	__uint(map_flags, BPF_F_NO_PREALLOC);
+	__type(key, int);
+	__type(value, struct rtcp_bpf_state);
+} rtcp_sk_state SEC(".maps");
+
+/* BBR, as in rtcp_bbr.c; BW_SCALE and BW_UNIT come from rtcp_core.c */
+#define BBR_SCALE 8	/* scaling factor for fractions in BBR (e.g. gains) */
+#define BBR_UNIT (1 << BBR_SCALE)
+
+enum bbr_mode {
+	BBR_STARTUP,	/* ramp up sending rate rapidly to fill pipe */
+	BBR_DRAIN,	/* drain any queue created during startup */
+	BBR_PROBE_BW,	/* discover, share bw: pace around estimated bw */
+	BBR_PROBE_RTT,	/* cut inflight to min to probe min_rtt */
+};
+
+struct bbr {
+	u32	min_rtt_us;	        /* min RTT in min_rtt_win_sec window */
+	u32	min_rtt_stamp;	        /* timestamp of min_rtt_us */
+	u32	probe_rtt_done_stamp;   /* end time for BBR_PROBE_RTT mode */
+	struct minmax bw;	/* Max recent delivery rate in pkts/uS << 24 */
+	u32	rtt_cnt;	    /* count of packet-timed rounds elapsed */
+	u32     next_rtt_delivered; /* scb->tx.delivered at end of round */
+	u32     mode:3,		     /* current bbr_mode in state machine */
+		prev_ca_state:3,     /* CA state on previous ACK */
+		packet_conservation:1,  /* use packet conservation? */
+		round_start:1,	     /* start of packet-timed tx->ack round? */
+		idle_restart:1,	     /* restarting after idle? */
+		probe_rtt_round_done:1,  /* a BBR_PROBE_RTT round at 4 pkts? */
+		unused:13,
+		lt_is_sampling:1,    /* taking long-term ("LT") samples now? */
+		lt_rtt_cnt:7,	     /* round trips in long-term interval */
+		lt_use_bw:1;	     /* use lt_bw as our bw estimate? */
+	u32	lt_bw;		     /* LT est delivery rate in pkts/uS << 24 */
+	u32	lt_last_delivered;   /* LT intvl start: tp->delivered */
+	u32	lt_last_stamp;	     /* LT intvl start: tp->delivered_mstamp */
+	u32	lt_last_lost;	     /* LT intvl start: tp->lost */
+	u32	pacing_gain:10,	/* current gain for setting pacing rate */
+		cwnd_gain:10,	/* current gain for setting cwnd */
+		full_bw_reached:1,   /* reached full bw in Startup? */
+		full_bw_cnt:2,	/* number of rounds without large bw gains */
+		cycle_idx:3,	/* current index in pacing_gain cycle array */
+		has_seen_rtt:1, /* have we seen an RTT sample yet? */
+		unused_b:5;
+	u32	prior_cwnd;	/* prior cwnd upon entering loss recovery */
+	u32	full_bw;	/* recent bw, to estimate if pipe is full */
+
+	/* For tracking ACK aggregation: */
+	u64	ack_epoch_mstamp;	/* start of ACK sampling epoch */
+	u16	extra_acked[2];		/* max excess data ACKed in epoch */
+	u32	ack_epoch_acked:20,	/* packets (S)ACKed in sampling epoch */
+		extra_acked_win_rtts:5,	/* age of extra_acked, in round trips */
+		extra_acked_win_idx:1,	/* current index in extra_acked array */
+		unused_c:6;
+
+	u64	cycle_mstamp;	     /* time of this cycle phase start */
+};
+
+#define CYCLE_LEN	8	/* number of phases in a pacing gain cycle */
+
+static const int bbr_bw_rtts = CYCLE_LEN + 2;
+static const u32 bbr_min_rtt_win_sec = 10;
+static const u32 bbr_probe_rtt_mode_ms = 200;
+static const int bbr_min_tso_rate = 1200000;
+static const int bbr_pacing_margin_percent = 1;
+static const int bbr_high_gain  = BBR_UNIT * 2885 / 1000 + 1;
+static const int bbr_drain_gain = BBR_UNIT * 1000 / 2885;
+static const int bbr_cwnd_gain  = BBR_UNIT * 2;
+static const int bbr_pacing_gain[] = {
+	BBR_UNIT * 5 / 4,	/* probe for more available bw */
+	BBR_UNIT * 3 / 4,	/* drain queue and/or yield bw to other flows */
+	BBR_UNIT, BBR_UNIT, BBR_UNIT,	/* cruise at 1.0*bw to utilize pipe, */
+	BBR_UNIT, BBR_UNIT, BBR_UNIT	/* without creating excess queue... */
+};
+static const u32 bbr_cycle_rand = 7;
+static const u32 bbr_cwnd_min_target = 4;
+static const u32 bbr_full_bw_thresh = BBR_UNIT * 5 / 4;
+static const u32 bbr_full_bw_cnt = 3;
+static const u32 bbr_lt_intvl_min_rtts = 4;
+static const u32 bbr_lt_loss_thresh = 50;
+static const u32 bbr_lt_bw_ratio = BBR_UNIT / 8;
+static const u32 bbr_lt_bw_diff = 4000 / 8;
+static const u32 bbr_lt_bw_max_rtts = 48;
+static const int bbr_extra_acked_gain = BBR_UNIT;
+static const u32 bbr_extra_acked_win_rtts = 5;
+static const u32 bbr_ack_epoch_acked_reset_thresh = 1U << 20;
+static const u32 bbr_extra_acked_max_us = 100 * 1000;
+
+static struct PMODRL *bbr_pmodrl(struct sock *sk)
+{
+	struct rtcp_bpf_state *st;
+
+	st = bpf_sk_storage_get(&rtcp_sk_state, sk, 0, 0);
+	return st ? &st->pmodrl : NULL;
+}
+
+/* rtcp_now_us() of rtcp.h */
+static u32 rtcp_now_us(struct sock *sk, const struct PMODRL *pmodrl)
+{
+	if (((const struct rtcp_bpf_state *)pmodrl)->deterministic)
+		return RTCP_CLOCK_ORIGIN_US +
+		       (u32)(tcp_sk(sk)->tcp_mstamp - pmodrl->clock_base_us);
+	return jiffies_to_usecs(tcp_jiffies32);
+}
+
+/* jhash_3words() of linux/jhash.h */
+static __always_inline u32 rol32(u32 word, unsigned int shift)
+{
+	return (word << (shift & 31)) | (word >> ((-shift) & 31));
+}
+
+static u32 jhash_3words(u32 a, u32 b, u32 c, u32 initval)
+{
+	initval += 0xdeadbeef + (3 << 2);
+	a += initval;
+	b += initval;
+	c += initval;
+	c ^= b; c -= rol32(b, 14);
+	a ^= c; a -= rol32(c, 11);
+	b ^= a; b -= rol32(a, 25);
+	c ^= b; c -= rol32(b, 16);
+	a ^= c; a -= rol32(c, 4);
+	b ^= a; b -= rol32(a, 14);
+	c ^= b; c -= rol32(b, 24);
+	return c;
+}
+
+/* rtcp_rand_below() of rtcp.h: the module's draws in deterministic mode */
+static u32 rtcp_rand_below(struct sock *sk, u32 ceil)
+{
+	struct PMODRL *pmodrl = bbr_pmodrl(sk);
+	u32 r;
+
+	if (pmodrl && ((struct rtcp_bpf_state *)pmodrl)->deterministic)
+		r = jhash_3words(tcp_sk(sk)->delivered,
+				 (u32)sk->__sk_common.skc_num << 16 |
+				 bpf_ntohs(sk->__sk_common.skc_dport),
+				 rand_seed, ceil);
+	else
+		r = bpf_get_prandom_u32();
+	return (u32)(((u64)r * ceil) >> 32);
+}
+
+static bool bbr_full_bw_reached(const struct sock *sk)
+{
+	const struct bbr *bbr = inet_csk_ca(sk);
+
+	return bbr->full_bw_reached;
+}
+
+static u32 bbr_max_bw(const struct sock *sk)
+{
+	struct bbr *bbr = inet_csk_ca(sk);
+
+	return minmax_get(&bbr->bw);
+}
+
+static u32 bbr_bw(const struct sock *sk)
+{
+	struct bbr *bbr = inet_csk_ca(sk);
+
+	return bbr->lt_use_bw ? bbr->lt_bw : bbr_max_bw(sk);
+}
+
+static u16 bbr_extra_acked(const struct sock *sk)
+{
+	struct bbr *bbr = inet_csk_ca(sk);
+
+	return max(bbr->extra_acked[0], bbr->extra_acked[1]);
+}
+
+static u64 bbr_rate_bytes_per_sec(struct sock *sk, u64 rate, int gain)
+{
+	unsigned int mss = tcp_sk(sk)->mss_cache;
+
+	rate *= mss;
+	rate *= gain;
+	rate >>= BBR_SCALE;
+	rate *= USEC_PER_SEC / 100 * (100 - bbr_pacing_margin_percent);
+	return rate >> BW_SCALE;
+}
+
+static unsigned long bbr_bw_to_pacing_rate(struct sock *sk, u32 bw, int gain)
+{
+	u64 rate = bw;
+
+	rate = bbr_rate_bytes_per_sec(sk, rate, gain);
+	rate = min_t(u64, rate, sk->sk_max_pacing_rate);
+	return rate;
+}
+
+static void bbr_init_pacing_rate_from_rtt(struct sock *sk)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bbr *bbr = inet_csk_ca(sk);
+	u64 bw;
+	u32 rtt_us;
+
+	if (tp->srtt_us) {		/* any RTT sample yet? */
+		rtt_us = max(tp->srtt_us >> 3, 1U);
+		bbr->has_seen_rtt = 1;
+	} else {			 /* no RTT sample yet */
+		rtt_us = USEC_PER_MSEC;	 /* use nominal default RTT */
+	}
+	bw = (u64)tp->snd_cwnd * BW_UNIT;
+	do_div(bw, rtt_us);
+	sk->sk_pacing_rate = bbr_bw_to_pacing_rate(sk, bw, bbr_high_gain);
+}
+
+static unsigned long bbr_bw_to_pacing_rate_pmodrl(struct sock *sk,
+						  struct PMODRL *pmodrl,
+						  u32 bw, int gain)
+{
+	u64 rate = bw;
+
+	if (pmodrl)
+		gain = rtcp_cap_gain(pmodrl, gain);
+	rate = bbr_rate_bytes_per_sec(sk, rate, gain);
+	rate = min_t(u64, rate, sk->sk_max_pacing_rate);
+	return rate;
+}
+
+static void bbr_set_pacing_rate(struct sock *sk, struct PMODRL *pmodrl,
+				u32 bw, int gain)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bbr *bbr = inet_csk_ca(sk);
+	unsigned long rate = bbr_bw_to_pacing_rate(sk, bw, gain);
+	u8 flag = 0;
+
+	if (pmodrl && rtcp_cap_active(pmodrl)) {
+		unsigned long pmodrl_rate =
+			bbr_bw_to_pacing_rate_pmodrl(sk, pmodrl, rtcp_R(pmodrl), BBR_UNIT);
+
+		if (rate > pmodrl_rate || rtcp_probing(pmodrl)) {
+			rate = pmodrl_rate;
+			flag = 1;
+		}
+	}
+
+	if (unlikely(!bbr->has_seen_rtt && tp->srtt_us))
+		bbr_init_pacing_rate_from_rtt(sk);
+	if (bbr_full_bw_reached(sk) || rate > sk->sk_pacing_rate)
+		sk->sk_pacing_rate = rate;
+	if (flag)
+		sk->sk_pacing_rate = rate;
+}
+
+static u32 bbr_min_tso_segs_(struct sock *sk)
+{
+	return sk->sk_pacing_rate < (bbr_min_tso_rate >> 3) ? 1 : 2;
+}
+
+static u32 bbr_tso_segs_goal(struct sock *sk)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	u32 segs, bytes;
+
+	bytes = min_t(unsigned long, sk->sk_pacing_rate >> sk->sk_pacing_shift,
+		      RTCP_GSO_MAX_SIZE - 1 - MAX_TCP_HEADER);
+	segs = max_t(u32, bytes / tp->mss_cache, bbr_min_tso_segs_(sk));
+
+	return min(segs, 0x7FU);
+}
+
+static void bbr_save_cwnd(struct sock *sk)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bbr *bbr = inet_csk_ca(sk);
+
+	if (bbr->prev_ca_state < TCP_CA_Recovery && bbr->mode != BBR_PROBE_RTT)
+		bbr->prior_cwnd = tp->snd_cwnd;  /* this cwnd is good enough */
+	else  /* loss recovery or BBR_PROBE_RTT have temporarily cut cwnd */
+		bbr->prior_cwnd = max(bbr->prior_cwnd, tp->snd_cwnd);
+}
+
+static u32 bbr_bdp(struct sock *sk, u32 bw, int gain)
+{
+	struct bbr *bbr = inet_csk_ca(sk);
+	u32 bdp;
+	u64 w;
+
+	if (unlikely(bbr->min_rtt_us == ~0U))	 /* no valid RTT samples yet? */
+		return TCP_INIT_CWND;  /* be safe: cap at default initial cwnd*/
+
+	w = (u64)bw * bbr->min_rtt_us;
+	bdp = (((w * gain) >> BBR_SCALE) + BW_UNIT - 1) / BW_UNIT;
+
+	return bdp;
+}
+
+static u32 bbr_quantization_budget(struct sock *sk, u32 cwnd)
+{
+	struct bbr *bbr = inet_csk_ca(sk);
+
+	cwnd += 3 * bbr_tso_segs_goal(sk);
+	cwnd = (cwnd + 1) & ~1U;
+	if (bbr->mode == BBR_PROBE_BW && bbr->cycle_idx == 0)
+		cwnd += 2;
+
+	return cwnd;
+}
+
+static u32 bbr_inflight(struct sock *sk, u32 bw, int gain)
+{
+	u32 inflight;
+
+	inflight = bbr_bdp(sk, bw, gain);
+	inflight = bbr_quantization_budget(sk, inflight);
+
+	return inflight;
+}
+
+static u32 bbr_packets_in_net_at_edt(struct sock *sk, u32 inflight_now)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bbr *bbr = inet_csk_ca(sk);
+	u64 now_ns, edt_ns, interval_us;
+	u32 interval_delivered, inflight_at_edt;
+
+	now_ns = tp->tcp_clock_cache;
+	edt_ns = max(tp->tcp_wstamp_ns, now_ns);
+	interval_us = div_u64(edt_ns - now_ns, NSEC_PER_USEC);
+	interval_delivered = (u64)bbr_bw(sk) * interval_us >> BW_SCALE;
+	inflight_at_edt = inflight_now;
+	if (bbr->pacing_gain > BBR_UNIT)              /* increasing inflight */
+		inflight_at_edt += bbr_tso_segs_goal(sk);  /* include EDT skb */
+	if (interval_delivered >= inflight_at_edt)
+		return 0;
+	return inflight_at_edt - interval_delivered;
+}
+
+static u32 bbr_ack_aggregation_cwnd(struct sock *sk)
+{
+	u32 max_aggr_cwnd, aggr_cwnd = 0;
+
+	if (bbr_extra_acked_gain && bbr_full_bw_reached(sk)) {
+		max_aggr_cwnd = ((u64)bbr_bw(sk) * bbr_extra_acked_max_us)
+				/ BW_UNIT;
+		aggr_cwnd = (bbr_extra_acked_gain * bbr_extra_acked(sk))
+			     >> BBR_SCALE;
+		aggr_cwnd = min(aggr_cwnd, max_aggr_cwnd);
+	}
+
+	return aggr_cwnd;
+}
+
+static bool bbr_set_cwnd_to_recover_or_restore(
+	struct sock *sk, struct PMODRL *pmodrl, const struct rate_sample *rs,
+	u32 acked, u32 *new_cwnd)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bbr *bbr = inet_csk_ca(sk);
+	u8 prev_state = bbr->prev_ca_state, state = inet_csk(sk)->icsk_ca_state;
+	u32 cwnd = tp->snd_cwnd;
+
+	if (rs->losses > 0)
+		cwnd = max_t(s32, cwnd - rs->losses, 1);
+
+	if (state == TCP_CA_Recovery && prev_state != TCP_CA_Recovery) {
+		bbr->packet_conservation = 1;
+		bbr->next_rtt_delivered = tp->delivered;  /* start round now */
+		if (pmodrl)
+			rtcp_restart_round(pmodrl, tp->delivered);
+		cwnd = tcp_packets_in_flight(tp) + acked;
+	} else if (prev_state >= TCP_CA_Recovery && state < TCP_CA_Recovery) {
+		cwnd = max(cwnd, bbr->prior_cwnd);
+		bbr->packet_conservation = 0;
+	}
+	bbr->prev_ca_state = state;
+
+	if (bbr->packet_conservation) {
+		*new_cwnd = max(cwnd, tcp_packets_in_flight(tp) + acked);
+		return true;	/* yes, using packet conservation */
+	}
+	*new_cwnd = cwnd;
+	return false;
+}
+
+static void bbr_set_cwnd(struct sock *sk, struct PMODRL *pmodrl,
+			 const struct rate_sample *rs, u32 acked, u32 bw,
+			 int gain)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bbr *bbr = inet_csk_ca(sk);
+	u32 cwnd = tp->snd_cwnd, target_cwnd = 0;
+
+	if (!acked)
+		goto done;  /* no packet fully ACKed; just apply caps */
+
+	if (bbr_set_cwnd_to_recover_or_restore(sk, pmodrl, rs, acked, &cwnd))
+		goto done;
+
+	target_cwnd = bbr_bdp(sk, bw, gain);
+	target_cwnd += bbr_ack_aggregation_cwnd(sk);
+	target_cwnd = bbr_quantization_budget(sk, target_cwnd);
+
+	if (bbr_full_bw_reached(sk))  /* only cut cwnd if we filled the pipe */
+		cwnd = min(cwnd + acked, target_cwnd);
+	else if (cwnd < target_cwnd || tp->delivered < TCP_INIT_CWND)
+		cwnd = cwnd + acked;
+	cwnd = max(cwnd, bbr_cwnd_min_target);
+
+done:
+	tp->snd_cwnd = min(cwnd, tp->snd_cwnd_clamp);	/* apply global cap */
+	if (bbr->mode == BBR_PROBE_RTT)  /* drain queue, refresh min_rtt */
+		tp->snd_cwnd = min(tp->snd_cwnd, bbr_cwnd_min_target);
+}
+
+static bool bbr_is_next_cycle_phase(struct sock *sk,
+				    const struct rate_sample *rs)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bbr *bbr = inet_csk_ca(sk);
+	bool is_full_length =
+		tcp_stamp_us_delta(tp->delivered_mstamp, bbr->cycle_mstamp) >
+		bbr->min_rtt_us;
+	u32 inflight, bw;
+
+	if (bbr->pacing_gain == BBR_UNIT)
+		return is_full_length;		/* just use wall clock time */
+
+	inflight = bbr_packets_in_net_at_edt(sk, rs->prior_in_flight);
+	bw = bbr_max_bw(sk);
+
+	if (bbr->pacing_gain > BBR_UNIT)
+		return is_full_length &&
+			(rs->losses ||  /* perhaps pacing_gain*BDP won't fit */
+			 inflight >= bbr_inflight(sk, bw, bbr->pacing_gain));
+
+	return is_full_length ||
+		inflight <= bbr_inflight(sk, bw, BBR_UNIT);
+}
+
+static void bbr_advance_cycle_phase(struct sock *sk)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bbr *bbr = inet_csk_ca(sk);
+
+	bbr->cycle_idx = (bbr->cycle_idx + 1) & (CYCLE_LEN - 1);
+	bbr->cycle_mstamp = tp->delivered_mstamp;
+}
+
+static void bbr_update_cycle_phase(struct sock *sk,
+				   const struct rate_sample *rs)
+{
+	struct bbr *bbr = inet_csk_ca(sk);
+
+	if (bbr->mode == BBR_PROBE_BW && bbr_is_next_cycle_phase(sk, rs))
+		bbr_advance_cycle_phase(sk);
+}
+
+static void bbr_reset_startup_mode(struct sock *sk)
+{
+	struct bbr *bbr = inet_csk_ca(sk);
+
+	bbr->mode = BBR_STARTUP;
+}
+
+static void bbr_reset_probe_bw_mode(struct sock *sk)
+{
+	struct bbr *bbr = inet_csk_ca(sk);
+
+	bbr->mode = BBR_PROBE_BW;
+	bbr->cycle_idx = CYCLE_LEN - 1 - rtcp_rand_below(sk, bbr_cycle_rand);
+	bbr_advance_cycle_phase(sk);	/* flip to next phase of gain cycle */
+}
+
+static void bbr_reset_mode(struct sock *sk)
+{
+	if (!bbr_full_bw_reached(sk))
+		bbr_reset_startup_mode(sk);
+	else
+		bbr_reset_probe_bw_mode(sk);
+}
+
+static void bbr_reset_lt_bw_sampling_interval(struct sock *sk)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bbr *bbr = inet_csk_ca(sk);
+
+	bbr->lt_last_stamp = div_u64(tp->delivered_mstamp, USEC_PER_MSEC);
+	bbr->lt_last_delivered = tp->delivered;
+	bbr->lt_last_lost = tp->lost;
+	bbr->lt_rtt_cnt = 0;
+}
+
+static void bbr_reset_lt_bw_sampling(struct sock *sk)
+{
+	struct bbr *bbr = inet_csk_ca(sk);
+
+	bbr->lt_bw = 0;
+	bbr->lt_use_bw = 0;
+	bbr->lt_is_sampling = false;
+	bbr_reset_lt_bw_sampling_interval(sk);
+}
+
+static void bbr_lt_bw_interval_done(struct sock *sk, u32 bw)
+{
+	struct bbr *bbr = inet_csk_ca(sk);
+	u32 diff;
+
+	if (bbr->lt_bw) {  /* do we have bw from a previous interval? */
+		diff = abs(bw - bbr->lt_bw);
+		if ((diff * BBR_UNIT <= bbr_lt_bw_ratio * bbr->lt_bw) ||
+		    (bbr_rate_bytes_per_sec(sk, diff, BBR_UNIT) <=
+		     bbr_lt_bw_diff)) {
+			bbr->lt_bw = (bw + bbr->lt_bw) >> 1;  /* avg 2 intvls */
+			bbr->lt_use_bw = 1;
+			bbr->pacing_gain = BBR_UNIT;  /* try to avoid drops */
+			bbr->lt_rtt_cnt = 0;
+			return;
+		}
+	}
+	bbr->lt_bw = bw;
+	bbr_reset_lt_bw_sampling_interval(sk);
+}
+
+static void bbr_lt_bw_sampling(struct sock *sk, const struct rate_sample *rs)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bbr *bbr = inet_csk_ca(sk);
+	u32 lost, delivered;
+	u64 bw;
+	u32 t;
+
+	if (bbr->lt_use_bw) {	/* already using long-term rate, lt_bw? */
+		if (bbr->mode == BBR_PROBE_BW && bbr->round_start &&
+		    ++bbr->lt_rtt_cnt >= bbr_lt_bw_max_rtts) {
+			bbr_reset_lt_bw_sampling(sk);    /* stop using lt_bw */
+			bbr_reset_probe_bw_mode(sk);  /* restart gain cycling */
+		}
+		return;
+	}
+
+	if (!bbr->lt_is_sampling) {
+		if (!rs->losses)
+			return;
+		bbr_reset_lt_bw_sampling_interval(sk);
+		bbr->lt_is_sampling = true;
+	}
+
+	if (rs->is_app_limited) {
+		bbr_reset_lt_bw_sampling(sk);
+		return;
+	}
+
+	if (bbr->round_start)
+		bbr->lt_rtt_cnt++;	/* count round trips in this interval */
+	if (bbr->lt_rtt_cnt < bbr_lt_intvl_min_rtts)
+		return;		/* sampling interval needs to be longer */
+	if (bbr->lt_rtt_cnt > 4 * bbr_lt_intvl_min_rtts) {
+		bbr_reset_lt_bw_sampling(sk);  /* interval is too long */
+		return;
+	}
+
+	if (!rs->losses)
+		return;
+
+	lost = tp->lost - bbr->lt_last_lost;
+	delivered = tp->delivered - bbr->lt_last_delivered;
+	if (!delivered || (lost << BBR_SCALE) < bbr_lt_loss_thresh * delivered)
+		return;
+
+	t = div_u64(tp->delivered_mstamp, USEC_PER_MSEC) - bbr->lt_last_stamp;
+	if ((s32)t < 1)
+		return;		/* interval is less than one ms, so wait */
+	if (t >= ~0U / USEC_PER_MSEC) {
+		bbr_reset_lt_bw_sampling(sk);  /* interval too long; reset */
+		return;
+	}
+	t *= USEC_PER_MSEC;
+	bw = (u64)delivered * BW_UNIT;
+	do_div(bw, t);
+	bbr_lt_bw_interval_done(sk, bw);
+}
+
+static void bbr_update_bw(struct sock *sk, const struct rate_sample *rs)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bbr *bbr = inet_csk_ca(sk);
+	u64 bw;
+
+	bbr->round_start = 0;
+	if (rs->delivered < 0 || rs->interval_us <= 0)
+		return; /* Not a valid observation */
+
+	if (!before(rs->prior_delivered, bbr->next_rtt_delivered)) {
+		bbr->next_rtt_delivered = tp->delivered;
+		bbr->rtt_cnt++;
+		bbr->round_start = 1;
+		bbr->packet_conservation = 0;
+	}
+
+	bbr_lt_bw_sampling(sk, rs);
+
+	bw = (u64)rs->delivered * BW_UNIT;
+	do_div(bw, rs->interval_us);
+
+	if (!rs->is_app_limited || bw >= bbr_max_bw(sk))
+		minmax_running_max(&bbr->bw, bbr_bw_rtts, bbr->rtt_cnt, bw);
+}
+
+static void bbr_update_ack_aggregation(struct sock *sk,
+				       const struct rate_sample *rs)
+{
+	u32 epoch_us, expected_acked, extra_acked;
+	struct bbr *bbr = inet_csk_ca(sk);
+	struct tcp_sock *tp = tcp_sk(sk);
+
+	if (!bbr_extra_acked_gain || rs->acked_sacked <= 0 ||
+	    rs->delivered < 0 || rs->interval_us <= 0)
+		return;
+
+	if (bbr->round_start) {
+		bbr->extra_acked_win_rtts = min(0x1F,
+						bbr->extra_acked_win_rtts + 1);
+		if (bbr->extra_acked_win_rtts >= bbr_extra_acked_win_rtts) {
+			bbr->extra_acked_win_rtts = 0;
+			bbr->extra_acked_win_idx = bbr->extra_acked_win_idx ?
+						   0 : 1;
+			bbr->extra_acked[bbr->extra_acked_win_idx] = 0;
+		}
+	}
+
+	epoch_us = tcp_stamp_us_delta(tp->delivered_mstamp,
+				      bbr->ack_epoch_mstamp);
+	expected_acked = ((u64)bbr_bw(sk) * epoch_us) / BW_UNIT;
+
+	if (bbr->ack_epoch_acked <= expected_acked ||
+	    (bbr->ack_epoch_acked + rs->acked_sacked >=
+	     bbr_ack_epoch_acked_reset_thresh)) {
+		bbr->ack_epoch_acked = 0;
+		bbr->ack_epoch_mstamp = tp->delivered_mstamp;
+		expected_acked = 0;
+	}
+
+	bbr->ack_epoch_acked = min_t(u32, 0xFFFFF,
+				     bbr->ack_epoch_acked + rs->acked_sacked);
+	extra_acked = bbr->ack_epoch_acked - expected_acked;
+	extra_acked = min(extra_acked, tp->snd_cwnd);
+	if (extra_acked > bbr->extra_acked[bbr->extra_acked_win_idx])
+		bbr->extra_acked[bbr->extra_acked_win_idx] = extra_acked;
+}
+
+static void bbr_check_full_bw_reached(struct sock *sk,
+				      const struct rate_sample *rs)
+{
+	struct bbr *bbr = inet_csk_ca(sk);
+	u32 bw_thresh;
+
+	if (bbr_full_bw_reached(sk) || !bbr->round_start || rs->is_app_limited)
+		return;
+
+	bw_thresh = (u64)bbr->full_bw * bbr_full_bw_thresh >> BBR_SCALE;
+	if (bbr_max_bw(sk) >= bw_thresh) {
+		bbr->full_bw = bbr_max_bw(sk);
+		bbr->full_bw_cnt = 0;
+		return;
+	}
+	++bbr->full_bw_cnt;
+	bbr->full_bw_reached = bbr->full_bw_cnt >= bbr_full_bw_cnt;
+}
+
+static void bbr_check_drain(struct sock *sk, const struct rate_sample *rs)
+{
+	struct bbr *bbr = inet_csk_ca(sk);
+
+	if (bbr->mode == BBR_STARTUP && bbr_full_bw_reached(sk)) {
+		bbr->mode = BBR_DRAIN;	/* drain queue we created */
+		tcp_sk(sk)->snd_ssthresh =
+				bbr_inflight(sk, bbr_max_bw(sk), BBR_UNIT);
+	}	/* fall through to check if in-flight is already small: */
+	if (bbr->mode == BBR_DRAIN &&
+	    bbr_packets_in_net_at_edt(sk, tcp_packets_in_flight(tcp_sk(sk))) <=
+	    bbr_inflight(sk, bbr_max_bw(sk), BBR_UNIT))
+		bbr_reset_probe_bw_mode(sk);  /* we estimate queue is drained */
+}
+
+static void bbr_check_probe_rtt_done(struct sock *sk)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bbr *bbr = inet_csk_ca(sk);
+
+	if (!(bbr->probe_rtt_done_stamp &&
+	      after(tcp_jiffies32, bbr->probe_rtt_done_stamp)))
+		return;
+
+	bbr->min_rtt_stamp = tcp_jiffies32;  /* wait a while until PROBE_RTT */
+	tp->snd_cwnd = max(tp->snd_cwnd, bbr->prior_cwnd);
+	bbr_reset_mode(sk);
+}
+
+static void bbr_update_min_rtt(struct sock *sk, struct PMODRL *pmodrl,
+			       const struct rate_sample *rs)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bbr *bbr = inet_csk_ca(sk);
+	bool filter_expired;
+
+	filter_expired = after(tcp_jiffies32,
+			       bbr->min_rtt_stamp + bbr_min_rtt_win_sec * HZ);
+	if (rs->rtt_us >= 0 &&
+	    (rs->rtt_us <= bbr->min_rtt_us ||
+	     (filter_expired && !rs->is_ack_delayed))) {
+		bbr->min_rtt_us = rs->rtt_us;
+		bbr->min_rtt_stamp = tcp_jiffies32;
+	}
+
+	if (bbr_probe_rtt_mode_ms > 0 && filter_expired &&
+	    !bbr->idle_restart && bbr->mode != BBR_PROBE_RTT) {
+		bbr->mode = BBR_PROBE_RTT;  /* dip, drain queue */
+		bbr_save_cwnd(sk);  /* note cwnd so we can restore it */
+		bbr->probe_rtt_done_stamp = 0;
+	}
+
+	if (bbr->mode == BBR_PROBE_RTT) {
+		/* Ignore low rate samples during this mode. */
+		u32 app_limited = tp->delivered + tcp_packets_in_flight(tp);
+
+		tp->app_limited = app_limited ? : 1;
+		if (pmodrl)
+			pmodrl->probe_rtt_flag = 1;
+		if (!bbr->probe_rtt_done_stamp &&
+		    tcp_packets_in_flight(tp) <= bbr_cwnd_min_target) {
+			bbr->probe_rtt_done_stamp = tcp_jiffies32 +
+				msecs_to_jiffies(bbr_probe_rtt_mode_ms);
+			bbr->probe_rtt_round_done = 0;
+			bbr->next_rtt_delivered = tp->delivered;
+			if (pmodrl)
+				rtcp_restart_round(pmodrl, tp->delivered);
+		} else if (bbr->probe_rtt_done_stamp) {
+			if (bbr->round_start)
+				bbr->probe_rtt_round_done = 1;
+			if (bbr->probe_rtt_round_done)
+				bbr_check_probe_rtt_done(sk);
+		}
+	}
+	if (rs->delivered > 0)
+		bbr->idle_restart = 0;
+}
+
+static void bbr_update_gains(struct sock *sk)
+{
+	struct bbr *bbr = inet_csk_ca(sk);
+
+	switch (bbr->mode) {
+	case BBR_STARTUP:
+		bbr->pacing_gain = bbr_high_gain;
+		bbr->cwnd_gain	 = bbr_high_gain;
+		break;
+	case BBR_DRAIN:
+		bbr->pacing_gain = bbr_drain_gain;	/* slow, to drain */
+		bbr->cwnd_gain	 = bbr_high_gain;	/* keep cwnd */
+		break;
+	case BBR_PROBE_BW:
+		bbr->pacing_gain = (bbr->lt_use_bw ?
+				    BBR_UNIT :
+				    bbr_pacing_gain[bbr->cycle_idx]);
+		bbr->cwnd_gain	 = bbr_cwnd_gain;
+		break;
+	case BBR_PROBE_RTT:
+		bbr->pacing_gain = BBR_UNIT;
+		bbr->cwnd_gain	 = BBR_UNIT;
+		break;
+	}
+}
+
+static void bbr_update_model(struct sock *sk, struct PMODRL *pmodrl,
+			     const struct rate_sample *rs)
+{
+	bbr_update_bw(sk, rs);
+	bbr_update_ack_aggregation(sk, rs);
+	bbr_update_cycle_phase(sk, rs);
+	bbr_check_full_bw_reached(sk, rs);
+	bbr_check_drain(sk, rs);
+	bbr_update_min_rtt(sk, pmodrl, rs);
+	bbr_update_gains(sk);
+}
+
+/* rtcp_fill_sample() of rtcp.h */
+static void bbr_fill_sample(struct sock *sk, const struct PMODRL *pmodrl,
+			    const struct rate_sample *rs, u32 min_rtt_us,
+			    struct rtcp_sample *s)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+
+	memset(s, 0, sizeof(*s));
+	s->now_us = rtcp_now_us(sk, pmodrl);
+	s->min_rtt_us = min_rtt_us;
+	s->delivered = tp->delivered;
+	s->lost = tp->lost;
+	s->acked = tp->snd_una / tp->mss_cache;
+	s->bytes_acked = tp->bytes_acked;
+	s->rwnd_limited = tp->chrono_type == TCP_CHRONO_RWND_LIMITED;
+	if (rs) {
+		s->prior_delivered = rs->prior_delivered;
+		s->rs_delivered = rs->delivered;
+		s->interval_us = rs->interval_us;
+		s->app_limited = rs->is_app_limited;
+	}
+}
+
+/* The engine events of the last rtcp_ack(), as in bbr_rtcp_event() of
+ * rtcp_bbr.c. The engine does not look at BBR state, so handling them after
+ * rtcp_ack() returns is the same as handling them when raised.
+ */
+static void bbr_rtcp_events(struct sock *sk, struct PMODRL *pmodrl)
+{
+	struct rtcp_bpf_state *st = (struct rtcp_bpf_state *)pmodrl;
+	struct bbr *bbr = inet_csk_ca(sk);
+
+	if (st->events & (1U << RTCP_EV_CLASSIFYING))
+		bbr_reset_lt_bw_sampling(sk);
+	if (st->events & (1U << RTCP_EV_PROBE)) {
+		bbr_advance_cycle_phase(sk);
+		bbr->cycle_idx = 0;
+		bbr->mode = BBR_PROBE_BW;
+	}
+	st->events = 0;
+}
+
+static void bbr_main_(struct sock *sk, const struct rate_sample *rs)
+{
+	struct bbr *bbr = inet_csk_ca(sk);
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct PMODRL *pmodrl = bbr_pmodrl(sk);
+	struct rtcp_sample s;
+	u32 bw;
+
+	bbr_update_model(sk, pmodrl, rs);
+
+	if (pmodrl) {
+		bbr_fill_sample(sk, pmodrl, rs, bbr->min_rtt_us, &s);
+		rtcp_ack(pmodrl, &s);
+		bbr_rtcp_events(sk, pmodrl);
+		if (rtcp_capped(pmodrl))
+			bbr_reset_lt_bw_sampling(sk);
+		if (tp->write_seq - tp->snd_nxt < tp->mss_cache &&
+		    sk->sk_wmem_alloc.refs.counter - 1 < SKB_TRUESIZE(1) &&
+		    tcp_packets_in_flight(tp) < tp->snd_cwnd &&
+		    tp->lost_out <= tp->retrans_out)
+			pmodrl->probe_rtt_flag = 0;
+	}
+
+	bw = bbr_bw(sk);
+	bbr_set_pacing_rate(sk, pmodrl, bw, bbr->pacing_gain);
+	bbr_set_cwnd(sk, pmodrl, rs, rs->acked_sacked, bw, bbr->cwnd_gain);
+
+	if (pmodrl) {
+		s.rto_exit = bbr->prev_ca_state == TCP_CA_Loss &&
+			     inet_csk(sk)->icsk_ca_state != TCP_CA_Loss;
+		rtcp_ack_end(pmodrl, &s);
+		if (enable_printk)
+			bpf_printk("!!!ACK: port:%u c:%u B:%llu R:%llu mode:%u idx:%u n:%u r_p:%lu d:%u l:%u cwnd:%u",
+				   bpf_ntohs(sk->__sk_common.skc_dport), pmodrl->classify,
+				   rtcp_B(pmodrl), rtcp_R(pmodrl), bbr->mode, bbr->cycle_idx,
+				   pmodrl->nominator, sk->sk_pacing_rate, tp->delivered,
+				   tp->lost, tp->snd_cwnd);
+	}
+}
+
+#ifdef RTCP_CONG_CONTROL_ACK
+SEC("struct_ops")
+void BPF_PROG(bbr_main, struct sock *sk, u32 ack, int flag,
+	      const struct rate_sample *rs)
+#else
+SEC("struct_ops")
+void BPF_PROG(bbr_main, struct sock *sk, const struct rate_sample *rs)
+#endif
+{
+	bbr_main_(sk, rs);
+}
+
+SEC("struct_ops")
+void BPF_PROG(bbr_init, struct sock *sk)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bbr *bbr = inet_csk_ca(sk);
+	struct rtcp_bpf_state *st;
+
+	st = bpf_sk_storage_get(&rtcp_sk_state, sk, 0,
+				BPF_SK_STORAGE_GET_F_CREATE);
+	if (st) {
+		memset(st, 0, sizeof(*st));
+		/* rtcp_clock_start() of rtcp.h */
+		st->deterministic = !!deterministic;
+		st->pmodrl.clock_base_us = tp->tcp_mstamp;
+		st->pmodrl.bbr_start_us = rtcp_now_us(sk, &st->pmodrl);
+	}
+
+	bbr->prior_cwnd = 0;
+	tp->snd_ssthresh = TCP_INFINITE_SSTHRESH;
+	bbr->rtt_cnt = 0;
+	bbr->next_rtt_delivered = 0;
+	bbr->prev_ca_state = TCP_CA_Open;
+	bbr->packet_conservation = 0;
+
+	bbr->probe_rtt_done_stamp = 0;
+	bbr->probe_rtt_round_done = 0;
+	bbr->min_rtt_us = tcp_min_rtt(tp);
+	bbr->min_rtt_stamp = tcp_jiffies32;
+
+	minmax_reset(&bbr->bw, bbr->rtt_cnt, 0);  /* init max bw to 0 */
+
+	bbr->has_seen_rtt = 0;
+	bbr_init_pacing_rate_from_rtt(sk);
+
+	bbr->round_start = 0;
+	bbr->idle_restart = 0;
+	bbr->full_bw_reached = 0;
+	bbr->full_bw = 0;
+	bbr->full_bw_cnt = 0;
+	bbr->cycle_mstamp = 0;
+	bbr->cycle_idx = 0;
+	bbr_reset_lt_bw_sampling(sk);
+	bbr_reset_startup_mode(sk);
+
+	bbr->ack_epoch_mstamp = tp->tcp_mstamp;
+	bbr->ack_epoch_acked = 0;
+	bbr->extra_acked_win_rtts = 0;
+	bbr->extra_acked_win_idx = 0;
+	bbr->extra_acked[0] = 0;
+	bbr->extra_acked[1] = 0;
+
+	if (sk->sk_pacing_status == SK_PACING_NONE)
+		sk->sk_pacing_status = SK_PACING_NEEDED;
+}
+
+/* rtcp_flow_id() of rtcp.h: IPv6 unless the peer is v4-mapped */
+static bool bbr_sk_ipv6(const struct sock *sk)
+{
+	const u32 *a = sk->__sk_common.skc_v6_daddr.in6_u.u6_addr32;
+
+	return sk->__sk_common.skc_family == AF_INET6 &&
+	       !(a[0] == 0 && a[1] == 0 && a[2] == bpf_htonl(0x0000ffff));
+}
+
+SEC("struct_ops")
+void BPF_PROG(bbr_release, struct sock *sk)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct inet_sock *inet = (struct inet_sock *)sk;
+	struct PMODRL *pmodrl = bbr_pmodrl(sk);
+
+	if (!pmodrl)
+		return;
+	if (enable_printk && bbr_sk_ipv6(sk))
+		bpf_printk("!!!Release sip:%pI6 sp:%u dip:%pI6 dp:%u p:%u c:%u B:%llu R:%llu b:%llu",
+			   &sk->__sk_common.skc_v6_rcv_saddr, bpf_ntohs(inet->inet_sport),
+			   &sk->__sk_common.skc_v6_daddr, bpf_ntohs(sk->__sk_common.skc_dport),
+			   tp->delivered, pmodrl->classify, rtcp_B(pmodrl),
+			   rtcp_R(pmodrl), pmodrl->detected_bytes_acked);
+	else if (enable_printk)
+		bpf_printk("!!!Release sip:%pI4 sp:%u dip:%pI4 dp:%u p:%u c:%u B:%llu R:%llu b:%llu",
+			   &sk->__sk_common.skc_rcv_saddr, bpf_ntohs(inet->inet_sport),
+			   &sk->__sk_common.skc_daddr, bpf_ntohs(sk->__sk_common.skc_dport),
+			   tp->delivered, pmodrl->classify, rtcp_B(pmodrl),
+			   rtcp_R(pmodrl), pmodrl->detected_bytes_acked);
+	bpf_sk_storage_delete(&rtcp_sk_state, sk);
+}
+
+SEC("struct_ops")
+void BPF_PROG(bbr_cwnd_event, struct sock *sk, enum tcp_ca_event event)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bbr *bbr = inet_csk_ca(sk);
+
+	if (event == CA_EVENT_TX_START && tp->app_limited) {
+		struct PMODRL *pmodrl = bbr_pmodrl(sk);
+
+		bbr->idle_restart = 1;
+		bbr->ack_epoch_mstamp = tp->tcp_mstamp;
+		bbr->ack_epoch_acked = 0;
+		if (bbr->mode == BBR_PROBE_BW)
+			bbr_set_pacing_rate(sk, pmodrl, bbr_bw(sk), BBR_UNIT);
+		else if (bbr->mode == BBR_PROBE_RTT)
+			bbr_check_probe_rtt_done(sk);
+
+		if (pmodrl) {
+			struct rtcp_sample s;
+
+			bbr_fill_sample(sk, pmodrl, NULL, bbr->min_rtt_us, &s);
+			rtcp_start(pmodrl, &s);
+		}
+	}
+}
+
+SEC("struct_ops")
+u32 BPF_PROG(bbr_sndbuf_expand, struct sock *sk)
+{
+	/* Provision 3 * cwnd since BBR may slow-start even during recovery. */
+	return 3;
+}
+
+SEC("struct_ops")
+u32 BPF_PROG(bbr_undo_cwnd, struct sock *sk)
+{
+	struct bbr *bbr = inet_csk_ca(sk);
+
+	bbr->full_bw = 0;   /* spurious slow-down; reset full pipe detection */
+	bbr->full_bw_cnt = 0;
+	bbr_reset_lt_bw_sampling(sk);
+	return tcp_sk(sk)->snd_cwnd;
+}
+
+SEC("struct_ops")
+u32 BPF_PROG(bbr_ssthresh, struct sock *sk)
+{
+	bbr_save_cwnd(sk);
+	return tcp_sk(sk)->snd_ssthresh;
+}
+
+SEC("struct_ops")
+u32 BPF_PROG(bbr_min_tso_segs, struct sock *sk)
+{
+	return bbr_min_tso_segs_(sk);
+}
+
+SEC("struct_ops")
+void BPF_PROG(bbr_set_state, struct sock *sk, u8 new_state)
+{
+	struct bbr *bbr = inet_csk_ca(sk);
+
+	if (new_state == TCP_CA_Loss) {
+		struct rate_sample rs = { .losses = 1 };
+
+		bbr->prev_ca_state = TCP_CA_Loss;
+		bbr->full_bw = 0;
+		bbr->round_start = 1;	/* treat RTO like end of a round */
+		bbr_lt_bw_sampling(sk, &rs);
+	}
+}
+
+SEC(".struct_ops")
+struct tcp_congestion_ops rtcp_bbr_bpf = {
+	.flags		= TCP_CONG_NON_RESTRICTED,
+	.init		= (void *)bbr_init,
+	.release	= (void *)bbr_release,
+	.cong_control	= (void *)bbr_main,
+	.sndbuf_expand	= (void *)bbr_sndbuf_expand,
+	.undo_cwnd	= (void *)bbr_undo_cwnd,
+	.cwnd_event	= (void *)bbr_cwnd_event,
+	.ssthresh	= (void *)bbr_ssthresh,
+	.min_tso_segs	= (void *)bbr_min_tso_segs,
+	.set_state	= (void *)bbr_set_state,
+	.name		= RTCP_BPF_NAME,
+};
+
+char _license[] SEC("license") = "Dual BSD/GPL";
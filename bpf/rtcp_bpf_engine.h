@@ -0,0 +1,84 @@
+/*
+ * R-TCP: the engine as the BPF struct_ops program builds it
+ *
+ * rtcp_core.c with the kernel helpers that vmlinux.h does not carry, the
+ * engine parameters as .data globals and the events collected in struct
+ * rtcp_bpf_state. rtcp_bbr.bpf.c includes it, and so does user/rtcp_bpf.c,
+ * which builds the same engine in userspace for rtcp_replay -B: the two
+ * builds are then fed the same capture and must agree bit for bit (see
+ * bench/diff_bpf.sh).
+ *
+ * The includer provides u8..u64, s32, s64, bool and __always_inline.
+ *
+ * The R-TCP module was designed and implemented by
+ * Shengtong Zhu, Yan Liu, Lingfeng Guo and Jack Y. B. Lee,
+ *  "R-TCP: A Framework to Optimize TCP Performance Over Rate-Limiting Networks", NSDI, 2026.
+ *
+ * Contact  : zs021@ie.cuhk.edu.hk
+ */
+#ifndef _RTCP_BPF_ENGINE_H
+#define _RTCP_BPF_ENGINE_H
+
+#define USEC_PER_MSEC	1000ULL
+#define USEC_PER_SEC	1000000ULL
+#define NSEC_PER_USEC	1000ULL
+#define MSEC_PER_SEC	1000U
+
+#define min(a, b)	((a) < (b) ? (a) : (b))
+#define max(a, b)	((a) > (b) ? (a) : (b))
+#define min_t(type, a, b)	min((type)(a), (type)(b))
+#define max_t(type, a, b)	max((type)(a), (type)(b))
+/* Kernel abs(): the absolute value of x taken as a signed type of its size */
+#define abs(x) __builtin_choose_expr(sizeof(x) == sizeof(s64),		\
+	({ s64 __x = (x); __x < 0 ? -__x : __x; }),			\
+	({ s32 __x = (x); __x < 0 ? -__x : __x; }))
+#define div_u64(n, d)	((u64)(n) / (d))
+#define div64_u64(n, d)	((u64)(n) / (u64)(d))
+#define do_div(n, base) ({ u32 __rem = (n) % (base); (n) /= (base); __rem; })
+#define memset		__builtin_memset
+#define memcpy		__builtin_memcpy
+#ifndef INT_MAX
+#define INT_MAX		((int)(~0U >> 1))
+#endif
+#ifndef NULL
+#define NULL		((void *)0)
+#endif
+#define unlikely(x)	__builtin_expect(!!(x), 0)
+
+static __always_inline bool before(u32 seq1, u32 seq2)
+{
+	return (s32)(seq1 - seq2) < 0;
+}
+#define after(seq2, seq1)	before(seq1, seq2)
+
+#include "../rtcp_core.h"
+
+/* Engine parameters, same names and defaults as in rtcp.c */
+int probe_interval = 20;
+int probe_per = 24;
+int optimize_flag = 1;
+int monitor_peroid = 3;
+int high_loss_disclassify = 2;
+int use_goodput = 1;
+int exclude_RTO = 0;
+int exclude_rwnd = 0;
+int exclude_applimited = 0;
+int window_ms = 200;
+int window_kb = 0;
+
+/* Per-socket engine state */
+struct rtcp_bpf_state {
+	struct PMODRL pmodrl;	/* first, see rtcp_event() */
+	u32 events;		/* 1 << enum rtcp_event, raised in rtcp_ack() */
+	u8 deterministic;	/* host: deterministic mode, latched in init() */
+};
+
+#define rtcp_event(pmodrl, ev) \
+	(((struct rtcp_bpf_state *)(pmodrl))->events |= 1U << (ev))
+#define rtcp_history(pmodrl, s)	do { } while (0)
+
+#define RTCP_MAX_SHIFTS	32
+#define RTCP_CORE_API	static __attribute__((unused))
+#include "../rtcp_core.c"
+
+#endif /* _RTCP_BPF_ENGINE_H */
@@ -0,0 +1,69 @@
+/*
+ * R-TCP: move live sockets from one congestion control to another
+ *
+ * A BPF TCP iterator that calls setsockopt(TCP_CONGESTION) on every socket
+ * of the current network namespace that runs cfg.from, switching it to
+ * cfg.to. The kernel releases the old algorithm and initialises the new one
+ * back to back under the socket lock; rtcp_bbr builds hand their state over
+ * in between (rtcp_handover_put/take), so detection and the learned B/R
+ * survive the upgrade. Loaded and run by rtcp_migrate.c; needs Linux 5.16 or
+ * later for setsockopt from a TCP iterator.
+ */
+#include "vmlinux.h"
+#include <bpf/bpf_helpers.h>
+#include <bpf/bpf_tracing.h>
+#include <bpf/bpf_endian.h>
+#include "rtcp_migrate.h"
+
+#define AF_INET6	10
+#define SOL_TCP		6
+#define TCP_CONGESTION	13
+
+const volatile struct rtcp_migrate_cfg cfg = {};
+
+static bool ca_is(const char *a, const volatile char *b)
+{
+	int i;
+
+	for (i = 0; i < RTCP_CA_NAME_MAX; i++) {
+		if (a[i] != b[i])
+			return false;
+		if (!a[i])
+			return true;
+	}
+	return true;
+}
+
+SEC("iter/tcp")
+int rtcp_migrate(struct bpf_iter__tcp *ctx)
+{
+	struct sock_common *skc = ctx->sk_common;
+	struct seq_file *seq = ctx->meta->seq;
+	char to[RTCP_CA_NAME_MAX], cur[RTCP_CA_NAME_MAX] = {};
+	struct tcp_sock *tp;
+	int i, err;
+
+	if (!skc)
+		return 0;
+	tp = bpf_skc_to_tcp_sock(skc);
+	if (!tp)
+		return 0;
+	if (bpf_getsockopt(tp, SOL_TCP, TCP_CONGESTION, cur, sizeof(cur)) ||
+	    !ca_is(cur, cfg.from))
+		return 0;
+
+	for (i = 0; i < RTCP_CA_NAME_MAX; i++)
+		to[i] = cfg.to[i];
+	err = bpf_setsockopt(tp, SOL_TCP, TCP_CONGESTION, to, sizeof(to));
+	if (skc->skc_family == AF_INET6)
+		BPF_SEQ_PRINTF(seq, "[%pI6]:%u [%pI6]:%u %d\n",
+			       &skc->skc_v6_rcv_saddr, skc->skc_num,
+			       &skc->skc_v6_daddr, bpf_ntohs(skc->skc_dport), err);
+	else
+		BPF_SEQ_PRINTF(seq, "%pI4:%u %pI4:%u %d\n",
+			       &skc->skc_rcv_saddr, skc->skc_num,
+			       &skc->skc_daddr, bpf_ntohs(skc->skc_dport), err);
+	return 0;
+}
+
+char _license[] SEC("license") = "Dual BSD/GPL";
@@ -0,0 +1,76 @@
+/*
+ * R-TCP: move live sockets from one congestion control to another
+ *
+ * Usage: rtcp_migrate FROM TO
+ *
+ * Loads rtcp_migrate.bpf.o and runs its TCP iterator once over the sockets
+ * of the current network namespace. Prints one line per socket moved:
+ * local and remote address, and the setsockopt() result (0 on success).
+ * TO must already be registered (modprobe or bpftool struct_ops register).
+ */
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <bpf/libbpf.h>
+#include <bpf/bpf.h>
+#include "rtcp_migrate.h"
+
+#define BPF_OBJ "rtcp_migrate.bpf.o"
+
+int main(int argc, char **argv)
+{
+	struct rtcp_migrate_cfg *cfg;
+	struct bpf_program *prog;
+	struct bpf_object *obj;
+	struct bpf_link *link;
+	struct bpf_map *map;
+	char buf[4096];
+	size_t size;
+	ssize_t n;
+	int fd, ret = 1;
+
+	if (argc != 3 || strlen(argv[1]) >= RTCP_CA_NAME_MAX ||
+	    strlen(argv[2]) >= RTCP_CA_NAME_MAX) {
+		fprintf(stderr, "usage: %s FROM TO\n", argv[0]);
+		return 2;
+	}
+
+	obj = bpf_object__open_file(BPF_OBJ, NULL);
+	if (!obj) {
+		fprintf(stderr, "cannot open %s\n", BPF_OBJ);
+		return 1;
+	}
+	map = bpf_object__find_map_by_name(obj, ".rodata");
+	cfg = map ? bpf_map__initial_value(map, &size) : NULL;
+	if (!cfg || size < sizeof(*cfg)) {
+		fprintf(stderr, "%s has no configuration\n", BPF_OBJ);
+		goto out;
+	}
+	strncpy(cfg->from, argv[1], RTCP_CA_NAME_MAX - 1);
+	strncpy(cfg->to, argv[2], RTCP_CA_NAME_MAX - 1);
+
+	if (bpf_object__load(obj)) {
+		fprintf(stderr, "cannot load %s\n", BPF_OBJ);
+		goto out;
+	}
+	prog = bpf_object__find_program_by_name(obj, "rtcp_migrate");
+	link = prog ? bpf_program__attach_iter(prog, NULL) : NULL;
+	if (!link) {
+		fprintf(stderr, "cannot attach the TCP iterator\n");
+		goto out;
+	}
+	fd = bpf_iter_create(bpf_link__fd(link));
+	if (fd < 0) {
+		fprintf(stderr, "cannot create the TCP iterator\n");
+		bpf_link__destroy(link);
+		goto out;
+	}
+	while ((n = read(fd, buf, sizeof(buf))) > 0)
+		fwrite(buf, 1, n, stdout);
+	ret = n < 0;
+	close(fd);
+	bpf_link__destroy(link);
+out:
+	bpf_object__close(obj);
+	return ret;
+}
@@ -0,0 +1,14 @@
+/*
+ * R-TCP: configuration shared by rtcp_migrate.bpf.c and its loader
+ */
+#ifndef _RTCP_MIGRATE_H
+#define _RTCP_MIGRATE_H
+
+#define RTCP_CA_NAME_MAX 16	/* TCP_CA_NAME_MAX */
+
+struct rtcp_migrate_cfg {
+	char from[RTCP_CA_NAME_MAX];
+	char to[RTCP_CA_NAME_MAX];
+};
+
+#endif /* _RTCP_MIGRATE_H */
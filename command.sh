@@ -1,9 +1,14 @@
 sudo sysctl net.ipv4.tcp_no_metrics_save=1
 sudo sysctl net.ipv4.tcp_congestion_control=cubic
 sudo modprobe -r rtcp_bbr
+sudo modprobe -r rtcp_cubic
+sudo modprobe -r rtcp_bbr2
+sudo modprobe -r rtcp
 make
-sudo install rtcp_bbr.ko /lib/modules/`uname -r`
+sudo install rtcp.ko rtcp_bbr.ko rtcp_cubic.ko rtcp_bbr2.ko /lib/modules/`uname -r`
 sudo depmod
 sudo modprobe rtcp_bbr
+sudo modprobe rtcp_cubic
+sudo modprobe rtcp_bbr2
 sudo sysctl net.ipv4.tcp_congestion_control=rtcp_bbr
 sudo dmesg -C
@@ -0,0 +1,427 @@
+/*
+ * R-TCP: rate-limit detection engine
+ *
+ * See rtcp.h for the interface. The detection logic lives in rtcp_core.c,
+ * which is shared with the BPF struct_ops build; this file adds the kernel
+ * side: module parameters, allocation, event dispatch through struct
+ * rtcp_ops, the per-flow history string, the handover store that keeps
+ * a socket's state while it switches between module versions, the
+ * binary ACK capture in debugfs and the deterministic mode.
+ *
+ * The R-TCP module was designed and implemented by
+ * Shengtong Zhu, Yan Liu, Lingfeng Guo and Jack Y. B. Lee,
+ *  "R-TCP: A Framework to Optimize TCP Performance Over Rate-Limiting Networks", NSDI, 2026.
+ *
+ * Contact  : zs021@ie.cuhk.edu.hk
+ */
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/hashtable.h>
+#include <linux/debugfs.h>
+#include <linux/kfifo.h>
+#include <linux/jhash.h>
+#include <linux/workqueue.h>
+#include "rtcp.h"
+
+#define STORE_INTERVAL 400
+
+static int probe_interval = 20;
+static int probe_per = 24;
+static int optimize_flag = 1;
+static int high_loss_disclassify = 2;
+static int monitor_peroid = 3;
+static int use_goodput = 1;
+static int exclude_RTO = 0;
+static int exclude_rwnd = 0;
+static int exclude_applimited = 0;
+static int window_ms = 200;
+static int window_kb = 0;
+static int trace_buf_kb = 4096;
+
+static void rtcp_event(struct PMODRL *pmodrl, enum rtcp_event ev)
+{
+	if (pmodrl->ops && pmodrl->ops->event)
+		pmodrl->ops->event(pmodrl->ctx, ev);
+}
+
+/* Append "bytes_acked;classify;B;R-" to the history every STORE_INTERVAL ACKs. */
+static void rtcp_history(struct PMODRL *pmodrl, const struct rtcp_sample *s)
+{
+	pmodrl->store_interval+=1;
+	if(pmodrl->buffer && pmodrl->store_interval >= STORE_INTERVAL){
+		pmodrl->store_interval = 0;
+		if(strlen(pmodrl->buffer) + 90 < MAX_STR_LEN){
+			char temp[90];
+			memset(temp, 0, 90);
+			snprintf(temp, sizeof(temp), "%llu;%u;%llu;%llu-", s->bytes_acked, pmodrl->classify, rtcp_B(pmodrl), rtcp_R(pmodrl));
+			strcat(pmodrl->buffer, temp);
+		}
+	}
+}
+
+#define RTCP_CORE_API
+#include "rtcp_core.c"
+
+/* Allocate the per-flow state; events are delivered to ops->event(ctx, ...).
+ * Hosts call this from init(), which runs in softirq for a passive open and
+ * under lock_sock_fast() when bpf/rtcp_migrate switches a socket, so they
+ * pass GFP_ATOMIC.
+ */
+struct PMODRL *rtcp_alloc(const struct rtcp_ops *ops, void *ctx, gfp_t gfp)
+{
+	struct PMODRL *pmodrl;
+
+	pmodrl = kzalloc(sizeof(struct PMODRL), gfp);
+	if (!pmodrl)
+		return NULL;
+	pmodrl->ops = ops;
+	pmodrl->ctx = ctx;
+	pmodrl->buffer = kzalloc(MAX_STR_LEN, gfp);
+	return pmodrl;
+}
+EXPORT_SYMBOL_GPL(rtcp_alloc);
+
+void rtcp_free(struct PMODRL *pmodrl)
+{
+	if (!pmodrl)
+		return;
+	kfree(pmodrl->buffer);
+	kfree(pmodrl);
+}
+EXPORT_SYMBOL_GPL(rtcp_free);
+
+EXPORT_SYMBOL_GPL(rtcp_start);
+EXPORT_SYMBOL_GPL(rtcp_restart_round);
+EXPORT_SYMBOL_GPL(rtcp_ack);
+EXPORT_SYMBOL_GPL(rtcp_ack_end);
+EXPORT_SYMBOL_GPL(rtcp_capped);
+EXPORT_SYMBOL_GPL(rtcp_cap_active);
+EXPORT_SYMBOL_GPL(rtcp_probing);
+EXPORT_SYMBOL_GPL(rtcp_cap_gain);
+EXPORT_SYMBOL_GPL(rtcp_save);
+EXPORT_SYMBOL_GPL(rtcp_restore);
+
+/* Handover store. When a socket switches congestion control, the kernel
+ * calls release() of the old one and init() of the new one back to back
+ * under the socket lock, so an entry is normally taken right after it is
+ * put. Entries older than RTCP_HANDOVER_TTL belong to sockets that moved to
+ * an algorithm without R-TCP; rtcp_handover_gc frees them, running every
+ * RTCP_HANDOVER_TTL while the store is not empty. The store holds at most
+ * RTCP_HANDOVER_MAX entries.
+ */
+#define RTCP_HANDOVER_BITS	8
+#define RTCP_HANDOVER_MAX	4096
+#define RTCP_HANDOVER_TTL	HZ
+
+struct rtcp_handover {
+	struct hlist_node node;
+	const struct sock *sk;
+	u32 snd_una;		/* with sk, tells a reused socket apart */
+	unsigned long stamp;
+	char *buffer;		/* history string, moved to the new owner */
+	struct rtcp_state st;
+};
+
+static DEFINE_HASHTABLE(rtcp_handover_tbl, RTCP_HANDOVER_BITS);
+static DEFINE_SPINLOCK(rtcp_handover_lock);
+static unsigned int rtcp_handover_cnt;
+
+static void rtcp_handover_free(struct rtcp_handover *h)
+{
+	kfree(h->buffer);
+	kfree(h);
+}
+
+/* Called with rtcp_handover_lock held. */
+static void rtcp_handover_expire(bool all)
+{
+	struct rtcp_handover *h;
+	struct hlist_node *tmp;
+	int bkt;
+
+	hash_for_each_safe(rtcp_handover_tbl, bkt, tmp, h, node) {
+		if (all || time_after(jiffies, h->stamp + RTCP_HANDOVER_TTL)) {
+			hash_del(&h->node);
+			rtcp_handover_cnt--;
+			rtcp_handover_free(h);
+		}
+	}
+}
+
+static void rtcp_handover_gc_fn(struct work_struct *work);
+static DECLARE_DELAYED_WORK(rtcp_handover_gc, rtcp_handover_gc_fn);
+
+static void rtcp_handover_gc_fn(struct work_struct *work)
+{
+	spin_lock_bh(&rtcp_handover_lock);
+	rtcp_handover_expire(false);
+	if (rtcp_handover_cnt)
+		schedule_delayed_work(&rtcp_handover_gc, RTCP_HANDOVER_TTL + 1);
+	spin_unlock_bh(&rtcp_handover_lock);
+}
+
+/* Save the engine state of sk, plus host_len bytes of host state tagged with
+ * family, for the next init() on this socket. The history buffer moves with
+ * it. Returns 0 if saved; the caller still frees pmodrl.
+ */
+int rtcp_handover_put(struct sock *sk, struct PMODRL *pmodrl,
+		      const char *family, const void *host, u16 host_len)
+{
+	struct rtcp_handover *h;
+
+	if (host_len > RTCP_STATE_HOST_MAX)
+		return -EINVAL;
+	h = kmalloc(sizeof(*h), GFP_ATOMIC);
+	if (!h)
+		return -ENOMEM;
+	rtcp_save(pmodrl, &h->st);
+	strscpy(h->st.family, family, sizeof(h->st.family));
+	if (host_len)
+		memcpy(h->st.host, host, host_len);
+	h->st.host_len = host_len;
+	h->sk = sk;
+	h->snd_una = tcp_sk(sk)->snd_una;
+	h->stamp = jiffies;
+	h->buffer = pmodrl->buffer;
+
+	spin_lock_bh(&rtcp_handover_lock);
+	rtcp_handover_expire(false);
+	if (rtcp_handover_cnt >= RTCP_HANDOVER_MAX) {
+		spin_unlock_bh(&rtcp_handover_lock);
+		kfree(h);
+		return -ENOSPC;
+	}
+	hash_add(rtcp_handover_tbl, &h->node, (unsigned long)sk);
+	rtcp_handover_cnt++;
+	/* No-op if already pending */
+	schedule_delayed_work(&rtcp_handover_gc, RTCP_HANDOVER_TTL + 1);
+	spin_unlock_bh(&rtcp_handover_lock);
+
+	pmodrl->buffer = NULL;
+	return 0;
+}
+EXPORT_SYMBOL_GPL(rtcp_handover_put);
+
+/* Restore the engine state saved for sk, if any, into a freshly allocated
+ * pmodrl. Returns true if host state of the same family and size was saved
+ * too and has been copied to host.
+ */
+bool rtcp_handover_take(struct sock *sk, struct PMODRL *pmodrl,
+			const char *family, void *host, u16 host_len)
+{
+	struct rtcp_handover *h, *found = NULL;
+	bool host_ok = false;
+
+	spin_lock_bh(&rtcp_handover_lock);
+	hash_for_each_possible(rtcp_handover_tbl, h, node, (unsigned long)sk) {
+		if (h->sk == sk && h->snd_una == tcp_sk(sk)->snd_una &&
+		    !time_after(jiffies, h->stamp + RTCP_HANDOVER_TTL)) {
+			hash_del(&h->node);
+			rtcp_handover_cnt--;
+			found = h;
+			break;
+		}
+	}
+	spin_unlock_bh(&rtcp_handover_lock);
+	if (!found)
+		return false;
+
+	if (rtcp_restore(pmodrl, &found->st)) {
+		rtcp_trace(sk, pmodrl, RTCP_TRACE_RESUME, NULL, NULL);
+		if (found->buffer) {
+			kfree(pmodrl->buffer);
+			pmodrl->buffer = found->buffer;
+			found->buffer = NULL;
+		}
+		if (host && found->st.host_len == host_len &&
+		    !strncmp(found->st.family, family, sizeof(found->st.family))) {
+			memcpy(host, found->st.host, host_len);
+			host_ok = true;
+		}
+	}
+	rtcp_handover_free(found);
+	return host_ok;
+}
+EXPORT_SYMBOL_GPL(rtcp_handover_take);
+
+/* Binary capture. Opening rtcp/trace in debugfs writes a struct
+ * rtcp_trace_hdr into a trace_buf_kb buffer and turns rtcp_trace() on in
+ * the hosts; reading drains the buffer and blocks when it is empty, so
+ *
+ *	cat /sys/kernel/debug/rtcp/trace > capture.bin
+ *
+ * records until interrupted. Records that do not fit while the reader is
+ * behind are dropped and counted. One reader at a time.
+ */
+DEFINE_STATIC_KEY_FALSE(rtcp_trace_key);
+EXPORT_SYMBOL_GPL(rtcp_trace_key);
+
+static struct dentry *rtcp_debugfs;
+static DEFINE_SPINLOCK(rtcp_trace_lock);
+static DEFINE_MUTEX(rtcp_trace_read_lock);
+static DECLARE_WAIT_QUEUE_HEAD(rtcp_trace_wait);
+static struct kfifo rtcp_trace_fifo;
+static bool rtcp_trace_on;
+static unsigned long rtcp_trace_open_bit;
+static u64 rtcp_trace_dropped;
+
+void rtcp_trace_put(const struct rtcp_trace_rec *rec)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&rtcp_trace_lock, flags);
+	if (rtcp_trace_on) {
+		if (kfifo_avail(&rtcp_trace_fifo) >= sizeof(*rec))
+			kfifo_in(&rtcp_trace_fifo, rec, sizeof(*rec));
+		else
+			rtcp_trace_dropped++;
+	}
+	spin_unlock_irqrestore(&rtcp_trace_lock, flags);
+	if (wq_has_sleeper(&rtcp_trace_wait))
+		wake_up_interruptible(&rtcp_trace_wait);
+}
+EXPORT_SYMBOL_GPL(rtcp_trace_put);
+
+static int rtcp_trace_open(struct inode *inode, struct file *file)
+{
+	struct rtcp_trace_hdr hdr = {
+		.magic			= RTCP_TRACE_MAGIC,
+		.version		= RTCP_TRACE_VERSION,
+		.rec_size		= sizeof(struct rtcp_trace_rec),
+		.probe_interval		= probe_interval,
+		.probe_per		= probe_per,
+		.optimize_flag		= optimize_flag,
+		.monitor_peroid		= monitor_peroid,
+		.use_goodput		= use_goodput,
+		.exclude_RTO		= exclude_RTO,
+		.exclude_rwnd		= exclude_rwnd,
+		.exclude_applimited	= exclude_applimited,
+		.high_loss_disclassify	= high_loss_disclassify,
+		.window_ms		= window_ms,
+		.window_kb		= window_kb,
+	};
+	struct kfifo fifo;
+
+	if (test_and_set_bit(0, &rtcp_trace_open_bit))
+		return -EBUSY;
+	if (kfifo_alloc(&fifo, max(trace_buf_kb, 64) * 1024, GFP_KERNEL)) {
+		clear_bit(0, &rtcp_trace_open_bit);
+		return -ENOMEM;
+	}
+	kfifo_in(&fifo, &hdr, sizeof(hdr));
+
+	spin_lock_irq(&rtcp_trace_lock);
+	rtcp_trace_fifo = fifo;
+	rtcp_trace_dropped = 0;
+	rtcp_trace_on = true;
+	spin_unlock_irq(&rtcp_trace_lock);
+	static_branch_enable(&rtcp_trace_key);
+	return nonseekable_open(inode, file);
+}
+
+static int rtcp_trace_release(struct inode *inode, struct file *file)
+{
+	struct kfifo fifo;
+	u64 dropped;
+
+	static_branch_disable(&rtcp_trace_key);
+	spin_lock_irq(&rtcp_trace_lock);
+	rtcp_trace_on = false;
+	fifo = rtcp_trace_fifo;
+	dropped = rtcp_trace_dropped;
+	spin_unlock_irq(&rtcp_trace_lock);
+	kfifo_free(&fifo);
+	if (dropped)
+		pr_info("rtcp: trace dropped %llu records, raise trace_buf_kb\n", dropped);
+	clear_bit(0, &rtcp_trace_open_bit);
+	return 0;
+}
+
+static ssize_t rtcp_trace_read(struct file *file, char __user *buf,
+			       size_t count, loff_t *ppos)
+{
+	unsigned int copied;
+	int ret;
+
+	if (mutex_lock_interruptible(&rtcp_trace_read_lock))
+		return -ERESTARTSYS;
+	while (kfifo_is_empty(&rtcp_trace_fifo)) {
+		mutex_unlock(&rtcp_trace_read_lock);
+		if (file->f_flags & O_NONBLOCK)
+			return -EAGAIN;
+		if (wait_event_interruptible(rtcp_trace_wait,
+					     !kfifo_is_empty(&rtcp_trace_fifo)))
+			return -ERESTARTSYS;
+		if (mutex_lock_interruptible(&rtcp_trace_read_lock))
+			return -ERESTARTSYS;
+	}
+	ret = kfifo_to_user(&rtcp_trace_fifo, buf, count, &copied);
+	mutex_unlock(&rtcp_trace_read_lock);
+	return ret ? ret : copied;
+}
+
+static const struct file_operations rtcp_trace_fops = {
+	.owner		= THIS_MODULE,
+	.open		= rtcp_trace_open,
+	.release	= rtcp_trace_release,
+	.read		= rtcp_trace_read,
+};
+
+/* Deterministic mode (rtcp.h). The port pair tells concurrent flows apart,
+ * so runs that should match need fixed ports (iperf3 --cport).
+ */
+static int deterministic;
+static unsigned int rand_seed;
+
+DEFINE_STATIC_KEY_FALSE(rtcp_det_key);
+EXPORT_SYMBOL_GPL(rtcp_det_key);
+
+u32 rtcp_det_random(const struct sock *sk, u32 salt)
+{
+	const struct inet_sock *inet = inet_sk(sk);
+
+	return jhash_3words(tcp_sk(sk)->delivered,
+			    ntohs(inet->inet_sport) << 16 | ntohs(inet->inet_dport),
+			    rand_seed, salt);
+}
+EXPORT_SYMBOL_GPL(rtcp_det_random);
+
+static int __init rtcp_init(void)
+{
+	if (deterministic)
+		static_branch_enable(&rtcp_det_key);
+	rtcp_debugfs = debugfs_create_dir("rtcp", NULL);
+	debugfs_create_file("trace", 0400, rtcp_debugfs, NULL, &rtcp_trace_fops);
+	return 0;
+}
+
+static void __exit rtcp_exit(void)
+{
+	debugfs_remove_recursive(rtcp_debugfs);
+	cancel_delayed_work_sync(&rtcp_handover_gc);
+	spin_lock_bh(&rtcp_handover_lock);
+	rtcp_handover_expire(true);
+	spin_unlock_bh(&rtcp_handover_lock);
+}
+
+module_param_named(probe_interval_external, probe_interval, int, 0644);
+module_param_named(probe_per_external, probe_per, int, 0644);
+module_param_named(optimize_flag_external, optimize_flag, int, 0644);
+module_param_named(high_loss_disclassify_external, high_loss_disclassify, int, 0644);
+module_param_named(monitor_peroid_external, monitor_peroid, int, 0644);
+module_param_named(exclude_RTO_external, exclude_RTO, int, 0644);
+module_param_named(exclude_rwnd_external, exclude_rwnd, int, 0644);
+module_param_named(use_goodput_external, use_goodput, int, 0644);
+module_param_named(exclude_applimited_external, exclude_applimited, int, 0644);
+module_param_named(window_ms_external, window_ms, int, 0644);
+module_param_named(window_kb_external, window_kb, int, 0644);
+module_param(trace_buf_kb, int, 0644);
+module_param(deterministic, int, 0444);
+module_param(rand_seed, uint, 0644);
+
+module_init(rtcp_init);
+module_exit(rtcp_exit);
+
+MODULE_AUTHOR("Shengtong Zhu <zs021@ie.cuhk.edu.hk>");
+MODULE_LICENSE("Dual BSD/GPL");
+MODULE_DESCRIPTION("R-TCP rate-limit detection engine");
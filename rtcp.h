@@ -0,0 +1,194 @@
+/*
+ * R-TCP: rate-limit detection engine
+ *
+ * Token-bucket detection, (B, R) estimation and cap probing from the NSDI '26
+ * paper, factored out of rtcp_bbr.c so that any congestion control module can
+ * drive it. The engine is built as its own kernel object (rtcp.ko) and knows
+ * nothing about the host algorithm: the host feeds it one struct rtcp_sample
+ * per ACK, queries the cap, and reacts to the events it raises through
+ * struct rtcp_ops.
+ *
+ * The R-TCP module was designed and implemented by
+ * Shengtong Zhu, Yan Liu, Lingfeng Guo and Jack Y. B. Lee,
+ *  "R-TCP: A Framework to Optimize TCP Performance Over Rate-Limiting Networks", NSDI, 2026.
+ *
+ * Contact  : zs021@ie.cuhk.edu.hk
+ */
+#ifndef _RTCP_H
+#define _RTCP_H
+
+#include <net/tcp.h>
+#include <linux/in6.h>
+#include <net/ipv6.h>
+#include <linux/hash.h>
+#include <linux/jump_label.h>
+#include "rtcp_core.h"
+#include "rtcp_trace.h"
+#include "rtcp_compat.h"
+
+struct PMODRL *rtcp_alloc(const struct rtcp_ops *ops, void *ctx, gfp_t gfp);
+void rtcp_free(struct PMODRL *pmodrl);
+void rtcp_start(struct PMODRL *pmodrl, const struct rtcp_sample *s);
+void rtcp_restart_round(struct PMODRL *pmodrl, u32 delivered);
+void rtcp_ack(struct PMODRL *pmodrl, const struct rtcp_sample *s);
+void rtcp_ack_end(struct PMODRL *pmodrl, const struct rtcp_sample *s);
+bool rtcp_capped(const struct PMODRL *pmodrl);
+bool rtcp_cap_active(const struct PMODRL *pmodrl);
+bool rtcp_probing(const struct PMODRL *pmodrl);
+int rtcp_cap_gain(const struct PMODRL *pmodrl, int gain);
+void rtcp_save(const struct PMODRL *pmodrl, struct rtcp_state *st);
+bool rtcp_restore(struct PMODRL *pmodrl, const struct rtcp_state *st);
+
+/* Carry the state of a socket across a congestion control switch: release()
+ * of the old module puts it, init() of the new one takes it back. release()
+ * is a switch rather than a close while the socket is not yet closed.
+ */
+static inline bool rtcp_switching(const struct sock *sk)
+{
+	return sk->sk_state != TCP_CLOSE;
+}
+int rtcp_handover_put(struct sock *sk, struct PMODRL *pmodrl,
+		      const char *family, const void *host, u16 host_len);
+bool rtcp_handover_take(struct sock *sk, struct PMODRL *pmodrl,
+			const char *family, void *host, u16 host_len);
+
+/* Endpoints of a flow, by address family: IPv6, or IPv4 for IPv4 and
+ * v4-mapped IPv6 sockets. Log lines print them with %pISc; it is also the
+ * key to use for anything kept per flow or per destination.
+ */
+struct rtcp_flow_id {
+	union {
+		struct sockaddr sa;
+		struct sockaddr_in v4;
+		struct sockaddr_in6 v6;
+	} src, dst;
+};
+
+static inline void rtcp_flow_id(const struct sock *sk, struct rtcp_flow_id *id)
+{
+	const struct inet_sock *inet = inet_sk(sk);
+
+	memset(id, 0, sizeof(*id));
+#if IS_ENABLED(CONFIG_IPV6)
+	if (sk->sk_family == AF_INET6 && !ipv6_addr_v4mapped(&sk->sk_v6_daddr)) {
+		id->src.v6.sin6_family = AF_INET6;
+		id->src.v6.sin6_addr = sk->sk_v6_rcv_saddr;
+		id->src.v6.sin6_port = inet->inet_sport;
+		id->dst.v6.sin6_family = AF_INET6;
+		id->dst.v6.sin6_addr = sk->sk_v6_daddr;
+		id->dst.v6.sin6_port = inet->inet_dport;
+		return;
+	}
+#endif
+	id->src.v4.sin_family = AF_INET;
+	id->src.v4.sin_addr.s_addr = sk->sk_rcv_saddr;
+	id->src.v4.sin_port = inet->inet_sport;
+	id->dst.v4.sin_family = AF_INET;
+	id->dst.v4.sin_addr.s_addr = sk->sk_daddr;
+	id->dst.v4.sin_port = inet->inet_dport;
+}
+
+/* Deterministic mode, for benchmarks and regression runs (parameter
+ * deterministic of rtcp.ko, set at load time). The engine clock becomes the
+ * socket's microsecond clock counted from the start of the flow instead of
+ * jiffies, and the hosts' random draws come from rand_seed, the port pair
+ * and tp->delivered instead of the system RNG. Two runs of a flow over the
+ * same link then see the same timeline and make the same choices; only the
+ * link varies from run to run.
+ */
+DECLARE_STATIC_KEY_FALSE(rtcp_det_key);
+u32 rtcp_det_random(const struct sock *sk, u32 salt);
+
+/* Deterministic time of the first ACK; not 0, which the engine reads as unset */
+#define RTCP_CLOCK_ORIGIN_US	USEC_PER_SEC
+
+/* Engine clock, in microseconds */
+static inline u32 rtcp_now_us(const struct sock *sk,
+			      const struct PMODRL *pmodrl)
+{
+	if (static_branch_unlikely(&rtcp_det_key))
+		return RTCP_CLOCK_ORIGIN_US +
+		       (u32)(tcp_sk(sk)->tcp_mstamp - pmodrl->clock_base_us);
+	return jiffies_to_usecs(tcp_jiffies32);
+}
+
+/* Start the engine clock of a new flow, from the host's init(). */
+static inline void rtcp_clock_start(struct sock *sk, struct PMODRL *pmodrl)
+{
+	pmodrl->clock_base_us = tcp_sk(sk)->tcp_mstamp;
+	pmodrl->bbr_start_us = rtcp_now_us(sk, pmodrl);
+}
+
+/* Uniform in [0, ceil), seeded in deterministic mode. */
+static inline u32 rtcp_rand_below(const struct sock *sk, u32 ceil)
+{
+	if (static_branch_unlikely(&rtcp_det_key))
+		return reciprocal_scale(rtcp_det_random(sk, ceil), ceil);
+	return rtcp_random_below(ceil);
+}
+
+/* Fill an engine sample from the socket; rs may be NULL outside of ACKs. */
+static inline void rtcp_fill_sample(struct sock *sk,
+				    const struct PMODRL *pmodrl,
+				    const struct rate_sample *rs,
+				    u32 min_rtt_us, struct rtcp_sample *s)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+
+	memset(s, 0, sizeof(*s));
+	s->now_us = rtcp_now_us(sk, pmodrl);
+	s->min_rtt_us = min_rtt_us;
+	s->delivered = tp->delivered;
+	s->lost = tp->lost;
+	s->acked = tp->snd_una / tp->mss_cache;
+	s->bytes_acked = tp->bytes_acked;
+	s->rwnd_limited = tp->chrono_type == TCP_CHRONO_RWND_LIMITED;
+	if (rs) {
+		s->prior_delivered = rs->prior_delivered;
+		s->rs_delivered = rs->delivered;
+		s->interval_us = rs->interval_us;
+		s->app_limited = rs->is_app_limited;
+	}
+}
+
+/* Binary capture (rtcp_trace.h): while debugfs rtcp/trace is open, hosts
+ * record every call into the engine with rtcp_trace(), right before the
+ * call, or after rtcp_alloc() or rtcp_handover_take() for RTCP_TRACE_INIT
+ * and RTCP_TRACE_RESUME. s is NULL except for ACKs and rtcp_start(), rs is
+ * NULL outside of ACKs.
+ */
+DECLARE_STATIC_KEY_FALSE(rtcp_trace_key);
+void rtcp_trace_put(const struct rtcp_trace_rec *rec);
+
+static inline void rtcp_trace(struct sock *sk, const struct PMODRL *pmodrl,
+			      u8 op, const struct rtcp_sample *s,
+			      const struct rate_sample *rs)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct rtcp_trace_rec rec;
+
+	if (!static_branch_unlikely(&rtcp_trace_key))
+		return;
+	memset(&rec, 0, sizeof(rec));
+	if (s) {
+		rtcp_trace_from_sample(&rec, s, pmodrl);
+	} else {
+		rec.now_us = op == RTCP_TRACE_INIT ? pmodrl->bbr_start_us :
+			     rtcp_now_us(sk, pmodrl);
+		rec.delivered = tp->delivered;
+		rec.lost = tp->lost;
+		rec.bytes_acked = tp->bytes_acked;
+		if (pmodrl->probe_rtt_flag)
+			rec.flags = RTCP_TRACE_PROBE_RTT;
+	}
+	rec.flow = hash_ptr(sk, 32);
+	rec.op = op;
+	rec.snd_una = tp->snd_una;
+	rec.rtt_us = rs ? rs->rtt_us : -1;
+	rec.mss = tp->mss_cache;
+	rec.ca_state = inet_csk(sk)->icsk_ca_state;
+	rec.chrono = tp->chrono_type;
+	rtcp_trace_put(&rec);
+}
+
+#endif /* _RTCP_H */
@@ -75,6 +75,15 @@
 #include <linux/inet.h>
 #include <linux/random.h>
 #include <linux/win_minmax.h>
+#include "rtcp.h"
+#include "rtcp_compat.h"
+
+/* Algorithm name; a new version can be built under another name to load it
+ * next to the running one (see the Makefile).
+ */
+#ifndef RTCP_BBR_NAME
+#define RTCP_BBR_NAME "rtcp_bbr"
+#endif
 
 /* Scale factor for rate in pkt/uSec unit to avoid truncation in bandwidth
  * estimation. The rate unit ~= (1500 bytes / 1 usec / 2^24) ~= 715 bps.
@@ -99,80 +108,8 @@ enum bbr_mode {
 void nothing_to_do(char* a, ...) {}
 
 #define printA nothing_to_do
-#define MAX_STR_LEN 5000
-#define STORE_INTERVAL 400
-
-#define BASED_SCALE 8
-#define BASED_UNIT (1 << BASED_SCALE)
-// static const u8 percent_arr_num = 13;
-// static const int percent_arr[] = {BW_UNIT,BW_UNIT*11/12,BW_UNIT*10/12,BW_UNIT*9/12,BW_UNIT*8/12,BW_UNIT*7/12,BW_UNIT*6/12,BW_UNIT*5/12,BW_UNIT*4/12,BW_UNIT*3/12,BW_UNIT*2/12,BW_UNIT*1/12,0};
-static const u8 percent_arr_num = 9;
-static const int percent_arr[] = {BW_UNIT,BW_UNIT*7/8,BW_UNIT*6/8,BW_UNIT*5/8,BW_UNIT*4/8,BW_UNIT*3/8,BW_UNIT*2/8,BW_UNIT*1/8,0};
-/* If lost/delivered ratio > 20*/
-static const u32 loss_thresh = 50;
-/* If goodput diff / before empty > 40*/
-static const u32 abrupt_decrease_thresh = 150;
-static int probe_interval = 20;
-static int probe_per = 24;
-static int optimize_flag = 1;
-static int high_loss_disclassify = 2;
-static int monitor_peroid = 3;
-static int use_goodput = 1;
-static int exclude_RTO = 0;
-static int exclude_rwnd = 0;
-static int exclude_applimited = 0;
-static int enable_printk = 1;
-
-struct PMODRL {
-	u64   B_arr[9];
-	u64   R_arr[9];
-	u8 best_index;
-	u8 classify;
-	u32 classify_time_us;
-	u8 high_loss_flag;
-	u32 loss_start_time_us;
-	u32 before_loss_delivered;
-	u32 before_loss_time_us;
-	u32 before_loss_lost;
-	u32 bbr_start_us;
-	u64 bef_empty_goodput;
-	u32 nominator;
-
-	u32 latest_ack_us;
-	u32 lastest_ack_loss;
-	u64 detected_bytes_acked;
-	u32 detected_time;
-
-	u8 disable_flag;
-
-	u64 mem_B;
-	u64 mem_R;
-
-	u8 probe_rtt_flag;
-
-	u8 upper_bound;
-	u32 round_count;
-	u32 round_count_no;
-	u32 next_rtt_delivered;
-	u8 round_start;
-
-	u32 transfer_start_deliverd;
-	u32 transfer_start_lost;
-
-	u8 reset_ltbw_flag;
-
-	char* buffer;
-	u32 store_interval;
-
-	u64 acc_rto_dur;
-
-	u64	cycle_mstamp;	     /* time of this cycle phase start */
-
-	u64 dis_loss_start;
-	u64 dis_deliver_start;
-	u8 dis_enable_flag;
-};
 
+static int enable_printk = 1;
 
 /* BBR congestion control block */
 struct bbr {
@@ -369,18 +306,18 @@ static void bbr_init_pacing_rate_from_rtt(struct sock *sk)
 	}
 	bw = (u64)tp->snd_cwnd * BW_UNIT;
 	do_div(bw, rtt_us);
-	sk->sk_pacing_rate = bbr_bw_to_pacing_rate(sk, bw, bbr_high_gain);
+	WRITE_ONCE(sk->sk_pacing_rate, bbr_bw_to_pacing_rate(sk, bw, bbr_high_gain));
 }
 
 
-static unsigned long bbr_bw_to_pacing_rate_pmodrl(struct sock *sk, u32 bw, int gain, int nominator)
+static unsigned long bbr_bw_to_pacing_rate_pmodrl(struct sock *sk, u32 bw, int gain)
 {
 	// struct tcp_sock *tp = tcp_sk(sk);
 	struct bbr *bbr = inet_csk_ca(sk);
 	u64 rate = bw;
 
-	if(bbr->pmodrl && bbr->pmodrl->classify == 1 && nominator != 0){
-		gain = gain * probe_per / 20;
+	if(bbr->pmodrl){
+		gain = rtcp_cap_gain(bbr->pmodrl, gain);
 	}
 	rate = bbr_rate_bytes_per_sec(sk, rate, gain);
 	rate = min_t(u64, rate, sk->sk_max_pacing_rate);
@@ -395,10 +332,10 @@ static void bbr_set_pacing_rate(struct sock *sk, u32 bw, int gain)
 	unsigned long rate = bbr_bw_to_pacing_rate(sk, bw, gain);
 
 	u8 flag = 0;
-	if(bbr->pmodrl && bbr->pmodrl->classify == 1 && bbr->pmodrl->upper_bound == 1){
-		unsigned long pmodrl_rate = bbr_bw_to_pacing_rate_pmodrl(sk, bbr->pmodrl->R_arr[bbr->pmodrl->best_index], BBR_UNIT, bbr->pmodrl->nominator);
+	if(bbr->pmodrl && rtcp_cap_active(bbr->pmodrl)){
+		unsigned long pmodrl_rate = bbr_bw_to_pacing_rate_pmodrl(sk, rtcp_R(bbr->pmodrl), BBR_UNIT);
 		// printA(KERN_INFO "!!! rate:%llu  pmodrl_rate:%llu\n",rate, pmodrl_rate);
-		if(rate > pmodrl_rate && optimize_flag){
+		if(rate > pmodrl_rate || rtcp_probing(bbr->pmodrl)){
 			rate = pmodrl_rate;
 			flag = 1;
 		}
@@ -407,9 +344,9 @@ static void bbr_set_pacing_rate(struct sock *sk, u32 bw, int gain)
 	if (unlikely(!bbr->has_seen_rtt && tp->srtt_us))
 		bbr_init_pacing_rate_from_rtt(sk);
 	if (bbr_full_bw_reached(sk) || rate > sk->sk_pacing_rate)
-		sk->sk_pacing_rate = rate;
-	if(bbr->pmodrl && bbr->pmodrl->classify == 1 && flag && optimize_flag){
-		sk->sk_pacing_rate = rate;
+		WRITE_ONCE(sk->sk_pacing_rate, rate);
+	if(flag){
+		WRITE_ONCE(sk->sk_pacing_rate, rate);
 	}
 }
 
@@ -451,8 +388,8 @@ static u32 bbr_tso_segs_goal(struct sock *sk)
 	/* Sort of tcp_tso_autosize() but ignoring
 	 * driver provided sk_gso_max_size.
 	 */
-	bytes = min_t(unsigned long, sk->sk_pacing_rate >> sk->sk_pacing_shift,
-		      GSO_MAX_SIZE - 1 - MAX_TCP_HEADER);
+	bytes = min_t(unsigned long, sk->sk_pacing_rate >> READ_ONCE(sk->sk_pacing_shift),
+		      RTCP_GSO_MAX_SIZE - 1 - MAX_TCP_HEADER);
 	segs = max_t(u32, bytes / tp->mss_cache, bbr_min_tso_segs(sk));
 
 	return min(segs, 0x7FU);
@@ -474,7 +411,6 @@ static void bbr_cwnd_event(struct sock *sk, enum tcp_ca_event event)
 {
 	struct tcp_sock *tp = tcp_sk(sk);
 	struct bbr *bbr = inet_csk_ca(sk);
-	u32 now_us = jiffies_to_usecs(tcp_jiffies32);
 
 	if (event == CA_EVENT_TX_START && tp->app_limited) {
 		bbr->idle_restart = 1;
@@ -511,11 +447,12 @@ static void bbr_cwnd_event(struct sock *sk, enum tcp_ca_event event)
 		// 		bbr->pmodrl->cycle_mstamp = cycle_mstamp;
 		// 	}
 		// }
-		bbr->pmodrl->bbr_start_us = now_us;
-		bbr->pmodrl->transfer_start_lost = tp->lost;
-		bbr->pmodrl->transfer_start_deliverd = tp->delivered;
-		if(use_goodput){
-			bbr->pmodrl->transfer_start_deliverd = tp->snd_una / tp->mss_cache;
+		if(bbr->pmodrl){
+			struct rtcp_sample s;
+
+			rtcp_fill_sample(sk, bbr->pmodrl, NULL, bbr->min_rtt_us, &s);
+			rtcp_trace(sk, bbr->pmodrl, RTCP_TRACE_START, &s, NULL);
+			rtcp_start(bbr->pmodrl, &s);
 		}
 	}
 }
@@ -673,7 +610,8 @@ static bool bbr_set_cwnd_to_recover_or_restore(
 		bbr->packet_conservation = 1;
 		bbr->next_rtt_delivered = tp->delivered;  /* start round now */
 		if(bbr->pmodrl){
-			bbr->pmodrl->next_rtt_delivered = tp->delivered;
+			rtcp_trace(sk, bbr->pmodrl, RTCP_TRACE_RESTART, NULL, NULL);
+			rtcp_restart_round(bbr->pmodrl, tp->delivered);
 		}
 		/* Cut unused cwnd from app behavior, TSQ, or TSO deferral: */
 		cwnd = tcp_packets_in_flight(tp) + acked;
@@ -798,7 +736,7 @@ static void bbr_reset_probe_bw_mode(struct sock *sk)
 	struct bbr *bbr = inet_csk_ca(sk);
 
 	bbr->mode = BBR_PROBE_BW;
-	bbr->cycle_idx = CYCLE_LEN - 1 - prandom_u32_max(bbr_cycle_rand);
+	bbr->cycle_idx = CYCLE_LEN - 1 - rtcp_rand_below(sk, bbr_cycle_rand);
 	bbr_advance_cycle_phase(sk);	/* flip to next phase of gain cycle */
 }
 
@@ -1158,7 +1096,8 @@ static void bbr_update_min_rtt(struct sock *sk, const struct rate_sample *rs)
 			bbr->probe_rtt_round_done = 0;
 			bbr->next_rtt_delivered = tp->delivered;
 			if(bbr->pmodrl){
-				bbr->pmodrl->next_rtt_delivered = tp->delivered;
+				rtcp_trace(sk, bbr->pmodrl, RTCP_TRACE_RESTART, NULL, NULL);
+				rtcp_restart_round(bbr->pmodrl, tp->delivered);
 			}
 		} else if (bbr->probe_rtt_done_stamp) {
 			if (bbr->round_start)
@@ -1212,273 +1151,35 @@ static void bbr_update_model(struct sock *sk, const struct rate_sample *rs)
 	bbr_update_gains(sk);
 }
 
-static int comp(struct sock *sk, u32 now_us){
-	struct bbr *bbr = inet_csk_ca(sk);
-	u8 best_index = 0;
-	u64 b_diff;
-	u64 r_diff;
-	u64 flow_len_us;
-	u8 i;
-	for(i = 1; i < percent_arr_num; i++){
-		b_diff = (u64)abs(bbr->pmodrl->B_arr[i] - bbr->pmodrl->B_arr[best_index]);
-		r_diff = (u64)abs(bbr->pmodrl->R_arr[i] - bbr->pmodrl->R_arr[best_index]);
-		flow_len_us = now_us - bbr->pmodrl->bbr_start_us;
-		if(r_diff == 0){
-			best_index = i;
-		}
-		else{
-			if(div_u64(b_diff * BASED_SCALE * 2, r_diff) > flow_len_us * BASED_SCALE){
-				best_index = i;
-			}
-			else{
-				break;
-			}	
-		}
-	}
-	return best_index;
-}
-
-static void estimation_classify(struct sock *sk){
-	struct tcp_sock *tp = tcp_sk(sk);
-	struct bbr *bbr = inet_csk_ca(sk);
-	u32 now_us = jiffies_to_usecs(tcp_jiffies32);
-	u32 cur_delivered = tp->delivered - bbr->pmodrl->transfer_start_deliverd;
-	u32 cur_lost = tp->lost - bbr->pmodrl->transfer_start_lost;
-	u32 d;
-	u32 l;
-	u64 bef_empty;
-	u8 i;
-	u64 h;
-	u64 t;
-	u64 R;
-	u64 incr_diff;
-	u8 abrupt_decrease_flag = 0;
-	u8 best_index = 0;
-	u64 lower_bound_B;
-
-	if(use_goodput){
-		cur_delivered = tp->snd_una / tp->mss_cache - bbr->pmodrl->transfer_start_deliverd;
-	}
-
-	if(bbr->pmodrl->high_loss_flag == 0){
-		if(bbr->pmodrl->loss_start_time_us != 0 && bbr->pmodrl->loss_start_time_us + 7 * bbr->min_rtt_us < now_us){
-			d = cur_delivered - bbr->pmodrl->before_loss_delivered;
-			l = cur_lost - bbr->pmodrl->before_loss_lost;
-			// if(d < 10) {
-			// 	return;
-			// }
-			if((d + l) != 0 && (u64)l * 10 > (u64)(d + l) * 2){
-				bbr->pmodrl->high_loss_flag = 1;
-				t = div_u64(bbr->pmodrl->before_loss_time_us, USEC_PER_MSEC) - div_u64(bbr->pmodrl->bbr_start_us, USEC_PER_MSEC);
-				if ((s32)t < 1){
-					return;	
-				}
-				bef_empty = div_u64((u64)bbr->pmodrl->before_loss_delivered * BW_UNIT, bbr->pmodrl->before_loss_time_us - bbr->pmodrl->bbr_start_us);
-				bbr->pmodrl->bef_empty_goodput = bef_empty;
-				lower_bound_B = (u64)bbr->pmodrl->before_loss_delivered * (BASED_UNIT -  abrupt_decrease_thresh);
-				for(i = 0; i < percent_arr_num; i++){
-					if(percent_arr[i] == 0){
-						bbr->pmodrl->B_arr[i] = 0;
-					}
-					else{
-						t = (BW_UNIT - percent_arr[i]) * lower_bound_B;
-						t = t >> BASED_SCALE;
-						bbr->pmodrl->B_arr[i] = (u64)bbr->pmodrl->before_loss_delivered * percent_arr[i] + t;
-					}
-				}
-				for(i = 0; i < percent_arr_num; i++){
-					if((u64)bbr->pmodrl->before_loss_delivered * BW_UNIT > bbr->pmodrl->B_arr[i]){
-						h = (u64)bbr->pmodrl->before_loss_delivered * BW_UNIT - bbr->pmodrl->B_arr[i];
-						t = div_u64(bbr->pmodrl->before_loss_time_us, USEC_PER_MSEC) - div_u64(bbr->pmodrl->bbr_start_us, USEC_PER_MSEC);
-						if ((s32)t < 1){
-							return;	
-						}
-						R = div_u64(h, bbr->pmodrl->before_loss_time_us - bbr->pmodrl->bbr_start_us);
-						bbr->pmodrl->R_arr[i] = max(bbr->pmodrl->R_arr[i], R);
-					}
-				}
-			}
-			else{
-				bbr->pmodrl->loss_start_time_us = 0;
-				return;
-			}
-		}
-		else{
-			return;
-		}
-	}
-	for(i = 0; i < percent_arr_num; i++){
-		if((u64)cur_delivered * BW_UNIT > bbr->pmodrl->B_arr[i]){
-			h = (u64)cur_delivered * BW_UNIT - bbr->pmodrl->B_arr[i];
-			t = div_u64(now_us, USEC_PER_MSEC) - div_u64(bbr->pmodrl->bbr_start_us, USEC_PER_MSEC);
-			if ((s32)t < 1){
-				return;	
-			}
-			R = div_u64(h, now_us - bbr->pmodrl->bbr_start_us);
-			bbr->pmodrl->R_arr[i] = max(bbr->pmodrl->R_arr[i], R);
-		}
-	}
-	best_index = comp(sk, now_us);
-	bbr->pmodrl->best_index = best_index;
-	while(best_index == 0){
-		incr_diff = bbr->pmodrl->B_arr[0] - bbr->pmodrl->B_arr[1];
-		for(i = percent_arr_num - 1; i>=1; i--){
-			bbr->pmodrl->B_arr[i] = bbr->pmodrl->B_arr[i - 1];
-			bbr->pmodrl->R_arr[i] = bbr->pmodrl->R_arr[i - 1];
-		}
-		bbr->pmodrl->B_arr[0] = bbr->pmodrl->B_arr[0] + incr_diff;
-		bbr->pmodrl->R_arr[0] = 0;
-		if((u64)cur_delivered * BW_UNIT > bbr->pmodrl->B_arr[0]){
-			h = (u64)cur_delivered * BW_UNIT - bbr->pmodrl->B_arr[0];
-			R = div_u64(h, now_us - bbr->pmodrl->bbr_start_us);
-			bbr->pmodrl->R_arr[i] = max(bbr->pmodrl->R_arr[i], R);	
-		}
-		if((u64)bbr->pmodrl->before_loss_delivered * BW_UNIT > bbr->pmodrl->B_arr[0]){
-			h = (u64)bbr->pmodrl->before_loss_delivered * BW_UNIT - bbr->pmodrl->B_arr[0];
-			R = div_u64(h, bbr->pmodrl->before_loss_time_us - bbr->pmodrl->bbr_start_us);
-			bbr->pmodrl->R_arr[i] = max(bbr->pmodrl->R_arr[i], R);			
-		}
-		best_index = comp(sk, now_us);
-	}
-	bbr->pmodrl->best_index = best_index;
-	if(bbr->pmodrl->R_arr[best_index] * BASED_UNIT <= abrupt_decrease_thresh * bbr->pmodrl->bef_empty_goodput){
-		abrupt_decrease_flag = 1;
-	}
-	if(bbr->pmodrl->classify == 1){
-		if(!abrupt_decrease_flag){
-			// printA(KERN_INFO "!!!Rate fail %llu", bbr->pmodrl->R_arr[best_index]);
-			// u64 cycle_mstamp = bbr->pmodrl->cycle_mstamp;
-			// memset(bbr->pmodrl, 0, sizeof(struct PMODRL));
-			bbr->pmodrl->classify = 2;
-			bbr->pmodrl->disable_flag = 1;
-			// bbr->pmodrl->cycle_mstamp = cycle_mstamp;
-		}
-	}
-	else{
-		// printk(KERN_INFO "!!!%u %u %llu %llu %u %u", bbr->pmodrl->high_loss_flag, abrupt_decrease_flag, bbr->pmodrl->R_arr[best_index], bbr->pmodrl->bef_empty_goodput, now_us, bbr->pmodrl->classify_time_us);
-		if(bbr->pmodrl->high_loss_flag && abrupt_decrease_flag){
-			if(bbr->pmodrl->classify_time_us == 0){
-				bbr->pmodrl->classify_time_us = now_us;
-			}
-			if(bbr->pmodrl->reset_ltbw_flag == 0){
-				bbr_reset_lt_bw_sampling(sk);
-				bbr->pmodrl->reset_ltbw_flag = 1;
-			}
-			
-			if(bbr->pmodrl->R_arr[best_index] != bbr->pmodrl->mem_R || bbr->pmodrl->B_arr[best_index] != bbr->pmodrl->mem_B) {
-				bbr->pmodrl->classify_time_us = now_us;
-				bbr->pmodrl->mem_B = bbr->pmodrl->B_arr[best_index];
-				bbr->pmodrl->mem_R = bbr->pmodrl->R_arr[best_index];
-
-			}
-			else{
-				if(now_us - bbr->pmodrl->classify_time_us > 10 * bbr->min_rtt_us){
-					bbr->pmodrl->classify = 1;
-					bbr->pmodrl->upper_bound = 1;
-					bbr->pmodrl->detected_time = now_us - bbr->pmodrl->bbr_start_us;
-					bbr->pmodrl->detected_bytes_acked = tp->bytes_acked;
-				}
-			}
-
-		}
-		else{
-			bbr->pmodrl->classify_time_us = 0;
-		}
-	}
-
-}
-
-static void probe_pmodrl(struct sock *sk) {
+/* R-TCP engine events: hand the policer over to R-TCP, or start a probe. */
+static void bbr_rtcp_event(void *ctx, enum rtcp_event ev)
+{
+	struct sock *sk = ctx;
 	struct bbr *bbr = inet_csk_ca(sk);
-	struct tcp_sock *tp = tcp_sk(sk);
-
-	if(bbr->pmodrl) {
-		if(bbr->pmodrl->classify == 1 && optimize_flag){
-			if(bbr->pmodrl->upper_bound != 1 || bbr->pmodrl->nominator != 0) {
-				if(bbr->pmodrl->round_start){
-					bbr->pmodrl->round_count_no++;
-					if(bbr->pmodrl->round_count_no >= monitor_peroid && bbr->pmodrl->mem_B == bbr->pmodrl->B_arr[bbr->pmodrl->best_index] && bbr->pmodrl->mem_R == bbr->pmodrl->R_arr[bbr->pmodrl->best_index]){
-						bbr->pmodrl->upper_bound = 1;
-						bbr->pmodrl->nominator = 0;
-						bbr->pmodrl->round_count_no = 0;
-					}
-				}
-				if(bbr->pmodrl->mem_B != bbr->pmodrl->B_arr[bbr->pmodrl->best_index] || bbr->pmodrl->mem_R != bbr->pmodrl->R_arr[bbr->pmodrl->best_index]){
-					bbr->pmodrl->upper_bound = 2;
-					bbr->pmodrl->nominator = 0;
-					bbr->pmodrl->mem_B = bbr->pmodrl->B_arr[bbr->pmodrl->best_index];
-					bbr->pmodrl->mem_R = bbr->pmodrl->R_arr[bbr->pmodrl->best_index];
-					bbr->pmodrl->round_count_no = 0;
-					bbr->pmodrl->next_rtt_delivered = tp->delivered;
-
-					bbr->pmodrl->dis_loss_start = 2;
-				}				
-			}
-			else{
-				if(bbr->pmodrl->round_start) {
-					bbr->pmodrl->round_count++;
-					if(bbr->pmodrl->round_count >= probe_interval){
-						bbr->pmodrl->upper_bound = 1;
-						bbr->pmodrl->nominator = 1;
-						// bbr->pmodrl->acc_rto_dur = 0;
-						bbr->pmodrl->mem_B = bbr->pmodrl->B_arr[bbr->pmodrl->best_index];
-						bbr->pmodrl->mem_R = bbr->pmodrl->R_arr[bbr->pmodrl->best_index];
-						bbr->pmodrl->round_count = 0;
-						bbr->pmodrl->round_count_no = 0;
-						bbr_advance_cycle_phase(sk);
-						bbr->cycle_idx = 0;
-						bbr->mode = BBR_PROBE_BW;
-					}
-				}
-			}
 
-		}
+	switch (ev) {
+	case RTCP_EV_CLASSIFYING:
+		bbr_reset_lt_bw_sampling(sk);
+		break;
+	case RTCP_EV_PROBE:
+		bbr_advance_cycle_phase(sk);
+		bbr->cycle_idx = 0;
+		bbr->mode = BBR_PROBE_BW;
+		break;
 	}
 }
 
-static void reset_pmodrl(struct sock *sk, u8 res1, u8 res2){
-	struct bbr *bbr = inet_csk_ca(sk);
-	struct tcp_sock *tp = tcp_sk(sk);
-	char* p;
-	int flag = 0;
-	if(bbr->pmodrl->classify == 1){
-		flag = 1;
-	}
-	else if(bbr->pmodrl->classify == 2){
-		flag = 2;
-	}
-	else if(bbr->pmodrl->classify != 0){
-		flag = bbr->pmodrl->classify;
-	}
-	p = bbr->pmodrl->buffer;
-	memset(bbr->pmodrl,0, sizeof(struct PMODRL));
-	bbr->pmodrl->bbr_start_us = jiffies_to_usecs(tcp_jiffies32);
-	bbr->pmodrl->transfer_start_lost = tp->lost;
-	if(use_goodput){
-		bbr->pmodrl->transfer_start_deliverd = tp->snd_una / tp->mss_cache;
-	}
-	else{
-		bbr->pmodrl->transfer_start_deliverd = tp->delivered;
-	}
-	bbr->pmodrl->buffer = p;
-	if(flag == 1){
-		bbr->pmodrl->classify = res1;
-	}
-	else if(flag == 2){
-		bbr->pmodrl->classify = res2;
-	}
-	else if(flag != 0){
-		bbr->pmodrl->classify = flag;
-	}
-}
+static const struct rtcp_ops bbr_rtcp_ops = {
+	.event		= bbr_rtcp_event,
+};
 
-static void bbr_main(struct sock *sk, const struct rate_sample *rs)
+static RTCP_CONG_CONTROL(bbr_main)
 {
 	struct bbr *bbr = inet_csk_ca(sk);
 	struct tcp_sock *tp = tcp_sk(sk);
 	struct inet_sock *inet = inet_sk(sk);
+	struct rtcp_sample s;
 	u32 bw;
-	u32 now_us = jiffies_to_usecs(tcp_jiffies32);
 	u64 srtt;
 	srtt = tp->srtt_us >> 3;
 
@@ -1487,47 +1188,17 @@ static void bbr_main(struct sock *sk, const struct rate_sample *rs)
 	// bbr_reset_lt_bw_sampling(sk);
 	
 	if(bbr->pmodrl){
-		bbr->pmodrl->latest_ack_us = now_us;
-
-		if(bbr->pmodrl->bbr_start_us == 0){
-			bbr->pmodrl->bbr_start_us = now_us;
-		}
-		if(bbr->pmodrl->disable_flag == 0){
-			estimation_classify(sk);
-		}
-
-		if(bbr->pmodrl->lastest_ack_loss!=tp->lost){
-			if(bbr->pmodrl->high_loss_flag == 0 && bbr->pmodrl->loss_start_time_us == 0){
-				bbr->pmodrl->loss_start_time_us = now_us;
-			}
-		}
-		else{
-			if(bbr->pmodrl->high_loss_flag == 0 && bbr->pmodrl->loss_start_time_us == 0) {
-				bbr->pmodrl->before_loss_delivered = tp->delivered - bbr->pmodrl->transfer_start_deliverd;
-				bbr->pmodrl->before_loss_time_us = now_us;
-				bbr->pmodrl->before_loss_lost = tp->lost - bbr->pmodrl->transfer_start_lost;
-				if(use_goodput){
-					bbr->pmodrl->before_loss_delivered = tp->snd_una / tp->mss_cache - bbr->pmodrl->transfer_start_deliverd;
-				}
-			}
-		}
-		bbr->pmodrl->lastest_ack_loss = tp->lost;
+		rtcp_fill_sample(sk, bbr->pmodrl, rs, bbr->min_rtt_us, &s);
+		rtcp_trace(sk, bbr->pmodrl, RTCP_TRACE_ACK, &s, rs);
+		rtcp_ack(bbr->pmodrl, &s);
 
-		if(bbr->pmodrl->classify == 1 && optimize_flag) {
+		if(rtcp_capped(bbr->pmodrl)) {
 			bbr_reset_lt_bw_sampling(sk);
 		}
 
 		if(tp->write_seq - tp->snd_nxt < tp->mss_cache && sk_wmem_alloc_get(sk) < SKB_TRUESIZE(1) && tcp_packets_in_flight(tp) < tp->snd_cwnd && tp->lost_out <= tp->retrans_out){
 			bbr->pmodrl->probe_rtt_flag = 0;
 		}
-
-		bbr->pmodrl->round_start = 0;
-		if (!before(rs->prior_delivered, bbr->pmodrl->next_rtt_delivered) && !(rs->delivered < 0 || rs->interval_us <= 0)) {
-			bbr->pmodrl->next_rtt_delivered = tp->delivered;
-			bbr->pmodrl->round_start = 1;
-		}
-
-		probe_pmodrl(sk);
 	}
 
 	bw = bbr_bw(sk);
@@ -1537,53 +1208,143 @@ static void bbr_main(struct sock *sk, const struct rate_sample *rs)
 
 	if(bbr->pmodrl){
 		u64 bw1;
-		bbr->pmodrl->store_interval+=1;
-		if(bbr->pmodrl->buffer && bbr->pmodrl->store_interval >= STORE_INTERVAL){
-			bbr->pmodrl->store_interval = 0;
-			if(strlen(bbr->pmodrl->buffer) + 90 < MAX_STR_LEN){
-				char temp[90];
-				memset(temp, 0, 90);
-				snprintf(temp, sizeof(temp), "%llu;%u;%llu;%llu-", tp->bytes_acked, bbr->pmodrl->classify, bbr->pmodrl->B_arr[bbr->pmodrl->best_index], bbr->pmodrl->R_arr[bbr->pmodrl->best_index]);
-				strcat(bbr->pmodrl->buffer, temp);
-			}
-		}
-		if(exclude_rwnd && tp->chrono_type == TCP_CHRONO_RWND_LIMITED){
-			reset_pmodrl(sk, (u8)5, (u8)6);
-		}
-
-		if(exclude_RTO && bbr->prev_ca_state == TCP_CA_Loss && inet_csk(sk)->icsk_ca_state != TCP_CA_Loss){
-			reset_pmodrl(sk, (u8)7, (u8)8);
-		}
-
-		if(exclude_applimited && rs->is_app_limited){
-			reset_pmodrl(sk, (u8)9, (u8)10);
-		}
+		s.rto_exit = bbr->prev_ca_state == TCP_CA_Loss && inet_csk(sk)->icsk_ca_state != TCP_CA_Loss;
+		rtcp_trace(sk, bbr->pmodrl, RTCP_TRACE_ACK_END, &s, rs);
+		rtcp_ack_end(bbr->pmodrl, &s);
 		bw1 = (u64)rs->delivered * BW_UNIT;
 		do_div(bw1, rs->interval_us);
 		if(enable_printk){
-			printk(KERN_INFO "!!!ACK: ip:%pI4 port:%hu c:%u B:%llu R:%llu mode:%u idx:%u n:%u u_p:%lu r_p:%lu b:%llu d:%u l:%u rd:%u rl:%u u:%u rc:%u rcn:%u cl:%u def:%u srtt:%llu state:%u cwnd:%u adv:%u inflight:%u rate:%lu s:%llu remain:%u acc_rto:%llu lim:%u limit:%u", 
-				&sk->sk_daddr, ntohs(inet->inet_dport), bbr->pmodrl->classify, bbr->pmodrl->B_arr[bbr->pmodrl->best_index], bbr->pmodrl->R_arr[bbr->pmodrl->best_index], 
-				bbr->mode, bbr->cycle_idx, bbr->pmodrl->nominator, bbr_bw_to_pacing_rate_pmodrl(sk,bbr->pmodrl->R_arr[bbr->pmodrl->best_index],BBR_UNIT,bbr->pmodrl->nominator), sk->sk_pacing_rate, tp->bytes_acked, tp->delivered, tp->lost, 
+			struct rtcp_flow_id id;
+
+			rtcp_flow_id(sk, &id);
+			printk(KERN_INFO "!!!ACK: ip:%pISc port:%hu c:%u B:%llu R:%llu mode:%u idx:%u n:%u u_p:%lu r_p:%lu b:%llu d:%u l:%u rd:%u rl:%u u:%u rc:%u rcn:%u cl:%u def:%u srtt:%llu state:%u cwnd:%u adv:%u inflight:%u rate:%lu s:%llu remain:%u acc_rto:%llu lim:%u limit:%u", 
+				&id.dst, ntohs(inet->inet_dport), bbr->pmodrl->classify, rtcp_B(bbr->pmodrl), rtcp_R(bbr->pmodrl), 
+				bbr->mode, bbr->cycle_idx, bbr->pmodrl->nominator, bbr_bw_to_pacing_rate_pmodrl(sk,rtcp_R(bbr->pmodrl),BBR_UNIT), sk->sk_pacing_rate, tp->bytes_acked, tp->delivered, tp->lost, 
 				rs->delivered, rs->losses ,bbr->pmodrl->upper_bound, bbr->pmodrl->round_count, bbr->pmodrl->round_count_no, tcp_is_cwnd_limited(sk), bbr->pmodrl->dis_enable_flag, srtt, inet_csk(sk)->icsk_ca_state, tp->snd_cwnd, tp->rcv_wnd,tcp_packets_in_flight(tp),
 				bbr_bw_to_pacing_rate(sk, bw1, BBR_UNIT), tp->bytes_sent, tp->write_seq - tp->snd_nxt, bbr->pmodrl->acc_rto_dur, bbr->lt_use_bw, bbr->lt_bw);	
 		}	
 	}
 }
 
+/* BBR state carried to the next module version when a socket switches
+ * congestion control, next to the engine state (struct rtcp_state). Every
+ * build of rtcp_bbr, whatever its name, is of family "rtcp_bbr"; a build
+ * that changes this layout bumps BBR_STATE_VERSION, and an unknown version
+ * restarts BBR from scratch while keeping the engine state.
+ */
+#define BBR_STATE_FAMILY	"rtcp_bbr"
+#define BBR_STATE_VERSION	1
+
+struct bbr_state {
+	u32	version;
+	u32	min_rtt_us;
+	u32	min_rtt_stamp;
+	u32	probe_rtt_done_stamp;
+	struct minmax bw;
+	u32	rtt_cnt;
+	u32	next_rtt_delivered;
+	u32	lt_bw;
+	u32	lt_last_delivered;
+	u32	lt_last_stamp;
+	u32	lt_last_lost;
+	u32	prior_cwnd;
+	u32	full_bw;
+	u32	ack_epoch_acked;
+	u64	ack_epoch_mstamp;
+	u64	cycle_mstamp;
+	u16	extra_acked[2];
+	u16	pacing_gain;
+	u16	cwnd_gain;
+	u8	mode;
+	u8	prev_ca_state;
+	u8	packet_conservation;
+	u8	round_start;
+	u8	idle_restart;
+	u8	probe_rtt_round_done;
+	u8	lt_is_sampling;
+	u8	lt_rtt_cnt;
+	u8	lt_use_bw;
+	u8	full_bw_reached;
+	u8	full_bw_cnt;
+	u8	cycle_idx;
+	u8	has_seen_rtt;
+	u8	extra_acked_win_rtts;
+	u8	extra_acked_win_idx;
+};
+
+#define BBR_STATE_COPY(dst, src)					\
+	do {								\
+		(dst)->min_rtt_us = (src)->min_rtt_us;			\
+		(dst)->min_rtt_stamp = (src)->min_rtt_stamp;		\
+		(dst)->probe_rtt_done_stamp = (src)->probe_rtt_done_stamp; \
+		(dst)->bw = (src)->bw;					\
+		(dst)->rtt_cnt = (src)->rtt_cnt;			\
+		(dst)->next_rtt_delivered = (src)->next_rtt_delivered;	\
+		(dst)->lt_bw = (src)->lt_bw;				\
+		(dst)->lt_last_delivered = (src)->lt_last_delivered;	\
+		(dst)->lt_last_stamp = (src)->lt_last_stamp;		\
+		(dst)->lt_last_lost = (src)->lt_last_lost;		\
+		(dst)->prior_cwnd = (src)->prior_cwnd;			\
+		(dst)->full_bw = (src)->full_bw;			\
+		(dst)->ack_epoch_acked = (src)->ack_epoch_acked;	\
+		(dst)->ack_epoch_mstamp = (src)->ack_epoch_mstamp;	\
+		(dst)->extra_acked[0] = (src)->extra_acked[0];		\
+		(dst)->extra_acked[1] = (src)->extra_acked[1];		\
+		(dst)->pacing_gain = (src)->pacing_gain;		\
+		(dst)->cwnd_gain = (src)->cwnd_gain;			\
+		(dst)->mode = (src)->mode;				\
+		(dst)->prev_ca_state = (src)->prev_ca_state;		\
+		(dst)->packet_conservation = (src)->packet_conservation; \
+		(dst)->round_start = (src)->round_start;		\
+		(dst)->idle_restart = (src)->idle_restart;		\
+		(dst)->probe_rtt_round_done = (src)->probe_rtt_round_done; \
+		(dst)->lt_is_sampling = (src)->lt_is_sampling;		\
+		(dst)->lt_rtt_cnt = (src)->lt_rtt_cnt;			\
+		(dst)->lt_use_bw = (src)->lt_use_bw;			\
+		(dst)->full_bw_reached = (src)->full_bw_reached;	\
+		(dst)->full_bw_cnt = (src)->full_bw_cnt;		\
+		(dst)->cycle_idx = (src)->cycle_idx;			\
+		(dst)->has_seen_rtt = (src)->has_seen_rtt;		\
+		(dst)->extra_acked_win_rtts = (src)->extra_acked_win_rtts; \
+		(dst)->extra_acked_win_idx = (src)->extra_acked_win_idx; \
+	} while (0)
+
+static void bbr_save_state(struct sock *sk, struct bbr_state *st)
+{
+	struct bbr *bbr = inet_csk_ca(sk);
+
+	memset(st, 0, sizeof(*st));
+	st->version = BBR_STATE_VERSION;
+	BBR_STATE_COPY(st, bbr);
+	st->cycle_mstamp = bbr->pmodrl->cycle_mstamp;
+}
+
+static void bbr_load_state(struct sock *sk, const struct bbr_state *st)
+{
+	struct bbr *bbr = inet_csk_ca(sk);
+
+	BBR_STATE_COPY(bbr, st);
+	bbr->pmodrl->cycle_mstamp = st->cycle_mstamp;
+}
+
 static void bbr_init(struct sock *sk)
 {
 	struct tcp_sock *tp = tcp_sk(sk);
 	struct bbr *bbr = inet_csk_ca(sk);
 
-	bbr->pmodrl = kmalloc(sizeof(struct PMODRL), GFP_KERNEL);
+	bbr->pmodrl = rtcp_alloc(&bbr_rtcp_ops, sk, GFP_ATOMIC);
 	if (bbr->pmodrl){
-		memset(bbr->pmodrl,0, sizeof(struct PMODRL));
-		bbr->pmodrl->bbr_start_us = jiffies_to_usecs(tcp_jiffies32);
-
-	    bbr->pmodrl->buffer = (char*)kmalloc(MAX_STR_LEN, GFP_KERNEL);
-	    if(bbr->pmodrl->buffer) {
-	    	memset(bbr->pmodrl->buffer, 0, MAX_STR_LEN);
-	    }
+		struct bbr_state st;
+
+		rtcp_clock_start(sk, bbr->pmodrl);
+		rtcp_trace(sk, bbr->pmodrl, RTCP_TRACE_INIT, NULL, NULL);
+		/* Switched from another rtcp_bbr build: continue where it was. */
+		if (rtcp_handover_take(sk, bbr->pmodrl, BBR_STATE_FAMILY, &st, sizeof(st)) &&
+		    st.version == BBR_STATE_VERSION) {
+			bbr_load_state(sk, &st);
+			cmpxchg(&sk->sk_pacing_status, SK_PACING_NONE, SK_PACING_NEEDED);
+			return;
+		}
 	}
 
 	bbr->prior_cwnd = 0;
@@ -1633,18 +1394,27 @@ static void bbr_release(struct sock *sk)
 
    	if (!bbr->pmodrl)
       		return;
+	if (rtcp_switching(sk)) {
+		struct bbr_state st;
+
+		bbr_save_state(sk, &st);
+		if (!rtcp_handover_put(sk, bbr->pmodrl, BBR_STATE_FAMILY, &st, sizeof(st))) {
+			rtcp_free(bbr->pmodrl);
+			bbr->pmodrl = NULL;
+			return;
+		}
+	}
     if(enable_printk){
-		printk(KERN_INFO "!!!Release sip:%pI4 sp:%hu dip:%pI4 dp:%hu p:%u c:%u B:%llu R:%llu b:%llu history:%s\n",
-				&sk->sk_rcv_saddr, ntohs(inet->inet_sport),
-				&sk->sk_daddr, ntohs(inet->inet_dport),
-				tp->delivered, bbr->pmodrl->classify,  bbr->pmodrl->B_arr[bbr->pmodrl->best_index], bbr->pmodrl->R_arr[bbr->pmodrl->best_index], bbr->pmodrl->detected_bytes_acked, bbr->pmodrl->buffer);
-    }
+		struct rtcp_flow_id id;
 
-    if(bbr->pmodrl->buffer){
-	   	kfree(bbr->pmodrl->buffer);
-	   	bbr->pmodrl->buffer = NULL;
+		rtcp_flow_id(sk, &id);
+		printk(KERN_INFO "!!!Release sip:%pISc sp:%hu dip:%pISc dp:%hu p:%u c:%u B:%llu R:%llu b:%llu history:%s\n",
+				&id.src, ntohs(inet->inet_sport),
+				&id.dst, ntohs(inet->inet_dport),
+				tp->delivered, bbr->pmodrl->classify,  rtcp_B(bbr->pmodrl), rtcp_R(bbr->pmodrl), bbr->pmodrl->detected_bytes_acked, bbr->pmodrl->buffer);
     }
-   	kfree(bbr->pmodrl);
+
+   	rtcp_free(bbr->pmodrl);
    	bbr->pmodrl = NULL;
 
 }
@@ -1697,8 +1467,8 @@ static size_t bbr_get_info(struct sock *sk, u32 ext, int *attr,
 				info->bbr.bbr_bw_lo		= bbr->pmodrl->classify;
 				info->bbr.bbr_bw_hi		= bbr->pmodrl->detected_time / 1000;
 				info->bbr.bbr_min_rtt		= bbr->pmodrl->detected_bytes_acked;
-				info->bbr.bbr_pacing_gain	= (bbr->pmodrl->B_arr[bbr->pmodrl->best_index] * (u64)tcp_sk(sk)->mss_cache / 1024) >> BW_SCALE;
-				info->bbr.bbr_cwnd_gain		= (bbr->pmodrl->R_arr[bbr->pmodrl->best_index] * (u64)tcp_sk(sk)->mss_cache * 1000) >> BW_SCALE;
+				info->bbr.bbr_pacing_gain	= (rtcp_B(bbr->pmodrl) * (u64)tcp_sk(sk)->mss_cache / 1024) >> BW_SCALE;
+				info->bbr.bbr_cwnd_gain		= (rtcp_R(bbr->pmodrl) * (u64)tcp_sk(sk)->mss_cache * 1000) >> BW_SCALE;
 			}
 			else{
 				info->bbr.bbr_bw_lo		= bbr->pmodrl->classify;
@@ -1746,20 +1516,11 @@ static void bbr_set_state(struct sock *sk, u8 new_state)
 	}
 }
 
-module_param_named(probe_interval_external, probe_interval, int, 0644);
-module_param_named(probe_per_external, probe_per, int, 0644);
-module_param_named(optimize_flag_external, optimize_flag, int, 0644);
-module_param_named(high_loss_disclassify_external, high_loss_disclassify, int, 0644);
-module_param_named(monitor_peroid_external, monitor_peroid, int, 0644);
-module_param_named(exclude_RTO_external, exclude_RTO, int, 0644);
-module_param_named(exclude_rwnd_external, exclude_rwnd, int, 0644);
-module_param_named(use_goodput_external, use_goodput, int, 0644);
-module_param_named(exclude_applimited_external, exclude_applimited, int, 0644);
 module_param_named(enable_printk_external, enable_printk, int, 0644);
 
 static struct tcp_congestion_ops tcp_bbr_cong_ops __read_mostly = {
 	.flags		= TCP_CONG_NON_RESTRICTED,
-	.name		= "rtcp_bbr",
+	.name		= RTCP_BBR_NAME,
 	.owner		= THIS_MODULE,
 	.init		= bbr_init,
 	.release	= bbr_release,
@@ -1777,6 +1538,7 @@ static struct tcp_congestion_ops tcp_bbr_cong_ops __read_mostly = {
 static int __init bbr_register(void)
 {
 	BUILD_BUG_ON(sizeof(struct bbr) > ICSK_CA_PRIV_SIZE);
+	BUILD_BUG_ON(sizeof(struct bbr_state) > RTCP_STATE_HOST_MAX);
 	return tcp_register_congestion_control(&tcp_bbr_cong_ops);
 }
 
@@ -0,0 +1,1415 @@
+/*
+ * R-TCP-BBRv2: a BBRv2-style model with R-TCP
+ *
+ * This follows the BBRv2 alpha release (github.com/google/bbr, v2alpha
+ * branch), restricted to what a stock Linux v5.4.0 tcp_congestion_ops can
+ * see. PROBE_BW cycles through DOWN, CRUISE, REFILL and UP phases, and the
+ * path model keeps loss-aware bounds next to max bw and min_rtt:
+ *
+ *   bw_hi, inflight_hi:  long-term bounds, from the max bw filter over the
+ *                        last two probe cycles and from the inflight level at
+ *                        which probing saw excessive loss
+ *   bw_lo, inflight_lo:  short-term bounds, cut by beta on rounds with loss
+ *
+ * Stock 5.4 has no per-skb tx_in_flight/lost in struct rate_sample, so loss is
+ * judged per packet-timed round from tp->lost and tp->delivered rather than
+ * per ACKed skb, and ECN is not used. ACK aggregation provisioning is left
+ * out so that struct bbr fits in ICSK_CA_PRIV_SIZE.
+ *
+ * Once the R-TCP engine (see rtcp.h) classifies the flow as policed, the
+ * detected (B, R) becomes the long-term bounds: bw_hi is the token rate R
+ * (raised by gamma while probing the cap) and inflight_hi is the BDP at R plus
+ * as much of the bucket B as fits in one more BDP. Losses no longer lower
+ * inflight_hi while capped.
+ *
+ * The R-TCP module was designed and implemented by
+ * Shengtong Zhu, Yan Liu, Lingfeng Guo and Jack Y. B. Lee,
+ *  "R-TCP: A Framework to Optimize TCP Performance Over Rate-Limiting Networks", NSDI, 2026.
+ *
+ * Contact  : zs021@ie.cuhk.edu.hk
+ */
+#include <linux/module.h>
+#include <net/tcp.h>
+#include <linux/inet_diag.h>
+#include <linux/inet.h>
+#include <linux/random.h>
+#include "rtcp.h"
+#include "rtcp_compat.h"
+
+/* Scale factor for rate in pkt/uSec unit to avoid truncation in bandwidth
+ * estimation. The rate unit ~= (1500 bytes / 1 usec / 2^24) ~= 715 bps.
+ */
+#define BW_SCALE 24
+#define BW_UNIT (1 << BW_SCALE)
+
+#define BBR_SCALE 8	/* scaling factor for fractions in BBR (e.g. gains) */
+#define BBR_UNIT (1 << BBR_SCALE)
+
+/* BBR has the following modes for deciding how fast to send: */
+enum bbr_mode {
+	BBR_STARTUP,	/* ramp up sending rate rapidly to fill pipe */
+	BBR_DRAIN,	/* drain any queue created during startup */
+	BBR_PROBE_BW,	/* discover, share bw: pace around estimated bw */
+	BBR_PROBE_RTT,	/* cut inflight to min to probe min_rtt */
+};
+
+/* How does the incoming ACK stream relate to our bandwidth probing? */
+enum bbr_pacing_gain_phase {
+	BBR_BW_PROBE_UP		= 0,  /* push up inflight to probe for bw/vol */
+	BBR_BW_PROBE_DOWN	= 1,  /* drain excess inflight from the queue */
+	BBR_BW_PROBE_CRUISE	= 2,  /* use pipe, w/ headroom in queue/pipe */
+	BBR_BW_PROBE_REFILL	= 3,  /* refill the pipe again to 100% */
+};
+
+static int enable_printk = 1;
+
+/* BBR congestion control block */
+struct bbr {
+	u32	min_rtt_us;	        /* min RTT in min_rtt_win_sec window */
+	u32	min_rtt_stamp;	        /* timestamp of min_rtt_us */
+	u32	probe_rtt_done_stamp;   /* end time for BBR_PROBE_RTT mode */
+	u32	probe_rtt_min_us;	/* min RTT in bbr_probe_rtt_win_ms window */
+	u32	probe_rtt_min_stamp;	/* timestamp of probe_rtt_min_us */
+	u32     next_rtt_delivered; /* scb->tx.delivered at end of round */
+	u64	cycle_mstamp;	     /* time of this cycle phase start */
+	u32     mode:2,		     /* current bbr_mode in state machine */
+		prev_ca_state:3,     /* CA state on previous ACK */
+		packet_conservation:1,  /* use packet conservation? */
+		round_start:1,	     /* start of packet-timed tx->ack round? */
+		idle_restart:1,	     /* restarting after idle? */
+		probe_rtt_round_done:1,  /* a BBR_PROBE_RTT round at 4 pkts? */
+		full_bw_reached:1,   /* reached full bw in Startup? */
+		full_bw_cnt:2,	/* number of rounds without large bw gains */
+		cycle_idx:2,	/* current PROBE_BW phase */
+		has_seen_rtt:1, /* have we seen an RTT sample yet? */
+		loss_in_round:1,	/* loss marked in this round? */
+		bw_probe_samples:1,	/* rate samples reflect bw probing? */
+		prev_probe_too_high:1,	/* did last PROBE_UP go too high? */
+		stopped_risky_probe:1,	/* last PROBE_UP stopped due to risk? */
+		rtcp_capped:1,		/* (B, R) set the long-term bounds */
+		bw_probe_up_rounds:5,	/* cwnd-limited rounds in PROBE_UP */
+		unused:6;
+	u32	pacing_gain:11,	/* current gain for setting pacing rate */
+		cwnd_gain:11,	/* current gain for setting cwnd */
+		rounds_since_probe:6,	/* packet-timed rounds since probed bw */
+		unused_b:4;
+	u32	prior_cwnd;	/* prior cwnd upon entering loss recovery */
+	u32	full_bw;	/* recent bw, to estimate if pipe is full */
+
+	u32	bw_hi[2];	/* max bw in the last two probe cycles */
+	u32	bw_latest;	/* max delivered bw in last round trip */
+	u32	bw_lo;		/* lower bound on sending bandwidth */
+	u32	inflight_latest; /* max delivered data in last round trip */
+	u32	inflight_lo;	/* lower bound of inflight data range */
+	u32	inflight_hi;	/* upper bound of inflight data range */
+	u32	bw_probe_up_cnt; /* packets delivered per inflight_hi incr */
+	u32	bw_probe_up_acks;  /* packets (S)ACKed since inflight_hi incr */
+	u32	probe_wait_us;	/* PROBE_DOWN until next clock-driven probe */
+	u32	loss_round_delivered; /* tp->delivered at start of round */
+	u32	loss_round_lost;	/* tp->lost at start of round */
+
+	struct PMODRL* pmodrl;
+};
+
+/* Window length of min_rtt filter (in sec): */
+static const u32 bbr_min_rtt_win_sec = 10;
+/* Window length of probe_rtt_min_us filter (in ms), and consequently the
+ * typical interval between PROBE_RTT mode entries:
+ */
+static const u32 bbr_probe_rtt_win_ms = 5000;
+/* Minimum time (in ms) spent at bbr_cwnd_min_target in BBR_PROBE_RTT mode: */
+static const u32 bbr_probe_rtt_mode_ms = 200;
+/* Skip TSO below the following bandwidth (bits/sec): */
+static const int bbr_min_tso_rate = 1200000;
+
+/* Pace at ~1% below estimated bw, on average, to reduce queue at bottleneck. */
+static const int bbr_pacing_margin_percent = 1;
+
+/* We use a high_gain value of 2/ln(2) because it's the smallest pacing gain
+ * that will allow a smoothly increasing pacing rate that will double each RTT
+ * and send the same number of packets per RTT that an un-paced, slow-starting
+ * Reno or CUBIC flow would:
+ */
+static const int bbr_high_gain  = BBR_UNIT * 2885 / 1000 + 1;
+/* The pacing gain of 1/high_gain in BBR_DRAIN is calculated to typically drain
+ * the queue created in BBR_STARTUP in a single round:
+ */
+static const int bbr_drain_gain = BBR_UNIT * 1000 / 2885;
+/* The gain for deriving steady-state cwnd tolerates delayed/stretched ACKs: */
+static const int bbr_cwnd_gain  = BBR_UNIT * 2;
+/* The pacing_gain values for the PROBE_BW phases, indexed by cycle_idx: */
+static const int bbr_pacing_gain[] = {
+	BBR_UNIT * 5 / 4,	/* UP: probe for more available bw */
+	BBR_UNIT * 3 / 4,	/* DOWN: drain queue and/or yield bw */
+	BBR_UNIT,		/* CRUISE: try to use pipe w/ some headroom */
+	BBR_UNIT,		/* REFILL: refill pipe to estimated 100% */
+};
+/* PROBE_UP ends once inflight reaches this gain times the BDP: */
+static const int bbr_bw_probe_pif_gain = BBR_UNIT * 5 / 4;
+/* cwnd gain in PROBE_RTT, to keep some data in flight: */
+static const int bbr_probe_rtt_cwnd_gain = BBR_UNIT * 1 / 2;
+
+/* Try to keep at least this many packets in flight, if things go smoothly. */
+static const u32 bbr_cwnd_min_target = 4;
+
+/* To estimate if BBR_STARTUP mode (i.e. high_gain) has filled pipe... */
+/* If bw has increased significantly (1.25x), there may be more bw available: */
+static const u32 bbr_full_bw_thresh = BBR_UNIT * 5 / 4;
+/* But after 3 rounds w/o significant bw growth, estimate pipe is full: */
+static const u32 bbr_full_bw_cnt = 3;
+
+/* Loss rate (lost/sent in a round) above which inflight is too high: 2% */
+static const u32 bbr_loss_thresh = BBR_UNIT * 2 / 100;
+/* Exit STARTUP on a lossy round with at least this many packets lost: */
+static const u32 bbr_full_loss_cnt = 8;
+/* Multiplicative decrease of the short-term bounds on a lossy round: */
+static const u32 bbr_beta = BBR_UNIT * 30 / 100;
+/* Fraction of inflight_hi left unused while cruising: */
+static const u32 bbr_inflight_headroom = BBR_UNIT * 15 / 100;
+
+/* Max packet-timed rounds to wait before probing for bandwidth, so that a
+ * Reno flow sharing the path keeps growing:
+ */
+static const u32 bbr_bw_probe_max_rounds = 63;
+/* Max random rounds subtracted from that wait: */
+static const u32 bbr_bw_probe_rand_rounds = 2;
+/* Wall-clock wait between bandwidth probes: base plus up to rand, in us: */
+static const u32 bbr_bw_probe_base_us = 2 * USEC_PER_SEC;
+static const u32 bbr_bw_probe_rand_us = 1 * USEC_PER_SEC;
+
+static void bbr_check_probe_rtt_done(struct sock *sk);
+static void bbr2_start_bw_probe_down(struct sock *sk);
+
+/* Do we estimate that STARTUP filled the pipe? */
+static bool bbr_full_bw_reached(const struct sock *sk)
+{
+	const struct bbr *bbr = inet_csk_ca(sk);
+
+	return bbr->full_bw_reached;
+}
+
+/* Return the max bw of the last two probe cycles, in pkts/uS << BW_SCALE. */
+static u32 bbr_max_bw(const struct sock *sk)
+{
+	struct bbr *bbr = inet_csk_ca(sk);
+
+	return max(bbr->bw_hi[0], bbr->bw_hi[1]);
+}
+
+/* Return the estimated bandwidth of the path, in pkts/uS << BW_SCALE. */
+static u32 bbr_bw(const struct sock *sk)
+{
+	struct bbr *bbr = inet_csk_ca(sk);
+
+	return min(bbr_max_bw(sk), bbr->bw_lo);
+}
+
+/* Return rate in bytes per second, optionally with a gain.
+ * The order here is chosen carefully to avoid overflow of u64. This should
+ * work for input rates of up to 2.9Tbit/sec and gain of 2.89x.
+ */
+static u64 bbr_rate_bytes_per_sec(struct sock *sk, u64 rate, int gain)
+{
+	unsigned int mss = tcp_sk(sk)->mss_cache;
+
+	rate *= mss;
+	rate *= gain;
+	rate >>= BBR_SCALE;
+	rate *= USEC_PER_SEC / 100 * (100 - bbr_pacing_margin_percent);
+	return rate >> BW_SCALE;
+}
+
+/* Convert a BBR bw and gain factor to a pacing rate in bytes per second. */
+static unsigned long bbr_bw_to_pacing_rate(struct sock *sk, u32 bw, int gain)
+{
+	u64 rate = bw;
+
+	rate = bbr_rate_bytes_per_sec(sk, rate, gain);
+	rate = min_t(u64, rate, sk->sk_max_pacing_rate);
+	return rate;
+}
+
+/* Initialize pacing rate to: high_gain * init_cwnd / RTT. */
+static void bbr_init_pacing_rate_from_rtt(struct sock *sk)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bbr *bbr = inet_csk_ca(sk);
+	u64 bw;
+	u32 rtt_us;
+
+	if (tp->srtt_us) {		/* any RTT sample yet? */
+		rtt_us = max(tp->srtt_us >> 3, 1U);
+		bbr->has_seen_rtt = 1;
+	} else {			 /* no RTT sample yet */
+		rtt_us = USEC_PER_MSEC;	 /* use nominal default RTT */
+	}
+	bw = (u64)tp->snd_cwnd * BW_UNIT;
+	do_div(bw, rtt_us);
+	WRITE_ONCE(sk->sk_pacing_rate, bbr_bw_to_pacing_rate(sk, bw, bbr_high_gain));
+}
+
+static unsigned long bbr_bw_to_pacing_rate_pmodrl(struct sock *sk, u32 bw, int gain)
+{
+	struct bbr *bbr = inet_csk_ca(sk);
+	u64 rate = bw;
+
+	if(bbr->pmodrl){
+		gain = rtcp_cap_gain(bbr->pmodrl, gain);
+	}
+	rate = bbr_rate_bytes_per_sec(sk, rate, gain);
+	rate = min_t(u64, rate, sk->sk_max_pacing_rate);
+	return rate;
+}
+
+/* Pace using current bw estimate and a gain factor, within the R-TCP cap. */
+static void bbr_set_pacing_rate(struct sock *sk, u32 bw, int gain)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bbr *bbr = inet_csk_ca(sk);
+	unsigned long rate = bbr_bw_to_pacing_rate(sk, bw, gain);
+
+	u8 flag = 0;
+	if(bbr->pmodrl && rtcp_cap_active(bbr->pmodrl)){
+		unsigned long pmodrl_rate = bbr_bw_to_pacing_rate_pmodrl(sk, rtcp_R(bbr->pmodrl), BBR_UNIT);
+		if(rate > pmodrl_rate){
+			rate = pmodrl_rate;
+			flag = 1;
+		}
+	}
+
+	if (unlikely(!bbr->has_seen_rtt && tp->srtt_us))
+		bbr_init_pacing_rate_from_rtt(sk);
+	if (bbr_full_bw_reached(sk) || rate > sk->sk_pacing_rate)
+		WRITE_ONCE(sk->sk_pacing_rate, rate);
+	if(flag){
+		WRITE_ONCE(sk->sk_pacing_rate, rate);
+	}
+}
+
+/* override sysctl_tcp_min_tso_segs */
+static u32 bbr_min_tso_segs(struct sock *sk)
+{
+	return sk->sk_pacing_rate < (bbr_min_tso_rate >> 3) ? 1 : 2;
+}
+
+static u32 bbr_tso_segs_goal(struct sock *sk)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	u32 segs, bytes;
+
+	/* Sort of tcp_tso_autosize() but ignoring
+	 * driver provided sk_gso_max_size.
+	 */
+	bytes = min_t(unsigned long, sk->sk_pacing_rate >> READ_ONCE(sk->sk_pacing_shift),
+		      RTCP_GSO_MAX_SIZE - 1 - MAX_TCP_HEADER);
+	segs = max_t(u32, bytes / tp->mss_cache, bbr_min_tso_segs(sk));
+
+	return min(segs, 0x7FU);
+}
+
+/* Save "last known good" cwnd so we can restore it after losses or PROBE_RTT */
+static void bbr_save_cwnd(struct sock *sk)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bbr *bbr = inet_csk_ca(sk);
+
+	if (bbr->prev_ca_state < TCP_CA_Recovery && bbr->mode != BBR_PROBE_RTT)
+		bbr->prior_cwnd = tp->snd_cwnd;  /* this cwnd is good enough */
+	else  /* loss recovery or BBR_PROBE_RTT have temporarily cut cwnd */
+		bbr->prior_cwnd = max(bbr->prior_cwnd, tp->snd_cwnd);
+}
+
+static void bbr_cwnd_event(struct sock *sk, enum tcp_ca_event event)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bbr *bbr = inet_csk_ca(sk);
+
+	if (event == CA_EVENT_TX_START && tp->app_limited) {
+		bbr->idle_restart = 1;
+		/* Avoid pointless buffer overflows: pace at est. bw if we don't
+		 * need more speed (we're restarting from idle and app-limited).
+		 */
+		if (bbr->mode == BBR_PROBE_BW)
+			bbr_set_pacing_rate(sk, bbr_bw(sk), BBR_UNIT);
+		else if (bbr->mode == BBR_PROBE_RTT)
+			bbr_check_probe_rtt_done(sk);
+
+		if(bbr->pmodrl){
+			struct rtcp_sample s;
+
+			rtcp_fill_sample(sk, bbr->pmodrl, NULL, bbr->min_rtt_us, &s);
+			rtcp_start(bbr->pmodrl, &s);
+		}
+	}
+}
+
+/* Calculate bdp based on min RTT and the estimated bottleneck bandwidth:
+ *
+ * bdp = ceil(bw * min_rtt * gain)
+ */
+static u32 bbr_bdp(struct sock *sk, u32 bw, int gain)
+{
+	struct bbr *bbr = inet_csk_ca(sk);
+	u32 bdp;
+	u64 w;
+
+	if (unlikely(bbr->min_rtt_us == ~0U))	 /* no valid RTT samples yet? */
+		return TCP_INIT_CWND;  /* be safe: cap at default initial cwnd*/
+
+	w = (u64)bw * bbr->min_rtt_us;
+
+	/* Apply a gain to the given value, remove the BW_SCALE shift, and
+	 * round the value up to avoid a negative feedback loop.
+	 */
+	bdp = (((w * gain) >> BBR_SCALE) + BW_UNIT - 1) / BW_UNIT;
+
+	return bdp;
+}
+
+/* Budget enough cwnd to fit full-sized skbs in-flight on both end hosts. */
+static u32 bbr_quantization_budget(struct sock *sk, u32 cwnd)
+{
+	struct bbr *bbr = inet_csk_ca(sk);
+
+	/* Allow enough full-sized skbs in flight to utilize end systems. */
+	cwnd += 3 * bbr_tso_segs_goal(sk);
+
+	/* Reduce delayed ACKs by rounding up cwnd to the next even number. */
+	cwnd = (cwnd + 1) & ~1U;
+
+	/* Ensure gain cycling gets inflight above BDP even for small BDPs. */
+	if (bbr->mode == BBR_PROBE_BW && bbr->cycle_idx == BBR_BW_PROBE_UP)
+		cwnd += 2;
+
+	return cwnd;
+}
+
+/* Find inflight based on min RTT and the estimated bottleneck bandwidth. */
+static u32 bbr_inflight(struct sock *sk, u32 bw, int gain)
+{
+	u32 inflight;
+
+	inflight = bbr_bdp(sk, bw, gain);
+	inflight = bbr_quantization_budget(sk, inflight);
+
+	return inflight;
+}
+
+/* Estimate of our packets in the network at the earliest departure time of
+ * the next skb, see the comment in rtcp_bbr.c.
+ */
+static u32 bbr_packets_in_net_at_edt(struct sock *sk, u32 inflight_now)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bbr *bbr = inet_csk_ca(sk);
+	u64 now_ns, edt_ns, interval_us;
+	u32 interval_delivered, inflight_at_edt;
+
+	now_ns = tp->tcp_clock_cache;
+	edt_ns = max(tp->tcp_wstamp_ns, now_ns);
+	interval_us = div_u64(edt_ns - now_ns, NSEC_PER_USEC);
+	interval_delivered = (u64)bbr_bw(sk) * interval_us >> BW_SCALE;
+	inflight_at_edt = inflight_now;
+	if (bbr->pacing_gain > BBR_UNIT)              /* increasing inflight */
+		inflight_at_edt += bbr_tso_segs_goal(sk);  /* include EDT skb */
+	if (interval_delivered >= inflight_at_edt)
+		return 0;
+	return inflight_at_edt - interval_delivered;
+}
+
+/* The BDP at the current bw, which is what we would like inflight to be. */
+static u32 bbr2_target_inflight(struct sock *sk)
+{
+	u32 bdp = bbr_inflight(sk, bbr_bw(sk), BBR_UNIT);
+
+	return min(bdp, tcp_sk(sk)->snd_cwnd);
+}
+
+/* inflight_hi minus the headroom we leave for other flows while cruising. */
+static u32 bbr2_inflight_with_headroom(const struct sock *sk)
+{
+	struct bbr *bbr = inet_csk_ca(sk);
+	u32 headroom, headroom_fraction;
+
+	if (bbr->inflight_hi == ~0U)
+		return ~0U;
+
+	headroom_fraction = bbr_inflight_headroom;
+	headroom = ((u64)bbr->inflight_hi * headroom_fraction) >> BBR_SCALE;
+	headroom = max(headroom, 1U);
+	return max_t(s32, bbr->inflight_hi - headroom, bbr_cwnd_min_target);
+}
+
+/* Bound cwnd by inflight_hi when probing, by inflight_hi less headroom when
+ * cruising or in PROBE_RTT, and by inflight_lo always.
+ */
+static u32 bbr2_bound_cwnd_for_inflight_model(struct sock *sk)
+{
+	struct bbr *bbr = inet_csk_ca(sk);
+	u32 cap = ~0U;
+
+	if (bbr->mode == BBR_PROBE_BW &&
+	    bbr->cycle_idx != BBR_BW_PROBE_CRUISE) {
+		cap = bbr->inflight_hi;
+	} else if (bbr->mode == BBR_PROBE_RTT ||
+		   (bbr->mode == BBR_PROBE_BW &&
+		    bbr->cycle_idx == BBR_BW_PROBE_CRUISE)) {
+		cap = bbr2_inflight_with_headroom(sk);
+	}
+	cap = min(cap, bbr->inflight_lo);
+	cap = max_t(u32, cap, bbr_cwnd_min_target);
+	return cap;
+}
+
+/* cwnd in PROBE_RTT: half a BDP, to keep some data in flight. */
+static u32 bbr2_probe_rtt_cwnd(struct sock *sk)
+{
+	return max_t(u32, bbr_bdp(sk, bbr_bw(sk), bbr_probe_rtt_cwnd_gain),
+		     bbr_cwnd_min_target);
+}
+
+/* On the first round of recovery follow packet conservation, see
+ * rtcp_bbr.c for the details.
+ */
+static bool bbr_set_cwnd_to_recover_or_restore(
+	struct sock *sk, const struct rate_sample *rs, u32 acked, u32 *new_cwnd)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bbr *bbr = inet_csk_ca(sk);
+	u8 prev_state = bbr->prev_ca_state, state = inet_csk(sk)->icsk_ca_state;
+	u32 cwnd = tp->snd_cwnd;
+
+	if (rs->losses > 0)
+		cwnd = max_t(s32, cwnd - rs->losses, 1);
+
+	if (state == TCP_CA_Recovery && prev_state != TCP_CA_Recovery) {
+		/* Starting 1st round of Recovery, so do packet conservation. */
+		bbr->packet_conservation = 1;
+		bbr->next_rtt_delivered = tp->delivered;  /* start round now */
+		if(bbr->pmodrl){
+			rtcp_restart_round(bbr->pmodrl, tp->delivered);
+		}
+		/* Cut unused cwnd from app behavior, TSQ, or TSO deferral: */
+		cwnd = tcp_packets_in_flight(tp) + acked;
+	} else if (prev_state >= TCP_CA_Recovery && state < TCP_CA_Recovery) {
+		/* Exiting loss recovery; restore cwnd saved before recovery. */
+		cwnd = max(cwnd, bbr->prior_cwnd);
+		bbr->packet_conservation = 0;
+	}
+	bbr->prev_ca_state = state;
+
+	if (bbr->packet_conservation) {
+		*new_cwnd = max(cwnd, tcp_packets_in_flight(tp) + acked);
+		return true;	/* yes, using packet conservation */
+	}
+	*new_cwnd = cwnd;
+	return false;
+}
+
+/* Slow-start up toward target cwnd, or snap down to target if above it, then
+ * apply the PROBE_RTT and inflight model bounds.
+ */
+static void bbr_set_cwnd(struct sock *sk, const struct rate_sample *rs,
+			 u32 acked, u32 bw, int gain)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bbr *bbr = inet_csk_ca(sk);
+	u32 cwnd = tp->snd_cwnd, target_cwnd = 0;
+
+	if (!acked)
+		goto done;  /* no packet fully ACKed; just apply caps */
+
+	if (bbr_set_cwnd_to_recover_or_restore(sk, rs, acked, &cwnd))
+		goto done;
+
+	target_cwnd = bbr_bdp(sk, bw, gain);
+	target_cwnd = bbr_quantization_budget(sk, target_cwnd);
+
+	/* If we're below target cwnd, slow start cwnd toward target cwnd. */
+	if (bbr_full_bw_reached(sk))  /* only cut cwnd if we filled the pipe */
+		cwnd = min(cwnd + acked, target_cwnd);
+	else if (cwnd < target_cwnd || tp->delivered < TCP_INIT_CWND)
+		cwnd = cwnd + acked;
+	cwnd = max(cwnd, bbr_cwnd_min_target);
+
+done:
+	tp->snd_cwnd = min(cwnd, tp->snd_cwnd_clamp);	/* apply global cap */
+	if (bbr->mode == BBR_PROBE_RTT)  /* drain queue, refresh min_rtt */
+		tp->snd_cwnd = min(tp->snd_cwnd, bbr2_probe_rtt_cwnd(sk));
+	tp->snd_cwnd = min(tp->snd_cwnd, bbr2_bound_cwnd_for_inflight_model(sk));
+}
+
+/* Has the given amount of time elapsed since we marked the phase start? */
+static bool bbr2_has_elapsed_in_phase(const struct sock *sk, u32 interval_us)
+{
+	const struct tcp_sock *tp = tcp_sk(sk);
+	const struct bbr *bbr = inet_csk_ca(sk);
+
+	return tcp_stamp_us_delta(tp->tcp_mstamp,
+				  bbr->cycle_mstamp + interval_us) > 0;
+}
+
+static void bbr2_reset_lower_bounds(struct sock *sk)
+{
+	struct bbr *bbr = inet_csk_ca(sk);
+
+	bbr->bw_lo = ~0U;
+	bbr->inflight_lo = ~0U;
+}
+
+static void bbr2_reset_congestion_signals(struct sock *sk)
+{
+	struct bbr *bbr = inet_csk_ca(sk);
+
+	bbr->loss_in_round = 0;
+	bbr->bw_latest = 0;
+	bbr->inflight_latest = 0;
+}
+
+/* Start a new slot of the max bw filter at each bw probe. */
+static void bbr2_advance_bw_hi_filter(struct sock *sk)
+{
+	struct bbr *bbr = inet_csk_ca(sk);
+
+	if (!bbr->bw_hi[1])
+		return;  /* no samples in this cycle; keep the old filter */
+	bbr->bw_hi[0] = bbr->bw_hi[1];
+	bbr->bw_hi[1] = 0;
+}
+
+/* Randomized wait before the next bw probe, in wall-clock time and rounds. */
+static void bbr2_pick_probe_wait(struct sock *sk)
+{
+	struct bbr *bbr = inet_csk_ca(sk);
+
+	bbr->rounds_since_probe = rtcp_rand_below(sk, bbr_bw_probe_rand_rounds);
+	bbr->probe_wait_us = bbr_bw_probe_base_us +
+			     rtcp_rand_below(sk, bbr_bw_probe_rand_us);
+}
+
+static void bbr2_set_cycle_idx(struct sock *sk, int cycle_idx)
+{
+	struct bbr *bbr = inet_csk_ca(sk);
+
+	bbr->cycle_idx = cycle_idx;
+	/* New phase, so need to update cwnd and pacing rate. */
+	bbr->pacing_gain = bbr->mode == BBR_PROBE_BW ?
+			   bbr_pacing_gain[cycle_idx] : BBR_UNIT;
+}
+
+/* Raise inflight_hi faster each round we stay cwnd-limited in PROBE_UP:
+ * 1, 2, 4, ... packets per round.
+ */
+static void bbr2_raise_inflight_hi_slope(struct sock *sk)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bbr *bbr = inet_csk_ca(sk);
+	u32 growth_this_round, cnt;
+
+	growth_this_round = 1 << bbr->bw_probe_up_rounds;
+	bbr->bw_probe_up_rounds = min(bbr->bw_probe_up_rounds + 1, 30);
+	cnt = tp->snd_cwnd / growth_this_round;
+	cnt = max(cnt, 1U);
+	bbr->bw_probe_up_cnt = cnt;
+}
+
+/* In PROBE_UP, raise inflight_hi while we use all of it. */
+static void bbr2_probe_inflight_hi_upward(struct sock *sk,
+					  const struct rate_sample *rs)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bbr *bbr = inet_csk_ca(sk);
+	u32 delta;
+
+	if (!tcp_is_cwnd_limited(sk) || tp->snd_cwnd < bbr->inflight_hi)
+		return;  /* not fully using inflight_hi, so don't grow it */
+
+	bbr->bw_probe_up_acks += rs->acked_sacked;
+	if (bbr->bw_probe_up_acks >= bbr->bw_probe_up_cnt) {
+		delta = bbr->bw_probe_up_acks / bbr->bw_probe_up_cnt;
+		bbr->bw_probe_up_acks -= delta * bbr->bw_probe_up_cnt;
+		bbr->inflight_hi += delta;
+	}
+
+	if (bbr->round_start)
+		bbr2_raise_inflight_hi_slope(sk);
+}
+
+static void bbr2_start_bw_probe_up(struct sock *sk)
+{
+	struct bbr *bbr = inet_csk_ca(sk);
+
+	bbr->bw_probe_up_acks = 0;
+	bbr->bw_probe_up_rounds = 0;
+	bbr2_raise_inflight_hi_slope(sk);
+	bbr->cycle_mstamp = tcp_sk(sk)->tcp_mstamp;
+	bbr2_set_cycle_idx(sk, BBR_BW_PROBE_UP);
+}
+
+/* Refill the pipe at the estimated bw for a round, with the short-term
+ * bounds lifted, before probing above it.
+ */
+static void bbr2_start_bw_probe_refill(struct sock *sk)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bbr *bbr = inet_csk_ca(sk);
+
+	bbr2_reset_lower_bounds(sk);
+	bbr2_advance_bw_hi_filter(sk);
+	bbr->bw_probe_up_rounds = 0;
+	bbr->bw_probe_up_acks = 0;
+	bbr->stopped_risky_probe = 0;
+	bbr->bw_probe_samples = 0;
+	bbr->next_rtt_delivered = tp->delivered;  /* refill lasts one round */
+	bbr->cycle_mstamp = tp->tcp_mstamp;
+	bbr2_set_cycle_idx(sk, BBR_BW_PROBE_REFILL);
+}
+
+static void bbr2_start_bw_probe_cruise(struct sock *sk)
+{
+	struct bbr *bbr = inet_csk_ca(sk);
+
+	if (bbr->inflight_lo != ~0U)
+		bbr->inflight_lo = min(bbr->inflight_lo, bbr->inflight_hi);
+
+	bbr2_set_cycle_idx(sk, BBR_BW_PROBE_CRUISE);
+}
+
+static void bbr2_start_bw_probe_down(struct sock *sk)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bbr *bbr = inet_csk_ca(sk);
+
+	bbr2_reset_congestion_signals(sk);
+	bbr->bw_probe_up_cnt = ~0U;     /* not growing inflight_hi any more */
+	bbr2_pick_probe_wait(sk);
+	bbr->cycle_mstamp = tp->tcp_mstamp;		/* start wall clock */
+	bbr->next_rtt_delivered = tp->delivered;
+	bbr2_set_cycle_idx(sk, BBR_BW_PROBE_DOWN);
+}
+
+/* Probe for bw at least as often as a Reno flow with our BDP would grow its
+ * cwnd by one BDP, so that we coexist with Reno/CUBIC.
+ */
+static bool bbr2_is_reno_coexistence_probe_time(struct sock *sk)
+{
+	struct bbr *bbr = inet_csk_ca(sk);
+	u32 rounds;
+
+	rounds = min_t(u32, bbr_bw_probe_max_rounds, bbr2_target_inflight(sk));
+	return bbr->rounds_since_probe >= rounds;
+}
+
+/* Is it time to probe for bw, either by wall clock or by rounds? */
+static bool bbr2_check_time_to_probe_bw(struct sock *sk)
+{
+	struct bbr *bbr = inet_csk_ca(sk);
+
+	if (bbr2_has_elapsed_in_phase(sk, bbr->probe_wait_us) ||
+	    bbr2_is_reno_coexistence_probe_time(sk)) {
+		bbr2_start_bw_probe_refill(sk);
+		return true;
+	}
+	return false;
+}
+
+/* Cruise once the queue from the last probe has drained. */
+static bool bbr2_check_time_to_cruise(struct sock *sk, u32 inflight, u32 bw)
+{
+	if (inflight > bbr2_inflight_with_headroom(sk))
+		return false;  /* not enough headroom */
+
+	return inflight <= bbr_inflight(sk, bw, BBR_UNIT);
+}
+
+/* Is the loss rate of this round above bbr_loss_thresh? */
+static bool bbr2_is_inflight_too_high(const struct sock *sk)
+{
+	const struct tcp_sock *tp = tcp_sk(sk);
+	const struct bbr *bbr = inet_csk_ca(sk);
+	u32 lost = tp->lost - bbr->loss_round_lost;
+	u32 delivered = tp->delivered - bbr->loss_round_delivered;
+
+	return lost && (u64)lost * BBR_UNIT >
+		       (u64)bbr_loss_thresh * (lost + delivered);
+}
+
+/* Probing hit excessive loss: bring inflight_hi down to where the loss
+ * started, and stop probing.
+ */
+static void bbr2_handle_inflight_too_high(struct sock *sk,
+					  const struct rate_sample *rs)
+{
+	struct bbr *bbr = inet_csk_ca(sk);
+	u32 beta_inflight;
+
+	bbr->prev_probe_too_high = 1;
+	bbr->bw_probe_samples = 0;
+	if (!rs->is_app_limited && !bbr->rtcp_capped) {
+		beta_inflight = (u64)bbr2_target_inflight(sk) *
+				(BBR_UNIT - bbr_beta) >> BBR_SCALE;
+		bbr->inflight_hi = max_t(u32, rs->prior_in_flight,
+					 beta_inflight);
+	}
+	if (bbr->mode == BBR_PROBE_BW && bbr->cycle_idx == BBR_BW_PROBE_UP)
+		bbr2_start_bw_probe_down(sk);
+}
+
+/* Update inflight_hi from the rounds we probed in. */
+static void bbr2_adapt_upper_bounds(struct sock *sk,
+				    const struct rate_sample *rs)
+{
+	struct bbr *bbr = inet_csk_ca(sk);
+
+	if (!bbr->bw_probe_samples)
+		return;  /* not probing; inflight_hi stays as is */
+
+	if (bbr2_is_inflight_too_high(sk)) {
+		bbr2_handle_inflight_too_high(sk, rs);
+		return;
+	}
+
+	if (bbr->inflight_hi == ~0U || bbr->rtcp_capped)
+		return;
+
+	/* No excessive loss at this inflight, so it is a safe upper bound. */
+	if (rs->prior_in_flight > bbr->inflight_hi)
+		bbr->inflight_hi = rs->prior_in_flight;
+
+	if (bbr->mode == BBR_PROBE_BW && bbr->cycle_idx == BBR_BW_PROBE_UP)
+		bbr2_probe_inflight_hi_upward(sk, rs);
+}
+
+/* PROBE_BW state machine: DOWN -> CRUISE -> REFILL -> UP -> DOWN ... */
+static void bbr2_update_cycle_phase(struct sock *sk,
+				    const struct rate_sample *rs)
+{
+	struct bbr *bbr = inet_csk_ca(sk);
+	bool is_bw_probe_done = false;
+	u32 inflight, bw;
+
+	if (!bbr_full_bw_reached(sk))
+		return;
+
+	bbr2_adapt_upper_bounds(sk, rs);
+
+	if (bbr->mode != BBR_PROBE_BW)
+		return;
+
+	inflight = bbr_packets_in_net_at_edt(sk, rs->prior_in_flight);
+	bw = bbr_max_bw(sk);
+
+	switch (bbr->cycle_idx) {
+	/* First we spend most of our time cruising with a pacing_gain of 1.0,
+	 * which paces at the estimated bw, to try to fully use the pipe
+	 * without building queue. If we encounter loss/ECN marks, we adapt
+	 * by slowing down.
+	 */
+	case BBR_BW_PROBE_CRUISE:
+		bbr2_check_time_to_probe_bw(sk);
+		break;
+
+	/* After cruising, when it's time to probe, we first "refill": we send
+	 * at the estimated bw to fill the pipe, before probing higher and
+	 * knowingly risking overflowing the bottleneck buffer (causing loss).
+	 */
+	case BBR_BW_PROBE_REFILL:
+		if (bbr->round_start) {
+			/* After one full round trip of sending in REFILL, we
+			 * start to see bw samples reflecting our REFILL, which
+			 * may be putting too much data in flight.
+			 */
+			bbr->bw_probe_samples = 1;
+			bbr2_start_bw_probe_up(sk);
+		}
+		break;
+
+	/* After we refill the pipe, we probe by using a pacing_gain > 1.0, to
+	 * probe for bw. If we have not seen loss/ECN, we try to raise inflight
+	 * to at least pacing_gain*BDP; note that this may take more than
+	 * min_rtt if min_rtt is small (e.g. on a LAN).
+	 */
+	case BBR_BW_PROBE_UP:
+		if (bbr->prev_probe_too_high &&
+		    inflight >= bbr->inflight_hi) {
+			bbr->stopped_risky_probe = 1;
+			is_bw_probe_done = true;
+		} else if (bbr2_has_elapsed_in_phase(sk, bbr->min_rtt_us) &&
+			   inflight >= bbr_inflight(sk, bw,
+						    bbr_bw_probe_pif_gain)) {
+			is_bw_probe_done = true;
+		}
+		if (is_bw_probe_done) {
+			bbr->prev_probe_too_high = 0;  /* no loss/ECN (yet) */
+			bbr2_start_bw_probe_down(sk);  /* restart w/ down */
+		}
+		break;
+
+	/* After probing in PROBE_UP, we have usually accumulated some data in
+	 * the bottleneck buffer (if bw probing didn't find more bw). We next
+	 * enter PROBE_DOWN to try to drain any excess data from the queue.
+	 */
+	case BBR_BW_PROBE_DOWN:
+		if (bbr2_check_time_to_probe_bw(sk))
+			return;		/* already decided state transition */
+		if (bbr2_check_time_to_cruise(sk, inflight, bw))
+			bbr2_start_bw_probe_cruise(sk);
+		break;
+
+	default:
+		WARN_ONCE(1, "BBR invalid cycle index %u\n", bbr->cycle_idx);
+	}
+}
+
+/* Cut the short-term bounds by beta after a round with loss, unless we are
+ * probing for bw and need to push inflight higher.
+ */
+static void bbr2_adapt_lower_bounds(struct sock *sk)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bbr *bbr = inet_csk_ca(sk);
+
+	if (bbr->mode == BBR_STARTUP ||
+	    (bbr->mode == BBR_PROBE_BW &&
+	     (bbr->cycle_idx == BBR_BW_PROBE_REFILL ||
+	      bbr->cycle_idx == BBR_BW_PROBE_UP)))
+		return;
+
+	if (!bbr->loss_in_round)
+		return;
+
+	if (bbr->bw_lo == ~0U)
+		bbr->bw_lo = bbr_max_bw(sk);
+	if (bbr->inflight_lo == ~0U)
+		bbr->inflight_lo = tp->snd_cwnd;
+	bbr->bw_lo = max_t(u32, bbr->bw_latest,
+			   (u64)bbr->bw_lo * (BBR_UNIT - bbr_beta) >> BBR_SCALE);
+	bbr->inflight_lo = max_t(u32, bbr->inflight_latest,
+				 (u64)bbr->inflight_lo *
+				 (BBR_UNIT - bbr_beta) >> BBR_SCALE);
+}
+
+/* Estimate the bandwidth and the per-round delivery signals from this ACK. */
+static void bbr2_update_bw(struct sock *sk, const struct rate_sample *rs)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bbr *bbr = inet_csk_ca(sk);
+	u64 bw;
+
+	bbr->round_start = 0;
+	if (rs->losses > 0)
+		bbr->loss_in_round = 1;
+	if (rs->delivered < 0 || rs->interval_us <= 0)
+		return; /* Not a valid observation */
+
+	/* See if we've reached the next RTT */
+	if (!before(rs->prior_delivered, bbr->next_rtt_delivered)) {
+		bbr->next_rtt_delivered = tp->delivered;
+		bbr->round_start = 1;
+		bbr->packet_conservation = 0;
+		bbr->rounds_since_probe = min_t(u32, bbr->rounds_since_probe + 1,
+						bbr_bw_probe_max_rounds);
+	}
+
+	bw = (u64)rs->delivered * BW_UNIT;
+	do_div(bw, rs->interval_us);
+
+	bbr->bw_latest = max_t(u32, bbr->bw_latest, bw);
+	bbr->inflight_latest = max_t(u32, bbr->inflight_latest, rs->delivered);
+
+	/* Filter out app-limited samples unless they describe the path bw at
+	 * least as well as our bw model, as in BBRv1.
+	 */
+	if (!rs->is_app_limited || bw >= bbr_max_bw(sk))
+		bbr->bw_hi[1] = max_t(u32, bbr->bw_hi[1], bw);
+}
+
+/* At the end of each round: adapt the short-term bounds to its losses and
+ * start the loss accounting of the next one.
+ */
+static void bbr2_update_congestion_signals(struct sock *sk)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bbr *bbr = inet_csk_ca(sk);
+
+	if (!bbr->round_start)
+		return;
+
+	bbr2_adapt_lower_bounds(sk);
+	bbr2_reset_congestion_signals(sk);
+	bbr->loss_round_delivered = tp->delivered;
+	bbr->loss_round_lost = tp->lost;
+}
+
+/* Exit STARTUP on excessive loss, taking inflight_hi from what we could
+ * deliver.
+ */
+static void bbr2_check_loss_too_high_in_startup(struct sock *sk)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bbr *bbr = inet_csk_ca(sk);
+
+	if (bbr_full_bw_reached(sk))
+		return;
+
+	if (tp->lost - bbr->loss_round_lost >= bbr_full_loss_cnt &&
+	    bbr2_is_inflight_too_high(sk)) {
+		bbr->inflight_hi = max_t(u32, bbr_bdp(sk, bbr_max_bw(sk), BBR_UNIT),
+					 bbr->inflight_latest);
+		bbr->full_bw_reached = 1;
+	}
+}
+
+/* Estimate when the pipe is full, using the change in delivery rate, as in
+ * BBRv1.
+ */
+static void bbr_check_full_bw_reached(struct sock *sk,
+				      const struct rate_sample *rs)
+{
+	struct bbr *bbr = inet_csk_ca(sk);
+	u32 bw_thresh;
+
+	if (bbr_full_bw_reached(sk) || !bbr->round_start || rs->is_app_limited)
+		return;
+
+	bw_thresh = (u64)bbr->full_bw * bbr_full_bw_thresh >> BBR_SCALE;
+	if (bbr_max_bw(sk) >= bw_thresh) {
+		bbr->full_bw = bbr_max_bw(sk);
+		bbr->full_bw_cnt = 0;
+		return;
+	}
+	++bbr->full_bw_cnt;
+	bbr->full_bw_reached = bbr->full_bw_cnt >= bbr_full_bw_cnt;
+}
+
+/* If pipe is probably full, drain the queue and then enter steady-state. */
+static void bbr_check_drain(struct sock *sk, const struct rate_sample *rs)
+{
+	struct bbr *bbr = inet_csk_ca(sk);
+
+	if (bbr->mode == BBR_STARTUP && bbr_full_bw_reached(sk)) {
+		bbr->mode = BBR_DRAIN;	/* drain queue we created */
+		tcp_sk(sk)->snd_ssthresh =
+				bbr_inflight(sk, bbr_max_bw(sk), BBR_UNIT);
+	}	/* fall through to check if in-flight is already small: */
+	if (bbr->mode == BBR_DRAIN &&
+	    bbr_packets_in_net_at_edt(sk, tcp_packets_in_flight(tcp_sk(sk))) <=
+	    bbr_inflight(sk, bbr_max_bw(sk), BBR_UNIT)) {
+		bbr->mode = BBR_PROBE_BW;  /* we estimate queue is drained */
+		bbr2_start_bw_probe_down(sk);
+	}
+}
+
+static void bbr2_exit_probe_rtt(struct sock *sk)
+{
+	struct bbr *bbr = inet_csk_ca(sk);
+
+	bbr2_reset_lower_bounds(sk);
+	if (bbr_full_bw_reached(sk)) {
+		bbr->mode = BBR_PROBE_BW;
+		/* Raising inflight after PROBE_RTT may cause loss, so reset
+		 * the PROBE_BW clock and schedule the next probing phase.
+		 */
+		bbr2_start_bw_probe_down(sk);
+		/* Since we are exiting PROBE_RTT, we know inflight is
+		 * below our estimated BDP, so it is reasonable to cruise.
+		 */
+		bbr2_start_bw_probe_cruise(sk);
+	} else {
+		bbr->mode = BBR_STARTUP;
+	}
+}
+
+static void bbr_check_probe_rtt_done(struct sock *sk)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bbr *bbr = inet_csk_ca(sk);
+
+	if (!(bbr->probe_rtt_done_stamp &&
+	      after(tcp_jiffies32, bbr->probe_rtt_done_stamp)))
+		return;
+
+	bbr->probe_rtt_min_stamp = tcp_jiffies32; /* schedule next PROBE_RTT */
+	tp->snd_cwnd = max(tp->snd_cwnd, bbr->prior_cwnd);
+	bbr2_exit_probe_rtt(sk);
+}
+
+/* Track min_rtt over 10 seconds and probe_rtt_min_us over 5 seconds; enter
+ * PROBE_RTT, at half a BDP, when the latter expires.
+ */
+static void bbr_update_min_rtt(struct sock *sk, const struct rate_sample *rs)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bbr *bbr = inet_csk_ca(sk);
+	bool probe_rtt_expired, min_rtt_expired;
+
+	/* Track min RTT in probe_rtt_win_ms to time next PROBE_RTT state. */
+	probe_rtt_expired = after(tcp_jiffies32,
+				  bbr->probe_rtt_min_stamp +
+				  msecs_to_jiffies(bbr_probe_rtt_win_ms));
+	if (rs->rtt_us >= 0 &&
+	    (rs->rtt_us < bbr->probe_rtt_min_us ||
+	     (probe_rtt_expired && !rs->is_ack_delayed))) {
+		bbr->probe_rtt_min_us = rs->rtt_us;
+		bbr->probe_rtt_min_stamp = tcp_jiffies32;
+	}
+	/* Track min RTT seen in the min_rtt_win_sec filter window: */
+	min_rtt_expired = after(tcp_jiffies32,
+				bbr->min_rtt_stamp + bbr_min_rtt_win_sec * HZ);
+	if (bbr->probe_rtt_min_us <= bbr->min_rtt_us || min_rtt_expired) {
+		bbr->min_rtt_us = bbr->probe_rtt_min_us;
+		bbr->min_rtt_stamp = bbr->probe_rtt_min_stamp;
+	}
+
+	if (bbr_probe_rtt_mode_ms > 0 && probe_rtt_expired &&
+	    !bbr->idle_restart && bbr->mode != BBR_PROBE_RTT) {
+		bbr->mode = BBR_PROBE_RTT;  /* dip, drain queue */
+		bbr_save_cwnd(sk);  /* note cwnd so we can restore it */
+		bbr->probe_rtt_done_stamp = 0;
+	}
+
+	if (bbr->mode == BBR_PROBE_RTT) {
+		/* Ignore low rate samples during this mode. */
+		tp->app_limited =
+			(tp->delivered + tcp_packets_in_flight(tp)) ? : 1;
+
+		/* Maintain inflight at half a BDP for max(200 ms, 1 round). */
+		if (!bbr->probe_rtt_done_stamp &&
+		    tcp_packets_in_flight(tp) <= bbr2_probe_rtt_cwnd(sk)) {
+			bbr->probe_rtt_done_stamp = tcp_jiffies32 +
+				msecs_to_jiffies(bbr_probe_rtt_mode_ms);
+			bbr->probe_rtt_round_done = 0;
+			bbr->next_rtt_delivered = tp->delivered;
+			if(bbr->pmodrl){
+				rtcp_restart_round(bbr->pmodrl, tp->delivered);
+			}
+		} else if (bbr->probe_rtt_done_stamp) {
+			if (bbr->round_start)
+				bbr->probe_rtt_round_done = 1;
+			if (bbr->probe_rtt_round_done)
+				bbr_check_probe_rtt_done(sk);
+		}
+	}
+	/* Restart after idle ends only once we process a new S/ACK for data */
+	if (rs->delivered > 0)
+		bbr->idle_restart = 0;
+}
+
+static void bbr_update_gains(struct sock *sk)
+{
+	struct bbr *bbr = inet_csk_ca(sk);
+
+	switch (bbr->mode) {
+	case BBR_STARTUP:
+		bbr->pacing_gain = bbr_high_gain;
+		bbr->cwnd_gain	 = bbr_high_gain;
+		break;
+	case BBR_DRAIN:
+		bbr->pacing_gain = bbr_drain_gain;	/* slow, to drain */
+		bbr->cwnd_gain	 = bbr_high_gain;	/* keep cwnd */
+		break;
+	case BBR_PROBE_BW:
+		bbr->pacing_gain = bbr_pacing_gain[bbr->cycle_idx];
+		bbr->cwnd_gain	 = bbr_cwnd_gain;
+		break;
+	case BBR_PROBE_RTT:
+		bbr->pacing_gain = BBR_UNIT;
+		bbr->cwnd_gain	 = BBR_UNIT;
+		break;
+	default:
+		WARN_ONCE(1, "BBR bad mode: %u\n", bbr->mode);
+		break;
+	}
+}
+
+static void bbr_update_model(struct sock *sk, const struct rate_sample *rs)
+{
+	bbr2_update_bw(sk, rs);
+	bbr2_update_cycle_phase(sk, rs);
+	bbr2_check_loss_too_high_in_startup(sk);
+	bbr_check_full_bw_reached(sk, rs);
+	bbr_check_drain(sk, rs);
+	bbr_update_min_rtt(sk, rs);
+	bbr2_update_congestion_signals(sk);
+	bbr_update_gains(sk);
+}
+
+/* While R-TCP caps the flow, (B, R) are the long-term bounds: bw_hi is R
+ * and inflight_hi is the BDP at R plus up to one more BDP of bucket.
+ */
+static void bbr2_rtcp_set_bounds(struct sock *sk)
+{
+	struct bbr *bbr = inet_csk_ca(sk);
+	u32 bw, bdp, bucket;
+
+	bw = min_t(u64, (u64)rtcp_R(bbr->pmodrl) *
+			rtcp_cap_gain(bbr->pmodrl, BBR_UNIT) >> BBR_SCALE, ~0U);
+	if (!bw)
+		return;
+	bbr->bw_hi[0] = bw;
+	bbr->bw_hi[1] = bw;
+
+	bdp = bbr_bdp(sk, bw, BBR_UNIT);
+	bucket = min_t(u64, rtcp_B(bbr->pmodrl) >> BW_SCALE, bdp);
+	bbr->inflight_hi = bbr_quantization_budget(sk, bdp) + bucket;
+}
+
+/* R-TCP engine events: hand the policer over to R-TCP, or start a probe. */
+static void bbr2_rtcp_event(void *ctx, enum rtcp_event ev)
+{
+	struct sock *sk = ctx;
+	struct bbr *bbr = inet_csk_ca(sk);
+
+	switch (ev) {
+	case RTCP_EV_CLASSIFYING:
+		bbr2_reset_lower_bounds(sk);
+		break;
+	case RTCP_EV_PROBE:
+		bbr->mode = BBR_PROBE_BW;
+		bbr2_start_bw_probe_refill(sk);
+		break;
+	}
+}
+
+static const struct rtcp_ops bbr2_rtcp_ops = {
+	.event		= bbr2_rtcp_event,
+};
+
+static RTCP_CONG_CONTROL(bbr_main)
+{
+	struct bbr *bbr = inet_csk_ca(sk);
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct inet_sock *inet = inet_sk(sk);
+	struct rtcp_sample s;
+	u32 bw;
+
+	bbr_update_model(sk, rs);
+
+	if(bbr->pmodrl){
+		rtcp_fill_sample(sk, bbr->pmodrl, rs, bbr->min_rtt_us, &s);
+		rtcp_ack(bbr->pmodrl, &s);
+
+		bbr->rtcp_capped = rtcp_capped(bbr->pmodrl);
+		if(bbr->rtcp_capped){
+			bbr2_rtcp_set_bounds(sk);
+		}
+	}
+
+	bw = bbr_bw(sk);
+
+	bbr_set_pacing_rate(sk, bw, bbr->pacing_gain);
+	bbr_set_cwnd(sk, rs, rs->acked_sacked, bw, bbr->cwnd_gain);
+
+	if(bbr->pmodrl){
+		s.rto_exit = bbr->prev_ca_state == TCP_CA_Loss && inet_csk(sk)->icsk_ca_state != TCP_CA_Loss;
+		rtcp_ack_end(bbr->pmodrl, &s);
+		if(enable_printk){
+			struct rtcp_flow_id id;
+
+			rtcp_flow_id(sk, &id);
+			printk(KERN_INFO "!!!ACK: ip:%pISc port:%hu c:%u B:%llu R:%llu mode:%u idx:%u n:%u u_p:%lu r_p:%lu b:%llu d:%u l:%u bw_hi:%u bw_lo:%u i_hi:%u i_lo:%u cwnd:%u inflight:%u",
+				&id.dst, ntohs(inet->inet_dport), bbr->pmodrl->classify, rtcp_B(bbr->pmodrl), rtcp_R(bbr->pmodrl),
+				bbr->mode, bbr->cycle_idx, bbr->pmodrl->nominator, bbr_bw_to_pacing_rate_pmodrl(sk,rtcp_R(bbr->pmodrl),BBR_UNIT), sk->sk_pacing_rate, tp->bytes_acked, tp->delivered, tp->lost,
+				bbr_max_bw(sk), bbr->bw_lo, bbr->inflight_hi, bbr->inflight_lo, tp->snd_cwnd, tcp_packets_in_flight(tp));
+		}
+	}
+}
+
+static void bbr_init(struct sock *sk)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bbr *bbr = inet_csk_ca(sk);
+
+	bbr->pmodrl = rtcp_alloc(&bbr2_rtcp_ops, sk, GFP_ATOMIC);
+	if (bbr->pmodrl){
+		rtcp_clock_start(sk, bbr->pmodrl);
+	}
+
+	bbr->prior_cwnd = 0;
+	tp->snd_ssthresh = TCP_INFINITE_SSTHRESH;
+	bbr->next_rtt_delivered = 0;
+	bbr->prev_ca_state = TCP_CA_Open;
+	bbr->packet_conservation = 0;
+
+	bbr->probe_rtt_done_stamp = 0;
+	bbr->probe_rtt_round_done = 0;
+	bbr->probe_rtt_min_us = tcp_min_rtt(tp);
+	bbr->probe_rtt_min_stamp = tcp_jiffies32;
+	bbr->min_rtt_us = tcp_min_rtt(tp);
+	bbr->min_rtt_stamp = tcp_jiffies32;
+
+	bbr->has_seen_rtt = 0;
+	bbr_init_pacing_rate_from_rtt(sk);
+
+	bbr->round_start = 0;
+	bbr->idle_restart = 0;
+	bbr->full_bw_reached = 0;
+	bbr->full_bw = 0;
+	bbr->full_bw_cnt = 0;
+	bbr->cycle_mstamp = 0;
+	bbr->cycle_idx = 0;
+	bbr->mode = BBR_STARTUP;
+
+	bbr->bw_hi[0] = 0;
+	bbr->bw_hi[1] = 0;
+	bbr->inflight_hi = ~0U;
+	bbr2_reset_lower_bounds(sk);
+	bbr2_reset_congestion_signals(sk);
+	bbr->loss_round_delivered = tp->delivered;
+	bbr->loss_round_lost = tp->lost;
+	bbr->bw_probe_up_cnt = ~0U;
+	bbr->bw_probe_up_acks = 0;
+	bbr->bw_probe_up_rounds = 0;
+	bbr->bw_probe_samples = 0;
+	bbr->prev_probe_too_high = 0;
+	bbr->stopped_risky_probe = 0;
+	bbr->rtcp_capped = 0;
+	bbr->rounds_since_probe = 0;
+	bbr->probe_wait_us = 0;
+
+	cmpxchg(&sk->sk_pacing_status, SK_PACING_NONE, SK_PACING_NEEDED);
+}
+
+static void bbr_release(struct sock *sk)
+{
+	struct bbr *bbr = inet_csk_ca(sk);
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct inet_sock *inet = inet_sk(sk);
+
+	if (!bbr->pmodrl)
+		return;
+	if(enable_printk){
+		struct rtcp_flow_id id;
+
+		rtcp_flow_id(sk, &id);
+		printk(KERN_INFO "!!!Release sip:%pISc sp:%hu dip:%pISc dp:%hu p:%u c:%u B:%llu R:%llu b:%llu history:%s\n",
+				&id.src, ntohs(inet->inet_sport),
+				&id.dst, ntohs(inet->inet_dport),
+				tp->delivered, bbr->pmodrl->classify, rtcp_B(bbr->pmodrl), rtcp_R(bbr->pmodrl), bbr->pmodrl->detected_bytes_acked, bbr->pmodrl->buffer);
+	}
+
+	rtcp_free(bbr->pmodrl);
+	bbr->pmodrl = NULL;
+}
+
+static u32 bbr_sndbuf_expand(struct sock *sk)
+{
+	/* Provision 3 * cwnd since BBR may slow-start even during recovery. */
+	return 3;
+}
+
+/* A spurious slow-down: reset full pipe detection and the short-term
+ * bounds, which were cut for losses that did not happen.
+ */
+static u32 bbr_undo_cwnd(struct sock *sk)
+{
+	struct bbr *bbr = inet_csk_ca(sk);
+
+	bbr->full_bw = 0;   /* spurious slow-down; reset full pipe detection */
+	bbr->full_bw_cnt = 0;
+	bbr2_reset_lower_bounds(sk);
+	return tcp_sk(sk)->snd_cwnd;
+}
+
+/* Entering loss recovery, so save cwnd for when we exit or undo recovery. */
+static u32 bbr_ssthresh(struct sock *sk)
+{
+	bbr_save_cwnd(sk);
+	return tcp_sk(sk)->snd_ssthresh;
+}
+
+static size_t bbr_get_info(struct sock *sk, u32 ext, int *attr,
+			   union tcp_cc_info *info)
+{
+	if (ext & (1 << (INET_DIAG_BBRINFO - 1)) ||
+	    ext & (1 << (INET_DIAG_VEGASINFO - 1))) {
+		struct tcp_sock *tp = tcp_sk(sk);
+		struct bbr *bbr = inet_csk_ca(sk);
+		u64 bw = bbr_bw(sk);
+
+		bw = bw * tp->mss_cache * USEC_PER_SEC >> BW_SCALE;
+		memset(&info->bbr, 0, sizeof(info->bbr));
+		info->bbr.bbr_bw_lo		= (u32)bw;
+		info->bbr.bbr_bw_hi		= (u32)(bw >> 32);
+		info->bbr.bbr_min_rtt		= bbr->min_rtt_us;
+		info->bbr.bbr_pacing_gain	= bbr->pacing_gain;
+		info->bbr.bbr_cwnd_gain		= bbr->cwnd_gain;
+		if(bbr->pmodrl){
+			if(bbr->pmodrl->classify == 1){
+				info->bbr.bbr_bw_lo		= bbr->pmodrl->classify;
+				info->bbr.bbr_bw_hi		= bbr->pmodrl->detected_time / 1000;
+				info->bbr.bbr_min_rtt		= bbr->pmodrl->detected_bytes_acked;
+				info->bbr.bbr_pacing_gain	= (rtcp_B(bbr->pmodrl) * (u64)tcp_sk(sk)->mss_cache / 1024) >> BW_SCALE;
+				info->bbr.bbr_cwnd_gain		= (rtcp_R(bbr->pmodrl) * (u64)tcp_sk(sk)->mss_cache * 1000) >> BW_SCALE;
+			}
+			else{
+				info->bbr.bbr_bw_lo		= bbr->pmodrl->classify;
+				info->bbr.bbr_bw_hi		= 0;
+				info->bbr.bbr_min_rtt		= 0;
+				info->bbr.bbr_pacing_gain	= 0;
+				info->bbr.bbr_cwnd_gain		= 0;
+			}
+		}
+		*attr = INET_DIAG_BBRINFO;
+		return sizeof(info->bbr);
+	}
+	return 0;
+}
+
+static void bbr_set_state(struct sock *sk, u8 new_state)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bbr *bbr = inet_csk_ca(sk);
+
+	if (new_state == TCP_CA_Loss) {
+		bbr->prev_ca_state = TCP_CA_Loss;
+		bbr->full_bw = 0;
+		bbr->loss_in_round = 1;
+		/* bbr2_adapt_lower_bounds() needs cwnd before we suffered an
+		 * RTO, to update inflight_lo:
+		 */
+		if (bbr->inflight_lo == ~0U)
+			bbr->inflight_lo = max(tp->snd_cwnd, bbr->prior_cwnd);
+		bbr->round_start = 1;	/* treat RTO like end of a round */
+		bbr2_update_congestion_signals(sk);
+	}
+}
+
+module_param_named(enable_printk_external, enable_printk, int, 0644);
+
+static struct tcp_congestion_ops tcp_bbr2_cong_ops __read_mostly = {
+	.flags		= TCP_CONG_NON_RESTRICTED,
+	.name		= "rtcp_bbr2",
+	.owner		= THIS_MODULE,
+	.init		= bbr_init,
+	.release	= bbr_release,
+	.cong_control	= bbr_main,
+	.sndbuf_expand	= bbr_sndbuf_expand,
+	.undo_cwnd	= bbr_undo_cwnd,
+	.cwnd_event	= bbr_cwnd_event,
+	.ssthresh	= bbr_ssthresh,
+	.min_tso_segs	= bbr_min_tso_segs,
+	.get_info	= bbr_get_info,
+	.set_state	= bbr_set_state,
+};
+
+static int __init bbr_register(void)
+{
+	BUILD_BUG_ON(sizeof(struct bbr) > ICSK_CA_PRIV_SIZE);
+	return tcp_register_congestion_control(&tcp_bbr2_cong_ops);
+}
+
+static void __exit bbr_unregister(void)
+{
+	tcp_unregister_congestion_control(&tcp_bbr2_cong_ops);
+}
+
+module_init(bbr_register);
+module_exit(bbr_unregister);
+
+MODULE_AUTHOR("Van Jacobson <vanj@google.com>");
+MODULE_AUTHOR("Neal Cardwell <ncardwell@google.com>");
+MODULE_AUTHOR("Yuchung Cheng <ycheng@google.com>");
+MODULE_AUTHOR("Soheil Hassas Yeganeh <soheil@google.com>");
+MODULE_LICENSE("Dual BSD/GPL");
+MODULE_DESCRIPTION("TCP BBRv2-style model with R-TCP");
@@ -0,0 +1,66 @@
+/*
+ * R-TCP: kernel compatibility
+ *
+ * The modules are written against the Linux v5.4.0 TCP stack. The wrappers
+ * below let the same source build, and behave the same, on the later
+ * long-term kernels (5.15, 6.1, 6.6 and newer). The Makefile refuses kernels
+ * older than 5.4.
+ */
+#ifndef _RTCP_COMPAT_H
+#define _RTCP_COMPAT_H
+
+#include <linux/version.h>
+#include <linux/random.h>
+#include <net/tcp.h>
+
+/* 6.2 removed prandom_u32_max() in favour of get_random_u32_below(). */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 2, 0)
+#define rtcp_random_below(ceil)	get_random_u32_below(ceil)
+#else
+#define rtcp_random_below(ceil)	prandom_u32_max(ceil)
+#endif
+
+/* BIG TCP (5.19) raised GSO_MAX_SIZE beyond 64KB. Like upstream BBR, size
+ * TSO bursts against the legacy 64KB limit on every kernel.
+ */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 19, 0)
+#define RTCP_GSO_MAX_SIZE	GSO_LEGACY_MAX_SIZE
+#else
+#define RTCP_GSO_MAX_SIZE	GSO_MAX_SIZE
+#endif
+
+/* 6.10 passes the ACK sequence and flags to cong_control(). Declare the
+ * handler with RTCP_CONG_CONTROL(name); the rate sample is always rs, and
+ * RTCP_ACK_FLAGS says whether flag is there too.
+ */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 10, 0)
+#define RTCP_CONG_CONTROL(fn)	\
+	void fn(struct sock *sk, u32 ack, int flag, const struct rate_sample *rs)
+#define RTCP_ACK_FLAGS		1
+#else
+#define RTCP_CONG_CONTROL(fn)	\
+	void fn(struct sock *sk, const struct rate_sample *rs)
+#define RTCP_ACK_FLAGS		0
+#endif
+
+/* The ACK flags cong_control() may look at. tcp_input.c keeps them
+ * private; the values have not changed since 5.4.
+ */
+#define RTCP_FLAG_DATA_ACKED		0x04
+#define RTCP_FLAG_SYN_ACKED		0x10
+#define RTCP_FLAG_DATA_SACKED		0x20
+#define RTCP_FLAG_SND_UNA_ADVANCED	0x400
+#define RTCP_FLAG_FORWARD_PROGRESS	\
+	(RTCP_FLAG_DATA_ACKED | RTCP_FLAG_SYN_ACKED | RTCP_FLAG_DATA_SACKED)
+
+/* 5.12 reworked tcp_cwnd_reduction(): PRR-SSRB once inflight is below
+ * ssthresh, with one extra segment on an ACK that advanced snd_una and
+ * marked nothing lost.
+ */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 12, 0)
+#define RTCP_PRR_SSRB		1
+#else
+#define RTCP_PRR_SSRB		0
+#endif
+
+#endif /* _RTCP_COMPAT_H */
@@ -0,0 +1,1275 @@
+/*
+ * R-TCP: rate-limit detection engine, core logic
+ *
+ * Detection, (B, R) estimation and cap probing on struct PMODRL. This file
+ * is not built on its own: it is #included by each build of the engine,
+ * rtcp.c for the kernel module, bpf/rtcp_bbr.bpf.c for BPF struct_ops and
+ * user/rtcp_user.c for userspace, so that they run the same code. Before
+ * including it, the includer defines:
+ *
+ *   RTCP_CORE_API       storage class of the rtcp_*() entry points
+ *   the parameters      probe_interval, probe_per, optimize_flag,
+ *                       monitor_peroid, high_loss_disclassify,
+ *                       window_ms, window_kb, use_goodput,
+ *                       exclude_RTO, exclude_rwnd, exclude_applimited
+ *   rtcp_event()        deliver an enum rtcp_event to the host
+ *   rtcp_history()      per-ACK history record, may do nothing
+ *
+ * and provides div_u64(), abs(), max(), before(), memset(), memcpy() and
+ * USEC_PER_MSEC with their kernel semantics.
+ *
+ * The R-TCP module was designed and implemented by
+ * Shengtong Zhu, Yan Liu, Lingfeng Guo and Jack Y. B. Lee,
+ *  "R-TCP: A Framework to Optimize TCP Performance Over Rate-Limiting Networks", NSDI, 2026.
+ *
+ * Contact  : zs021@ie.cuhk.edu.hk
+ */
+#define BW_SCALE RTCP_BW_SCALE
+#define BW_UNIT RTCP_BW_UNIT
+
+#define BASED_SCALE 8
+#define BASED_UNIT (1 << BASED_SCALE)
+// static const u8 percent_arr_num = 13;
+// static const int percent_arr[] = {BW_UNIT,BW_UNIT*11/12,BW_UNIT*10/12,BW_UNIT*9/12,BW_UNIT*8/12,BW_UNIT*7/12,BW_UNIT*6/12,BW_UNIT*5/12,BW_UNIT*4/12,BW_UNIT*3/12,BW_UNIT*2/12,BW_UNIT*1/12,0};
+static const u8 percent_arr_num = RTCP_GRID;
+static const int percent_arr[] = {BW_UNIT,BW_UNIT*7/8,BW_UNIT*6/8,BW_UNIT*5/8,BW_UNIT*4/8,BW_UNIT*3/8,BW_UNIT*2/8,BW_UNIT*1/8,0};
+/* If lost/delivered ratio > 20*/
+static const u32 loss_thresh = 50;
+/* If goodput diff / before empty > 40*/
+static const u32 abrupt_decrease_thresh = 150;
+
+/* Probes that find nothing space out to probe_interval << 3 ticks */
+#define PROBE_BACKOFF_MAX 3
+
+/* States of the downward cap correction, pmodrl->dis_enable_flag */
+enum {
+	DIS_IDLE,	/* cap not in force */
+	DIS_WAIT,	/* cap just set or corrected, wait a round */
+	DIS_MEASURE,	/* measuring the loss under the cap */
+	DIS_SUSPECT,	/* measuring, after a window over target */
+	DIS_OFF,	/* loss is not the policer's, off for the flow */
+};
+
+/* Shortest rate window, in min_rtt */
+#define WIN_RTTS 4
+
+/* Plateau windows, in rounds (a BBR gain cycle), and how many in a row */
+#define PLATEAU_ROUNDS 8
+#define PLATEAU_WINDOWS 3
+
+/* Rounds a policer model is replayed before it can take over, and the fit
+ * error, 1/1024 of what was offered, it must be under
+ */
+#define MODEL_ROUNDS 8
+#define MODEL_ERR 16
+
+/* Rounds an estimate must also be stable for when ticks classify it */
+#define CLASSIFY_ROUNDS 4
+
+/* Grid shifts per ACK; only the BPF build bounds them. */
+#ifndef RTCP_MAX_SHIFTS
+#define RTCP_MAX_SHIFTS (~0U)
+#endif
+
+/* Packets delivered so far, counted as goodput if use_goodput is set. */
+static u32 rtcp_delivered(const struct rtcp_sample *s)
+{
+	return use_goodput ? s->acked : s->delivered;
+}
+
+static int comp(struct PMODRL *pmodrl, u32 now_us){
+	u8 best_index = 0;
+	u64 b_diff;
+	u64 r_diff;
+	u64 flow_len_us;
+	u8 i;
+	for(i = 1; i < percent_arr_num; i++){
+		b_diff = (u64)abs(pmodrl->B_arr[i] - pmodrl->B_arr[best_index]);
+		r_diff = (u64)abs(pmodrl->R_arr[i] - pmodrl->R_arr[best_index]);
+		flow_len_us = now_us - pmodrl->bbr_start_us;
+		if(r_diff == 0){
+			best_index = i;
+		}
+		else{
+			if(div_u64(b_diff * BASED_SCALE * 2, r_diff) > flow_len_us * BASED_SCALE){
+				best_index = i;
+			}
+			else{
+				break;
+			}
+		}
+	}
+	return best_index;
+}
+
+/* Windowed rate, a lower bound on R whatever B is. The policer's bucket is
+ * empty at a drop, so what was sent after it passes at most at R. The
+ * window starts at the first ACK for data sent after the drop was seen,
+ * when everything that passed the policer before is delivered, and counts
+ * packets from there, so ACK trains (LTE, Wi-Fi, GRO) that hold acks back
+ * and release them together cannot add to it; they only shift where the
+ * count ends. A train that ends a short window still lifts its rate, so
+ * windows are WIN_RTTS min_rtt long at least and the bound taken is the
+ * lower of the last two rounds' highest. The window moves up to a later
+ * drop once it is twice that old.
+ */
+static void window_pmodrl(struct PMODRL *pmodrl, const struct rtcp_sample *s){
+	u32 delivered = rtcp_delivered(s);
+	u32 h = WIN_RTTS * s->min_rtt_us;
+	u64 R;
+
+	if(s->lost != pmodrl->lastest_ack_loss && pmodrl->win_next_us == 0 &&
+	   (pmodrl->win_us == 0 || s->now_us - pmodrl->win_us >= 2 * h)){
+		pmodrl->win_next_us = s->now_us;
+		pmodrl->win_next_delivered = s->delivered;
+	}
+	if(pmodrl->win_next_us != 0 && !before(s->prior_delivered, pmodrl->win_next_delivered)){
+		pmodrl->win_us = pmodrl->win_next_us;
+		pmodrl->win_delivered = delivered;
+		pmodrl->win_next_us = 0;
+	}
+	if(pmodrl->round_start){
+		pmodrl->win_R[1] = pmodrl->win_R[0];
+		pmodrl->win_R[0] = 0;
+	}
+	if(pmodrl->win_us != 0 && h != 0 && s->now_us - pmodrl->win_us >= h &&
+	   (s32)(delivered - pmodrl->win_delivered) > 0){
+		R = div_u64((u64)(delivered - pmodrl->win_delivered) * BW_UNIT, s->now_us - pmodrl->win_us);
+		pmodrl->win_R[0] = max(pmodrl->win_R[0], R);
+	}
+}
+
+static u64 rtcp_win_R(const struct PMODRL *pmodrl)
+{
+	return min(pmodrl->win_R[0], pmodrl->win_R[1]);
+}
+
+/* Lower bound on R for the grid. Only a single bucket is empty at a drop;
+ * behind a dual bucket the window measures the peak rate.
+ */
+static u64 rtcp_floor_R(const struct PMODRL *pmodrl)
+{
+	return pmodrl->model == RTCP_MODEL_BUCKET ? rtcp_win_R(pmodrl) : 0;
+}
+
+/* Policer models. Besides a token bucket, operators police with a peak
+ * bucket in front of it (a dual bucket). Each model has its fit:
+ *
+ *   BUCKET  the grid's best (B, R), R no lower than the windowed rate
+ *   DUAL    the long-run rate as R, behind a peak bucket of one min_rtt
+ *           at P, the bucket's R: the first drops are the peak bucket's,
+ *           so the grid and the windowed rate measure P; only a model when
+ *           P is at least 3/2 R
+ *
+ * The long-run rate is the mean delivered from one loss onset (a drop a
+ * min_rtt or more after the last) to the next, over the time between
+ * them. DUAL's B is what the flow got beyond that rate since its first ACK,
+ * when both buckets were full: the grid's B is the peak bucket's. From the
+ * second onset on, once the grid is seeded, every model replays what the
+ * flow offered, the packets delivered and lost on each ACK, through its
+ * own policer. What was delivered beyond the model's credit, and what was
+ * lost while it still had credit, are the replay's misses; a loss empties
+ * the replayed bucket, as it does the policer's. The replay holds DUAL's
+ * sustained bucket empty, since by the first onset the flow has drained
+ * it. Once a round, each model's fit error moves an eighth of the way to
+ * its misses per packet offered. After MODEL_ROUNDS rounds, a model that
+ * misses less than MODEL_ERR and half as much as the current one takes
+ * over: the cap, the probes and the corrections then run on its (B, R),
+ * and only a single bucket keeps the windowed rate as a floor. Detection
+ * still needs the grid's abrupt decrease: random loss is fitted by the
+ * long-run rate as well as a policer is.
+ */
+static void model_pmodrl(struct PMODRL *pmodrl, const struct rtcp_sample *s){
+	struct rtcp_fit *f = &pmodrl->fit;
+	u32 delivered = rtcp_delivered(s);
+	u64 B[RTCP_MODELS];
+	u64 R[RTCP_MODELS];
+	u64 P;
+	u64 credit;
+	u64 c;
+	u64 e;
+	u32 d;
+	u32 l;
+	u32 t;
+	bool onset = false;
+	u8 best;
+	u8 i;
+
+	if(f->start_us == 0){
+		f->start_us = s->now_us;
+		f->start_delivered = delivered;
+	}
+	if(s->lost != pmodrl->lastest_ack_loss){
+		if(f->loss_us == 0 || s->now_us - f->loss_us >= s->min_rtt_us){
+			if(f->ons_n >= 1){
+				t = s->now_us - f->ons_us;
+				c = (u64)(delivered - f->ons_delivered) * BW_UNIT;
+				if(f->ons_n == 1){
+					f->ons_T_us = t;
+					f->ons_B = c;
+				}
+				else{
+					f->ons_T_us = f->ons_T_us - (f->ons_T_us >> 2) + (t >> 2);
+					f->ons_B = f->ons_B - (f->ons_B >> 2) + (c >> 2);
+				}
+			}
+			if(f->ons_n < 255){
+				f->ons_n++;
+			}
+			f->ons_us = s->now_us;
+			f->ons_delivered = delivered;
+			onset = true;
+			if(f->ons_n >= 2 && f->ons_T_us){
+				c = (u64)(delivered - f->start_delivered) * BW_UNIT;
+				e = div_u64(f->ons_B, f->ons_T_us) * (s->now_us - f->start_us);
+				e = c > e ? c - e : 0;
+				f->sus_B = e;
+			}
+		}
+		f->loss_us = s->now_us;
+	}
+	if(f->ons_n < 2 || f->ons_T_us == 0){
+		return;
+	}
+	if(f->us == 0){
+		if(!onset || !pmodrl->high_loss_flag){
+			return;
+		}
+		/* at an onset every policer is out of credit */
+		memset(f->level, 0, sizeof(f->level));
+		f->peak = 0;
+		f->us = s->now_us;
+		f->delivered = delivered;
+		f->lost = s->lost;
+		return;
+	}
+	if(rtcp_win_R(pmodrl)){
+		f->peak_R = rtcp_win_R(pmodrl);
+	}
+	P = max(rtcp_grid_R(pmodrl), f->peak_R);
+	B[RTCP_MODEL_BUCKET] = rtcp_grid_B(pmodrl);
+	R[RTCP_MODEL_BUCKET] = P;
+	B[RTCP_MODEL_DUAL] = 0;
+	R[RTCP_MODEL_DUAL] = div_u64(f->ons_B, f->ons_T_us);
+
+	d = delivered - f->delivered;
+	l = s->lost - f->lost;
+	t = s->now_us - f->us;
+	c = (u64)d * BW_UNIT;
+	for(i = 0; i < RTCP_MODELS; i++){
+		/* what arrived over the ACK passed as the tokens did */
+		f->level[i] += R[i] * t;
+		credit = f->level[i];
+		if(i == RTCP_MODEL_DUAL){
+			f->peak += P * t;
+			credit = min(credit, f->peak);
+		}
+		e = c > credit ? c - credit : 0;
+		if(l && credit > c){
+			e += min(credit - c, (u64)l * BW_UNIT);
+		}
+		f->miss[i] += e >> BW_SCALE;
+		f->level[i] = min(f->level[i] - min(c, f->level[i]), B[i]);
+		if(i == RTCP_MODEL_DUAL){
+			f->peak = min(f->peak - min(c, f->peak), P * s->min_rtt_us);
+			if(l && f->peak < f->level[i]){
+				f->peak = 0;
+				continue;
+			}
+		}
+		if(l){
+			f->level[i] = 0;
+		}
+	}
+	f->offered += d + l;
+	f->us = s->now_us;
+	f->delivered = delivered;
+	f->lost = s->lost;
+
+	if(pmodrl->round_start && f->offered){
+		for(i = 0; i < RTCP_MODELS; i++){
+			e = min(div_u64((u64)f->miss[i] << 10, f->offered), 1024ULL);
+			f->err[i] = f->err[i] - (f->err[i] >> 3) + (u32)(e >> 3);
+			f->miss[i] = 0;
+		}
+		f->offered = 0;
+		if(f->rounds < 255){
+			f->rounds++;
+		}
+		best = pmodrl->model;
+		for(i = 0; i < RTCP_MODELS; i++){
+			/* without a faster peak, a dual bucket is a bucket */
+			if(i == RTCP_MODEL_DUAL && P * 2 < R[i] * 3){
+				continue;
+			}
+			if(f->err[i] < f->err[best]){
+				best = i;
+			}
+		}
+		if(f->rounds >= MODEL_ROUNDS && f->err[best] < MODEL_ERR &&
+		   (u64)f->err[best] * 2 < (u64)f->err[pmodrl->model]){
+			/* refinements of the old model's estimate do not carry
+			 * over, and its modelled bucket starts again empty
+			 */
+			if(pmodrl->corr_R <= max(rtcp_model_R(pmodrl), R[best])){
+				pmodrl->corr_R = 0;
+			}
+			pmodrl->corr_B = 0;
+			pmodrl->tb_us = 0;
+			pmodrl->model = best;
+			pmodrl->model_B = best == RTCP_MODEL_DUAL ? f->sus_B : B[best];
+			pmodrl->model_R = R[best];
+		}
+	}
+	if(pmodrl->model == RTCP_MODEL_BUCKET || pmodrl->model >= RTCP_MODELS){
+		return;
+	}
+	/* onsets move the fit a little every time: follow it by more than 1/8
+	 * only, so that classification sees it settle, as it does the grid
+	 */
+	i = pmodrl->model;
+	if(i == RTCP_MODEL_DUAL){
+		B[i] = f->sus_B;
+	}
+	if((u64)abs((s64)(R[i] - pmodrl->model_R)) * 8 > pmodrl->model_R ||
+	   (u64)abs((s64)(B[i] - pmodrl->model_B)) * 8 > pmodrl->model_B){
+		pmodrl->model_B = B[i];
+		pmodrl->model_R = R[i];
+	}
+	pmodrl->model_P = i == RTCP_MODEL_DUAL ? P : 0;
+}
+
+/* Plateau detection, for a flow whose policer's bucket was already empty
+ * when it started (drained by other traffic of the subscriber): the flow
+ * never sees the abrupt drop from bef_empty_goodput that the classifier
+ * looks for. Over a policer it sees a plateau instead. The delivery rate
+ * holds at R whatever the sender's gain, the rounds that send above it lose
+ * their excess at the policer, and nothing queues, so no rate sample takes
+ * longer than a round trip. A bottleneck queues in the rounds that probe
+ * above its rate, random loss hits most rounds at any rate.
+ *
+ * The flow is on the plateau for a window of PLATEAU_ROUNDS rounds if it
+ * lost packets in at most half of them, no rate sample interval was over
+ * 19/16 min_rtt, nothing was app limited and the window's delivery rate is
+ * within an eighth of the last one's. After PLATEAU_WINDOWS windows in a
+ * row, unless the grid already shows an abrupt drop, plateau_flag stands in
+ * for it until the next reset, and the grid is refitted from the last window
+ * on with B = 0: the bucket's level there, its size is left to the probes.
+ */
+static void plateau_pmodrl(struct PMODRL *pmodrl, const struct rtcp_sample *s){
+	u32 delivered = rtcp_delivered(s);
+	u64 R;
+	bool on;
+
+	if(pmodrl->plateau_flag || pmodrl->classify == 1){
+		return;
+	}
+	if(pmodrl->pl_us == 0 || s->app_limited){
+		pmodrl->pl_us = s->now_us;
+		pmodrl->pl_delivered = delivered;
+		pmodrl->pl_lost = s->lost;
+		pmodrl->pl_round_lost = s->lost;
+		pmodrl->pl_interval_us = 0;
+		pmodrl->pl_rounds = 0;
+		pmodrl->pl_loss_rounds = 0;
+		if(s->app_limited){
+			pmodrl->pl_count = 0;
+			pmodrl->pl_R = 0;
+		}
+		return;
+	}
+	if(s->interval_us > pmodrl->pl_interval_us){
+		pmodrl->pl_interval_us = s->interval_us;
+	}
+	if(!pmodrl->round_start){
+		return;
+	}
+	pmodrl->pl_rounds++;
+	if(s->lost != pmodrl->pl_round_lost){
+		pmodrl->pl_loss_rounds++;
+		pmodrl->pl_round_lost = s->lost;
+	}
+	if(pmodrl->pl_rounds < PLATEAU_ROUNDS || s->now_us == pmodrl->pl_us){
+		return;
+	}
+	R = div_u64((u64)(delivered - pmodrl->pl_delivered) * BW_UNIT, s->now_us - pmodrl->pl_us);
+	on = s->lost != pmodrl->pl_lost &&
+	     pmodrl->pl_loss_rounds * 2 <= pmodrl->pl_rounds &&
+	     (u64)pmodrl->pl_interval_us * 16 <= (u64)s->min_rtt_us * 19 &&
+	     pmodrl->pl_R != 0 &&
+	     (u64)abs((s64)(R - pmodrl->pl_R)) * 8 <= pmodrl->pl_R;
+	pmodrl->pl_count = on ? pmodrl->pl_count + 1 : 0;
+	pmodrl->pl_R = R;
+	if(pmodrl->pl_count + 1 >= PLATEAU_WINDOWS &&
+	   (!pmodrl->high_loss_flag || pmodrl->R_arr[pmodrl->best_index] * BASED_UNIT > abrupt_decrease_thresh * pmodrl->bef_empty_goodput)){
+		/* refit from the last window, every hypothesis with B = 0 */
+		pmodrl->plateau_flag = 1;
+		pmodrl->high_loss_flag = 1;
+		pmodrl->bbr_start_us = pmodrl->pl_us;
+		pmodrl->transfer_start_deliverd = pmodrl->pl_delivered;
+		pmodrl->transfer_start_lost = pmodrl->pl_lost;
+		pmodrl->before_loss_delivered = 0;
+		pmodrl->before_loss_lost = 0;
+		pmodrl->before_loss_time_us = pmodrl->pl_us;
+		memset(pmodrl->B_arr, 0, sizeof(pmodrl->B_arr));
+		memset(pmodrl->R_arr, 0, sizeof(pmodrl->R_arr));
+	}
+	pmodrl->pl_us = 0;
+}
+
+/* The flow is less than 1ms old: now_us is still in the millisecond of
+ * start_us. Counted from start_us, so that it holds across the wrap of the
+ * u32 clock.
+ */
+static bool rtcp_young(u32 start_us, u32 now_us)
+{
+	return (u64)(start_us % USEC_PER_MSEC) + (u32)(now_us - start_us) < USEC_PER_MSEC;
+}
+
+/* Raise each hypothesis' R to the rate that delivered the packets beyond
+ * its bucket B since the start of the flow, and to the windowed rate.
+ * Returns false, with nothing updated, if a hypothesis needs it but the
+ * flow is not 1ms old yet.
+ */
+static bool rtcp_grid_rates(struct PMODRL *pmodrl, u32 cur_delivered, u32 now_us){
+	u64 win = rtcp_floor_R(pmodrl);
+	u64 h;
+	u64 R;
+	u8 i;
+	for(i = 0; i < percent_arr_num; i++){
+		if((u64)cur_delivered * BW_UNIT > pmodrl->B_arr[i]){
+			h = (u64)cur_delivered * BW_UNIT - pmodrl->B_arr[i];
+			if(rtcp_young(pmodrl->bbr_start_us, now_us)){
+				return false;
+			}
+			R = div_u64(h, now_us - pmodrl->bbr_start_us);
+			pmodrl->R_arr[i] = max(pmodrl->R_arr[i], R);
+		}
+	}
+	for(i = 0; i < percent_arr_num; i++){
+		pmodrl->R_arr[i] = max(pmodrl->R_arr[i], win);
+	}
+	return true;
+}
+
+static void estimation_classify(struct PMODRL *pmodrl, const struct rtcp_sample *s){
+	u32 now_us = s->now_us;
+	u32 cur_delivered = rtcp_delivered(s) - pmodrl->transfer_start_deliverd;
+	u32 cur_lost = s->lost - pmodrl->transfer_start_lost;
+	u32 d;
+	u32 l;
+	u64 bef_empty;
+	u8 i;
+	u64 h;
+	u64 t;
+	u64 R;
+	u64 incr_diff;
+	u8 abrupt_decrease_flag = 0;
+	u8 best_index = 0;
+	u64 lower_bound_B;
+	u32 shifts = 0;
+
+	if(pmodrl->high_loss_flag == 0){
+		if(pmodrl->loss_start_time_us != 0 && pmodrl->loss_start_time_us + 7 * s->min_rtt_us < now_us){
+			d = cur_delivered - pmodrl->before_loss_delivered;
+			l = cur_lost - pmodrl->before_loss_lost;
+			// if(d < 10) {
+			// 	return;
+			// }
+			if((d + l) != 0 && (u64)l * 10 > (u64)(d + l) * 2){
+				pmodrl->high_loss_flag = 1;
+				if(rtcp_young(pmodrl->bbr_start_us, pmodrl->before_loss_time_us)){
+					return;
+				}
+				bef_empty = div_u64((u64)pmodrl->before_loss_delivered * BW_UNIT, pmodrl->before_loss_time_us - pmodrl->bbr_start_us);
+				pmodrl->bef_empty_goodput = bef_empty;
+				lower_bound_B = (u64)pmodrl->before_loss_delivered * (BASED_UNIT -  abrupt_decrease_thresh);
+				for(i = 0; i < percent_arr_num; i++){
+					if(percent_arr[i] == 0){
+						pmodrl->B_arr[i] = 0;
+					}
+					else{
+						t = (BW_UNIT - percent_arr[i]) * lower_bound_B;
+						t = t >> BASED_SCALE;
+						pmodrl->B_arr[i] = (u64)pmodrl->before_loss_delivered * percent_arr[i] + t;
+					}
+				}
+				for(i = 0; i < percent_arr_num; i++){
+					if((u64)pmodrl->before_loss_delivered * BW_UNIT > pmodrl->B_arr[i]){
+						h = (u64)pmodrl->before_loss_delivered * BW_UNIT - pmodrl->B_arr[i];
+						if(rtcp_young(pmodrl->bbr_start_us, pmodrl->before_loss_time_us)){
+							return;
+						}
+						R = div_u64(h, pmodrl->before_loss_time_us - pmodrl->bbr_start_us);
+						pmodrl->R_arr[i] = max(pmodrl->R_arr[i], R);
+					}
+				}
+			}
+			else{
+				pmodrl->loss_start_time_us = 0;
+				return;
+			}
+		}
+		else{
+			return;
+		}
+	}
+	if(!rtcp_grid_rates(pmodrl, cur_delivered, now_us)){
+		return;
+	}
+	best_index = comp(pmodrl, now_us);
+	pmodrl->best_index = best_index;
+	while(best_index == 0 && shifts++ < RTCP_MAX_SHIFTS){
+		incr_diff = pmodrl->B_arr[0] - pmodrl->B_arr[1];
+		for(i = percent_arr_num - 1; i>=1; i--){
+			pmodrl->B_arr[i] = pmodrl->B_arr[i - 1];
+			pmodrl->R_arr[i] = pmodrl->R_arr[i - 1];
+		}
+		pmodrl->B_arr[0] = pmodrl->B_arr[0] + incr_diff;
+		pmodrl->R_arr[0] = rtcp_floor_R(pmodrl);
+		if((u64)cur_delivered * BW_UNIT > pmodrl->B_arr[0]){
+			h = (u64)cur_delivered * BW_UNIT - pmodrl->B_arr[0];
+			R = div_u64(h, now_us - pmodrl->bbr_start_us);
+			pmodrl->R_arr[i] = max(pmodrl->R_arr[i], R);
+		}
+		if((u64)pmodrl->before_loss_delivered * BW_UNIT > pmodrl->B_arr[0]){
+			h = (u64)pmodrl->before_loss_delivered * BW_UNIT - pmodrl->B_arr[0];
+			R = div_u64(h, pmodrl->before_loss_time_us - pmodrl->bbr_start_us);
+			pmodrl->R_arr[i] = max(pmodrl->R_arr[i], R);
+		}
+		best_index = comp(pmodrl, now_us);
+	}
+	pmodrl->best_index = best_index;
+	if(pmodrl->R_arr[best_index] * BASED_UNIT <= abrupt_decrease_thresh * pmodrl->bef_empty_goodput ||
+	   pmodrl->plateau_flag){
+		abrupt_decrease_flag = 1;
+	}
+	if(pmodrl->classify == 1){
+		if(!abrupt_decrease_flag){
+			// printA(KERN_INFO "!!!Rate fail %llu", pmodrl->R_arr[best_index]);
+			pmodrl->classify = 2;
+			pmodrl->disable_flag = 1;
+		}
+	}
+	else{
+		if(pmodrl->high_loss_flag && abrupt_decrease_flag){
+			if(pmodrl->classify_time_us == 0){
+				pmodrl->classify_time_us = now_us;
+				pmodrl->classify_ticks = 0;
+				pmodrl->classify_rounds = 0;
+			}
+			if(pmodrl->reset_ltbw_flag == 0){
+				rtcp_event(pmodrl, RTCP_EV_CLASSIFYING);
+				pmodrl->reset_ltbw_flag = 1;
+			}
+
+			if(rtcp_model_R(pmodrl) != pmodrl->mem_R || rtcp_model_B(pmodrl) != pmodrl->mem_B) {
+				pmodrl->classify_time_us = now_us;
+				pmodrl->classify_ticks = 0;
+				pmodrl->classify_rounds = 0;
+				pmodrl->mem_B = rtcp_model_B(pmodrl);
+				pmodrl->mem_R = rtcp_model_R(pmodrl);
+
+			}
+			else{
+				if(pmodrl->tick && pmodrl->classify_ticks < 255){
+					pmodrl->classify_ticks++;
+				}
+				if(pmodrl->round_start && pmodrl->classify_rounds < 255){
+					pmodrl->classify_rounds++;
+				}
+				/* stable for 10 min_rtt, or on a long path for 10
+				 * ticks and CLASSIFY_ROUNDS rounds
+				 */
+				if(now_us - pmodrl->classify_time_us > 10 * s->min_rtt_us ||
+				   (pmodrl->classify_ticks > 10 &&
+				    pmodrl->classify_rounds >= CLASSIFY_ROUNDS)){
+					pmodrl->classify = 1;
+					pmodrl->upper_bound = 1;
+					pmodrl->detected_time = now_us - pmodrl->bbr_start_us;
+					pmodrl->detected_bytes_acked = s->bytes_acked;
+				}
+			}
+
+		}
+		else{
+			pmodrl->classify_time_us = 0;
+		}
+	}
+
+}
+
+/* Token bucket behind the cap, modelled from the best hypothesis: empty at
+ * detection, refilled at rtcp_R() up to rtcp_B() and drained by what is
+ * delivered. What is delivered with no modelled tokens left adds to tb_over.
+ *
+ * Every drop after detection is a new constraint on B. If the model was full
+ * since the last drop, both buckets started the drain from full, at their
+ * own size: the policer's ran dry now, so it was smaller than the model's by
+ * the tokens the model still holds, or larger by what was delivered beyond
+ * the model's. The refined B moves halfway to that, drop after drop.
+ */
+static void bucket_pmodrl(struct PMODRL *pmodrl, const struct rtcp_sample *s){
+	u32 delivered = rtcp_delivered(s);
+	u64 B = rtcp_B(pmodrl);
+	u64 d;
+
+	if(pmodrl->classify != 1 || !optimize_flag){
+		pmodrl->tb_us = 0;
+		return;
+	}
+	if(pmodrl->tb_us == 0){
+		pmodrl->tb_level = 0;
+		pmodrl->tb_over = 0;
+		pmodrl->tb_full = 0;
+		pmodrl->tb_gap = 0;
+		pmodrl->tb_us = s->now_us;
+		pmodrl->tb_sync_us = s->now_us;
+		pmodrl->tb_delivered = delivered;
+		return;
+	}
+	pmodrl->tb_level += rtcp_R(pmodrl) * (u32)(s->now_us - pmodrl->tb_us);
+	if(pmodrl->tb_level >= B){
+		pmodrl->tb_level = B;
+		pmodrl->tb_full = 1;
+		pmodrl->tb_gap = 0;
+	}
+	/* a drop means the policer's bucket is dry whatever the model says */
+	if(s->lost != pmodrl->lastest_ack_loss){
+		if(pmodrl->tb_full){
+			B = B + pmodrl->tb_gap - pmodrl->tb_level;
+			if(B > rtcp_B(pmodrl)){
+				pmodrl->corr_B = rtcp_B(pmodrl) + ((B - rtcp_B(pmodrl)) >> 1);
+			}
+			else{
+				pmodrl->corr_B = rtcp_B(pmodrl) - ((rtcp_B(pmodrl) - B) >> 1);
+			}
+		}
+		pmodrl->tb_level = 0;
+		pmodrl->tb_sync_us = s->now_us;
+		pmodrl->tb_full = 0;
+		pmodrl->tb_gap = 0;
+	}
+	d = (u64)(delivered - pmodrl->tb_delivered) * BW_UNIT;
+	if(d > pmodrl->tb_level){
+		pmodrl->tb_over += d - pmodrl->tb_level;
+		pmodrl->tb_gap += d - pmodrl->tb_level;
+		pmodrl->tb_level = 0;
+	}
+	else{
+		pmodrl->tb_level -= d;
+	}
+	pmodrl->tb_us = s->now_us;
+	pmodrl->tb_delivered = delivered;
+}
+
+/* Window ticks. A packet-timed round is one, and so is window_ms of wall
+ * clock or window_kb acked since the last tick, whichever comes first (0
+ * turns either off). Counted in rounds, the probe interval, the settle and
+ * correction windows and the classification wait stretch with the RTT: at
+ * 128 kbit/s and 800 ms, 20 rounds are 16 s. They count ticks instead; what
+ * waits for loss feedback on packets just sent still counts rounds. Probes
+ * and classification also need a floor in rounds: each probe costs loss,
+ * and a tick without a round brings no new feedback.
+ */
+static void tick_pmodrl(struct PMODRL *pmodrl, const struct rtcp_sample *s){
+	pmodrl->tick = pmodrl->round_start ||
+		(window_ms > 0 && s->now_us - pmodrl->tick_us >= (u64)window_ms * USEC_PER_MSEC) ||
+		(window_kb > 0 && s->bytes_acked - pmodrl->tick_bytes >= (u64)window_kb * 1000);
+	if(pmodrl->tick){
+		pmodrl->tick_us = s->now_us;
+		pmodrl->tick_bytes = s->bytes_acked;
+	}
+}
+
+/* A probe (nominator 1) spends the modelled credit first, so it stays
+ * loss-free while the estimate is right. Once the surplus sent, what was
+ * delivered past the credit plus gamma * R * min_rtt in flight, overdraws
+ * the credit by a margin of an eighth of R * min_rtt plus two packets, the
+ * gain drops back and the probe watches (nominator 2) for two rounds.
+ *
+ * If half the margin is delivered with nothing lost, the policer's bucket
+ * held more than modelled: it has filled faster than R since the model was
+ * last known right, at the last drop or find. The cap goes up by that
+ * difference and the probe is done. Any loss ends the probe too: the
+ * policer is at the cap, at most the margin was lost, and half of what
+ * earlier probes raised the cap by is taken back. A probe that finds
+ * nothing doubles the wait for the next. Returns true if the probe ended.
+ */
+static bool probe_done(struct PMODRL *pmodrl, const struct rtcp_sample *s){
+	u64 margin = (rtcp_R(pmodrl) * s->min_rtt_us >> 3) + 2 * BW_UNIT;
+	u32 t = s->now_us - pmodrl->probe_us;
+	bool found = false;
+	u64 R;
+
+	if(s->lost == pmodrl->probe_lost){
+		if(pmodrl->nominator == 1){
+			R = probe_per > 20 ? div_u64(rtcp_R(pmodrl) * (probe_per - 20), 20) : 0;
+			if(pmodrl->tb_level + margin <= pmodrl->tb_over + R * min(t, s->min_rtt_us)){
+				pmodrl->nominator = 2;
+				pmodrl->round_count_no = 0;
+			}
+			return false;
+		}
+		found = pmodrl->tb_over >= margin >> 1 && s->now_us != pmodrl->tb_sync_us;
+		if(!found && pmodrl->round_count_no < 2){
+			return false;
+		}
+	}
+	if(found){
+		/* B = 0 was the bucket's level at the plateau, not its size */
+		if(pmodrl->plateau_flag && pmodrl->tb_full && pmodrl->tb_gap){
+			pmodrl->corr_B = rtcp_B(pmodrl) + pmodrl->tb_gap;
+			pmodrl->tb_gap = 0;
+		}
+		else{
+			pmodrl->corr_R = rtcp_R(pmodrl) + div_u64(pmodrl->tb_over, s->now_us - pmodrl->tb_sync_us);
+		}
+		pmodrl->tb_sync_us = s->now_us;
+		pmodrl->probe_backoff = 0;
+	}
+	else{
+		if(pmodrl->corr_R > rtcp_model_R(pmodrl) && s->lost != pmodrl->probe_lost){
+			pmodrl->corr_R -= (pmodrl->corr_R - rtcp_model_R(pmodrl)) >> 1;
+		}
+		if(pmodrl->probe_backoff < PROBE_BACKOFF_MAX){
+			pmodrl->probe_backoff++;
+		}
+	}
+	pmodrl->nominator = 0;
+	pmodrl->round_count = 0;
+	pmodrl->round_count_no = 0;
+	pmodrl->probe_rounds = 0;
+	return true;
+}
+
+static void probe_pmodrl(struct PMODRL *pmodrl, const struct rtcp_sample *s) {
+	if(pmodrl->classify == 1 && optimize_flag){
+		if(pmodrl->upper_bound == 1 && pmodrl->nominator != 0 && probe_done(pmodrl, s)){
+			return;
+		}
+		if(pmodrl->upper_bound != 1 || pmodrl->nominator != 0) {
+			/* the wait for a probe's loss goes by rounds, as the
+			 * feedback does, the others by ticks
+			 */
+			if(pmodrl->nominator == 2 ? pmodrl->round_start : pmodrl->tick){
+				pmodrl->round_count_no++;
+				if(pmodrl->round_count_no >= (pmodrl->nominator ? probe_interval : monitor_peroid) && pmodrl->mem_B == rtcp_model_B(pmodrl) && pmodrl->mem_R == rtcp_model_R(pmodrl)){
+					pmodrl->upper_bound = 1;
+					pmodrl->nominator = 0;
+					pmodrl->round_count_no = 0;
+				}
+			}
+			if(pmodrl->mem_B != rtcp_model_B(pmodrl) || pmodrl->mem_R != rtcp_model_R(pmodrl)){
+				/* Outside a probe, release the cap while the new
+				 * estimate settles. A probe runs on within its
+				 * credit, capped at the new R.
+				 */
+				if(pmodrl->nominator == 0){
+					pmodrl->upper_bound = 2;
+					pmodrl->round_count_no = 0;
+					pmodrl->next_rtt_delivered = s->delivered;
+					pmodrl->probe_backoff = 0;
+				}
+
+				/* Corrections of the old estimate go, unless a probe
+				 * raised the cap above the new one too.
+				 */
+				if(pmodrl->corr_R <= max(pmodrl->mem_R, rtcp_model_R(pmodrl))){
+					pmodrl->corr_R = 0;
+				}
+				pmodrl->corr_B = 0;
+				pmodrl->mem_B = rtcp_model_B(pmodrl);
+				pmodrl->mem_R = rtcp_model_R(pmodrl);
+			}
+		}
+		else{
+			if(pmodrl->round_start){
+				pmodrl->probe_rounds++;
+			}
+			/* probe after probe_interval ticks per backoff step,
+			 * and probe_interval rounds at least
+			 */
+			if(pmodrl->tick) {
+				pmodrl->round_count++;
+				if(pmodrl->round_count >= probe_interval << pmodrl->probe_backoff &&
+				   pmodrl->probe_rounds >= probe_interval){
+					pmodrl->upper_bound = 1;
+					pmodrl->nominator = 1;
+					// pmodrl->acc_rto_dur = 0;
+					pmodrl->mem_B = rtcp_model_B(pmodrl);
+					pmodrl->mem_R = rtcp_model_R(pmodrl);
+					pmodrl->round_count = 0;
+					pmodrl->round_count_no = 0;
+					pmodrl->probe_rounds = 0;
+					pmodrl->probe_us = s->now_us;
+					pmodrl->probe_lost = s->lost;
+					pmodrl->tb_over = 0;
+					rtcp_event(pmodrl, RTCP_EV_PROBE);
+				}
+			}
+		}
+
+	}
+}
+
+/* Downward cap correction. While the cap is in force, the loss ratio under
+ * it is checked every monitor_peroid ticks against high_loss_disclassify
+ * (%, 0 turns the correction off). Above it in two windows in a row, the
+ * policer is dropping what the cap lets through, so R is too high: the cap
+ * comes down by the share lost in the second window, to what behind an
+ * empty bucket is the token rate, and by half at most. A burst of radio
+ * loss seldom spans both windows. A cap a probe raised comes down the same
+ * way, but not below the estimate. The cap is corrected down once per
+ * estimate; if loss stays above target afterwards, it is not the policer's,
+ * and the correction is undone and not tried again on this flow.
+ */
+static void correct_pmodrl(struct PMODRL *pmodrl, const struct rtcp_sample *s){
+	u32 delivered = rtcp_delivered(s);
+	u32 d;
+	u32 l;
+	u64 R;
+	bool high = false;
+
+	if(!high_loss_disclassify || !optimize_flag || pmodrl->classify != 1 ||
+	   pmodrl->upper_bound != 1 || pmodrl->nominator != 0){
+		if(pmodrl->dis_enable_flag != DIS_OFF){
+			pmodrl->dis_enable_flag = DIS_IDLE;
+		}
+		return;
+	}
+	if(pmodrl->dis_enable_flag == DIS_OFF){
+		return;
+	}
+	/* The first round still acks what went out before the cap. */
+	if(pmodrl->dis_enable_flag == DIS_IDLE || pmodrl->dis_enable_flag == DIS_WAIT){
+		if(!pmodrl->round_start){
+			return;
+		}
+		if(pmodrl->dis_enable_flag == DIS_IDLE){
+			pmodrl->dis_enable_flag = DIS_WAIT;
+			return;
+		}
+	}
+	else{
+		if(!pmodrl->tick || ++pmodrl->dis_rounds < monitor_peroid){
+			return;
+		}
+		d = delivered - (u32)pmodrl->dis_deliver_start;
+		l = s->lost - (u32)pmodrl->dis_loss_start;
+		high = (u64)l * 100 > (u64)(d + l) * high_loss_disclassify;
+		if(high && pmodrl->dis_enable_flag == DIS_SUSPECT){
+			if(pmodrl->corr_R && pmodrl->corr_R < rtcp_model_R(pmodrl)){
+				pmodrl->corr_R = 0;
+				pmodrl->dis_enable_flag = DIS_OFF;
+				return;
+			}
+			R = max(div_u64(rtcp_R(pmodrl) * d, d + l), rtcp_R(pmodrl) >> 1);
+			if(pmodrl->corr_R && R <= rtcp_model_R(pmodrl)){
+				pmodrl->corr_R = 0;
+				pmodrl->dis_enable_flag = DIS_WAIT;
+				return;
+			}
+			if(R < rtcp_R(pmodrl)){
+				pmodrl->corr_R = R;
+				pmodrl->dis_enable_flag = DIS_WAIT;
+				return;
+			}
+		}
+	}
+	pmodrl->dis_enable_flag = high ? DIS_SUSPECT : DIS_MEASURE;
+	pmodrl->dis_rounds = 0;
+	pmodrl->dis_deliver_start = delivered;
+	pmodrl->dis_loss_start = s->lost;
+}
+
+static void reset_pmodrl(struct PMODRL *pmodrl, const struct rtcp_sample *s, u8 res1, u8 res2){
+	const struct rtcp_ops *ops = pmodrl->ops;
+	void *ctx = pmodrl->ctx;
+	char* p;
+	int flag = 0;
+	if(pmodrl->classify == 1){
+		flag = 1;
+	}
+	else if(pmodrl->classify == 2){
+		flag = 2;
+	}
+	else if(pmodrl->classify != 0){
+		flag = pmodrl->classify;
+	}
+	p = pmodrl->buffer;
+	memset(pmodrl,0, sizeof(struct PMODRL));
+	pmodrl->bbr_start_us = s->now_us;
+	pmodrl->transfer_start_lost = s->lost;
+	pmodrl->transfer_start_deliverd = rtcp_delivered(s);
+	pmodrl->buffer = p;
+	pmodrl->ops = ops;
+	pmodrl->ctx = ctx;
+	if(flag == 1){
+		pmodrl->classify = res1;
+	}
+	else if(flag == 2){
+		pmodrl->classify = res2;
+	}
+	else if(flag != 0){
+		pmodrl->classify = flag;
+	}
+}
+
+/* A new transfer starts (e.g. restart from idle): measure from here on. */
+RTCP_CORE_API void rtcp_start(struct PMODRL *pmodrl, const struct rtcp_sample *s)
+{
+	pmodrl->bbr_start_us = s->now_us;
+	pmodrl->transfer_start_lost = s->lost;
+	pmodrl->transfer_start_deliverd = rtcp_delivered(s);
+	pmodrl->fit.start_us = s->now_us;
+	pmodrl->fit.start_delivered = rtcp_delivered(s);
+}
+
+/* The host restarted its packet-timed round (recovery, PROBE_RTT). */
+RTCP_CORE_API void rtcp_restart_round(struct PMODRL *pmodrl, u32 delivered)
+{
+	pmodrl->next_rtt_delivered = delivered;
+}
+
+/* Feed one ACK: update loss bookkeeping, estimation, classification and the
+ * cap probing state machine. Call before the host sets pacing rate and cwnd.
+ */
+RTCP_CORE_API void rtcp_ack(struct PMODRL *pmodrl, const struct rtcp_sample *s)
+{
+	u32 now_us = s->now_us;
+
+	pmodrl->latest_ack_us = now_us;
+
+	if(pmodrl->bbr_start_us == 0){
+		pmodrl->bbr_start_us = now_us;
+	}
+	window_pmodrl(pmodrl, s);
+	model_pmodrl(pmodrl, s);
+	plateau_pmodrl(pmodrl, s);
+	if(pmodrl->disable_flag == 0){
+		estimation_classify(pmodrl, s);
+	}
+	bucket_pmodrl(pmodrl, s);
+
+	if(pmodrl->lastest_ack_loss!=s->lost){
+		if(pmodrl->high_loss_flag == 0 && pmodrl->loss_start_time_us == 0){
+			pmodrl->loss_start_time_us = now_us;
+		}
+	}
+	else{
+		if(pmodrl->high_loss_flag == 0 && pmodrl->loss_start_time_us == 0) {
+			pmodrl->before_loss_delivered = rtcp_delivered(s) - pmodrl->transfer_start_deliverd;
+			pmodrl->before_loss_time_us = now_us;
+			pmodrl->before_loss_lost = s->lost - pmodrl->transfer_start_lost;
+		}
+	}
+	pmodrl->lastest_ack_loss = s->lost;
+
+	pmodrl->round_start = 0;
+	if (!before(s->prior_delivered, pmodrl->next_rtt_delivered) && !(s->rs_delivered < 0 || s->interval_us <= 0)) {
+		pmodrl->next_rtt_delivered = s->delivered;
+		pmodrl->round_start = 1;
+	}
+	tick_pmodrl(pmodrl, s);
+
+	probe_pmodrl(pmodrl, s);
+	correct_pmodrl(pmodrl, s);
+}
+
+/* Per-ACK bookkeeping after the host applied pacing rate and cwnd: history
+ * record and the exclude_* resets.
+ */
+RTCP_CORE_API void rtcp_ack_end(struct PMODRL *pmodrl, const struct rtcp_sample *s)
+{
+	rtcp_history(pmodrl, s);
+	if(exclude_rwnd && s->rwnd_limited){
+		reset_pmodrl(pmodrl, s, (u8)5, (u8)6);
+	}
+
+	if(exclude_RTO && s->rto_exit){
+		reset_pmodrl(pmodrl, s, (u8)7, (u8)8);
+	}
+
+	if(exclude_applimited && s->app_limited){
+		reset_pmodrl(pmodrl, s, (u8)9, (u8)10);
+	}
+}
+
+/* Rate limiting detected and optimization enabled: the host should not run
+ * its own policer model.
+ */
+RTCP_CORE_API bool rtcp_capped(const struct PMODRL *pmodrl)
+{
+	return pmodrl->classify == 1 && optimize_flag;
+}
+
+/* Should the host clamp its pacing rate to rtcp_R()? */
+RTCP_CORE_API bool rtcp_cap_active(const struct PMODRL *pmodrl)
+{
+	return pmodrl->classify == 1 && pmodrl->upper_bound == 1 && optimize_flag;
+}
+
+/* A probe is running: the host should pace at the cap, not below it, so
+ * that the probe spends its surplus.
+ */
+RTCP_CORE_API bool rtcp_probing(const struct PMODRL *pmodrl)
+{
+	return rtcp_cap_active(pmodrl) && pmodrl->nominator == 1;
+}
+
+/* Gain to apply to rtcp_R(): raised by gamma while probing the cap. */
+RTCP_CORE_API int rtcp_cap_gain(const struct PMODRL *pmodrl, int gain)
+{
+	u64 cap, peak;
+
+	if(pmodrl->classify == 1 && pmodrl->nominator == 1){
+		cap = div_u64((u64)gain * probe_per, 20);
+		/* behind a dual bucket, no faster than its peak rate */
+		if(pmodrl->model == RTCP_MODEL_DUAL && rtcp_R(pmodrl) != 0 &&
+		   pmodrl->model_P > rtcp_R(pmodrl)){
+			peak = div64_u64((u64)gain * pmodrl->model_P, rtcp_R(pmodrl));
+			cap = min(cap, peak);
+		}
+		gain = cap > INT_MAX ? INT_MAX : (int)cap;
+	}
+	return gain;
+}
+
+#define RTCP_STATE_COPY(dst, src)					\
+	do {								\
+		memcpy((dst)->B_arr, (src)->B_arr, sizeof((dst)->B_arr)); \
+		memcpy((dst)->R_arr, (src)->R_arr, sizeof((dst)->R_arr)); \
+		(dst)->bef_empty_goodput = (src)->bef_empty_goodput;	\
+		(dst)->detected_bytes_acked = (src)->detected_bytes_acked; \
+		(dst)->mem_B = (src)->mem_B;				\
+		(dst)->mem_R = (src)->mem_R;				\
+		(dst)->acc_rto_dur = (src)->acc_rto_dur;		\
+		(dst)->dis_loss_start = (src)->dis_loss_start;		\
+		(dst)->dis_deliver_start = (src)->dis_deliver_start;	\
+		(dst)->classify_time_us = (src)->classify_time_us;	\
+		(dst)->loss_start_time_us = (src)->loss_start_time_us;	\
+		(dst)->before_loss_delivered = (src)->before_loss_delivered; \
+		(dst)->before_loss_time_us = (src)->before_loss_time_us; \
+		(dst)->before_loss_lost = (src)->before_loss_lost;	\
+		(dst)->bbr_start_us = (src)->bbr_start_us;		\
+		(dst)->nominator = (src)->nominator;			\
+		(dst)->latest_ack_us = (src)->latest_ack_us;		\
+		(dst)->lastest_ack_loss = (src)->lastest_ack_loss;	\
+		(dst)->detected_time = (src)->detected_time;		\
+		(dst)->round_count = (src)->round_count;		\
+		(dst)->round_count_no = (src)->round_count_no;		\
+		(dst)->next_rtt_delivered = (src)->next_rtt_delivered;	\
+		(dst)->transfer_start_deliverd = (src)->transfer_start_deliverd; \
+		(dst)->transfer_start_lost = (src)->transfer_start_lost; \
+		(dst)->store_interval = (src)->store_interval;		\
+		(dst)->best_index = (src)->best_index;			\
+		(dst)->classify = (src)->classify;			\
+		(dst)->high_loss_flag = (src)->high_loss_flag;		\
+		(dst)->disable_flag = (src)->disable_flag;		\
+		(dst)->probe_rtt_flag = (src)->probe_rtt_flag;		\
+		(dst)->upper_bound = (src)->upper_bound;		\
+		(dst)->round_start = (src)->round_start;		\
+		(dst)->reset_ltbw_flag = (src)->reset_ltbw_flag;	\
+		(dst)->dis_enable_flag = (src)->dis_enable_flag;	\
+	} while (0)
+
+/* Serialise the estimator; host state, if any, goes into st->host after. */
+RTCP_CORE_API void rtcp_save(const struct PMODRL *pmodrl, struct rtcp_state *st)
+{
+	memset(st, 0, sizeof(*st));
+	st->version = RTCP_STATE_VERSION;
+	RTCP_STATE_COPY(st, pmodrl);
+	st->clock_base_us = pmodrl->clock_base_us;
+	st->corr_R = pmodrl->corr_R;
+	st->dis_rounds = pmodrl->dis_rounds;
+	st->tb_level = pmodrl->tb_level;
+	st->tb_over = pmodrl->tb_over;
+	st->tb_us = pmodrl->tb_us;
+	st->tb_delivered = pmodrl->tb_delivered;
+	st->tb_sync_us = pmodrl->tb_sync_us;
+	st->probe_us = pmodrl->probe_us;
+	st->probe_lost = pmodrl->probe_lost;
+	st->probe_backoff = pmodrl->probe_backoff;
+	st->win_us = pmodrl->win_us;
+	st->win_delivered = pmodrl->win_delivered;
+	st->win_next_us = pmodrl->win_next_us;
+	st->win_next_delivered = pmodrl->win_next_delivered;
+	memcpy(st->win_R, pmodrl->win_R, sizeof(st->win_R));
+	st->corr_B = pmodrl->corr_B;
+	st->tb_gap = pmodrl->tb_gap;
+	st->tb_full = pmodrl->tb_full;
+	st->pl_R = pmodrl->pl_R;
+	st->pl_us = pmodrl->pl_us;
+	st->pl_delivered = pmodrl->pl_delivered;
+	st->pl_lost = pmodrl->pl_lost;
+	st->pl_round_lost = pmodrl->pl_round_lost;
+	st->pl_interval_us = pmodrl->pl_interval_us;
+	st->pl_rounds = pmodrl->pl_rounds;
+	st->pl_loss_rounds = pmodrl->pl_loss_rounds;
+	st->pl_count = pmodrl->pl_count;
+	st->plateau_flag = pmodrl->plateau_flag;
+	memcpy(st->fit_level, pmodrl->fit.level, sizeof(st->fit_level));
+	st->fit_peak = pmodrl->fit.peak;
+	st->fit_peak_R = pmodrl->fit.peak_R;
+	st->fit_ons_B = pmodrl->fit.ons_B;
+	st->fit_sus_B = pmodrl->fit.sus_B;
+	st->fit_ons_T_us = pmodrl->fit.ons_T_us;
+	st->fit_ons_us = pmodrl->fit.ons_us;
+	st->fit_ons_delivered = pmodrl->fit.ons_delivered;
+	st->fit_start_us = pmodrl->fit.start_us;
+	st->fit_start_delivered = pmodrl->fit.start_delivered;
+	st->fit_loss_us = pmodrl->fit.loss_us;
+	st->fit_us = pmodrl->fit.us;
+	st->fit_delivered = pmodrl->fit.delivered;
+	st->fit_lost = pmodrl->fit.lost;
+	st->fit_offered = pmodrl->fit.offered;
+	memcpy(st->fit_miss, pmodrl->fit.miss, sizeof(st->fit_miss));
+	memcpy(st->fit_err, pmodrl->fit.err, sizeof(st->fit_err));
+	st->fit_ons_n = pmodrl->fit.ons_n;
+	st->fit_rounds = pmodrl->fit.rounds;
+	st->model_B = pmodrl->model_B;
+	st->model_R = pmodrl->model_R;
+	st->model_P = pmodrl->model_P;
+	st->model = pmodrl->model;
+	st->tick_bytes = pmodrl->tick_bytes;
+	st->tick_us = pmodrl->tick_us;
+	st->tick = pmodrl->tick;
+	st->classify_ticks = pmodrl->classify_ticks;
+	st->probe_rounds = pmodrl->probe_rounds;
+	st->classify_rounds = pmodrl->classify_rounds;
+}
+
+/* Load the estimator from a saved state, keeping ops, ctx and the history
+ * buffer. Returns false, leaving pmodrl untouched, for a format this build
+ * does not know.
+ */
+RTCP_CORE_API bool rtcp_restore(struct PMODRL *pmodrl, const struct rtcp_state *st)
+{
+	if(st->version < 1 || st->version > RTCP_STATE_VERSION){
+		return false;
+	}
+	RTCP_STATE_COPY(pmodrl, st);
+	if(st->version >= 2){
+		pmodrl->clock_base_us = st->clock_base_us;
+	}
+	if(st->version >= 3){
+		pmodrl->corr_R = st->corr_R;
+		pmodrl->dis_rounds = st->dis_rounds;
+	}
+	else{
+		pmodrl->dis_enable_flag = DIS_IDLE;
+	}
+	if(st->version >= 4){
+		pmodrl->tb_level = st->tb_level;
+		pmodrl->tb_over = st->tb_over;
+		pmodrl->tb_us = st->tb_us;
+		pmodrl->tb_delivered = st->tb_delivered;
+		pmodrl->tb_sync_us = st->tb_sync_us;
+		pmodrl->probe_us = st->probe_us;
+		pmodrl->probe_lost = st->probe_lost;
+		pmodrl->probe_backoff = st->probe_backoff;
+	}
+	else{
+		/* no model: start one, and let a running probe go by rounds */
+		pmodrl->tb_us = 0;
+		pmodrl->probe_lost = st->lastest_ack_loss;
+		pmodrl->tb_over = 0;
+	}
+	if(st->version >= 5){
+		pmodrl->win_us = st->win_us;
+		pmodrl->win_delivered = st->win_delivered;
+		pmodrl->win_next_us = st->win_next_us;
+		pmodrl->win_next_delivered = st->win_next_delivered;
+		memcpy(pmodrl->win_R, st->win_R, sizeof(pmodrl->win_R));
+	}
+	else{
+		/* no window: start one at the next drop */
+		pmodrl->win_us = 0;
+		pmodrl->win_next_us = 0;
+		memset(pmodrl->win_R, 0, sizeof(pmodrl->win_R));
+	}
+	if(st->version >= 6){
+		pmodrl->corr_B = st->corr_B;
+		pmodrl->tb_gap = st->tb_gap;
+		pmodrl->tb_full = st->tb_full;
+	}
+	else{
+		/* not refined yet: wait for the model to fill */
+		pmodrl->corr_B = 0;
+		pmodrl->tb_gap = 0;
+		pmodrl->tb_full = 0;
+	}
+	if(st->version >= 7){
+		pmodrl->pl_R = st->pl_R;
+		pmodrl->pl_us = st->pl_us;
+		pmodrl->pl_delivered = st->pl_delivered;
+		pmodrl->pl_lost = st->pl_lost;
+		pmodrl->pl_round_lost = st->pl_round_lost;
+		pmodrl->pl_interval_us = st->pl_interval_us;
+		pmodrl->pl_rounds = st->pl_rounds;
+		pmodrl->pl_loss_rounds = st->pl_loss_rounds;
+		pmodrl->pl_count = st->pl_count;
+		pmodrl->plateau_flag = st->plateau_flag;
+	}
+	else{
+		/* no plateau yet: start a window */
+		pmodrl->pl_us = 0;
+		pmodrl->pl_count = 0;
+		pmodrl->pl_R = 0;
+		pmodrl->plateau_flag = 0;
+	}
+	if(st->version >= 8 && st->model < RTCP_MODELS){
+		memcpy(pmodrl->fit.level, st->fit_level, sizeof(pmodrl->fit.level));
+		pmodrl->fit.peak = st->fit_peak;
+		pmodrl->fit.peak_R = st->fit_peak_R;
+		pmodrl->fit.ons_B = st->fit_ons_B;
+		pmodrl->fit.sus_B = st->fit_sus_B;
+		pmodrl->fit.ons_T_us = st->fit_ons_T_us;
+		pmodrl->fit.ons_us = st->fit_ons_us;
+		pmodrl->fit.ons_delivered = st->fit_ons_delivered;
+		pmodrl->fit.start_us = st->fit_start_us;
+		pmodrl->fit.start_delivered = st->fit_start_delivered;
+		pmodrl->fit.loss_us = st->fit_loss_us;
+		pmodrl->fit.us = st->fit_us;
+		pmodrl->fit.delivered = st->fit_delivered;
+		pmodrl->fit.lost = st->fit_lost;
+		pmodrl->fit.offered = st->fit_offered;
+		memcpy(pmodrl->fit.miss, st->fit_miss, sizeof(pmodrl->fit.miss));
+		memcpy(pmodrl->fit.err, st->fit_err, sizeof(pmodrl->fit.err));
+		pmodrl->fit.ons_n = st->fit_ons_n;
+		pmodrl->fit.rounds = st->fit_rounds;
+		pmodrl->model_B = st->model_B;
+		pmodrl->model_R = st->model_R;
+		pmodrl->model_P = st->model_P;
+		pmodrl->model = st->model;
+	}
+	else{
+		/* no fit yet: a token bucket until the models are replayed */
+		memset(&pmodrl->fit, 0, sizeof(pmodrl->fit));
+		pmodrl->model = RTCP_MODEL_BUCKET;
+	}
+	if(st->version >= 9){
+		pmodrl->tick_bytes = st->tick_bytes;
+		pmodrl->tick_us = st->tick_us;
+		pmodrl->tick = st->tick;
+		pmodrl->classify_ticks = st->classify_ticks;
+	}
+	else{
+		/* the next ACK ticks and starts a window */
+		pmodrl->tick_bytes = 0;
+		pmodrl->tick_us = 0;
+		pmodrl->tick = 0;
+		pmodrl->classify_ticks = 0;
+	}
+	if(st->version >= 10){
+		pmodrl->probe_rounds = st->probe_rounds;
+		pmodrl->classify_rounds = st->classify_rounds;
+	}
+	else{
+		/* count the rounds afresh */
+		pmodrl->probe_rounds = 0;
+		pmodrl->classify_rounds = 0;
+	}
+	return true;
+}
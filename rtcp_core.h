@@ -0,0 +1,370 @@
+/*
+ * R-TCP: engine state and per-ACK sample
+ *
+ * Plain data types shared by every build of the engine: the kernel module
+ * (rtcp.h), the BPF struct_ops program (bpf/) and the userspace library
+ * (user/). This header includes nothing; the includer provides
+ * u8/u16/u32/u64, s32 and bool.
+ */
+#ifndef _RTCP_CORE_H
+#define _RTCP_CORE_H
+
+/* B_arr is in pkts << RTCP_BW_SCALE, R_arr in pkts/uSec << RTCP_BW_SCALE, the
+ * same unit as BBR's bandwidth model.
+ */
+#define RTCP_BW_SCALE 24
+#define RTCP_BW_UNIT (1 << RTCP_BW_SCALE)
+
+/* Number of (B, R) hypotheses tracked per flow */
+#define RTCP_GRID 9
+
+/* Size of the per-flow history string */
+#define MAX_STR_LEN 5000
+
+/* Events raised to the host congestion control */
+enum rtcp_event {
+	RTCP_EV_CLASSIFYING,	/* policer evidence found, drop own policer model */
+	RTCP_EV_PROBE,		/* cap raised by gamma, start probing for bw */
+};
+
+struct rtcp_ops {
+	void (*event)(void *ctx, enum rtcp_event ev);
+};
+
+/* Policer models the engine fits, pmodrl->model */
+enum rtcp_model {
+	RTCP_MODEL_BUCKET,	/* token bucket: B, refilled at R */
+	RTCP_MODEL_DUAL,	/* token bucket behind a peak bucket at P */
+	RTCP_MODELS,
+};
+
+/* Model fit state: loss onset statistics and each model's replay of the
+ * flow's offered packets (rtcp_core.c, model_pmodrl).
+ */
+struct rtcp_fit {
+	u64 level[RTCP_MODELS];	/* replayed tokens, DUAL's sustained bucket */
+	u64 peak;		/* DUAL's replayed peak bucket */
+	u64 peak_R;		/* the last windowed rate */
+	u64 ons_B;		/* delivered from one loss onset to the next, mean */
+	u32 ons_T_us;		/* time from one to the next, mean */
+	u32 ons_us;		/* last loss onset */
+	u32 ons_delivered;	/* delivered at it */
+	u32 start_us;		/* first ACK of the transfer, buckets full */
+	u32 start_delivered;	/* delivered at it */
+	u64 sus_B;		/* DUAL's sustained bucket */
+	u32 loss_us;		/* last ACK with a new loss */
+	u32 us;			/* last replay step, 0 if not replaying */
+	u32 delivered;		/* delivered at it */
+	u32 lost;		/* lost at it */
+	u32 offered;		/* packets offered this round */
+	u32 miss[RTCP_MODELS];	/* packets each replay got wrong this round */
+	u32 err[RTCP_MODELS];	/* fit error, 1/1024 of what was offered */
+	u8 ons_n;		/* onsets seen, up to 255 */
+	u8 rounds;		/* rounds replayed, up to 255 */
+};
+
+/* Per-ACK input of the engine, taken from tcp_sock and rate_sample */
+struct rtcp_sample {
+	u32 now_us;		/* wall-clock time of this ACK */
+	u32 min_rtt_us;		/* host's current min_rtt estimate */
+	u32 delivered;		/* tp->delivered */
+	u32 lost;		/* tp->lost */
+	u32 acked;		/* tp->snd_una / mss, used with use_goodput */
+	u64 bytes_acked;	/* tp->bytes_acked */
+	u32 prior_delivered;	/* rs->prior_delivered */
+	s32 rs_delivered;	/* rs->delivered */
+	long interval_us;	/* rs->interval_us */
+	u8 app_limited:1,	/* rs->is_app_limited */
+	   rwnd_limited:1,	/* sender is limited by the receive window */
+	   rto_exit:1,		/* just left TCP_CA_Loss */
+	   unused:5;
+};
+
+struct PMODRL {
+	u64   B_arr[RTCP_GRID];
+	u64   R_arr[RTCP_GRID];
+	u8 best_index;
+	u8 classify;
+	u32 classify_time_us;
+	u8 high_loss_flag;
+	u32 loss_start_time_us;
+	u32 before_loss_delivered;
+	u32 before_loss_time_us;
+	u32 before_loss_lost;
+	u32 bbr_start_us;
+	u64 bef_empty_goodput;
+	u32 nominator;
+
+	u32 latest_ack_us;
+	u32 lastest_ack_loss;
+	u64 detected_bytes_acked;
+	u32 detected_time;
+
+	u8 disable_flag;
+
+	u64 mem_B;
+	u64 mem_R;
+
+	u8 probe_rtt_flag;
+
+	u8 upper_bound;
+	u32 round_count;
+	u32 round_count_no;
+	u32 next_rtt_delivered;
+	u8 round_start;
+
+	u32 transfer_start_deliverd;
+	u32 transfer_start_lost;
+
+	u8 reset_ltbw_flag;
+
+	char* buffer;
+	u32 store_interval;
+
+	u64 acc_rto_dur;
+
+	u64	cycle_mstamp;	     /* host scratch: BBR's cycle phase start */
+	u64	clock_base_us;	     /* host scratch: deterministic clock origin */
+
+	u64 dis_loss_start;	/* loss correction window: lost at start */
+	u64 dis_deliver_start;	/* delivered at start */
+	u8 dis_enable_flag;	/* correction state, DIS_* in rtcp_core.c */
+	u8 dis_rounds;		/* rounds in the window */
+	u64 corr_R;		/* cap corrected for loss or by a probe, 0 if none */
+
+	u64 tb_level;		/* modelled bucket behind the cap, as B_arr */
+	u64 tb_over;		/* delivered beyond it since the probe started */
+	u32 tb_us;		/* time of the last update, 0 if not modelled */
+	u32 tb_delivered;	/* delivered at the last update */
+	u32 tb_sync_us;		/* last time a drop showed the bucket empty */
+	u32 probe_us;		/* probe start */
+	u32 probe_lost;		/* lost at probe start */
+	u8 probe_backoff;	/* probes in a row that found nothing */
+	u8 tb_full;		/* model bucket full since the last drop */
+	u64 tb_gap;		/* delivered beyond it since then */
+	u64 corr_B;		/* bucket refined by later drops, 0 if not */
+
+	u32 win_us;		/* rate window start: a drop seen, 0 if none yet */
+	u32 win_delivered;	/* delivered once what went before is acked */
+	u32 win_next_us;	/* a later drop, the next window start */
+	u32 win_next_delivered;	/* delivered when it was seen */
+	u64 win_R[2];		/* highest windowed rate, this and last round */
+
+	u32 pl_us;		/* plateau window start, 0 if none */
+	u32 pl_delivered;	/* delivered at its start */
+	u32 pl_lost;		/* lost at its start */
+	u32 pl_round_lost;	/* lost at the start of this round */
+	u32 pl_interval_us;	/* longest rate sample interval in it */
+	u8 pl_rounds;		/* rounds in it */
+	u8 pl_loss_rounds;	/* rounds in it with a drop */
+	u8 pl_count;		/* windows in a row on the plateau */
+	u8 plateau_flag;	/* policer found by its plateau, no abrupt drop */
+	u64 pl_R;		/* delivery rate of the last window */
+
+	u8 model;		/* RTCP_MODEL_*, the best fit */
+	u64 model_B;		/* its B, R and peak rate P, unless a bucket */
+	u64 model_R;
+	u64 model_P;
+	struct rtcp_fit fit;
+
+	u8 tick;		/* a round, window_ms or window_kb ended */
+	u8 classify_ticks;	/* ticks the estimate has been stable */
+	u8 classify_rounds;	/* and rounds */
+	u32 probe_rounds;	/* rounds since the last probe */
+	u32 tick_us;		/* time of the last tick */
+	u64 tick_bytes;		/* bytes_acked at it */
+
+	const struct rtcp_ops *ops;
+	void *ctx;
+};
+
+/* Serialised engine state, handed from one module version to the next when
+ * a socket switches congestion control (rtcp_handover_put/take in rtcp.h).
+ * Fields are only appended; version tells the reader which ones are set.
+ * In the kernel both ends run the engine of the one loaded rtcp.ko, so only
+ * the host changes across a handover. The versions keep the format safe
+ * to restore should an engine ever be built into a host.
+ * The host algorithm may carry its own state in host[], tagged with its
+ * family name so that only a host of the same family restores it.
+ */
+#define RTCP_STATE_VERSION	10
+#define RTCP_STATE_FAMILY_LEN	16
+#define RTCP_STATE_HOST_MAX	128
+
+struct rtcp_state {
+	u16 version;
+	u16 host_len;				/* bytes used in host[] */
+	char family[RTCP_STATE_FAMILY_LEN];	/* host family, e.g. "rtcp_bbr" */
+
+	/* version 1 */
+	u64 B_arr[RTCP_GRID];
+	u64 R_arr[RTCP_GRID];
+	u64 bef_empty_goodput;
+	u64 detected_bytes_acked;
+	u64 mem_B;
+	u64 mem_R;
+	u64 acc_rto_dur;
+	u64 dis_loss_start;
+	u64 dis_deliver_start;
+	u32 classify_time_us;
+	u32 loss_start_time_us;
+	u32 before_loss_delivered;
+	u32 before_loss_time_us;
+	u32 before_loss_lost;
+	u32 bbr_start_us;
+	u32 nominator;
+	u32 latest_ack_us;
+	u32 lastest_ack_loss;
+	u32 detected_time;
+	u32 round_count;
+	u32 round_count_no;
+	u32 next_rtt_delivered;
+	u32 transfer_start_deliverd;
+	u32 transfer_start_lost;
+	u32 store_interval;
+	u8 best_index;
+	u8 classify;
+	u8 high_loss_flag;
+	u8 disable_flag;
+	u8 probe_rtt_flag;
+	u8 upper_bound;
+	u8 round_start;
+	u8 reset_ltbw_flag;
+	u8 dis_enable_flag;
+
+	u8 host[RTCP_STATE_HOST_MAX];
+
+	/* version 2 */
+	u64 clock_base_us;
+
+	/* version 3 */
+	u64 corr_R;
+	u8 dis_rounds;
+
+	/* version 4 */
+	u64 tb_level;
+	u64 tb_over;
+	u32 tb_us;
+	u32 tb_delivered;
+	u32 tb_sync_us;
+	u32 probe_us;
+	u32 probe_lost;
+	u8 probe_backoff;
+
+	/* version 5 */
+	u64 win_R[2];
+	u32 win_us;
+	u32 win_delivered;
+	u32 win_next_us;
+	u32 win_next_delivered;
+
+	/* version 6 */
+	u64 corr_B;
+	u64 tb_gap;
+	u8 tb_full;
+
+	/* version 7 */
+	u64 pl_R;
+	u32 pl_us;
+	u32 pl_delivered;
+	u32 pl_lost;
+	u32 pl_round_lost;
+	u32 pl_interval_us;
+	u8 pl_rounds;
+	u8 pl_loss_rounds;
+	u8 pl_count;
+	u8 plateau_flag;
+
+	/* version 8, struct rtcp_fit field by field */
+	u64 fit_level[RTCP_MODELS];
+	u64 fit_peak;
+	u64 fit_peak_R;
+	u64 fit_ons_B;
+	u64 fit_sus_B;
+	u32 fit_ons_T_us;
+	u32 fit_ons_us;
+	u32 fit_ons_delivered;
+	u32 fit_start_us;
+	u32 fit_start_delivered;
+	u32 fit_loss_us;
+	u32 fit_us;
+	u32 fit_delivered;
+	u32 fit_lost;
+	u32 fit_offered;
+	u32 fit_miss[RTCP_MODELS];
+	u32 fit_err[RTCP_MODELS];
+	u8 fit_ons_n;
+	u8 fit_rounds;
+	u64 model_B;
+	u64 model_R;
+	u64 model_P;
+	u8 model;
+
+	/* version 9 */
+	u64 tick_bytes;
+	u32 tick_us;
+	u8 tick;
+	u8 classify_ticks;
+
+	/* version 10 */
+	u32 probe_rounds;
+	u8 classify_rounds;
+};
+
+/* Estimated token bucket size and rate of the best hypothesis */
+static inline u64 rtcp_grid_B(const struct PMODRL *pmodrl)
+{
+	u8 i = pmodrl->best_index;
+
+	if (i >= RTCP_GRID)	/* bound for the BPF verifier */
+		return 0;
+	return pmodrl->B_arr[i];
+}
+
+static inline u64 rtcp_grid_R(const struct PMODRL *pmodrl)
+{
+	u8 i = pmodrl->best_index;
+
+	if (i >= RTCP_GRID)
+		return 0;
+	return pmodrl->R_arr[i];
+}
+
+/* The policer model's fit: the best hypothesis for a token bucket, the
+ * model's own otherwise.
+ */
+static inline u64 rtcp_model_B(const struct PMODRL *pmodrl)
+{
+	if (pmodrl->model != RTCP_MODEL_BUCKET)
+		return pmodrl->model_B;
+	return rtcp_grid_B(pmodrl);
+}
+
+static inline u64 rtcp_model_R(const struct PMODRL *pmodrl)
+{
+	if (pmodrl->model != RTCP_MODEL_BUCKET)
+		return pmodrl->model_R;
+	return rtcp_grid_R(pmodrl);
+}
+
+/* Bucket size: the model's B, unless drops after detection have refined
+ * it.
+ */
+static inline u64 rtcp_B(const struct PMODRL *pmodrl)
+{
+	if (pmodrl->corr_B)
+		return pmodrl->corr_B;
+	return rtcp_model_B(pmodrl);
+}
+
+/* Rate to cap at: the model's R, unless loss under the cap has corrected
+ * it down or a loss-free probe up.
+ */
+static inline u64 rtcp_R(const struct PMODRL *pmodrl)
+{
+	if (pmodrl->corr_R)
+		return pmodrl->corr_R;
+	return rtcp_model_R(pmodrl);
+}
+
+#endif /* _RTCP_CORE_H */
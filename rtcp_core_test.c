@@ -0,0 +1,462 @@
+/*
+ * R-TCP: engine test cases and per-ACK benchmark
+ *
+ * Like rtcp_core.c, this file is not built on its own: rtcp_test.c includes
+ * it into a KUnit suite and user/rtcp_test.c into a userspace runner, each
+ * after rtcp_core.c, so the cases can reach the engine's static functions.
+ * Before including it, the includer provides the KUnit calls used here
+ * (struct kunit, KUNIT_EXPECT_*() and KUNIT_ASSERT_*(), kunit_info(),
+ * kunit_kzalloc()) and rtcp_test_ns(), a monotonic clock in ns.
+ *
+ * The curves are the ones of user/rtcp_bench: an open-loop sender at a
+ * constant rate through a token-bucket policer with a fixed RTT, generated
+ * in integer arithmetic one ACK at a time.
+ *
+ * The R-TCP module was designed and implemented by
+ * Shengtong Zhu, Yan Liu, Lingfeng Guo and Jack Y. B. Lee,
+ *  "R-TCP: A Framework to Optimize TCP Performance Over Rate-Limiting Networks", NSDI, 2026.
+ *
+ * Contact  : zs021@ie.cuhk.edu.hk
+ */
+
+#define RTCP_TEST_MSS		1448
+/* Packets in flight the generator keeps, more than any curve has */
+#define RTCP_TEST_RING		1024
+/* ACKs per timed chunk of the benchmark */
+#define RTCP_TEST_CHUNK		256
+
+struct rtcp_test_curve {
+	const char *name;
+	u32 rate_kbps;		/* policer token rate, 0 for no policer */
+	u32 bucket_kb;		/* policer bucket */
+	u32 send_kbps;		/* sender rate */
+	u32 rtt_ms;
+	u32 duration_s;
+	/* most the estimate may be off once classified, in 1/1000 */
+	u32 B_tol;
+	u32 R_tol;
+};
+
+static const struct rtcp_test_curve rtcp_test_curves[] = {
+	{ "unpoliced",	0,	0,	20000,	40,	60 },
+	{ "policed",	10000,	1000,	20000,	40,	60,	200,	50 },
+	{ "small-B",	10000,	100,	20000,	40,	60,	200,	50 },
+	{ "large-B",	10000,	10000,	20000,	40,	60,	200,	50 },
+	{ "slow-R",	1000,	1000,	4000,	80,	60,	200,	50 },
+	{ "fast-R",	100000,	5000,	200000,	20,	20,	200,	50 },
+	{ "long-RTT",	10000,	1000,	20000,	300,	60,	200,	50 },
+};
+
+struct rtcp_test_pkt {
+	u64 send_ns;
+	u64 delivered_ns;	/* delivered_mstamp at send */
+	u64 first_tx_ns;	/* first_tx_mstamp at send */
+	u32 delivered;		/* delivered at send */
+	u8 dropped;
+};
+
+struct rtcp_test_gen {
+	const struct rtcp_test_curve *c;
+	struct rtcp_test_pkt pkt[RTCP_TEST_RING];
+	u64 gap_ns;		/* between sends */
+	u64 rtt_ns;
+	u64 end_ns;
+	u64 tokens;		/* bytes * 8000, as the rate is in kbit/s */
+	u64 token_ns;
+	u64 delivered_ns;
+	u64 first_tx_ns;
+	u32 base_us;		/* engine clock at time 0 */
+	u32 sent;		/* next packet to send */
+	u32 acked;		/* next packet to ack or find lost */
+	u32 delivered;
+	u32 lost;
+};
+
+static void rtcp_test_gen_init(struct rtcp_test_gen *g,
+			       const struct rtcp_test_curve *c, u32 base_us)
+{
+	memset(g, 0, sizeof(*g));
+	g->c = c;
+	g->gap_ns = div_u64((u64)RTCP_TEST_MSS * 8 * 1000000, c->send_kbps);
+	g->rtt_ns = (u64)c->rtt_ms * 1000000;
+	g->end_ns = (u64)c->duration_s * 1000000000;
+	g->tokens = (u64)c->bucket_kb * 1000 * 8000;
+	g->base_us = base_us;
+}
+
+/* Next ACK of the curve into s; false at the end. */
+static bool rtcp_test_gen_ack(struct rtcp_test_gen *g, struct rtcp_sample *s)
+{
+	for (;;) {
+		u64 send_ns = (u64)g->sent * g->gap_ns;
+		struct rtcp_test_pkt *p = &g->pkt[g->acked % RTCP_TEST_RING];
+
+		/* ACKs and losses due before the next send, all at the end */
+		if (g->acked < g->sent && (send_ns >= g->end_ns ||
+					   p->send_ns + g->rtt_ns <= send_ns)) {
+			u64 at = p->send_ns + g->rtt_ns, interval;
+
+			g->acked++;
+			if (p->dropped) {
+				g->lost++;
+				continue;
+			}
+			g->delivered++;
+			g->delivered_ns = at;
+			interval = max(p->send_ns - p->first_tx_ns,
+				       at - p->delivered_ns);
+			g->first_tx_ns = p->send_ns;
+
+			memset(s, 0, sizeof(*s));
+			s->now_us = g->base_us + (u32)div_u64(at, 1000);
+			s->min_rtt_us = (u32)div_u64(g->rtt_ns, 1000);
+			s->delivered = g->delivered;
+			s->lost = g->lost;
+			s->acked = g->delivered;
+			s->bytes_acked = (u64)g->delivered * RTCP_TEST_MSS;
+			s->prior_delivered = p->delivered;
+			s->rs_delivered = g->delivered - p->delivered;
+			s->interval_us = (long)div_u64(interval, 1000);
+			return true;
+		}
+		if (send_ns >= g->end_ns)
+			return false;
+
+		p = &g->pkt[g->sent % RTCP_TEST_RING];
+		if (g->sent == 0)
+			g->first_tx_ns = g->delivered_ns = send_ns;
+		p->send_ns = send_ns;
+		p->delivered = g->delivered;
+		p->delivered_ns = g->delivered_ns;
+		p->first_tx_ns = g->first_tx_ns;
+		p->dropped = 0;
+		if (g->c->rate_kbps) {
+			u64 cap = (u64)g->c->bucket_kb * 1000 * 8000;
+
+			g->tokens += div_u64((send_ns - g->token_ns) *
+					     g->c->rate_kbps, 1000);
+			g->tokens = min(g->tokens, cap);
+			g->token_ns = send_ns;
+			if (g->tokens < (u64)RTCP_TEST_MSS * 8000)
+				p->dropped = 1;
+			else
+				g->tokens -= (u64)RTCP_TEST_MSS * 8000;
+		}
+		g->sent++;
+	}
+}
+
+/* Estimate against the policer, in 1/1000: est / real - 1 */
+static s64 rtcp_test_err(u64 est, u64 real)
+{
+	return (s64)div_u64(est * 1000, (u32)real) - 1000;
+}
+
+/* Run a curve through a fresh engine; returns the final state. */
+static struct PMODRL *rtcp_test_run(struct kunit *test,
+				    const struct rtcp_test_curve *c,
+				    u32 base_us)
+{
+	struct rtcp_test_gen *g;
+	struct PMODRL *pmodrl;
+	struct rtcp_sample s;
+
+	g = kunit_kzalloc(test, sizeof(*g), GFP_KERNEL);
+	pmodrl = kunit_kzalloc(test, sizeof(*pmodrl), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, g);
+	KUNIT_ASSERT_NOT_NULL(test, pmodrl);
+	rtcp_test_gen_init(g, c, base_us);
+	while (rtcp_test_gen_ack(g, &s)) {
+		rtcp_ack(pmodrl, &s);
+		rtcp_ack_end(pmodrl, &s);
+	}
+	return pmodrl;
+}
+
+static void rtcp_test_check(struct kunit *test, const struct rtcp_test_curve *c,
+			    const struct PMODRL *pmodrl)
+{
+	s64 B_err, R_err;
+
+	if (!c->rate_kbps) {
+		KUNIT_EXPECT_NE_MSG(test, pmodrl->classify, 1,
+				    "%s: classified without a policer", c->name);
+		return;
+	}
+	KUNIT_EXPECT_EQ_MSG(test, pmodrl->classify, 1,
+			    "%s: policer not detected", c->name);
+	B_err = rtcp_test_err(rtcp_B(pmodrl) * RTCP_TEST_MSS >> BW_SCALE,
+			      (u64)c->bucket_kb * 1000);
+	R_err = rtcp_test_err((rtcp_R(pmodrl) * RTCP_TEST_MSS * USEC_PER_SEC) >>
+			      BW_SCALE, (u64)c->rate_kbps * 125);
+	KUNIT_EXPECT_LE_MSG(test, abs(B_err), (s64)c->B_tol,
+			    "%s: B off by %lld/1000", c->name, (long long)B_err);
+	KUNIT_EXPECT_LE_MSG(test, abs(R_err), (s64)c->R_tol,
+			    "%s: R off by %lld/1000", c->name, (long long)R_err);
+}
+
+/* Each curve is detected, or not, with B and R within its tolerance. */
+static void rtcp_test_curves_case(struct kunit *test)
+{
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(rtcp_test_curves); i++)
+		rtcp_test_check(test, &rtcp_test_curves[i],
+				rtcp_test_run(test, &rtcp_test_curves[i], 0));
+}
+
+/* The same, with the engine's u32 clock wrapping 2 s into the flow. */
+static void rtcp_test_wrap_case(struct kunit *test)
+{
+	const struct rtcp_test_curve *c = &rtcp_test_curves[1];
+
+	rtcp_test_check(test, c, rtcp_test_run(test, c, (u32)-(2 * USEC_PER_SEC)));
+}
+
+/* comp() takes |B[i] - B[best]| and |R[i] - R[best]| of u64 values through
+ * abs(), which must work on the signed difference: a grid listed the other
+ * way round picks the same hypothesis.
+ */
+static void rtcp_test_comp_abs_case(struct kunit *test)
+{
+	struct PMODRL *pmodrl = kunit_kzalloc(test, sizeof(*pmodrl), GFP_KERNEL);
+	const u64 B = 1ULL << 40, R = 1ULL << 20;
+	/* a flow 2^20 us long: i wins if B per R is over 2^19 us apart */
+	const u32 now_us = 1 + (1U << 20);
+	u8 i;
+
+	KUNIT_ASSERT_NOT_NULL(test, pmodrl);
+	pmodrl->bbr_start_us = 1;
+	for (i = 0; i < RTCP_GRID; i++) {
+		pmodrl->B_arr[i] = B - i * ((R << 19) + R);
+		pmodrl->R_arr[i] = R + i * R;
+	}
+	KUNIT_EXPECT_EQ(test, comp(pmodrl, now_us), RTCP_GRID - 1);
+	for (i = 0; i < RTCP_GRID; i++)
+		pmodrl->B_arr[i] = B + i * ((R << 19) + R);
+	KUNIT_EXPECT_EQ(test, comp(pmodrl, now_us), RTCP_GRID - 1);
+	for (i = 0; i < RTCP_GRID; i++)
+		pmodrl->R_arr[i] = R * RTCP_GRID - i * R;
+	KUNIT_EXPECT_EQ(test, comp(pmodrl, now_us), RTCP_GRID - 1);
+
+	/* exactly 2^19 us apart, either way: the first stays */
+	for (i = 0; i < RTCP_GRID; i++)
+		pmodrl->B_arr[i] = B - i * (R << 19);
+	KUNIT_EXPECT_EQ(test, comp(pmodrl, now_us), 0);
+	for (i = 0; i < RTCP_GRID; i++)
+		pmodrl->B_arr[i] = B + i * (R << 19);
+	KUNIT_EXPECT_EQ(test, comp(pmodrl, now_us), 0);
+	/* equal R: the later one */
+	for (i = 0; i < RTCP_GRID; i++)
+		pmodrl->R_arr[i] = R;
+	KUNIT_EXPECT_EQ(test, comp(pmodrl, now_us), RTCP_GRID - 1);
+}
+
+/* rtcp_grid_rates() leaves the grid alone while the flow is in its first
+ * millisecond, the guard the (s32)t < 1 checks on ms used to be, and
+ * divides by the elapsed us after, also across the wrap of the u32 clock.
+ */
+static void rtcp_test_young_case(struct kunit *test)
+{
+	struct PMODRL *pmodrl = kunit_kzalloc(test, sizeof(*pmodrl), GFP_KERNEL);
+	static const struct {
+		u32 start_us;
+		u32 age_us;
+		bool young;
+	} t[] = {
+		{ 999500,	400,	true },		/* same ms */
+		{ 999500,	500,	false },	/* the next */
+		{ 999500,	1200,	false },
+		/* 2^32 - 204, in ms 4294967, which the wrap cuts short:
+		 * young for the ms all the same
+		 */
+		{ -204U,	200,	true },
+		{ -204U,	908,	false },
+		{ -500U,	100,	true },
+		{ -500U,	1200,	false },	/* wraps */
+		{ -1500U,	1200,	false },
+	};
+	size_t k;
+	u8 i;
+
+	KUNIT_ASSERT_NOT_NULL(test, pmodrl);
+	for (k = 0; k < ARRAY_SIZE(t); k++) {
+		memset(pmodrl, 0, sizeof(*pmodrl));
+		pmodrl->bbr_start_us = t[k].start_us;
+		for (i = 0; i < RTCP_GRID; i++)
+			pmodrl->B_arr[i] = (u64)i * BW_UNIT;
+
+		KUNIT_EXPECT_EQ_MSG(test, rtcp_grid_rates(pmodrl, 100,
+				    t[k].start_us + t[k].age_us), !t[k].young,
+				    "start %u, %u us later", t[k].start_us,
+				    t[k].age_us);
+		for (i = 0; i < RTCP_GRID; i++)
+			KUNIT_EXPECT_EQ(test, pmodrl->R_arr[i], t[k].young ? 0 :
+					div_u64((100 - (u64)i) * BW_UNIT,
+						t[k].age_us));
+	}
+}
+
+/* When the best hypothesis is the largest B, estimation_classify() shifts
+ * the grid up by one step at a time until a smaller one fits, keeping the
+ * spacing and fitting each new hypothesis' R.
+ */
+static void rtcp_test_shift_case(struct kunit *test)
+{
+	struct PMODRL *pmodrl = kunit_kzalloc(test, sizeof(*pmodrl), GFP_KERNEL);
+	const u64 step = 100ULL * BW_UNIT;
+	struct rtcp_sample s;
+	u8 i;
+
+	KUNIT_ASSERT_NOT_NULL(test, pmodrl);
+	memset(&s, 0, sizeof(s));
+	s.now_us = 2 * USEC_PER_SEC;
+	s.min_rtt_us = 40000;
+	/* 9000 packets in the first 100 ms, 1000 in the 900 after: the
+	 * bucket is near 9000 packets, far beyond a grid of B up to 800
+	 */
+	s.delivered = s.acked = 10000;
+	pmodrl->bbr_start_us = USEC_PER_SEC;
+	pmodrl->high_loss_flag = 1;
+	pmodrl->before_loss_delivered = 9000;
+	pmodrl->before_loss_time_us = USEC_PER_SEC + 100000;
+	for (i = 0; i < RTCP_GRID; i++) {
+		pmodrl->B_arr[i] = (RTCP_GRID - 1 - i) * step;
+		pmodrl->R_arr[i] = div_u64(9000ULL * BW_UNIT - pmodrl->B_arr[i],
+					   100000);
+	}
+	KUNIT_ASSERT_EQ(test, comp(pmodrl, s.now_us), 0);
+
+	estimation_classify(pmodrl, &s);
+	KUNIT_EXPECT_NE(test, pmodrl->best_index, 0);
+	KUNIT_EXPECT_GE(test, pmodrl->B_arr[pmodrl->best_index], 8000ULL * BW_UNIT);
+	KUNIT_EXPECT_LE(test, pmodrl->B_arr[pmodrl->best_index], 9000ULL * BW_UNIT);
+	for (i = 0; i < RTCP_GRID; i++) {
+		if (i)
+			KUNIT_EXPECT_EQ(test, pmodrl->B_arr[i - 1] - pmodrl->B_arr[i],
+					step);
+		/* each R delivers what its B could not, in either span */
+		if (pmodrl->B_arr[i] < 10000ULL * BW_UNIT)
+			KUNIT_EXPECT_GE(test, pmodrl->R_arr[i],
+					div_u64(10000ULL * BW_UNIT - pmodrl->B_arr[i],
+						USEC_PER_SEC));
+		if (pmodrl->B_arr[i] < 9000ULL * BW_UNIT)
+			KUNIT_EXPECT_GE(test, pmodrl->R_arr[i],
+					div_u64(9000ULL * BW_UNIT - pmodrl->B_arr[i],
+						100000));
+	}
+}
+
+/* rtcp_save() and rtcp_restore() carry every field the engine goes on with:
+ * a flow restored halfway through the policed curve ends as the one that
+ * ran through.
+ */
+static void rtcp_test_state_case(struct kunit *test)
+{
+	const struct rtcp_test_curve *c = &rtcp_test_curves[1];
+	struct rtcp_test_gen *g = kunit_kzalloc(test, sizeof(*g), GFP_KERNEL);
+	struct PMODRL *a = kunit_kzalloc(test, sizeof(*a), GFP_KERNEL);
+	struct PMODRL *b = kunit_kzalloc(test, sizeof(*b), GFP_KERNEL);
+	struct rtcp_state *st = kunit_kzalloc(test, sizeof(*st), GFP_KERNEL);
+	struct rtcp_sample s;
+	bool saved = false;
+
+	KUNIT_ASSERT_NOT_NULL(test, g);
+	KUNIT_ASSERT_NOT_NULL(test, a);
+	KUNIT_ASSERT_NOT_NULL(test, b);
+	KUNIT_ASSERT_NOT_NULL(test, st);
+	rtcp_test_gen_init(g, c, 0);
+	while (rtcp_test_gen_ack(g, &s)) {
+		if (!saved && s.now_us >= c->duration_s * USEC_PER_SEC / 2) {
+			KUNIT_EXPECT_EQ(test, a->classify, 1);
+			KUNIT_EXPECT_GT(test, a->fit.ons_n, 0);
+			rtcp_save(a, st);
+			KUNIT_ASSERT_EQ(test, rtcp_restore(b, st), true);
+			KUNIT_EXPECT_EQ(test, memcmp(&a->fit, &b->fit, sizeof(a->fit)), 0);
+			saved = true;
+		}
+		rtcp_ack(a, &s);
+		rtcp_ack_end(a, &s);
+		if (saved) {
+			rtcp_ack(b, &s);
+			rtcp_ack_end(b, &s);
+		}
+	}
+	KUNIT_EXPECT_TRUE(test, saved);
+	KUNIT_EXPECT_EQ(test, b->classify, a->classify);
+	KUNIT_EXPECT_EQ(test, b->model, a->model);
+	KUNIT_EXPECT_EQ(test, rtcp_B(b), rtcp_B(a));
+	KUNIT_EXPECT_EQ(test, rtcp_R(b), rtcp_R(a));
+	KUNIT_EXPECT_EQ(test, memcmp(&a->fit, &b->fit, sizeof(a->fit)), 0);
+}
+
+/* rtcp_cap_gain() while probing: gamma over the gain, no faster than the
+ * peak rate of a dual bucket, and no division by a zero R.
+ */
+static void rtcp_test_cap_gain_case(struct kunit *test)
+{
+	struct PMODRL *pmodrl = kunit_kzalloc(test, sizeof(*pmodrl), GFP_KERNEL);
+	const int gain = 256, probe = gain * probe_per / 20;
+
+	KUNIT_ASSERT_NOT_NULL(test, pmodrl);
+	KUNIT_EXPECT_EQ(test, rtcp_cap_gain(pmodrl, gain), gain);
+	pmodrl->classify = 1;
+	pmodrl->nominator = 1;
+	KUNIT_EXPECT_EQ(test, rtcp_cap_gain(pmodrl, gain), probe);
+
+	pmodrl->model = RTCP_MODEL_DUAL;
+	pmodrl->model_P = 1ULL << 40;
+	KUNIT_EXPECT_EQ(test, rtcp_cap_gain(pmodrl, gain), probe);
+	pmodrl->model_R = 1;
+	KUNIT_EXPECT_EQ(test, rtcp_cap_gain(pmodrl, gain), probe);
+	pmodrl->model_R = 100ULL * BW_UNIT;
+	pmodrl->model_P = 105ULL * BW_UNIT;
+	KUNIT_EXPECT_EQ(test, rtcp_cap_gain(pmodrl, gain), gain * 105 / 100);
+}
+
+/* Cost of rtcp_ack() + rtcp_ack_end() per ACK on the policed curve, before
+ * the flow is classified and after; the minimum over passes.
+ */
+static void rtcp_test_bench_case(struct kunit *test)
+{
+	const struct rtcp_test_curve *c = &rtcp_test_curves[1];
+	struct rtcp_sample *s = kunit_kzalloc(test, RTCP_TEST_CHUNK * sizeof(*s),
+					      GFP_KERNEL);
+	struct rtcp_test_gen *g = kunit_kzalloc(test, sizeof(*g), GFP_KERNEL);
+	struct PMODRL *pmodrl = kunit_kzalloc(test, sizeof(*pmodrl), GFP_KERNEL);
+	u64 best[2] = { U64_MAX, U64_MAX };
+	int pass;
+
+	KUNIT_ASSERT_NOT_NULL(test, s);
+	KUNIT_ASSERT_NOT_NULL(test, g);
+	KUNIT_ASSERT_NOT_NULL(test, pmodrl);
+	for (pass = 0; pass < 5; pass++) {
+		u64 ns[2] = { 0, 0 }, acks[2] = { 0, 0 };
+		int n, i, k;
+
+		memset(pmodrl, 0, sizeof(*pmodrl));
+		rtcp_test_gen_init(g, c, 0);
+		do {
+			u64 t;
+
+			for (n = 0; n < RTCP_TEST_CHUNK &&
+			     rtcp_test_gen_ack(g, &s[n]); n++)
+				;
+			k = pmodrl->classify == 1;
+			t = rtcp_test_ns();
+			for (i = 0; i < n; i++) {
+				rtcp_ack(pmodrl, &s[i]);
+				rtcp_ack_end(pmodrl, &s[i]);
+			}
+			ns[k] += rtcp_test_ns() - t;
+			acks[k] += n;
+		} while (n == RTCP_TEST_CHUNK);
+		KUNIT_EXPECT_GT(test, acks[0], 0);
+		KUNIT_EXPECT_GT(test, acks[1], 0);
+		for (k = 0; k < 2; k++)
+			if (acks[k])
+				best[k] = min(best[k], div_u64(ns[k], (u32)acks[k]));
+	}
+	kunit_info(test, "rtcp_ack: %llu ns/ACK unclassified, %llu ns/ACK classified\n",
+		   (unsigned long long)best[0], (unsigned long long)best[1]);
+}
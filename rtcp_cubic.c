@@ -0,0 +1,869 @@
+/*
+ * R-TCP-CUBIC: CUBIC with R-TCP
+ *
+ * This is based on the TCP CUBIC implementation from Linux v5.4.0
+ * (see below for TCP CUBIC's original header).
+ *
+ * R-TCP runs in the rtcp engine module (see rtcp.h). While no rate limiting
+ * is detected this module behaves like stock CUBIC. Once the flow is
+ * classified as policed, the cubic window is bypassed: cwnd is capped at the
+ * BDP of the estimated token rate R and the pacing rate is set to R, and
+ * policer drops no longer cause a multiplicative decrease.
+ *
+ * CUBIC has no way to set its pacing rate from cong_avoid(), so this module
+ * implements cong_control() and repeats what tcp_cong_control() does for
+ * stock CUBIC (PRR, cong_avoid gated by tcp_may_raise_cwnd(),
+ * tcp_update_pacing_rate) when not capped, with the semantics of the kernel
+ * it is built for (see rtcp_compat.h).
+ *
+ * The R-TCP module was designed and implemented by
+ * Shengtong Zhu, Yan Liu, Lingfeng Guo and Jack Y. B. Lee,
+ *  "R-TCP: A Framework to Optimize TCP Performance Over Rate-Limiting Networks", NSDI, 2026.
+ *
+ * Contact  : zs021@ie.cuhk.edu.hk
+ */
+
+/*
+ * TCP CUBIC: Binary Increase Congestion control for TCP v2.3
+ * Home page:
+ *      http://netsrv.csc.ncsu.edu/twiki/bin/view/Main/BIC
+ * This is from the implementation of CUBIC TCP in
+ * Sangtae Ha, Injong Rhee and Lisong Xu,
+ *  "CUBIC: A New TCP-Friendly High-Speed TCP Variant"
+ *  in ACM SIGOPS Operating System Review, July 2008.
+ * Available from:
+ *  http://netsrv.csc.ncsu.edu/export/cubic_a_new_tcp_2008.pdf
+ *
+ * CUBIC integrates a new slow start algorithm, called HyStart.
+ * The details of HyStart are presented in
+ *  Sangtae Ha and Injong Rhee,
+ *  "Taming the Elephants: New TCP Slow Start", NCSU TechReport 2008.
+ * Available from:
+ *  http://netsrv.csc.ncsu.edu/export/hystart_techreport_2008.pdf
+ *
+ * All testing results are available from:
+ * http://netsrv.csc.ncsu.edu/wiki/index.php/TCP_Testing
+ *
+ * Unless CUBIC is enabled and congestion window is large
+ * this behaves the same as the original Reno.
+ */
+
+#include <linux/mm.h>
+#include <linux/module.h>
+#include <linux/math64.h>
+#include <net/tcp.h>
+#include <linux/inet_diag.h>
+#include "rtcp.h"
+#include "rtcp_compat.h"
+
+#define BICTCP_BETA_SCALE    1024	/* Scale factor beta calculation
+					 * max_cwnd = snd_cwnd * beta
+					 */
+#define	BICTCP_HZ		10	/* BIC HZ 2^10 = 1024 */
+
+/* Two methods of hybrid slow start */
+#define HYSTART_ACK_TRAIN	0x1
+#define HYSTART_DELAY		0x2
+
+/* Number of delay samples for detecting the increase of delay */
+#define HYSTART_MIN_SAMPLES	8
+#define HYSTART_DELAY_MIN	(4U<<3)
+#define HYSTART_DELAY_MAX	(16U<<3)
+#define HYSTART_DELAY_THRESH(x)	clamp(x, HYSTART_DELAY_MIN, HYSTART_DELAY_MAX)
+
+#define GAIN_SCALE 8	/* scaling factor for the R-TCP cap gains */
+#define GAIN_UNIT (1 << GAIN_SCALE)
+
+static int fast_convergence __read_mostly = 1;
+static int beta __read_mostly = 717;	/* = 717/1024 (BICTCP_BETA_SCALE) */
+static int initial_ssthresh __read_mostly;
+static int bic_scale __read_mostly = 41;
+static int tcp_friendliness __read_mostly = 1;
+
+static int hystart __read_mostly = 1;
+static int hystart_detect __read_mostly = HYSTART_ACK_TRAIN | HYSTART_DELAY;
+static int hystart_low_window __read_mostly = 16;
+static int hystart_ack_delta __read_mostly = 2;
+
+static u32 cube_rtt_scale __read_mostly;
+static u32 beta_scale __read_mostly;
+static u64 cube_factor __read_mostly;
+
+static int enable_printk = 1;
+
+/* While capped, cwnd is this gain times the BDP at the token rate, to
+ * tolerate delayed/stretched ACKs like BBR's steady-state cwnd_gain:
+ */
+static const int rtcp_cwnd_gain = GAIN_UNIT * 2;
+/* Never cap cwnd below this many packets: */
+static const u32 rtcp_cwnd_min_target = 4;
+
+/* Note parameters that are used for precomputing scale factors are read-only */
+module_param(fast_convergence, int, 0644);
+MODULE_PARM_DESC(fast_convergence, "turn on/off fast convergence");
+module_param(beta, int, 0644);
+MODULE_PARM_DESC(beta, "beta for multiplicative increase");
+module_param(initial_ssthresh, int, 0644);
+MODULE_PARM_DESC(initial_ssthresh, "initial value of slow start threshold");
+module_param(bic_scale, int, 0444);
+MODULE_PARM_DESC(bic_scale, "scale (scaled by 1024) value for bic function (bic_scale/1024)");
+module_param(tcp_friendliness, int, 0644);
+MODULE_PARM_DESC(tcp_friendliness, "turn on/off tcp friendliness");
+module_param(hystart, int, 0644);
+MODULE_PARM_DESC(hystart, "turn on/off hybrid slow start algorithm");
+module_param(hystart_detect, int, 0644);
+MODULE_PARM_DESC(hystart_detect, "hybrid slow start detection mechanisms"
+		 " 1: packet-train 2: delay 3: both packet-train and delay");
+module_param(hystart_low_window, int, 0644);
+MODULE_PARM_DESC(hystart_low_window, "lower bound cwnd for hybrid slow start");
+module_param(hystart_ack_delta, int, 0644);
+MODULE_PARM_DESC(hystart_ack_delta, "spacing between ack's indicating train (msecs)");
+module_param_named(enable_printk_external, enable_printk, int, 0644);
+
+/* BIC TCP Parameters */
+struct bictcp {
+	u32	cnt;		/* increase cwnd by 1 after ACKs */
+	u32	last_max_cwnd;	/* last maximum snd_cwnd */
+	u32	last_cwnd;	/* the last snd_cwnd */
+	u32	last_time;	/* time when updated last_cwnd */
+	u32	bic_origin_point;/* origin point of bic function */
+	u32	bic_K;		/* time to origin point
+				   from the beginning of the current epoch */
+	u32	delay_min;	/* min delay (msec << 3) */
+	u32	epoch_start;	/* beginning of an epoch */
+	u32	ack_cnt;	/* number of acks */
+	u32	tcp_cwnd;	/* estimated tcp cwnd */
+	u8	prev_ca_state:3,	/* CA state on previous ACK */
+		rtcp_capped:1,	/* cwnd and pacing follow the R-TCP cap */
+		unused:4;
+	u8	unused_b;
+	u8	sample_cnt;	/* number of samples to decide curr_rtt */
+	u8	found;		/* the exit point is found? */
+	u32	round_start;	/* beginning of each round */
+	u32	end_seq;	/* end_seq of the round */
+	u32	last_ack;	/* last time when the ACK spacing is close */
+	u32	curr_rtt;	/* the minimum rtt of current round */
+	u32	prior_snd_una;	/* snd_una on previous ACK, see bictcp_ack_flag() */
+
+	struct PMODRL* pmodrl;
+};
+
+static inline void bictcp_reset(struct bictcp *ca)
+{
+	ca->cnt = 0;
+	ca->last_max_cwnd = 0;
+	ca->last_cwnd = 0;
+	ca->last_time = 0;
+	ca->bic_origin_point = 0;
+	ca->bic_K = 0;
+	ca->delay_min = 0;
+	ca->epoch_start = 0;
+	ca->ack_cnt = 0;
+	ca->tcp_cwnd = 0;
+	ca->found = 0;
+}
+
+static inline u32 bictcp_clock(void)
+{
+#if HZ < 1000
+	return ktime_to_ms(ktime_get_real());
+#else
+	return jiffies_to_msecs(jiffies);
+#endif
+}
+
+static inline void bictcp_hystart_reset(struct sock *sk)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bictcp *ca = inet_csk_ca(sk);
+
+	ca->round_start = ca->last_ack = bictcp_clock();
+	ca->end_seq = tp->snd_nxt;
+	ca->curr_rtt = 0;
+	ca->sample_cnt = 0;
+}
+
+/* R-TCP engine events: pace once policing is suspected; probes need no
+ * action since cwnd and pacing follow rtcp_cap_gain().
+ */
+static void bictcp_rtcp_event(void *ctx, enum rtcp_event ev)
+{
+	struct sock *sk = ctx;
+
+	switch (ev) {
+	case RTCP_EV_CLASSIFYING:
+		cmpxchg(&sk->sk_pacing_status, SK_PACING_NONE, SK_PACING_NEEDED);
+		break;
+	case RTCP_EV_PROBE:
+		break;
+	}
+}
+
+static const struct rtcp_ops bictcp_rtcp_ops = {
+	.event		= bictcp_rtcp_event,
+};
+
+static void bictcp_init(struct sock *sk)
+{
+	struct bictcp *ca = inet_csk_ca(sk);
+
+	bictcp_reset(ca);
+	ca->prev_ca_state = TCP_CA_Open;
+	ca->rtcp_capped = 0;
+	ca->prior_snd_una = tcp_sk(sk)->snd_una;
+
+	ca->pmodrl = rtcp_alloc(&bictcp_rtcp_ops, sk, GFP_ATOMIC);
+	if (ca->pmodrl)
+		rtcp_clock_start(sk, ca->pmodrl);
+
+	if (hystart)
+		bictcp_hystart_reset(sk);
+
+	if (!hystart && initial_ssthresh)
+		tcp_sk(sk)->snd_ssthresh = initial_ssthresh;
+}
+
+static void bictcp_release(struct sock *sk)
+{
+	struct bictcp *ca = inet_csk_ca(sk);
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct inet_sock *inet = inet_sk(sk);
+
+	if (!ca->pmodrl)
+		return;
+	if (enable_printk) {
+		struct rtcp_flow_id id;
+
+		rtcp_flow_id(sk, &id);
+		printk(KERN_INFO "!!!Release sip:%pISc sp:%hu dip:%pISc dp:%hu p:%u c:%u B:%llu R:%llu b:%llu history:%s\n",
+				&id.src, ntohs(inet->inet_sport),
+				&id.dst, ntohs(inet->inet_dport),
+				tp->delivered, ca->pmodrl->classify, rtcp_B(ca->pmodrl), rtcp_R(ca->pmodrl), ca->pmodrl->detected_bytes_acked, ca->pmodrl->buffer);
+	}
+	rtcp_free(ca->pmodrl);
+	ca->pmodrl = NULL;
+}
+
+static void bictcp_cwnd_event(struct sock *sk, enum tcp_ca_event event)
+{
+	if (event == CA_EVENT_TX_START) {
+		struct bictcp *ca = inet_csk_ca(sk);
+		u32 now = tcp_jiffies32;
+		s32 delta;
+
+		delta = now - tcp_sk(sk)->lsndtime;
+
+		/* We were application limited (idle) for a while.
+		 * Shift epoch_start to keep cwnd growth to cubic curve.
+		 */
+		if (ca->epoch_start && delta > 0) {
+			ca->epoch_start += delta;
+			if (after(ca->epoch_start, now))
+				ca->epoch_start = now;
+		}
+
+		if (ca->pmodrl && tcp_sk(sk)->app_limited) {
+			struct rtcp_sample s;
+
+			rtcp_fill_sample(sk, ca->pmodrl, NULL, tcp_min_rtt(tcp_sk(sk)), &s);
+			rtcp_start(ca->pmodrl, &s);
+		}
+		return;
+	}
+}
+
+/* calculate the cubic root of x using a table lookup followed by one
+ * Newton-Raphson iteration.
+ * Avg err ~= 0.195%
+ */
+static u32 cubic_root(u64 a)
+{
+	u32 x, b, shift;
+	/*
+	 * cbrt(x) MSB values for x MSB values in [0..63].
+	 * Precomputed then refined by hand - Willy Tarreau
+	 *
+	 * For x in [0..63],
+	 *   v = cbrt(x << 18) - 1
+	 *   cbrt(x) = (v[x] + 10) >> 6
+	 */
+	static const u8 v[] = {
+		/* 0x00 */    0,   54,   54,   54,  118,  118,  118,  118,
+		/* 0x08 */  123,  129,  134,  138,  143,  147,  151,  156,
+		/* 0x10 */  157,  161,  164,  168,  170,  173,  176,  179,
+		/* 0x18 */  181,  185,  187,  190,  192,  194,  197,  199,
+		/* 0x20 */  200,  202,  204,  206,  209,  211,  213,  215,
+		/* 0x28 */  217,  219,  221,  222,  224,  225,  227,  229,
+		/* 0x30 */  231,  232,  234,  236,  237,  239,  240,  242,
+		/* 0x38 */  244,  245,  246,  248,  250,  251,  252,  254,
+	};
+
+	b = fls64(a);
+	if (b < 7) {
+		/* a in [0..63] */
+		return ((u32)v[(u32)a] + 35) >> 6;
+	}
+
+	b = ((b * 84) >> 8) - 1;
+	shift = (a >> (b * 3));
+
+	x = ((u32)(((u32)v[shift] + 10) << b)) >> 6;
+
+	/*
+	 * Newton-Raphson iteration
+	 *                         2
+	 * x    = ( 2 * x  +  a / x  ) / 3
+	 *  k+1          k         k
+	 */
+	x = (2 * x + (u32)div64_u64(a, (u64)x * (u64)(x - 1)));
+	x = ((x * 341) >> 10);
+	return x;
+}
+
+/*
+ * Compute congestion window to use.
+ */
+static inline void bictcp_update(struct bictcp *ca, u32 cwnd, u32 acked)
+{
+	u32 delta, bic_target, max_cnt;
+	u64 offs, t;
+
+	ca->ack_cnt += acked;	/* count the number of ACKed packets */
+
+	if (ca->last_cwnd == cwnd &&
+	    (s32)(tcp_jiffies32 - ca->last_time) <= HZ / 32)
+		return;
+
+	/* The CUBIC function can update ca->cnt at most once per jiffy.
+	 * On all cwnd reduction events, ca->epoch_start is set to 0,
+	 * which will force a recalculation of ca->cnt.
+	 */
+	if (ca->epoch_start && tcp_jiffies32 == ca->last_time)
+		goto tcp_friendliness;
+
+	ca->last_cwnd = cwnd;
+	ca->last_time = tcp_jiffies32;
+
+	if (ca->epoch_start == 0) {
+		ca->epoch_start = tcp_jiffies32;	/* record beginning */
+		ca->ack_cnt = acked;			/* start counting */
+		ca->tcp_cwnd = cwnd;			/* syn with cubic */
+
+		if (ca->last_max_cwnd <= cwnd) {
+			ca->bic_K = 0;
+			ca->bic_origin_point = cwnd;
+		} else {
+			/* Compute new K based on
+			 * (wmax-cwnd) * (srtt>>3 / HZ) / c * 2^(3*bictcp_HZ)
+			 */
+			ca->bic_K = cubic_root(cube_factor
+					       * (ca->last_max_cwnd - cwnd));
+			ca->bic_origin_point = ca->last_max_cwnd;
+		}
+	}
+
+	/* cubic function - calc*/
+	/* calculate c * time^3 / rtt,
+	 *  while considering overflow in calculation of time^3
+	 * (so time^3 is done by using 64 bit)
+	 * and without the support of division of 64bit numbers
+	 * (so all divisions are done by using 32 bit)
+	 *  also NOTE the unit of those veriables
+	 *	  time  = (t - K) / 2^bictcp_HZ
+	 *	  c = bic_scale >> 10
+	 * rtt  = (srtt >> 3) / HZ
+	 * !!! The following code does not have overflow problems,
+	 * if the cwnd < 1 million packets !!!
+	 */
+
+	t = (s32)(tcp_jiffies32 - ca->epoch_start);
+	t += msecs_to_jiffies(ca->delay_min >> 3);
+	/* change the unit from HZ to bictcp_HZ */
+	t <<= BICTCP_HZ;
+	do_div(t, HZ);
+
+	if (t < ca->bic_K)		/* t - K */
+		offs = ca->bic_K - t;
+	else
+		offs = t - ca->bic_K;
+
+	/* c/rtt * (t-K)^3 */
+	delta = (cube_rtt_scale * offs * offs * offs) >> (10+3*BICTCP_HZ);
+	if (t < ca->bic_K)                            /* below origin*/
+		bic_target = ca->bic_origin_point - delta;
+	else                                          /* above origin*/
+		bic_target = ca->bic_origin_point + delta;
+
+	/* cubic function - calc bictcp_cnt*/
+	if (bic_target > cwnd) {
+		ca->cnt = cwnd / (bic_target - cwnd);
+	} else {
+		ca->cnt = 100 * cwnd;              /* very small increment*/
+	}
+
+	/*
+	 * The initial growth of cubic function may be too conservative
+	 * when the available bandwidth is still unknown.
+	 */
+	if (ca->last_max_cwnd == 0 && ca->cnt > 20)
+		ca->cnt = 20;	/* increase cwnd 5% per RTT */
+
+tcp_friendliness:
+	/* TCP Friendly */
+	if (tcp_friendliness) {
+		u32 scale = beta_scale;
+
+		delta = (cwnd * scale) >> 3;
+		while (ca->ack_cnt > delta) {		/* update tcp cwnd */
+			ca->ack_cnt -= delta;
+			ca->tcp_cwnd++;
+		}
+
+		if (ca->tcp_cwnd > cwnd) {	/* if bic is slower than tcp */
+			delta = ca->tcp_cwnd - cwnd;
+			max_cnt = cwnd / delta;
+			if (ca->cnt > max_cnt)
+				ca->cnt = max_cnt;
+		}
+	}
+
+	/* The maximum rate of cwnd increase CUBIC allows is 1 packet per
+	 * 2 packets ACKed, meaning cwnd grows at 1.5x per RTT.
+	 */
+	ca->cnt = max(ca->cnt, 2U);
+}
+
+static void bictcp_cong_avoid(struct sock *sk, u32 ack, u32 acked)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bictcp *ca = inet_csk_ca(sk);
+
+	if (!tcp_is_cwnd_limited(sk))
+		return;
+
+	if (tcp_in_slow_start(tp)) {
+		if (hystart && after(ack, ca->end_seq))
+			bictcp_hystart_reset(sk);
+		acked = tcp_slow_start(tp, acked);
+		if (!acked)
+			return;
+	}
+	bictcp_update(ca, tp->snd_cwnd, acked);
+	tcp_cong_avoid_ai(tp, ca->cnt, acked);
+}
+
+static u32 bictcp_recalc_ssthresh(struct sock *sk)
+{
+	const struct tcp_sock *tp = tcp_sk(sk);
+	struct bictcp *ca = inet_csk_ca(sk);
+
+	/* Policer drops while capped: the cap already paces at the token
+	 * rate, so keep cwnd and the cubic state as they are.
+	 */
+	if (ca->rtcp_capped)
+		return max(tp->snd_cwnd, 2U);
+
+	ca->epoch_start = 0;	/* end of epoch */
+
+	/* Wmax and fast convergence */
+	if (tp->snd_cwnd < ca->last_max_cwnd && fast_convergence)
+		ca->last_max_cwnd = (tp->snd_cwnd * (BICTCP_BETA_SCALE + beta))
+			/ (2 * BICTCP_BETA_SCALE);
+	else
+		ca->last_max_cwnd = tp->snd_cwnd;
+
+	return max((tp->snd_cwnd * beta) / BICTCP_BETA_SCALE, 2U);
+}
+
+static void bictcp_state(struct sock *sk, u8 new_state)
+{
+	if (new_state == TCP_CA_Loss) {
+		bictcp_reset(inet_csk_ca(sk));
+		bictcp_hystart_reset(sk);
+	}
+}
+
+static void hystart_update(struct sock *sk, u32 delay)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bictcp *ca = inet_csk_ca(sk);
+
+	if (ca->found & hystart_detect)
+		return;
+
+	if (hystart_detect & HYSTART_ACK_TRAIN) {
+		u32 now = bictcp_clock();
+
+		/* first detection parameter - ack-train detection */
+		if ((s32)(now - ca->last_ack) <= hystart_ack_delta) {
+			ca->last_ack = now;
+			if ((s32)(now - ca->round_start) > ca->delay_min >> 4) {
+				ca->found |= HYSTART_ACK_TRAIN;
+				NET_INC_STATS(sock_net(sk),
+					      LINUX_MIB_TCPHYSTARTTRAINDETECT);
+				NET_ADD_STATS(sock_net(sk),
+					      LINUX_MIB_TCPHYSTARTTRAINCWND,
+					      tp->snd_cwnd);
+				tp->snd_ssthresh = tp->snd_cwnd;
+			}
+		}
+	}
+
+	if (hystart_detect & HYSTART_DELAY) {
+		/* obtain the minimum delay of more than sampling packets */
+		if (ca->sample_cnt < HYSTART_MIN_SAMPLES) {
+			if (ca->curr_rtt == 0 || ca->curr_rtt > delay)
+				ca->curr_rtt = delay;
+
+			ca->sample_cnt++;
+		} else {
+			if (ca->curr_rtt > ca->delay_min +
+			    HYSTART_DELAY_THRESH(ca->delay_min >> 3)) {
+				ca->found |= HYSTART_DELAY;
+				NET_INC_STATS(sock_net(sk),
+					      LINUX_MIB_TCPHYSTARTDELAYDETECT);
+				NET_ADD_STATS(sock_net(sk),
+					      LINUX_MIB_TCPHYSTARTDELAYCWND,
+					      tp->snd_cwnd);
+				tp->snd_ssthresh = tp->snd_cwnd;
+			}
+		}
+	}
+}
+
+/* Track delayed acknowledgment ratio using sliding window
+ * ratio = (15*ratio + sample) / 16
+ */
+static void bictcp_acked(struct sock *sk, const struct ack_sample *sample)
+{
+	const struct tcp_sock *tp = tcp_sk(sk);
+	struct bictcp *ca = inet_csk_ca(sk);
+	u32 delay;
+
+	/* Some calls are for duplicates without timetamps */
+	if (sample->rtt_us < 0)
+		return;
+
+	/* Discard delay samples right after fast recovery */
+	if (ca->epoch_start && (s32)(tcp_jiffies32 - ca->epoch_start) < HZ)
+		return;
+
+	delay = (sample->rtt_us << 3) / USEC_PER_MSEC;
+	if (delay == 0)
+		delay = 1;
+
+	/* first time call or link delay decreases */
+	if (ca->delay_min == 0 || ca->delay_min > delay)
+		ca->delay_min = delay;
+
+	/* hystart triggers when cwnd is larger than some threshold */
+	if (hystart && tcp_in_slow_start(tp) &&
+	    tp->snd_cwnd >= hystart_low_window)
+		hystart_update(sk, delay);
+}
+
+/* Same as tcp_cwnd_reduction() (PRR, RFC 6937) of the running kernel.
+ * Before 5.12 the bound below ssthresh is the conservative one, since the
+ * retransmission flags it also looked at are not known here.
+ */
+static void bictcp_cwnd_reduction(struct sock *sk, int newly_acked_sacked,
+				  int newly_lost, int flag)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	int sndcnt = 0;
+	int delta = tp->snd_ssthresh - tcp_packets_in_flight(tp);
+
+	if (newly_acked_sacked <= 0 || WARN_ON_ONCE(!tp->prior_cwnd))
+		return;
+
+	tp->prr_delivered += newly_acked_sacked;
+	if (delta < 0) {
+		u64 dividend = (u64)tp->snd_ssthresh * tp->prr_delivered +
+			       tp->prior_cwnd - 1;
+		sndcnt = div_u64(dividend, tp->prior_cwnd) - tp->prr_out;
+	} else if (RTCP_PRR_SSRB) {
+		sndcnt = max_t(int, tp->prr_delivered - tp->prr_out,
+			       newly_acked_sacked);
+		if (flag & RTCP_FLAG_SND_UNA_ADVANCED && !newly_lost)
+			sndcnt++;
+		sndcnt = min(delta, sndcnt);
+	} else {
+		sndcnt = min(delta, newly_acked_sacked);
+	}
+	/* Force a fast retransmit upon entering fast recovery */
+	sndcnt = max(sndcnt, (tp->prr_out ? 0 : 1));
+	tp->snd_cwnd = tcp_packets_in_flight(tp) + sndcnt;
+}
+
+/* Same as tcp_end_cwnd_reduction(), which the stack skips for modules with
+ * cong_control(): back to ssthresh when leaving CWR or Recovery, unless the
+ * reduction was undone.
+ */
+static void bictcp_end_cwnd_reduction(struct sock *sk, u8 prev_state)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+
+	if (tp->snd_ssthresh < TCP_INFINITE_SSTHRESH &&
+	    (prev_state == TCP_CA_CWR || tp->undo_marker)) {
+		tp->snd_cwnd = tp->snd_ssthresh;
+		tp->snd_cwnd_stamp = tcp_jiffies32;
+	}
+}
+
+/* Same as tcp_update_pacing_rate(): 200% of cwnd * mss / srtt in slow start,
+ * 120% in congestion avoidance (by default).
+ */
+static void bictcp_update_pacing_rate(struct sock *sk)
+{
+	const struct tcp_sock *tp = tcp_sk(sk);
+	u64 rate;
+
+	rate = (u64)tp->mss_cache * ((USEC_PER_SEC / 100) << 3);
+
+	if (tp->snd_cwnd < tp->snd_ssthresh / 2)
+		rate *= READ_ONCE(sock_net(sk)->ipv4.sysctl_tcp_pacing_ss_ratio);
+	else
+		rate *= READ_ONCE(sock_net(sk)->ipv4.sysctl_tcp_pacing_ca_ratio);
+
+	rate *= max(tp->snd_cwnd, tp->packets_out);
+
+	if (likely(tp->srtt_us))
+		do_div(rate, tp->srtt_us);
+
+	WRITE_ONCE(sk->sk_pacing_rate, min_t(u64, rate,
+					     sk->sk_max_pacing_rate));
+}
+
+/* Token rate R, with the probing gain, in pkts/uS << RTCP_BW_SCALE. */
+static u64 bictcp_rtcp_bw(struct sock *sk)
+{
+	struct bictcp *ca = inet_csk_ca(sk);
+
+	return rtcp_R(ca->pmodrl) * rtcp_cap_gain(ca->pmodrl, GAIN_UNIT) >> GAIN_SCALE;
+}
+
+/* Pacing rate of the cap, in bytes per second. */
+static unsigned long bictcp_rtcp_pacing_rate(struct sock *sk)
+{
+	u64 rate = bictcp_rtcp_bw(sk);
+
+	rate *= tcp_sk(sk)->mss_cache;
+	rate *= USEC_PER_SEC;
+	rate >>= RTCP_BW_SCALE;
+	return min_t(u64, rate, sk->sk_max_pacing_rate);
+}
+
+/* cwnd of the cap: rtcp_cwnd_gain * R * min_rtt. */
+static u32 bictcp_rtcp_cwnd(struct sock *sk)
+{
+	u32 min_rtt_us = tcp_min_rtt(tcp_sk(sk));
+	u64 w;
+
+	if (unlikely(min_rtt_us == ~0U))	 /* no valid RTT samples yet? */
+		return TCP_INIT_CWND;
+
+	w = bictcp_rtcp_bw(sk) * min_rtt_us;
+	w = ((w * rtcp_cwnd_gain) >> GAIN_SCALE) + RTCP_BW_UNIT - 1;
+	return max_t(u32, w >> RTCP_BW_SCALE, rtcp_cwnd_min_target);
+}
+
+/* Rate-based control while capped. Losses do not cut cwnd: after an RTO or
+ * a burst of policer drops, cwnd slow-starts back up to the cap, and snaps
+ * down to it if the cap was lowered.
+ */
+static void bictcp_rtcp_control(struct sock *sk, const struct rate_sample *rs)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	u32 cwnd = tp->snd_cwnd;
+
+	if (rs->acked_sacked > 0)
+		cwnd = min(cwnd + rs->acked_sacked, bictcp_rtcp_cwnd(sk));
+	cwnd = max(cwnd, rtcp_cwnd_min_target);
+	tp->snd_cwnd = min(cwnd, tp->snd_cwnd_clamp);
+	WRITE_ONCE(sk->sk_pacing_rate, bictcp_rtcp_pacing_rate(sk));
+}
+
+#if !RTCP_ACK_FLAGS
+/* The ACK flags tcp_ack() would pass to cong_control() since 6.10, as far
+ * as they can be told from the socket: snd_una moved, or the rate sample
+ * counted newly delivered data (cumulatively or by SACK).
+ */
+static int bictcp_ack_flag(struct sock *sk, const struct rate_sample *rs)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct bictcp *ca = inet_csk_ca(sk);
+	int flag = 0;
+
+	if (after(tp->snd_una, ca->prior_snd_una))
+		flag |= RTCP_FLAG_DATA_ACKED | RTCP_FLAG_SND_UNA_ADVANCED;
+	else if (rs->acked_sacked > 0)
+		flag |= RTCP_FLAG_DATA_SACKED;
+	ca->prior_snd_una = tp->snd_una;
+	return flag;
+}
+#endif
+
+/* Same as tcp_may_raise_cwnd(): grow cwnd on in-order delivery only
+ * (RFC 5681), or on any delivery once reordering is high.
+ */
+static bool bictcp_may_raise_cwnd(const struct sock *sk, int flag)
+{
+	if (tcp_sk(sk)->reordering >
+	    READ_ONCE(sock_net(sk)->ipv4.sysctl_tcp_reordering))
+		return flag & RTCP_FLAG_FORWARD_PROGRESS;
+
+	return flag & RTCP_FLAG_DATA_ACKED;
+}
+
+/* What tcp_cong_control() does for congestion controls without
+ * cong_control(), including the cwnd timestamp tcp_cong_avoid() updates.
+ */
+static void bictcp_stock_control(struct sock *sk, const struct rate_sample *rs,
+				 int flag)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+
+	if (tcp_in_cwnd_reduction(sk)) {
+		bictcp_cwnd_reduction(sk, rs->acked_sacked, rs->losses, flag);
+	} else if (bictcp_may_raise_cwnd(sk, flag)) {
+		bictcp_cong_avoid(sk, tp->snd_una, rs->acked_sacked);
+		tp->snd_cwnd_stamp = tcp_jiffies32;
+	}
+	bictcp_update_pacing_rate(sk);
+}
+
+static RTCP_CONG_CONTROL(bictcp_main)
+{
+	struct bictcp *ca = inet_csk_ca(sk);
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct inet_sock *inet = inet_sk(sk);
+	u8 state = inet_csk(sk)->icsk_ca_state;
+	struct rtcp_sample s;
+#if !RTCP_ACK_FLAGS
+	int flag = bictcp_ack_flag(sk, rs);
+#endif
+
+	if (ca->pmodrl) {
+		rtcp_fill_sample(sk, ca->pmodrl, rs, tcp_min_rtt(tp), &s);
+		rtcp_ack(ca->pmodrl, &s);
+	}
+
+	if (ca->pmodrl && rtcp_capped(ca->pmodrl)) {
+		ca->rtcp_capped = 1;
+		bictcp_rtcp_control(sk, rs);
+	} else {
+		if (ca->rtcp_capped) {
+			/* Cap dropped: restart the cubic epoch from here. */
+			ca->rtcp_capped = 0;
+			ca->epoch_start = 0;
+			ca->last_max_cwnd = tp->snd_cwnd;
+			tp->snd_ssthresh = tp->snd_cwnd;
+		}
+		if ((ca->prev_ca_state == TCP_CA_CWR ||
+		     ca->prev_ca_state == TCP_CA_Recovery) &&
+		    state < TCP_CA_CWR)
+			bictcp_end_cwnd_reduction(sk, ca->prev_ca_state);
+		bictcp_stock_control(sk, rs, flag);
+	}
+
+	if (ca->pmodrl) {
+		s.rto_exit = ca->prev_ca_state == TCP_CA_Loss && state != TCP_CA_Loss;
+		rtcp_ack_end(ca->pmodrl, &s);
+		if (enable_printk) {
+			struct rtcp_flow_id id;
+
+			rtcp_flow_id(sk, &id);
+			printk(KERN_INFO "!!!ACK: ip:%pISc port:%hu c:%u B:%llu R:%llu n:%u u_p:%lu r_p:%lu b:%llu d:%u l:%u state:%u cwnd:%u ssthresh:%u",
+				&id.dst, ntohs(inet->inet_dport), ca->pmodrl->classify, rtcp_B(ca->pmodrl), rtcp_R(ca->pmodrl),
+				ca->pmodrl->nominator, bictcp_rtcp_pacing_rate(sk), sk->sk_pacing_rate, tp->bytes_acked, tp->delivered, tp->lost,
+				state, tp->snd_cwnd, tp->snd_ssthresh);
+		}
+	}
+	ca->prev_ca_state = state;
+}
+
+static size_t bictcp_get_info(struct sock *sk, u32 ext, int *attr,
+			      union tcp_cc_info *info)
+{
+	struct bictcp *ca = inet_csk_ca(sk);
+
+	if (!ca->pmodrl)
+		return 0;
+	if (ext & (1 << (INET_DIAG_BBRINFO - 1)) ||
+	    ext & (1 << (INET_DIAG_VEGASINFO - 1))) {
+		/* Same layout as rtcp_bbr's R-TCP report */
+		memset(&info->bbr, 0, sizeof(info->bbr));
+		info->bbr.bbr_bw_lo		= ca->pmodrl->classify;
+		if (ca->pmodrl->classify == 1) {
+			info->bbr.bbr_bw_hi		= ca->pmodrl->detected_time / 1000;
+			info->bbr.bbr_min_rtt		= ca->pmodrl->detected_bytes_acked;
+			info->bbr.bbr_pacing_gain	= (rtcp_B(ca->pmodrl) * (u64)tcp_sk(sk)->mss_cache / 1024) >> RTCP_BW_SCALE;
+			info->bbr.bbr_cwnd_gain		= (rtcp_R(ca->pmodrl) * (u64)tcp_sk(sk)->mss_cache * 1000) >> RTCP_BW_SCALE;
+		}
+		*attr = INET_DIAG_BBRINFO;
+		return sizeof(info->bbr);
+	}
+	return 0;
+}
+
+static struct tcp_congestion_ops cubictcp __read_mostly = {
+	.init		= bictcp_init,
+	.release	= bictcp_release,
+	.ssthresh	= bictcp_recalc_ssthresh,
+	.cong_control	= bictcp_main,
+	.set_state	= bictcp_state,
+	.undo_cwnd	= tcp_reno_undo_cwnd,
+	.cwnd_event	= bictcp_cwnd_event,
+	.pkts_acked     = bictcp_acked,
+	.get_info	= bictcp_get_info,
+	.owner		= THIS_MODULE,
+	.name		= "rtcp_cubic",
+};
+
+static int __init cubictcp_register(void)
+{
+	BUILD_BUG_ON(sizeof(struct bictcp) > ICSK_CA_PRIV_SIZE);
+
+	/* Precompute a bunch of the scaling factors that are used per-packet
+	 * based on SRTT of 100ms
+	 */
+
+	beta_scale = 8*(BICTCP_BETA_SCALE+beta) / 3
+		/ (BICTCP_BETA_SCALE - beta);
+
+	cube_rtt_scale = (bic_scale * 10);	/* 1024*c/rtt */
+
+	/* calculate the "K" for (wmax-cwnd) = c/rtt * K^3
+	 *  so K = cubic_root( (wmax-cwnd)*rtt/c )
+	 * the unit of K is bictcp_HZ=2^10, not HZ
+	 *
+	 *  c = bic_scale >> 10
+	 *  rtt = 100ms
+	 *
+	 * the following code has been designed and tested for
+	 * cwnd < 1 million packets
+	 * RTT < 100 seconds
+	 * HZ < 1,000,00  (corresponding to 10 nano-second)
+	 */
+
+	/* 1/c * 2^2*bictcp_HZ * srtt */
+	cube_factor = 1ull << (10+3*BICTCP_HZ); /* 2^40 */
+
+	/* divide by bic_scale and by constant Srtt (100ms) */
+	do_div(cube_factor, bic_scale * 10);
+
+	return tcp_register_congestion_control(&cubictcp);
+}
+
+static void __exit cubictcp_unregister(void)
+{
+	tcp_unregister_congestion_control(&cubictcp);
+}
+
+module_init(cubictcp_register);
+module_exit(cubictcp_unregister);
+
+MODULE_AUTHOR("Sangtae Ha, Stephen Hemminger");
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("CUBIC TCP with R-TCP");
+MODULE_VERSION("2.3");
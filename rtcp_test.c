@@ -0,0 +1,69 @@
+/*
+ * R-TCP: KUnit suite of the engine
+ *
+ * Builds its own copy of rtcp_core.c, with the engine's functions static and
+ * the module parameters at the defaults of rtcp.c, and runs the cases of
+ * rtcp_core_test.c against it: (B, R) estimates on the standard curves, the
+ * u32 clock wrap, the grid comparison and shifting, the probing gain and the
+ * per-ACK cost of rtcp_ack(). Built when the kernel has CONFIG_KUNIT;
+ * user/rtcp_test runs the same cases in userspace.
+ *
+ * The R-TCP module was designed and implemented by
+ * Shengtong Zhu, Yan Liu, Lingfeng Guo and Jack Y. B. Lee,
+ *  "R-TCP: A Framework to Optimize TCP Performance Over Rate-Limiting Networks", NSDI, 2026.
+ *
+ * Contact  : zs021@ie.cuhk.edu.hk
+ */
+#include <linux/module.h>
+#include <linux/ktime.h>
+#include <net/tcp.h>
+#include <kunit/test.h>
+#include "rtcp_core.h"
+
+/* Same defaults as rtcp.c */
+static int probe_interval = 20;
+static int probe_per = 24;
+static int optimize_flag = 1;
+static int high_loss_disclassify = 2;
+static int monitor_peroid = 3;
+static int use_goodput = 1;
+static int exclude_RTO = 0;
+static int exclude_rwnd = 0;
+static int exclude_applimited = 0;
+static int window_ms = 200;
+static int window_kb = 0;
+
+#define rtcp_event(pmodrl, ev)	do { } while (0)
+#define rtcp_history(pmodrl, s)	do { } while (0)
+
+#define RTCP_CORE_API static __maybe_unused
+#include "rtcp_core.c"
+
+static u64 rtcp_test_ns(void)
+{
+	return ktime_get_ns();
+}
+
+#include "rtcp_core_test.c"
+
+static struct kunit_case rtcp_test_cases[] = {
+	KUNIT_CASE(rtcp_test_curves_case),
+	KUNIT_CASE(rtcp_test_wrap_case),
+	KUNIT_CASE(rtcp_test_comp_abs_case),
+	KUNIT_CASE(rtcp_test_young_case),
+	KUNIT_CASE(rtcp_test_shift_case),
+	KUNIT_CASE(rtcp_test_state_case),
+	KUNIT_CASE(rtcp_test_cap_gain_case),
+	KUNIT_CASE(rtcp_test_bench_case),
+	{}
+};
+
+static struct kunit_suite rtcp_test_suite = {
+	.name = "rtcp",
+	.test_cases = rtcp_test_cases,
+};
+kunit_test_suite(rtcp_test_suite);
+
+MODULE_AUTHOR("Shengtong Zhu <zs021@ie.cuhk.edu.hk>");
+MODULE_LICENSE("Dual BSD/GPL");
+MODULE_DESCRIPTION("R-TCP engine KUnit tests");
@@ -0,0 +1,113 @@
+/*
+ * R-TCP: binary per-ACK capture format
+ *
+ * A capture is one struct rtcp_trace_hdr followed by struct rtcp_trace_rec
+ * records, in host byte order. There is one record per call into the engine
+ * (rtcp_start, rtcp_restart_round, rtcp_ack, rtcp_ack_end) carrying the full
+ * engine sample, so that a capture fed back through rtcp_core.c reproduces
+ * the engine state bit for bit; the socket fields the engine does not read
+ * (snd_una, rtt_us, ca_state, chrono, mss) are kept for analysis. Records of
+ * concurrent flows are interleaved and told apart by flow.
+ *
+ * The kernel writes captures to debugfs (rtcp/trace), user/rtcp_replay reads
+ * them. Like rtcp_core.h this header includes nothing; include it after
+ * rtcp_core.h.
+ */
+#ifndef _RTCP_TRACE_H
+#define _RTCP_TRACE_H
+
+#define RTCP_TRACE_MAGIC	0x50435452	/* "RTCP" */
+#define RTCP_TRACE_VERSION	1
+
+/* Engine parameters in effect when the capture started */
+struct rtcp_trace_hdr {
+	u32 magic;
+	u16 version;
+	u16 rec_size;		/* sizeof(struct rtcp_trace_rec) */
+	s32 probe_interval;
+	s32 probe_per;
+	s32 optimize_flag;
+	s32 monitor_peroid;
+	s32 use_goodput;
+	s32 exclude_RTO;
+	s32 exclude_rwnd;
+	s32 exclude_applimited;
+	s32 high_loss_disclassify;	/* 0 in captures from before it */
+	s32 window_ms;			/* 0 in captures from before them */
+	s32 window_kb;
+	u32 reserved[3];
+};
+
+enum rtcp_trace_op {
+	RTCP_TRACE_INIT,	/* new flow, engine started at now_us */
+	RTCP_TRACE_START,	/* rtcp_start() */
+	RTCP_TRACE_RESTART,	/* rtcp_restart_round(delivered) */
+	RTCP_TRACE_ACK,		/* rtcp_ack() */
+	RTCP_TRACE_ACK_END,	/* rtcp_ack_end() */
+	RTCP_TRACE_RESUME,	/* new flow, engine state from a handover */
+};
+
+#define RTCP_TRACE_APP_LIMITED	(1 << 0)
+#define RTCP_TRACE_RWND_LIMITED	(1 << 1)
+#define RTCP_TRACE_RTO_EXIT	(1 << 2)
+#define RTCP_TRACE_PROBE_RTT	(1 << 3)	/* host's pmodrl->probe_rtt_flag */
+
+struct rtcp_trace_rec {
+	u64 bytes_acked;
+	s64 interval_us;
+	u32 flow;		/* hash of the socket, reused after INIT */
+	u32 now_us;
+	u32 min_rtt_us;
+	u32 delivered;
+	u32 lost;
+	u32 acked;
+	u32 snd_una;
+	s32 rtt_us;		/* rs->rtt_us, -1 if none */
+	u32 prior_delivered;
+	s32 rs_delivered;
+	u16 mss;
+	u8 op;			/* enum rtcp_trace_op */
+	u8 flags;		/* RTCP_TRACE_* */
+	u8 ca_state;
+	u8 chrono;		/* tp->chrono_type */
+	u16 reserved;
+};
+
+static inline void rtcp_trace_from_sample(struct rtcp_trace_rec *r,
+					  const struct rtcp_sample *s,
+					  const struct PMODRL *pmodrl)
+{
+	r->now_us = s->now_us;
+	r->min_rtt_us = s->min_rtt_us;
+	r->delivered = s->delivered;
+	r->lost = s->lost;
+	r->acked = s->acked;
+	r->bytes_acked = s->bytes_acked;
+	r->prior_delivered = s->prior_delivered;
+	r->rs_delivered = s->rs_delivered;
+	r->interval_us = s->interval_us;
+	r->flags = (s->app_limited ? RTCP_TRACE_APP_LIMITED : 0) |
+		   (s->rwnd_limited ? RTCP_TRACE_RWND_LIMITED : 0) |
+		   (s->rto_exit ? RTCP_TRACE_RTO_EXIT : 0) |
+		   (pmodrl->probe_rtt_flag ? RTCP_TRACE_PROBE_RTT : 0);
+}
+
+static inline void rtcp_trace_to_sample(const struct rtcp_trace_rec *r,
+					struct rtcp_sample *s)
+{
+	memset(s, 0, sizeof(*s));
+	s->now_us = r->now_us;
+	s->min_rtt_us = r->min_rtt_us;
+	s->delivered = r->delivered;
+	s->lost = r->lost;
+	s->acked = r->acked;
+	s->bytes_acked = r->bytes_acked;
+	s->prior_delivered = r->prior_delivered;
+	s->rs_delivered = r->rs_delivered;
+	s->interval_us = r->interval_us;
+	s->app_limited = !!(r->flags & RTCP_TRACE_APP_LIMITED);
+	s->rwnd_limited = !!(r->flags & RTCP_TRACE_RWND_LIMITED);
+	s->rto_exit = !!(r->flags & RTCP_TRACE_RTO_EXIT);
+}
+
+#endif /* _RTCP_TRACE_H */
@@ -0,0 +1,436 @@
+/*
+ * R-TCP: estimator microbenchmark
+ *
+ * Feeds synthetic delivery curves to the R-TCP engine (librtcp, the same
+ * rtcp_core.c as the kernel module) and reports, per curve:
+ *
+ *   - the classification and the error of the B and R estimates against
+ *     the policer that produced the curve, and
+ *   - the cost of the per-ACK path (rtcp_flow_ack() + rtcp_flow_ack_end())
+ *     in ns per ACK, separately for the ACKs before the flow is classified
+ *     and after.
+ *
+ * -g checks and times the batch grid kernels of rtcp_grid.h instead: random
+ * and edge-case grids of many flows go through both the vector and the
+ * engine's scalar code, any difference is reported (and fails the run), and
+ * the cost of each is given in ns per flow.
+ *
+ * A curve is an open-loop sender at a constant rate through a token-bucket
+ * policer with a fixed RTT, so the engine sees the textbook shape: the bucket
+ * drains at the sending rate, then deliveries fall to the token rate with
+ * steady loss. The ACK stream is generated once and replayed for every timed
+ * pass; the minimum over passes is reported.
+ *
+ * The R-TCP module was designed and implemented by
+ * Shengtong Zhu, Yan Liu, Lingfeng Guo and Jack Y. B. Lee,
+ *  "R-TCP: A Framework to Optimize TCP Performance Over Rate-Limiting Networks", NSDI, 2026.
+ *
+ * Contact  : zs021@ie.cuhk.edu.hk
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "rtcp_user.h"
+#include "rtcp_grid.h"
+
+struct bench_curve {
+	const char *name;
+	double rate_mbps;	/* policer token rate, 0 for no policer */
+	double bucket_kb;	/* policer bucket */
+	double send_mbps;	/* sender rate */
+	double rtt_ms;
+};
+
+static const struct bench_curve curves[] = {
+	{ "unpoliced",	0,	0,	20,	40 },
+	{ "policed",	10,	1000,	20,	40 },
+	{ "small-B",	10,	100,	20,	40 },
+	{ "large-B",	10,	10000,	20,	40 },
+	{ "slow-R",	1,	1000,	4,	80 },
+	{ "fast-R",	100,	5000,	200,	20 },
+	{ "long-RTT",	10,	1000,	20,	300 },
+};
+
+struct bench_pkt {
+	double send_us;
+	double delivered_us;	/* delivered_mstamp at send */
+	double first_tx_us;	/* first_tx_mstamp at send */
+	uint32_t delivered;	/* delivered at send */
+	int dropped;
+};
+
+/* Build the ACK stream of a curve; returns the number of ACKs. */
+static size_t bench_gen(const struct bench_curve *c, double duration_s,
+			unsigned int mss, struct rtcp_ack **out)
+{
+	double gap = mss * 8 / c->send_mbps, rtt = c->rtt_ms * 1000;
+	size_t n = (size_t)(duration_s * 1e6 / gap), i, j = 0, nacks = 0;
+	double tokens = c->bucket_kb * 1000, token_us = 0;
+	double delivered_us = 0, first_tx_us = 0;
+	uint32_t delivered = 0, lost = 0;
+	struct bench_pkt *pkt;
+	struct rtcp_ack *acks;
+
+	pkt = calloc(n, sizeof(*pkt));
+	acks = calloc(n, sizeof(*acks));
+	if (!pkt || !acks) {
+		free(pkt);
+		free(acks);
+		return 0;
+	}
+
+	for (i = 0; i <= n; i++) {
+		double now = i < n ? i * gap : 1e300;
+
+		/* ACKs and loss detections due before this send, in order */
+		for (; j < i && pkt[j].send_us + rtt <= now; j++) {
+			const struct bench_pkt *p = &pkt[j];
+			double at = p->send_us + rtt, interval;
+			struct rtcp_ack *a;
+
+			if (p->dropped) {
+				lost++;
+				continue;
+			}
+			delivered++;
+			delivered_us = at;
+			interval = p->send_us - p->first_tx_us;
+			if (at - p->delivered_us > interval)
+				interval = at - p->delivered_us;
+			first_tx_us = p->send_us;
+
+			a = &acks[nacks++];
+			a->now_us = (uint64_t)at;
+			a->min_rtt_us = (uint32_t)rtt;
+			a->delivered = delivered;
+			a->lost = lost;
+			a->acked = delivered;
+			a->bytes_acked = (uint64_t)delivered * mss;
+			a->prior_delivered = p->delivered;
+			a->sample_delivered = delivered - p->delivered;
+			a->interval_us = (int64_t)interval;
+		}
+		if (i == n)
+			break;
+
+		if (i == 0)
+			first_tx_us = delivered_us = now;
+		pkt[i].send_us = now;
+		pkt[i].delivered = delivered;
+		pkt[i].delivered_us = delivered_us;
+		pkt[i].first_tx_us = first_tx_us;
+		if (c->rate_mbps > 0) {
+			tokens += (now - token_us) * c->rate_mbps / 8;
+			if (tokens > c->bucket_kb * 1000)
+				tokens = c->bucket_kb * 1000;
+			token_us = now;
+			if (tokens < mss)
+				pkt[i].dropped = 1;
+			else
+				tokens -= mss;
+		}
+	}
+
+	free(pkt);
+	*out = acks;
+	return nacks;
+}
+
+static double bench_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Replay acks[from, to) on flow; returns the elapsed ns. */
+static double bench_replay(struct rtcp_flow *flow, const struct rtcp_ack *acks,
+			   size_t from, size_t to)
+{
+	double t0 = bench_now_ns();
+	size_t i;
+
+	for (i = from; i < to; i++) {
+		rtcp_flow_ack(flow, &acks[i]);
+		rtcp_flow_ack_end(flow, &acks[i]);
+	}
+	return bench_now_ns() - t0;
+}
+
+static int bench_run(const struct bench_curve *c, double duration_s,
+		     unsigned int mss, int passes)
+{
+	double pre_ns = -1, post_ns = -1, b_err = 0, r_err = 0;
+	struct rtcp_estimate est;
+	struct rtcp_flow *flow;
+	struct rtcp_ack *acks;
+	size_t n, split, i;
+	int pass;
+
+	n = bench_gen(c, duration_s, mss, &acks);
+	if (!n)
+		return -1;
+
+	/* Untimed pass: classification, estimate and where detection happens */
+	flow = rtcp_flow_new(0);
+	if (!flow) {
+		free(acks);
+		return -1;
+	}
+	split = n;
+	for (i = 0; i < n; i++) {
+		rtcp_flow_ack(flow, &acks[i]);
+		rtcp_flow_ack_end(flow, &acks[i]);
+		if (split == n && rtcp_flow_capped(flow))
+			split = i + 1;
+	}
+	rtcp_flow_estimate(flow, mss, &est);
+	rtcp_flow_free(flow);
+	if (c->rate_mbps > 0) {
+		b_err = est.bucket_bytes / (c->bucket_kb * 1000) - 1;
+		r_err = est.rate_bps / (c->rate_mbps * 1e6 / 8) - 1;
+	}
+
+	for (pass = 0; pass < passes; pass++) {
+		double t;
+
+		flow = rtcp_flow_new(0);
+		if (!flow) {
+			free(acks);
+			return -1;
+		}
+		t = bench_replay(flow, acks, 0, split) / split;
+		if (pre_ns < 0 || t < pre_ns)
+			pre_ns = t;
+		if (split < n) {
+			t = bench_replay(flow, acks, split, n) / (n - split);
+			if (post_ns < 0 || t < post_ns)
+				post_ns = t;
+		}
+		rtcp_flow_free(flow);
+	}
+
+	printf("%-10s %8zu %8u %8.1f %8.1f %10zu %10.1f %10.1f\n", c->name, n,
+	       est.classify, b_err * 100, r_err * 100, split, pre_ns, post_ns);
+	free(acks);
+	return 0;
+}
+
+static u64 grid_rand(u64 *x)
+{
+	*x ^= *x << 13;
+	*x ^= *x >> 7;
+	*x ^= *x << 17;
+	return *x;
+}
+
+/* One flow of the check batch; the kinds cover the kernels' corner cases. */
+static void grid_gen(struct rtcp_grid_batch *b, size_t j, u64 *x)
+{
+	u32 e = grid_rand(x) % 60000000;
+	u64 D, step;
+	int i, kind = j % 8;
+
+	b->start_us[j] = grid_rand(x);
+	b->delivered[j] = grid_rand(x) % (e / 100 + 2);
+	switch (kind) {
+	case 1:		/* younger than, or just around, 1ms */
+		e = grid_rand(x) % 2000;
+		if (grid_rand(x) & 1)
+			break;
+		/* a few us old, but in the next ms */
+		b->start_us[j] -= b->start_us[j] % 1000 - 999 + grid_rand(x) % 8;
+		b->delivered[j] = grid_rand(x);
+		e = grid_rand(x) % 16 + 1;
+		break;
+	case 2:		/* now_us wraps */
+		b->start_us[j] = -(u32)(grid_rand(x) % 1000000);
+		break;
+	case 3:		/* huge counts and B */
+		b->delivered[j] = -(u32)(grid_rand(x) % 1000);
+		break;
+	}
+	b->now_us[j] = b->start_us[j] + e;
+	D = (u64)b->delivered[j] << RTCP_BW_SCALE;
+	/* no windowed rate yet, or one anywhere among the R */
+	b->win[j] = kind == 3 ? grid_rand(x) :
+		    grid_rand(x) & 1 ? grid_rand(x) % (1ULL << 40) : 0;
+
+	step = D / RTCP_GRID + 1;
+	for (i = 0; i < RTCP_GRID; i++) {
+		switch (kind) {
+		case 3:
+			b->B[i][j] = grid_rand(x);
+			b->R[i][j] = grid_rand(x);
+			break;
+		case 4:		/* all of B beyond what was delivered */
+			b->B[i][j] = D + grid_rand(x) % (step + 1);
+			b->R[i][j] = grid_rand(x) % (1ULL << 40);
+			break;
+		case 5:		/* equal R: comp() takes r_diff == 0 */
+			b->B[i][j] = step * i * 2;
+			b->R[i][j] = i & 4 ? 12345 : 0;
+			break;
+		default:
+			b->B[i][j] = step * i * 2 + grid_rand(x) % step;
+			b->R[i][j] = grid_rand(x) % (1ULL << 40);
+			break;
+		}
+	}
+	if (kind == 6) {
+		/* b_diff * 16 / r_diff within a hair of the flow length * 8:
+		 * exactly on it, or off by one part in 2^59
+		 */
+		u64 y1 = (u64)e * 8 + 1, r = (grid_rand(x) % (1 << 30)) + 1;
+
+		for (i = 1; i < RTCP_GRID; i++) {
+			b->R[i][j] = b->R[i - 1][j] + 16 * r;
+			b->B[i][j] = b->B[i - 1][j] + r * y1 -
+				     !(grid_rand(x) % 4);
+		}
+	}
+	if (kind == 7 && e) {
+		/* (D - B) / e exact: the quotient's last unit */
+		for (i = 0; i < RTCP_GRID; i++) {
+			u64 k = grid_rand(x) % (D / e + 1);
+
+			b->B[i][j] = D - k * e;
+			b->R[i][j] = k ? grid_rand(x) % k : 0;
+		}
+	}
+}
+
+static int grid_diff(const struct rtcp_grid_batch *a,
+		     const struct rtcp_grid_batch *b)
+{
+	int bad = 0, i;
+	size_t j;
+
+	for (j = 0; j < a->n; j++) {
+		int diff = a->best[j] != b->best[j] || a->young[j] != b->young[j];
+
+		for (i = 0; i < RTCP_GRID; i++)
+			diff |= a->R[i][j] != b->R[i][j];
+		if (diff && bad++ < 10)
+			fprintf(stderr, "grid: flow %zu (kind %zu) differs\n", j, j % 8);
+	}
+	return bad;
+}
+
+static void grid_copy(struct rtcp_grid_batch *d, const struct rtcp_grid_batch *s)
+{
+	int i;
+
+	for (i = 0; i < RTCP_GRID; i++) {
+		memcpy(d->B[i], s->B[i], s->n * sizeof(u64));
+		memcpy(d->R[i], s->R[i], s->n * sizeof(u64));
+	}
+	memcpy(d->delivered, s->delivered, s->n * sizeof(u32));
+	memcpy(d->now_us, s->now_us, s->n * sizeof(u32));
+	memcpy(d->start_us, s->start_us, s->n * sizeof(u32));
+	memcpy(d->win, s->win, s->n * sizeof(u64));
+}
+
+/* Check the batch kernels against the scalar code, then time both. */
+static int grid_run(size_t flows, int passes)
+{
+	struct rtcp_grid_batch in, vec, ref;
+	double t, vec_ns = -1, ref_ns = -1;
+	u64 x = 0x9e3779b97f4a7c15ULL;
+	int bad = 0, pass;
+	size_t j;
+
+	if (rtcp_grid_batch_alloc(&in, flows))
+		return -1;
+	if (rtcp_grid_batch_alloc(&vec, flows)) {
+		rtcp_grid_batch_free(&in);
+		return -1;
+	}
+	if (rtcp_grid_batch_alloc(&ref, flows)) {
+		rtcp_grid_batch_free(&in);
+		rtcp_grid_batch_free(&vec);
+		return -1;
+	}
+	for (j = 0; j < flows; j++)
+		grid_gen(&in, j, &x);
+
+	for (pass = 0; pass < passes; pass++) {
+		grid_copy(&vec, &in);
+		t = bench_now_ns();
+		rtcp_grid_batch_rates(&vec);
+		rtcp_grid_batch_best(&vec);
+		t = (bench_now_ns() - t) / flows;
+		if (vec_ns < 0 || t < vec_ns)
+			vec_ns = t;
+
+		grid_copy(&ref, &in);
+		t = bench_now_ns();
+		rtcp_grid_ref_rates(&ref, 0, flows);
+		rtcp_grid_ref_best(&ref, 0, flows);
+		t = (bench_now_ns() - t) / flows;
+		if (ref_ns < 0 || t < ref_ns)
+			ref_ns = t;
+
+		if (!pass)
+			bad = grid_diff(&vec, &ref);
+	}
+	/* comp() alone, on grids as they come, not after a rates step */
+	grid_copy(&vec, &in);
+	grid_copy(&ref, &in);
+	rtcp_grid_batch_best(&vec);
+	rtcp_grid_ref_best(&ref, 0, flows);
+	bad += grid_diff(&vec, &ref);
+
+	printf("%-10s %10s %10s %10s\n", "flows", "ns_batch", "ns_scalar",
+	       "mismatch");
+	printf("%-10zu %10.1f %10.1f %10d\n", flows, vec_ns, ref_ns, bad);
+	rtcp_grid_batch_free(&in);
+	rtcp_grid_batch_free(&vec);
+	rtcp_grid_batch_free(&ref);
+	return bad ? 1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+	double duration_s = 60;
+	unsigned int mss = 1448;
+	int passes = 20, opt;
+	size_t i, grid = 0;
+
+	while ((opt = getopt(argc, argv, "d:g:m:n:")) != -1) {
+		switch (opt) {
+		case 'd': duration_s = atof(optarg); break;
+		case 'g': grid = strtoul(optarg, NULL, 0); break;
+		case 'm': mss = atoi(optarg); break;
+		case 'n': passes = atoi(optarg); break;
+		default:
+			fprintf(stderr, "usage: %s [-d s] [-m mss] [-n passes] [-g flows]\n",
+				argv[0]);
+			return 2;
+		}
+	}
+	if (passes < 1)
+		passes = 1;
+
+	if (grid) {
+		int err = grid_run(grid, passes);
+
+		if (err < 0)
+			fprintf(stderr, "out of memory\n");
+		return err ? 1 : 0;
+	}
+
+	printf("%-10s %8s %8s %8s %8s %10s %10s %10s\n", "curve", "acks",
+	       "classify", "B_err%", "R_err%", "capped_at", "ns_before",
+	       "ns_after");
+	for (i = 0; i < sizeof(curves) / sizeof(curves[0]); i++) {
+		if (bench_run(&curves[i], duration_s, mss, passes)) {
+			fprintf(stderr, "out of memory\n");
+			return 1;
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,99 @@
+/*
+ * R-TCP: the BPF program's build of the engine, in userspace
+ *
+ * See rtcp_bpf.h. The engine comes with its own kernel helpers here, those
+ * of bpf/rtcp_bpf_engine.h, so this file does not use rtcp_shim.h.
+ *
+ * The R-TCP module was designed and implemented by
+ * Shengtong Zhu, Yan Liu, Lingfeng Guo and Jack Y. B. Lee,
+ *  "R-TCP: A Framework to Optimize TCP Performance Over Rate-Limiting Networks", NSDI, 2026.
+ *
+ * Contact  : zs021@ie.cuhk.edu.hk
+ */
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int32_t s32;
+typedef int64_t s64;
+
+#ifndef __always_inline
+#define __always_inline	inline __attribute__((always_inline))
+#endif
+
+#include "../bpf/rtcp_bpf_engine.h"
+#include "../rtcp_trace.h"
+#include "rtcp_bpf.h"
+
+struct rtcp_bpf_flow {
+	struct rtcp_bpf_state st;
+};
+
+void rtcp_bpf_set_params(const struct rtcp_trace_hdr *hdr)
+{
+	probe_interval = hdr->probe_interval;
+	probe_per = hdr->probe_per;
+	optimize_flag = hdr->optimize_flag;
+	monitor_peroid = hdr->monitor_peroid;
+	high_loss_disclassify = hdr->high_loss_disclassify;
+	use_goodput = hdr->use_goodput;
+	exclude_RTO = hdr->exclude_RTO;
+	exclude_rwnd = hdr->exclude_rwnd;
+	exclude_applimited = hdr->exclude_applimited;
+	window_ms = hdr->window_ms;
+	window_kb = hdr->window_kb;
+}
+
+struct rtcp_bpf_flow *rtcp_bpf_flow_new(void)
+{
+	return calloc(1, sizeof(struct rtcp_bpf_flow));
+}
+
+void rtcp_bpf_flow_free(struct rtcp_bpf_flow *flow)
+{
+	free(flow);
+}
+
+unsigned int rtcp_bpf_flow_replay(struct rtcp_bpf_flow *flow,
+				  const struct rtcp_trace_rec *rec)
+{
+	struct PMODRL *pmodrl = &flow->st.pmodrl;
+	struct rtcp_sample s;
+	unsigned int events;
+
+	if (rec->op == RTCP_TRACE_INIT) {
+		memset(flow, 0, sizeof(*flow));
+		pmodrl->bbr_start_us = rec->now_us;
+		return 0;
+	}
+
+	pmodrl->probe_rtt_flag = !!(rec->flags & RTCP_TRACE_PROBE_RTT);
+	rtcp_trace_to_sample(rec, &s);
+	switch (rec->op) {
+	case RTCP_TRACE_START:
+		rtcp_start(pmodrl, &s);
+		break;
+	case RTCP_TRACE_RESTART:
+		rtcp_restart_round(pmodrl, rec->delivered);
+		break;
+	case RTCP_TRACE_ACK:
+		rtcp_ack(pmodrl, &s);
+		break;
+	case RTCP_TRACE_ACK_END:
+		rtcp_ack_end(pmodrl, &s);
+		break;
+	}
+	events = flow->st.events;
+	flow->st.events = 0;
+	return events;
+}
+
+void rtcp_bpf_flow_save(const struct rtcp_bpf_flow *flow, struct rtcp_state *st)
+{
+	rtcp_save(&flow->st.pmodrl, st);
+}
@@ -0,0 +1,35 @@
+/*
+ * R-TCP: the BPF program's build of the engine, in userspace
+ *
+ * rtcp_core.c as bpf/rtcp_bbr.bpf.c builds it (bpf/rtcp_bpf_engine.h: its
+ * kernel helpers, parameters, event collection and bounded grid shifts),
+ * compiled for the host. rtcp_replay -B feeds every flow of a capture
+ * through it and through librtcp and requires the two to agree after every
+ * record, which is what bench/diff_bpf.sh runs.
+ *
+ * Internal to the userspace tools; not installed.
+ */
+#ifndef _RTCP_BPF_H
+#define _RTCP_BPF_H
+
+struct rtcp_bpf_flow;
+struct rtcp_trace_hdr;
+struct rtcp_trace_rec;
+struct rtcp_state;
+
+/* The engine parameters of the capture */
+void rtcp_bpf_set_params(const struct rtcp_trace_hdr *hdr);
+
+struct rtcp_bpf_flow *rtcp_bpf_flow_new(void);
+void rtcp_bpf_flow_free(struct rtcp_bpf_flow *flow);
+
+/* rtcp_flow_replay() of rtcp_user.h; returns the events, 1 << enum
+ * rtcp_event, raised by the record.
+ */
+unsigned int rtcp_bpf_flow_replay(struct rtcp_bpf_flow *flow,
+				  const struct rtcp_trace_rec *rec);
+/* rtcp_flow_save() of rtcp_user.h */
+void rtcp_bpf_flow_save(const struct rtcp_bpf_flow *flow,
+			struct rtcp_state *st);
+
+#endif /* _RTCP_BPF_H */
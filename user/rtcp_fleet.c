@@ -0,0 +1,528 @@
+/*
+ * R-TCP: offline parameter sweeps over captured flows
+ *
+ * Replays every flow of one or more binary captures (../rtcp_trace.h, from
+ * debugfs rtcp/trace or rtcp_sim -w) under every combination of the
+ * parameter values given with -s, on all cores, and prints one line per
+ * setting with the distribution of the outcome over the flows:
+ *
+ *   det%       flows classified as rate limited (classify == 1)
+ *   dis%       flows where the policer was ruled out (classify == 2)
+ *   detect_s   time from the start of the flow to the cap, p10/p50/p90
+ *   cap_ratio  cap rate over the goodput the flow got after the cap was
+ *              set, p10/p50/p90: below 1 the cap would have cost goodput,
+ *              above 1 it left the rate to the policer
+ *
+ * The replay is open loop: the captured ACKs do not change with the setting,
+ * so cap_ratio measures how well the cap fits what the path delivered, not
+ * the goodput the setting would have produced.
+ *
+ * Captures are mapped, not read. A flow is the records of one socket from
+ * RTCP_TRACE_INIT to the next INIT or RESUME. Each (setting, flow) pair is a
+ * work item; every thread starts with an equal slice of the items and, once
+ * its slice is done, steals half of what remains of the fullest other slice.
+ *
+ * The R-TCP module was designed and implemented by
+ * Shengtong Zhu, Yan Liu, Lingfeng Guo and Jack Y. B. Lee,
+ *  "R-TCP: A Framework to Optimize TCP Performance Over Rate-Limiting Networks", NSDI, 2026.
+ *
+ * Contact  : zs021@ie.cuhk.edu.hk
+ */
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "rtcp_shim.h"
+#include "rtcp_user.h"
+#include "../rtcp_core.h"
+#include "../rtcp_trace.h"
+
+#define FLEET_SWEEP_MAX		8	/* -s options */
+#define FLEET_VALUES_MAX	16	/* values per -s */
+#define FLEET_OPEN_BITS		16	/* open flows tracked while indexing */
+
+struct fleet_flow {
+	const struct rtcp_trace_rec *recs;	/* the flow's capture */
+	u32 *idx;				/* its records in recs[] */
+	u32 n, cap;
+	double goodput_mbps;
+};
+
+struct fleet_result {
+	float detect_s;		/* < 0 if never capped */
+	float cap_ratio;	/* < 0 if never capped */
+	u8 classify;
+};
+
+struct fleet_sweep {
+	char name[32];
+	int values[FLEET_VALUES_MAX];
+	int n;
+};
+
+static struct fleet_flow *flows;
+static size_t nflows, flows_cap;
+static struct rtcp_params *settings;
+static size_t nsettings;
+static struct fleet_result *results;	/* [setting][flow] */
+
+/* Work stealing: each worker owns items [begin, end) of results[], packed
+ * in one word so that the owner taking from the front and a thief taking
+ * the back half never hand out the same item.
+ */
+struct fleet_worker {
+	_Atomic u64 range;	/* begin << 32 | end */
+	pthread_t thread;
+} __attribute__((aligned(64)));
+
+static struct fleet_worker *workers;
+static int nworkers;
+
+#define RANGE(b, e)	((u64)(b) << 32 | (u32)(e))
+#define RANGE_BEGIN(r)	((u32)((r) >> 32))
+#define RANGE_END(r)	((u32)(r))
+
+static bool fleet_pop(struct fleet_worker *w, u32 *item)
+{
+	u64 r = atomic_load(&w->range);
+
+	while (RANGE_BEGIN(r) < RANGE_END(r)) {
+		if (atomic_compare_exchange_weak(&w->range, &r,
+				RANGE(RANGE_BEGIN(r) + 1, RANGE_END(r)))) {
+			*item = RANGE_BEGIN(r);
+			return true;
+		}
+	}
+	return false;
+}
+
+/* Move the back half of the fullest other range to w, whose range is empty. */
+static bool fleet_steal(struct fleet_worker *w)
+{
+	for (;;) {
+		struct fleet_worker *victim = NULL;
+		u32 most = 0, b, e, mid;
+		u64 r;
+		int i;
+
+		for (i = 0; i < nworkers; i++) {
+			r = atomic_load(&workers[i].range);
+			if (&workers[i] != w && RANGE_END(r) - RANGE_BEGIN(r) > most &&
+			    RANGE_BEGIN(r) < RANGE_END(r)) {
+				most = RANGE_END(r) - RANGE_BEGIN(r);
+				victim = &workers[i];
+			}
+		}
+		if (!victim)
+			return false;
+
+		r = atomic_load(&victim->range);
+		b = RANGE_BEGIN(r);
+		e = RANGE_END(r);
+		if (b >= e)
+			continue;
+		mid = b + (e - b) / 2;
+		if (atomic_compare_exchange_strong(&victim->range, &r, RANGE(b, mid))) {
+			atomic_store(&w->range, RANGE(mid, e));
+			return true;
+		}
+	}
+}
+
+static void fleet_replay(size_t item)
+{
+	const struct fleet_flow *ff = &flows[item % nflows];
+	struct fleet_result *res = &results[item];
+	u32 start_us = 0, cap_us = 0, last_us = 0;
+	u64 cap_bytes = 0, last_bytes = 0;
+	struct rtcp_estimate est;
+	struct rtcp_flow *flow;
+	u16 mss = 0;
+	u32 i;
+
+	rtcp_set_thread_params(&settings[item / nflows]);
+	res->detect_s = -1;
+	res->cap_ratio = -1;
+	flow = rtcp_flow_new(0);
+	if (!flow)
+		return;
+	for (i = 0; i < ff->n; i++) {
+		const struct rtcp_trace_rec *rec = &ff->recs[ff->idx[i]];
+
+		rtcp_flow_replay(flow, rec);
+		if (rec->op == RTCP_TRACE_INIT)
+			start_us = rec->now_us;
+		if (rec->op != RTCP_TRACE_ACK_END)
+			continue;
+		mss = rec->mss;
+		last_us = rec->now_us;
+		last_bytes = rec->bytes_acked;
+		if (!cap_us && rtcp_flow_capped(flow)) {
+			cap_us = rec->now_us;
+			cap_bytes = rec->bytes_acked;
+			res->detect_s = (cap_us - start_us) / 1e6;
+		}
+	}
+
+	rtcp_flow_estimate(flow, mss, &est);
+	res->classify = est.classify;
+	if (cap_us && last_us != cap_us && last_bytes > cap_bytes) {
+		double got = (double)(last_bytes - cap_bytes) * USEC_PER_SEC /
+			     (last_us - cap_us);
+		u64 cap = rtcp_flow_pacing_cap(flow, mss);
+
+		if (cap)
+			res->cap_ratio = cap / got;
+	}
+	rtcp_flow_free(flow);
+}
+
+static void *fleet_worker_fn(void *arg)
+{
+	struct fleet_worker *w = arg;
+	u32 item;
+
+	do {
+		while (fleet_pop(w, &item))
+			fleet_replay(item);
+	} while (fleet_steal(w));
+	return NULL;
+}
+
+static int fleet_add_rec(struct fleet_flow *ff, u32 i)
+{
+	if (ff->n == ff->cap) {
+		u32 cap = ff->cap ? ff->cap * 2 : 256;
+		u32 *idx = realloc(ff->idx, cap * sizeof(*idx));
+
+		if (!idx)
+			return -1;
+		ff->idx = idx;
+		ff->cap = cap;
+	}
+	ff->idx[ff->n++] = i;
+	return 0;
+}
+
+/* Goodput over the flow's ACKs, for the report header */
+static void fleet_flow_done(struct fleet_flow *ff)
+{
+	const struct rtcp_trace_rec *first = NULL, *last = NULL;
+	u32 i;
+
+	for (i = 0; i < ff->n; i++) {
+		const struct rtcp_trace_rec *rec = &ff->recs[ff->idx[i]];
+
+		if (rec->op != RTCP_TRACE_ACK_END)
+			continue;
+		if (!first)
+			first = rec;
+		last = rec;
+	}
+	ff->goodput_mbps = first && last->now_us != first->now_us ?
+		(double)(last->bytes_acked - first->bytes_acked) * 8 /
+		(last->now_us - first->now_us) : 0;
+}
+
+/* Map a capture and split it into flows. */
+static int fleet_load(const char *path, struct rtcp_trace_hdr *hdr)
+{
+	static size_t open_flow[1 << FLEET_OPEN_BITS];	/* flows[] + 1, by id hash */
+	static u32 open_id[1 << FLEET_OPEN_BITS];
+	const struct rtcp_trace_rec *recs;
+	struct stat st;
+	size_t n, i;
+	void *map;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st) < 0) {
+		perror(path);
+		return -1;
+	}
+	map = st.st_size >= (off_t)sizeof(*hdr) ?
+		mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+	close(fd);
+	if (map == MAP_FAILED) {
+		fprintf(stderr, "%s: cannot map\n", path);
+		return -1;
+	}
+	*hdr = *(const struct rtcp_trace_hdr *)map;
+	if (hdr->magic != RTCP_TRACE_MAGIC || hdr->version != RTCP_TRACE_VERSION ||
+	    hdr->rec_size != sizeof(struct rtcp_trace_rec)) {
+		fprintf(stderr, "%s: not an R-TCP capture of this version\n", path);
+		return -1;
+	}
+	madvise(map, st.st_size, MADV_SEQUENTIAL);
+	recs = (const struct rtcp_trace_rec *)((const char *)map + sizeof(*hdr));
+	n = (st.st_size - sizeof(*hdr)) / sizeof(*recs);
+	memset(open_flow, 0, sizeof(open_flow));
+
+	for (i = 0; i < n; i++) {
+		const struct rtcp_trace_rec *rec = &recs[i];
+		u32 h = (rec->flow * 2654435761U) >> (32 - FLEET_OPEN_BITS);
+		struct fleet_flow *ff;
+
+		/* Open flows whose slot is taken by another id are dropped. */
+		if (rec->op == RTCP_TRACE_INIT) {
+			if (open_flow[h])
+				fleet_flow_done(&flows[open_flow[h] - 1]);
+			if (nflows == flows_cap) {
+				size_t cap = flows_cap ? flows_cap * 2 : 1024;
+				struct fleet_flow *f = realloc(flows, cap * sizeof(*f));
+
+				if (!f)
+					return -1;
+				flows = f;
+				flows_cap = cap;
+			}
+			memset(&flows[nflows], 0, sizeof(flows[nflows]));
+			flows[nflows].recs = recs;
+			open_flow[h] = ++nflows;
+			open_id[h] = rec->flow;
+		}
+		if (!open_flow[h] || open_id[h] != rec->flow)
+			continue;
+		ff = &flows[open_flow[h] - 1];
+		if (rec->op == RTCP_TRACE_RESUME) {
+			ff->n = 0;	/* not replayable, left empty */
+			open_flow[h] = 0;
+			continue;
+		}
+		if (fleet_add_rec(ff, i))
+			return -1;
+	}
+	for (i = 0; i < (1 << FLEET_OPEN_BITS); i++)
+		if (open_flow[i])
+			fleet_flow_done(&flows[open_flow[i] - 1]);
+	return 0;
+}
+
+static int fleet_sweep_parse(struct fleet_sweep *sw, const char *arg)
+{
+	const char *eq = strchr(arg, '=');
+	char *dup, *tok, *save;
+
+	if (!eq || eq - arg >= (long)sizeof(sw->name))
+		return -1;
+	memcpy(sw->name, arg, eq - arg);
+	sw->name[eq - arg] = '\0';
+	dup = strdup(eq + 1);
+	for (tok = strtok_r(dup, ",", &save); tok && sw->n < FLEET_VALUES_MAX;
+	     tok = strtok_r(NULL, ",", &save))
+		sw->values[sw->n++] = atoi(tok);
+	free(dup);
+	return sw->n ? 0 : -1;
+}
+
+/* Cartesian product of the sweeps over base */
+static int fleet_settings(const struct rtcp_params *base,
+			  const struct fleet_sweep *sw, int nsw)
+{
+	size_t i;
+	int k;
+
+	nsettings = 1;
+	for (k = 0; k < nsw; k++)
+		nsettings *= sw[k].n;
+	settings = calloc(nsettings, sizeof(*settings));
+	if (!settings)
+		return -1;
+	for (i = 0; i < nsettings; i++) {
+		size_t rest = i;
+
+		settings[i] = *base;
+		for (k = nsw - 1; k >= 0; k--) {
+			char arg[48];
+
+			snprintf(arg, sizeof(arg), "%s=%d", sw[k].name,
+				 sw[k].values[rest % sw[k].n]);
+			rest /= sw[k].n;
+			if (rtcp_param_set(&settings[i], arg)) {
+				fprintf(stderr, "unknown parameter %s\n", sw[k].name);
+				return -1;
+			}
+		}
+	}
+	return 0;
+}
+
+static int cmp_float(const void *a, const void *b)
+{
+	float x = *(const float *)a, y = *(const float *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/* p-th percentile of v[0..n), sorted in place; -1 if empty */
+static float pct(float *v, size_t n, int p)
+{
+	if (!n)
+		return -1;
+	qsort(v, n, sizeof(*v), cmp_float);
+	return v[(n - 1) * p / 100];
+}
+
+static void fleet_report(const struct fleet_sweep *sw, int nsw)
+{
+	float *det = malloc(nflows * sizeof(*det));
+	float *ratio = malloc(nflows * sizeof(*ratio));
+	size_t s, f, nd, nr, ndet, ndis, live;
+	int k;
+
+	for (f = 0, nd = 0; f < nflows; f++)
+		if (flows[f].n)
+			det[nd++] = flows[f].goodput_mbps;
+	live = nd;
+	printf("# %zu flows, goodput Mbit/s p10 %.2f p50 %.2f p90 %.2f\n", live,
+	       pct(det, nd, 10), pct(det, nd, 50), pct(det, nd, 90));
+
+	for (k = 0; k < nsw; k++)
+		printf("%-16s ", sw[k].name);
+	printf("%6s %6s %26s %20s\n", "det%", "dis%",
+	       "detect_s p10/p50/p90", "cap_ratio p10/p50/p90");
+	for (s = 0; s < nsettings; s++) {
+		const struct fleet_result *r = &results[s * nflows];
+		size_t rest = s;
+		int vals[FLEET_SWEEP_MAX];
+
+		nd = nr = ndet = ndis = 0;
+		for (f = 0; f < nflows; f++) {
+			if (!flows[f].n)
+				continue;
+			ndet += r[f].classify == RTCP_FLOW_DETECTED;
+			ndis += r[f].classify == RTCP_FLOW_DISABLED;
+			if (r[f].detect_s >= 0)
+				det[nd++] = r[f].detect_s;
+			if (r[f].cap_ratio >= 0)
+				ratio[nr++] = r[f].cap_ratio;
+		}
+		for (k = nsw - 1; k >= 0; k--) {
+			vals[k] = sw[k].values[rest % sw[k].n];
+			rest /= sw[k].n;
+		}
+		for (k = 0; k < nsw; k++)
+			printf("%-16d ", vals[k]);
+		printf("%6.1f %6.1f %8.2f/%8.2f/%8.2f %6.2f/%6.2f/%6.2f\n",
+		       live ? 100.0 * ndet / live : 0, live ? 100.0 * ndis / live : 0,
+		       pct(det, nd, 10), pct(det, nd, 50), pct(det, nd, 90),
+		       pct(ratio, nr, 10), pct(ratio, nr, 50), pct(ratio, nr, 90));
+	}
+	free(det);
+	free(ratio);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-j threads] [-P param=value]... [-s param=v1,v2,..]...\n"
+		"          capture...\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+	struct fleet_sweep sw[FLEET_SWEEP_MAX];
+	struct rtcp_params base, overrides;
+	struct rtcp_trace_hdr hdr;
+	int nsw = 0, opt, i, have_base = 0;
+	char *set[64];
+	int nset = 0;
+	struct timespec t0, t1;
+	size_t items, per;
+
+	nworkers = sysconf(_SC_NPROCESSORS_ONLN);
+	memset(sw, 0, sizeof(sw));
+	while ((opt = getopt(argc, argv, "j:P:s:")) != -1) {
+		switch (opt) {
+		case 'j': nworkers = atoi(optarg); break;
+		case 'P':
+			if (nset < 64)
+				set[nset++] = optarg;
+			break;
+		case 's':
+			if (nsw == FLEET_SWEEP_MAX || fleet_sweep_parse(&sw[nsw++], optarg)) {
+				fprintf(stderr, "bad sweep %s\n", optarg);
+				return 2;
+			}
+			break;
+		default:
+			usage(argv[0]);
+			return 2;
+		}
+	}
+	if (optind == argc) {
+		usage(argv[0]);
+		return 2;
+	}
+	if (nworkers < 1)
+		nworkers = 1;
+
+	for (i = optind; i < argc; i++) {
+		if (fleet_load(argv[i], &hdr))
+			return 1;
+		if (!have_base) {
+			/* Parameters of the first capture, then -P */
+			base.probe_interval = hdr.probe_interval;
+			base.probe_per = hdr.probe_per;
+			base.optimize_flag = hdr.optimize_flag;
+			base.monitor_peroid = hdr.monitor_peroid;
+			base.high_loss_disclassify = hdr.high_loss_disclassify;
+			base.use_goodput = hdr.use_goodput;
+			base.exclude_RTO = hdr.exclude_RTO;
+			base.exclude_rwnd = hdr.exclude_rwnd;
+			base.exclude_applimited = hdr.exclude_applimited;
+			base.window_ms = hdr.window_ms;
+			base.window_kb = hdr.window_kb;
+			have_base = 1;
+		}
+	}
+	overrides = base;
+	for (i = 0; i < nset; i++) {
+		if (rtcp_param_set(&overrides, set[i])) {
+			fprintf(stderr, "unknown parameter %s\n", set[i]);
+			return 2;
+		}
+	}
+	if (!nflows) {
+		fprintf(stderr, "no replayable flows\n");
+		return 1;
+	}
+	if (fleet_settings(&overrides, sw, nsw))
+		return 1;
+
+	items = nsettings * nflows;
+	if (items > UINT32_MAX) {
+		fprintf(stderr, "too many flows x settings\n");
+		return 1;
+	}
+	results = calloc(items, sizeof(*results));
+	workers = calloc(nworkers, sizeof(*workers));
+	if (!results || !workers) {
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	per = (items + nworkers - 1) / nworkers;
+	for (i = 0; i < nworkers; i++) {
+		size_t b = min(items, i * per), e = min(items, b + per);
+
+		atomic_store(&workers[i].range, RANGE(b, e));
+	}
+	for (i = 0; i < nworkers; i++)
+		pthread_create(&workers[i].thread, NULL, fleet_worker_fn, &workers[i]);
+	for (i = 0; i < nworkers; i++)
+		pthread_join(workers[i].thread, NULL);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	fleet_report(sw, nsw);
+	fprintf(stderr, "%zu flows x %zu settings on %d threads in %.2f s\n",
+		nflows, nsettings, nworkers,
+		(t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9);
+	return 0;
+}
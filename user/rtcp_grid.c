@@ -0,0 +1,316 @@
+/*
+ * R-TCP: batch evaluation of (B, R) hypothesis grids
+ *
+ * See rtcp_grid.h. The AVX2 kernels reproduce the engine's integer results
+ * exactly:
+ *
+ *   - AVX2 has no 64-bit division. rtcp_grid_rates() divides h < 2^56 by
+ *     the flow age e < 2^32, so the quotient is estimated in double and made
+ *     exact by integer correction steps against h - q * e.
+ *   - comp() compares floor(x / r) against y for arbitrary 64-bit x and r.
+ *     The vector code decides in double when the two sides are clearly
+ *     apart and hands the rare near-ties to the scalar code.
+ *
+ * The R-TCP module was designed and implemented by
+ * Shengtong Zhu, Yan Liu, Lingfeng Guo and Jack Y. B. Lee,
+ *  "R-TCP: A Framework to Optimize TCP Performance Over Rate-Limiting Networks", NSDI, 2026.
+ *
+ * Contact  : zs021@ie.cuhk.edu.hk
+ */
+#include <stdlib.h>
+#include "rtcp_grid.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define RTCP_GRID_AVX2 1
+#endif
+
+int rtcp_grid_batch_alloc(struct rtcp_grid_batch *b, size_t n)
+{
+	int i, err = 0;
+
+	memset(b, 0, sizeof(*b));
+	b->n = n;
+	for (i = 0; i < RTCP_GRID; i++) {
+		b->B[i] = aligned_alloc(32, (n * sizeof(u64) + 31) & ~31UL);
+		b->R[i] = aligned_alloc(32, (n * sizeof(u64) + 31) & ~31UL);
+		err |= !b->B[i] || !b->R[i];
+	}
+	b->delivered = calloc(n, sizeof(u32));
+	b->now_us = calloc(n, sizeof(u32));
+	b->start_us = calloc(n, sizeof(u32));
+	b->win = calloc(n, sizeof(u64));
+	b->best = calloc(n, 1);
+	b->young = calloc(n, 1);
+	if (err || !b->delivered || !b->now_us || !b->start_us || !b->win ||
+	    !b->best || !b->young) {
+		rtcp_grid_batch_free(b);
+		return -1;
+	}
+	return 0;
+}
+
+void rtcp_grid_batch_free(struct rtcp_grid_batch *b)
+{
+	int i;
+
+	for (i = 0; i < RTCP_GRID; i++) {
+		free(b->B[i]);
+		free(b->R[i]);
+	}
+	free(b->delivered);
+	free(b->now_us);
+	free(b->start_us);
+	free(b->win);
+	free(b->best);
+	free(b->young);
+	memset(b, 0, sizeof(*b));
+}
+
+#ifdef RTCP_GRID_AVX2
+
+#define AVX2 __attribute__((target("avx2")))
+
+#define TWO52		4503599627370496.0		/* 2^52 */
+#define TWO52_51	6755399441055744.0		/* 2^52 + 2^51 */
+#define TWO32		4294967296.0
+
+/* u64 to double, rounded; exact below 2^53 */
+static inline AVX2 __m256d u64_to_pd(__m256i x)
+{
+	const __m256i magic = _mm256_set1_epi64x(0x4330000000000000LL);
+	__m256d lo = _mm256_sub_pd(_mm256_castsi256_pd(_mm256_or_si256(
+		_mm256_and_si256(x, _mm256_set1_epi64x(0xffffffffLL)), magic)),
+		_mm256_set1_pd(TWO52));
+	__m256d hi = _mm256_sub_pd(_mm256_castsi256_pd(_mm256_or_si256(
+		_mm256_srli_epi64(x, 32), magic)), _mm256_set1_pd(TWO52));
+
+	return _mm256_add_pd(_mm256_mul_pd(hi, _mm256_set1_pd(TWO32)), lo);
+}
+
+/* s64 in (-2^51, 2^51) to double and back, exact */
+static inline AVX2 __m256d s64_to_pd(__m256i x)
+{
+	const __m256d m = _mm256_set1_pd(TWO52_51);
+
+	return _mm256_sub_pd(_mm256_castsi256_pd(_mm256_add_epi64(x,
+		_mm256_castpd_si256(m))), m);
+}
+
+static inline AVX2 __m256i pd_to_s64(__m256d x)
+{
+	const __m256d m = _mm256_set1_pd(TWO52_51);
+
+	return _mm256_sub_epi64(_mm256_castpd_si256(_mm256_add_pd(x, m)),
+				_mm256_castpd_si256(m));
+}
+
+/* Low 64 bits of a * b for b < 2^32 */
+static inline AVX2 __m256i mullo_u64_u32(__m256i a, __m256i b)
+{
+	return _mm256_add_epi64(_mm256_mul_epu32(a, b), _mm256_slli_epi64(
+		_mm256_mul_epu32(_mm256_srli_epi64(a, 32), b), 32));
+}
+
+/* Unsigned a > b */
+static inline AVX2 __m256i cmpgt_u64(__m256i a, __m256i b)
+{
+	const __m256i bias = _mm256_set1_epi64x((long long)(1ULL << 63));
+
+	return _mm256_cmpgt_epi64(_mm256_xor_si256(a, bias),
+				  _mm256_xor_si256(b, bias));
+}
+
+/* floor(h / e) for h < 2^56, 16 <= e < 2^32, ed = e, inv16 = 16.0 / e */
+static inline AVX2 __m256i div_u56_u32(__m256i h, __m256i e, __m256d ed,
+				       __m256d inv16)
+{
+	const __m256d two52 = _mm256_set1_pd(TWO52);
+	__m256d q, c, r;
+
+	/* h / 16 is exact enough for an estimate within a few dozen, and the
+	 * estimate stays below 2^52, where the conversions are a single add
+	 */
+	q = _mm256_floor_pd(_mm256_mul_pd(_mm256_sub_pd(_mm256_castsi256_pd(
+		_mm256_or_si256(_mm256_srli_epi64(h, 4),
+				_mm256_castpd_si256(two52))), two52), inv16));
+	q = _mm256_add_pd(q, two52);
+	/* |h - q * e| < 2^51: the rest is exact in double */
+	r = s64_to_pd(_mm256_sub_epi64(h, mullo_u64_u32(_mm256_sub_epi64(
+		_mm256_castpd_si256(q), _mm256_castpd_si256(two52)), e)));
+	c = _mm256_floor_pd(_mm256_mul_pd(r, _mm256_mul_pd(inv16,
+		_mm256_set1_pd(1.0 / 16))));
+	r = _mm256_sub_pd(r, _mm256_mul_pd(c, ed));
+	/* the remainder's sign and size correct the last unit */
+	c = _mm256_add_pd(c, _mm256_and_pd(_mm256_cmp_pd(r, ed, _CMP_GE_OQ),
+					   _mm256_set1_pd(1)));
+	c = _mm256_sub_pd(c, _mm256_and_pd(_mm256_cmp_pd(r, _mm256_setzero_pd(),
+		_CMP_LT_OQ), _mm256_set1_pd(1)));
+	return _mm256_sub_epi64(_mm256_castpd_si256(_mm256_add_pd(q, c)),
+				_mm256_castpd_si256(two52));
+}
+
+/* x / 1000 for x < 2^32 */
+static inline AVX2 __m256i div1000_u32(__m256i x)
+{
+	return _mm256_srli_epi64(_mm256_mul_epu32(x,
+		_mm256_set1_epi64x(274877907)), 38);
+}
+
+static AVX2 size_t grid_rates_avx2(struct rtcp_grid_batch *b)
+{
+	size_t j, n = b->n & ~3UL;
+	int i;
+
+	for (j = 0; j < n; j += 4) {
+		__m256i now = _mm256_cvtepu32_epi64(_mm_loadu_si128(
+			(const __m128i *)&b->now_us[j]));
+		__m256i start = _mm256_cvtepu32_epi64(_mm_loadu_si128(
+			(const __m128i *)&b->start_us[j]));
+		__m256i d = _mm256_slli_epi64(_mm256_cvtepu32_epi64(
+			_mm_loadu_si128((const __m128i *)&b->delivered[j])),
+			RTCP_BW_SCALE);
+		__m256i e = _mm256_and_si256(_mm256_sub_epi64(now, start),
+					     _mm256_set1_epi64x(0xffffffffLL));
+		/* rtcp_young(): start % 1000 + e < 1000 */
+		__m256i old = _mm256_cmpgt_epi64(_mm256_add_epi64(e,
+			_mm256_sub_epi64(start, _mm256_mul_epu32(div1000_u32(start),
+				_mm256_set1_epi64x(1000)))),
+			_mm256_set1_epi64x(999));
+		__m256d ed = u64_to_pd(e);
+		__m256d inv16 = _mm256_div_pd(_mm256_set1_pd(16), ed);
+		__m256i win = _mm256_loadu_si256((const __m256i *)&b->win[j]);
+		__m256i any = _mm256_setzero_si256(), young;
+		int m;
+
+		/* a flow over 1ms old in ms but not in us: off the fast path */
+		if (!_mm256_testz_si256(old, _mm256_cmpgt_epi64(
+				_mm256_set1_epi64x(16), e))) {
+			rtcp_grid_ref_rates(b, j, j + 4);
+			continue;
+		}
+
+		for (i = 0; i < RTCP_GRID; i++)
+			any = _mm256_or_si256(any, cmpgt_u64(d,
+				_mm256_load_si256((const __m256i *)&b->B[i][j])));
+		young = _mm256_andnot_si256(old, any);
+		m = _mm256_movemask_pd(_mm256_castsi256_pd(young));
+		for (i = 0; i < 4; i++)
+			b->young[j + i] = m >> i & 1;
+
+		for (i = 0; i < RTCP_GRID; i++) {
+			__m256i B = _mm256_load_si256((const __m256i *)&b->B[i][j]);
+			__m256i R = _mm256_load_si256((const __m256i *)&b->R[i][j]);
+			__m256i upd = _mm256_andnot_si256(young, cmpgt_u64(d, B));
+			__m256i q = div_u56_u32(_mm256_sub_epi64(d, B), e, ed, inv16);
+
+			upd = _mm256_and_si256(upd, cmpgt_u64(q, R));
+			R = _mm256_blendv_epi8(R, q, upd);
+			/* then the windowed rate, unless the flow was young */
+			upd = _mm256_andnot_si256(young, cmpgt_u64(win, R));
+			_mm256_store_si256((__m256i *)&b->R[i][j],
+					   _mm256_blendv_epi8(R, win, upd));
+		}
+	}
+	return n;
+}
+
+/* |a - b| as the engine's abs() of a u64 difference */
+static inline AVX2 __m256i absdiff_u64(__m256i a, __m256i b)
+{
+	__m256i d = _mm256_sub_epi64(a, b);
+	__m256i sign = _mm256_cmpgt_epi64(_mm256_setzero_si256(), d);
+
+	return _mm256_sub_epi64(_mm256_xor_si256(d, sign), sign);
+}
+
+static AVX2 size_t grid_best_avx2(struct rtcp_grid_batch *b)
+{
+	/* x and (y + 1) * r in double are each within 2^-51 */
+	const __m256d hi_tol = _mm256_set1_pd(1 + 0x1p-48);
+	const __m256d lo_tol = _mm256_set1_pd(1 - 0x1p-48);
+	size_t j, n = b->n & ~3UL;
+	u64 lane[4];
+	int i, m;
+
+	for (j = 0; j < n; j += 4) {
+		__m256i now = _mm256_cvtepu32_epi64(_mm_loadu_si128(
+			(const __m128i *)&b->now_us[j]));
+		__m256i start = _mm256_cvtepu32_epi64(_mm_loadu_si128(
+			(const __m128i *)&b->start_us[j]));
+		/* floor(x / r) > y  <=>  x >= (y + 1) * r */
+		__m256d y1 = _mm256_add_pd(u64_to_pd(_mm256_slli_epi64(
+			_mm256_and_si256(_mm256_sub_epi64(now, start),
+					 _mm256_set1_epi64x(0xffffffffLL)), 3)),
+			_mm256_set1_pd(1));
+		__m256d y1_hi = _mm256_mul_pd(y1, hi_tol);
+		__m256d y1_lo = _mm256_mul_pd(y1, lo_tol);
+		__m256i best = _mm256_setzero_si256();
+		__m256i live = _mm256_set1_epi64x(-1), unsure = _mm256_setzero_si256();
+
+		/* comp() either moves on to i or stops, so while a flow is still
+		 * going its best is i - 1 and the hypotheses are independent
+		 */
+		for (i = 1; i < RTCP_GRID && !_mm256_testz_si256(live, live); i++) {
+			__m256i x = _mm256_slli_epi64(absdiff_u64(
+				_mm256_load_si256((const __m256i *)&b->B[i][j]),
+				_mm256_load_si256((const __m256i *)&b->B[i - 1][j])), 4);
+			__m256i r = absdiff_u64(
+				_mm256_load_si256((const __m256i *)&b->R[i][j]),
+				_mm256_load_si256((const __m256i *)&b->R[i - 1][j]));
+			__m256d xd = u64_to_pd(x), rd = u64_to_pd(r);
+			__m256i yes = _mm256_castpd_si256(_mm256_cmp_pd(xd,
+				_mm256_mul_pd(y1_hi, rd), _CMP_GE_OQ));
+			__m256i no = _mm256_castpd_si256(_mm256_cmp_pd(xd,
+				_mm256_mul_pd(y1_lo, rd), _CMP_LT_OQ));
+
+			/* r_diff == 0 always takes i, as x >= 0 does. Neither
+			 * clearly above nor below: leave it to the scalar code.
+			 */
+			unsure = _mm256_or_si256(unsure, _mm256_andnot_si256(
+				_mm256_or_si256(yes, no), live));
+			live = _mm256_and_si256(live, yes);
+			best = _mm256_sub_epi64(best, live);
+		}
+		_mm256_storeu_si256((__m256i *)lane, best);
+		m = _mm256_movemask_pd(_mm256_castsi256_pd(unsure));
+		for (i = 0; i < 4; i++) {
+			b->best[j + i] = lane[i];
+			if (m >> i & 1)
+				rtcp_grid_ref_best(b, j + i, j + i + 1);
+		}
+	}
+	return n;
+}
+
+static bool grid_avx2(void)
+{
+	static int has = -1;
+
+	if (has < 0)
+		has = __builtin_cpu_supports("avx2");
+	return has;
+}
+#endif /* RTCP_GRID_AVX2 */
+
+void rtcp_grid_batch_rates(struct rtcp_grid_batch *b)
+{
+	size_t done = 0;
+
+#ifdef RTCP_GRID_AVX2
+	if (grid_avx2())
+		done = grid_rates_avx2(b);
+#endif
+	rtcp_grid_ref_rates(b, done, b->n);
+}
+
+void rtcp_grid_batch_best(struct rtcp_grid_batch *b)
+{
+	size_t done = 0;
+
+#ifdef RTCP_GRID_AVX2
+	if (grid_avx2())
+		done = grid_best_avx2(b);
+#endif
+	rtcp_grid_ref_best(b, done, b->n);
+}
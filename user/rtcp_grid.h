@@ -0,0 +1,45 @@
+/*
+ * R-TCP: batch evaluation of (B, R) hypothesis grids
+ *
+ * The two per-ACK grid kernels of the engine, rtcp_grid_rates() and comp()
+ * in rtcp_core.c, run over many flows at once for the offline tools. Grids
+ * are stored as structure of arrays, one array per hypothesis with one
+ * element per flow, so that a vector register holds the same hypothesis of
+ * consecutive flows. On x86 with AVX2 four flows are updated per step; other
+ * CPUs, and the flows left over, use the engine's own scalar code, which is
+ * also exported here as the reference the vector code must match bit for
+ * bit (rtcp_bench -g checks it).
+ *
+ * Internal to the userspace tools; not installed.
+ */
+#ifndef _RTCP_GRID_H
+#define _RTCP_GRID_H
+
+#include <stddef.h>
+#include "rtcp_shim.h"
+#include "../rtcp_core.h"
+
+struct rtcp_grid_batch {
+	size_t n;			/* flows */
+	u64 *B[RTCP_GRID];		/* B[i][flow], as PMODRL.B_arr */
+	u64 *R[RTCP_GRID];		/* R[i][flow], as PMODRL.R_arr */
+	u32 *delivered;			/* packets since the transfer started */
+	u32 *now_us;
+	u32 *start_us;			/* PMODRL.bbr_start_us */
+	u64 *win;			/* rtcp_floor_R(), the floor on R */
+	u8 *best;			/* out: comp() */
+	u8 *young;			/* out: rtcp_grid_rates() returned false */
+};
+
+int rtcp_grid_batch_alloc(struct rtcp_grid_batch *b, size_t n);
+void rtcp_grid_batch_free(struct rtcp_grid_batch *b);
+
+/* rtcp_grid_rates() and comp() for every flow of the batch */
+void rtcp_grid_batch_rates(struct rtcp_grid_batch *b);
+void rtcp_grid_batch_best(struct rtcp_grid_batch *b);
+
+/* The engine's scalar code for flows [from, to), in rtcp_user.c */
+void rtcp_grid_ref_rates(struct rtcp_grid_batch *b, size_t from, size_t to);
+void rtcp_grid_ref_best(struct rtcp_grid_batch *b, size_t from, size_t to);
+
+#endif /* _RTCP_GRID_H */
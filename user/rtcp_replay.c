@@ -0,0 +1,248 @@
+/*
+ * R-TCP: capture replayer
+ *
+ * Feeds a binary capture of the kernel module (debugfs rtcp/trace, format in
+ * ../rtcp_trace.h) back through the engine, with the parameters recorded in
+ * the capture header, and prints per flow the final classification and B/R
+ * estimate. The engine is the same rtcp_core.c as the module's and every
+ * call into it is in the capture, so the result matches the kernel's bit for
+ * bit. -v also prints the classification and estimate after every ACK.
+ *
+ * -B replays every flow through the engine as the BPF program builds it
+ * (rtcp_bpf.h) as well, and compares the two after every record: the events
+ * raised and the whole engine state must be identical. The first record
+ * where a flow differs is printed, and the exit status is 1 if any does.
+ *
+ * Flows whose first record is not RTCP_TRACE_INIT (the capture started while
+ * they were running) or that resumed a handover cannot be replayed and are
+ * skipped.
+ *
+ * The R-TCP module was designed and implemented by
+ * Shengtong Zhu, Yan Liu, Lingfeng Guo and Jack Y. B. Lee,
+ *  "R-TCP: A Framework to Optimize TCP Performance Over Rate-Limiting Networks", NSDI, 2026.
+ *
+ * Contact  : zs021@ie.cuhk.edu.hk
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "rtcp_shim.h"
+#include "rtcp_user.h"
+#include "../rtcp_core.h"
+#include "../rtcp_trace.h"
+#include "rtcp_bpf.h"
+
+#define REPLAY_FLOWS_BITS	12
+#define REPLAY_FLOWS		(1 << REPLAY_FLOWS_BITS)
+
+struct replay_flow {
+	u32 id;
+	bool used;
+	bool skip;		/* no INIT seen, or resumed from a handover */
+	struct rtcp_flow *flow;
+	struct rtcp_bpf_flow *bpf;	/* -B */
+	bool differs;			/* -B found a difference */
+	u32 start_us, detect_us;
+	u64 acks;
+	u16 mss;
+	unsigned int events;
+};
+
+static struct replay_flow flows[REPLAY_FLOWS];
+
+/* Open addressing on the flow hash; a full table drops new flows. */
+static struct replay_flow *replay_lookup(u32 id)
+{
+	unsigned int i, h = (id * 2654435761U) >> (32 - REPLAY_FLOWS_BITS);
+
+	for (i = 0; i < REPLAY_FLOWS; i++) {
+		struct replay_flow *f = &flows[(h + i) & (REPLAY_FLOWS - 1)];
+
+		if (!f->used) {
+			f->used = true;
+			f->id = id;
+			f->skip = true;
+			return f;
+		}
+		if (f->id == id)
+			return f;
+	}
+	return NULL;
+}
+
+static void replay_print(const struct replay_flow *f)
+{
+	static bool header;
+	struct rtcp_estimate est;
+
+	if (!header) {
+		printf("%-8s %10s %8s %10s %12s %12s %6s\n", "flow", "acks",
+		       "classify", "detect_s", "B_bytes", "R_Bps", "probed");
+		header = true;
+	}
+	rtcp_flow_estimate(f->flow, f->mss, &est);
+	printf("%08x %10llu %8u %10.3f %12llu %12llu %6s\n", f->id,
+	       (unsigned long long)f->acks, est.classify,
+	       f->detect_us ? (f->detect_us - f->start_us) / 1e6 : -1.0,
+	       (unsigned long long)est.bucket_bytes,
+	       (unsigned long long)est.rate_bps,
+	       f->events & RTCP_FLOW_PROBE ? "probe" : "-");
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-v] [-B] [-f flow] capture\n", prog);
+}
+
+/* -B: compare the BPF build with librtcp after the record; true if equal */
+static bool replay_compare(struct replay_flow *f, const struct rtcp_trace_rec *rec,
+			   unsigned int events, unsigned int bpf_events)
+{
+	static struct rtcp_state a, b;
+
+	rtcp_flow_save(f->flow, &a);
+	rtcp_bpf_flow_save(f->bpf, &b);
+	if (events == bpf_events && !memcmp(&a, &b, sizeof(a)))
+		return true;
+	printf("%08x: BPF build differs at now_us %u delivered %u op %u: "
+	       "events %x/%x classify %u/%u B %llu/%llu R %llu/%llu\n",
+	       rec->flow, rec->now_us, rec->delivered, rec->op, events,
+	       bpf_events, a.classify, b.classify,
+	       (unsigned long long)a.B_arr[a.best_index % RTCP_GRID],
+	       (unsigned long long)b.B_arr[b.best_index % RTCP_GRID],
+	       (unsigned long long)a.R_arr[a.best_index % RTCP_GRID],
+	       (unsigned long long)b.R_arr[b.best_index % RTCP_GRID]);
+	return false;
+}
+
+int main(int argc, char **argv)
+{
+	struct rtcp_trace_hdr hdr;
+	struct rtcp_trace_rec rec;
+	struct rtcp_params params;
+	unsigned long long skipped = 0, compared = 0, differ = 0;
+	int verbose = 0, only = 0, bpf = 0, opt;
+	u32 only_id = 0;
+	unsigned int i;
+	FILE *in;
+
+	while ((opt = getopt(argc, argv, "vBf:")) != -1) {
+		switch (opt) {
+		case 'v': verbose = 1; break;
+		case 'B': bpf = 1; break;
+		case 'f': only = 1; only_id = strtoul(optarg, NULL, 16); break;
+		default:
+			usage(argv[0]);
+			return 2;
+		}
+	}
+	if (optind != argc - 1) {
+		usage(argv[0]);
+		return 2;
+	}
+
+	in = strcmp(argv[optind], "-") ? fopen(argv[optind], "rb") : stdin;
+	if (!in) {
+		perror(argv[optind]);
+		return 1;
+	}
+	if (fread(&hdr, sizeof(hdr), 1, in) != 1 || hdr.magic != RTCP_TRACE_MAGIC ||
+	    hdr.version != RTCP_TRACE_VERSION || hdr.rec_size != sizeof(rec)) {
+		fprintf(stderr, "%s: not an R-TCP capture of this version\n",
+			argv[optind]);
+		return 1;
+	}
+	params.probe_interval = hdr.probe_interval;
+	params.probe_per = hdr.probe_per;
+	params.optimize_flag = hdr.optimize_flag;
+	params.monitor_peroid = hdr.monitor_peroid;
+	params.high_loss_disclassify = hdr.high_loss_disclassify;
+	params.use_goodput = hdr.use_goodput;
+	params.exclude_RTO = hdr.exclude_RTO;
+	params.exclude_rwnd = hdr.exclude_rwnd;
+	params.exclude_applimited = hdr.exclude_applimited;
+	params.window_ms = hdr.window_ms;
+	params.window_kb = hdr.window_kb;
+	rtcp_set_params(&params);
+	rtcp_bpf_set_params(&hdr);
+
+	if (verbose)
+		printf("%-8s %10s %10s %8s %12s %12s\n", "flow", "now_us",
+		       "delivered", "classify", "B_bytes", "R_Bps");
+	while (fread(&rec, sizeof(rec), 1, in) == 1) {
+		struct replay_flow *f;
+		unsigned int events;
+
+		if (only && rec.flow != only_id)
+			continue;
+		f = replay_lookup(rec.flow);
+		if (!f) {
+			skipped++;
+			continue;
+		}
+		if (rec.op == RTCP_TRACE_INIT) {
+			if (f->flow && !f->skip)
+				replay_print(f);
+			if ((!f->flow && !(f->flow = rtcp_flow_new(rec.now_us))) ||
+			    (bpf && !f->bpf && !(f->bpf = rtcp_bpf_flow_new()))) {
+				fprintf(stderr, "out of memory\n");
+				return 1;
+			}
+			f->differs = false;
+			compared += bpf;
+			f->skip = false;
+			f->start_us = rec.now_us;
+			f->detect_us = 0;
+			f->acks = 0;
+			f->events = 0;
+		} else if (rec.op == RTCP_TRACE_RESUME) {
+			f->skip = true;
+		}
+		if (f->skip) {
+			skipped++;
+			continue;
+		}
+
+		events = rtcp_flow_replay(f->flow, &rec);
+		f->events |= events;
+		if (bpf && !f->differs &&
+		    !replay_compare(f, &rec, events,
+				    rtcp_bpf_flow_replay(f->bpf, &rec))) {
+			f->differs = true;
+			differ++;
+		}
+		if (rec.op != RTCP_TRACE_ACK_END)
+			continue;
+		f->acks++;
+		f->mss = rec.mss;
+		if (!f->detect_us && rtcp_flow_capped(f->flow))
+			f->detect_us = rec.now_us;
+		if (verbose) {
+			struct rtcp_estimate est;
+
+			rtcp_flow_estimate(f->flow, rec.mss, &est);
+			printf("%08x %10u %10u %8u %12llu %12llu\n", rec.flow,
+			       rec.now_us, rec.delivered, est.classify,
+			       (unsigned long long)est.bucket_bytes,
+			       (unsigned long long)est.rate_bps);
+		}
+	}
+	if (in != stdin)
+		fclose(in);
+
+	for (i = 0; i < REPLAY_FLOWS; i++) {
+		if (flows[i].flow && !flows[i].skip)
+			replay_print(&flows[i]);
+		rtcp_flow_free(flows[i].flow);
+		rtcp_bpf_flow_free(flows[i].bpf);
+	}
+	if (skipped)
+		fprintf(stderr, "%llu records of flows that cannot be replayed skipped\n",
+			skipped);
+	if (bpf) {
+		fprintf(stderr, "%llu of %llu flows differ in the BPF build\n",
+			differ, compared);
+		return differ ? 1 : 0;
+	}
+	return 0;
+}
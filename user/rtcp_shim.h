@@ -0,0 +1,40 @@
+/*
+ * R-TCP: kernel types and helpers for userspace builds of the engine
+ *
+ * Just enough of the kernel environment for rtcp_core.h and rtcp_core.c,
+ * with the same semantics as the kernel versions (u32 sequence wrap-around
+ * in before(), abs() of the operand's signed type).
+ */
+#ifndef _RTCP_SHIM_H
+#define _RTCP_SHIM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <limits.h>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int32_t s32;
+typedef int64_t s64;
+
+#define USEC_PER_MSEC	1000ULL
+#define USEC_PER_SEC	1000000ULL
+
+#define min(a, b)	((a) < (b) ? (a) : (b))
+#define max(a, b)	((a) > (b) ? (a) : (b))
+#define abs(x) __builtin_choose_expr(sizeof(x) == sizeof(s64),		\
+	({ s64 __x = (x); __x < 0 ? -__x : __x; }),			\
+	({ s32 __x = (x); __x < 0 ? -__x : __x; }))
+#define div_u64(n, d)	((u64)(n) / (d))
+#define div64_u64(n, d)	((u64)(n) / (u64)(d))
+
+static inline bool before(u32 seq1, u32 seq2)
+{
+	return (s32)(seq1 - seq2) < 0;
+}
+#define after(seq2, seq1)	before(seq1, seq2)
+
+#endif /* _RTCP_SHIM_H */
@@ -0,0 +1,911 @@
+/*
+ * R-TCP: trace-driven simulator
+ *
+ * Runs the R-TCP engine (librtcp, the same rtcp_core.c as the kernel module)
+ * without a kernel, in one of two modes:
+ *
+ *   link   A sender paced by a simplified BBR host, as in rtcp_bbr.c, sends
+ *          over a token-bucket policer (rate, bucket) and a drop-tail
+ *          bottleneck (link rate, queue) with a fixed base RTT. Every
+ *          combination of the comma-separated -r/-b/-t lists is one run.
+ *          Rate 0 is no policer; -f starts its bucket part full, -W
+ *          replaces the bucket with a quota of rate * ms per sliding
+ *          window, -D puts a peak bucket (rate, KB) in front of it, -S
+ *          turns the policer into a shaper with a queue, -l adds random
+ *          loss past the bottleneck (a lossy radio link) and -G bursty
+ *          Gilbert-Elliott loss, -A puts CoDel or FQ-CoDel on the
+ *          bottleneck, -x adds competing CUBIC flows, -B changes the link
+ *          rate mid-run (a handover), -a compresses the ACKs into periodic
+ *          trains, -o makes the sender idle periodically (chunked video),
+ *          and -n runs the host as stock BBR, without the engine's cap and
+ *          PROBE, as the baseline.
+ *   trace  Recorded ACKs (-T), one per line, are fed to the engine as is.
+ *
+ * Each run prints one line: detection latency (from the first policer drop
+ * to classify == 1), the error of the B and R estimates (B against the
+ * quota under -W), goodput, loss rate, mean RTT, the time the cap was in
+ * force, the loss rate of what was sent under it and the policer model the
+ * estimate is for. Runs are deterministic for a given -s seed. In link mode, -w also writes the runs as a binary capture
+ * (../rtcp_trace.h), one flow per run, for rtcp_replay.
+ *
+ * The competing flows are one fluid aggregate: CUBIC windows that fill the
+ * shared FIFO and back off on its overflow or CoDel drops. Under FQ-CoDel
+ * they are always backlogged in their own queues, so the sender gets an
+ * equal share of the link.
+ *
+ * The host model has BBR's startup, drain and gain cycling, windowed max
+ * bandwidth filter and the R-TCP hooks of rtcp_bbr.c (cap, PROBE event); it
+ * has no long-term bandwidth sampling, recovery or PROBE_RTT. Lost packets
+ * are not retransmitted, so goodput is the delivered packets alone.
+ *
+ * The R-TCP module was designed and implemented by
+ * Shengtong Zhu, Yan Liu, Lingfeng Guo and Jack Y. B. Lee,
+ *  "R-TCP: A Framework to Optimize TCP Performance Over Rate-Limiting Networks", NSDI, 2026.
+ *
+ * Contact  : zs021@ie.cuhk.edu.hk
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include "rtcp_shim.h"
+#include "rtcp_user.h"
+#include "../rtcp_core.h"
+#include "../rtcp_trace.h"
+
+#define SIM_RING	(1 << 17)	/* max packets in flight */
+#define SIM_LIST_MAX	64
+
+#define BBR_HIGH_GAIN	2.885
+#define BBR_BW_ROUNDS	10
+#define BBR_CYCLE_LEN	8
+
+static const double bbr_pacing_gain[BBR_CYCLE_LEN] = {
+	1.25, 0.75, 1, 1, 1, 1, 1, 1
+};
+
+enum { BBR_STARTUP, BBR_DRAIN, BBR_PROBE_BW };
+
+enum { SIM_FIFO, SIM_CODEL, SIM_FQ_CODEL };
+
+#define CODEL_TARGET_US		5000
+#define CODEL_INTERVAL_US	100000
+
+#define CUBIC_C			0.4
+#define CUBIC_BETA		0.7
+
+/* -w: binary capture of the link mode runs */
+static FILE *sim_capture;
+static u32 sim_capture_flow;
+
+static void sim_capture_rec(u8 op, const struct rtcp_ack *ack, unsigned int mss)
+{
+	struct rtcp_trace_rec rec;
+
+	if (!sim_capture)
+		return;
+	memset(&rec, 0, sizeof(rec));
+	rec.flow = sim_capture_flow;
+	rec.op = op;
+	rec.now_us = (u32)ack->now_us;
+	rec.min_rtt_us = ack->min_rtt_us;
+	rec.delivered = ack->delivered;
+	rec.lost = ack->lost;
+	rec.acked = ack->acked;
+	rec.bytes_acked = ack->bytes_acked;
+	rec.prior_delivered = ack->prior_delivered;
+	rec.rs_delivered = ack->sample_delivered;
+	rec.interval_us = ack->interval_us;
+	rec.flags = ack->app_limited ? RTCP_TRACE_APP_LIMITED : 0;
+	rec.rtt_us = -1;
+	rec.mss = mss;
+	fwrite(&rec, sizeof(rec), 1, sim_capture);
+}
+
+static int sim_capture_open(const char *path, const struct rtcp_params *p)
+{
+	struct rtcp_trace_hdr hdr = {
+		.magic			= RTCP_TRACE_MAGIC,
+		.version		= RTCP_TRACE_VERSION,
+		.rec_size		= sizeof(struct rtcp_trace_rec),
+		.probe_interval		= p->probe_interval,
+		.probe_per		= p->probe_per,
+		.optimize_flag		= p->optimize_flag,
+		.monitor_peroid		= p->monitor_peroid,
+		.high_loss_disclassify	= p->high_loss_disclassify,
+		.use_goodput		= p->use_goodput,
+		.exclude_RTO		= p->exclude_RTO,
+		.exclude_rwnd		= p->exclude_rwnd,
+		.exclude_applimited	= p->exclude_applimited,
+		.window_ms		= p->window_ms,
+		.window_kb		= p->window_kb,
+	};
+
+	sim_capture = fopen(path, "wb");
+	if (!sim_capture) {
+		perror(path);
+		return -1;
+	}
+	fwrite(&hdr, sizeof(hdr), 1, sim_capture);
+	return 0;
+}
+
+struct sim_cfg {
+	double rate_mbps;	/* policer token rate */
+	double bucket_kb;	/* policer bucket size */
+	double fill;		/* share of the bucket full at the start */
+	double window_ms;	/* > 0: sliding-window quota, not a bucket */
+	double peak_mbps, peak_kb;	/* > 0: peak bucket before the bucket */
+	double rtt_ms;		/* base RTT */
+	double link_mbps;	/* bottleneck link rate */
+	unsigned int queue;	/* bottleneck queue, packets */
+	double duration_s;
+	unsigned int mss;
+	double shape_kb;	/* > 0: shaper queue instead of policer drops */
+	double loss;		/* random loss probability past the bottleneck */
+	double ge_p, ge_r;	/* Gilbert-Elliott: good to bad, bad to good */
+	double ge_loss;		/* loss probability in the bad state */
+	int aqm;		/* SIM_FIFO, SIM_CODEL or SIM_FQ_CODEL */
+	double aggr_ms;		/* > 0: ACKs released in trains at this period */
+	double on_ms, off_ms;	/* off_ms > 0: data for on_ms, then none */
+	unsigned int cross;	/* competing CUBIC flows */
+	double rates[SIM_LIST_MAX];	/* -B: time s, link Mbit/s pairs */
+	int nrates;
+	unsigned long seed;
+	int plain;		/* stock BBR: no cap, no PROBE */
+};
+
+struct sim_pkt {
+	double send_us;
+	double event_us;	/* ACK arrival, or loss detection if dropped */
+	double delivered_us;	/* delivered_mstamp at send */
+	double first_tx_us;	/* first_tx_mstamp at send */
+	uint32_t delivered;	/* delivered at send */
+	int dropped;
+	int capped;		/* sent with the cap in force */
+};
+
+struct sim_result {
+	double detect_s;	/* < 0 if not detected */
+	double b_err, r_err;	/* relative error of the final estimate */
+	double goodput_mbps;
+	double loss;
+	double rtt_ms;		/* mean over delivered packets */
+	double capped_s;	/* time with the cap in force */
+	double capped_loss;	/* loss rate of the packets sent capped */
+	unsigned int classify;
+	unsigned int model;	/* enum rtcp_model at the end */
+};
+
+struct sim {
+	struct sim_cfg cfg;
+	struct sim_pkt *ring;
+	unsigned long head, tail;	/* ring[head..tail) in flight */
+
+	/* policer and bottleneck */
+	double tokens, token_us;
+	double peak_tokens, peak_us;
+	double *win_pass;		/* -W: pass times in the window, a ring */
+	unsigned long win_head, win_tail, win_quota;
+	double link_free_us;
+	double first_drop_us;
+	u64 rand;			/* xorshift state for -l and -G */
+	int ge_bad;
+	double rtt_sum_us;
+
+	/* CoDel, on the sender's queue */
+	double codel_above_us, codel_next_us;
+	unsigned int codel_count;
+	int codel_dropping;
+
+	/* competing CUBIC flows, per flow window in packets */
+	double x_cwnd, x_wmax, x_epoch_us, x_loss_us, x_us;
+	int x_ss;
+
+	/* sender */
+	uint32_t sent, delivered, lost;
+	double delivered_us, first_tx_us, next_send_us, last_event_us;
+	double min_rtt_us;
+	double cwnd;
+	double capped_us, last_ack_us;
+	int capped;
+	uint32_t capped_sent, capped_lost;
+
+	/* BBR host */
+	int mode, cycle_idx;
+	double cycle_us;
+	double bw_round[BBR_BW_ROUNDS];	/* max bw per round, pkts/us */
+	uint32_t round, next_round_delivered;
+	double full_bw;
+	int full_bw_cnt;
+	double pacing_gain, cwnd_gain;
+	double pacing;			/* pkts/us */
+};
+
+static double sim_max_bw(const struct sim *s)
+{
+	double bw = 0;
+	int i;
+
+	for (i = 0; i < BBR_BW_ROUNDS; i++)
+		if (s->bw_round[i] > bw)
+			bw = s->bw_round[i];
+	return bw;
+}
+
+static double sim_bdp(const struct sim *s, double gain)
+{
+	return gain * sim_max_bw(s) * s->min_rtt_us;
+}
+
+/* Uniform in [0, 1) */
+static double sim_rand(struct sim *s)
+{
+	s->rand ^= s->rand << 13;
+	s->rand ^= s->rand >> 7;
+	s->rand ^= s->rand << 17;
+	return (s->rand >> 11) * 0x1p-53;
+}
+
+/* Loss past the bottleneck: -G's two-state chain, else -l */
+static int sim_radio_loss(struct sim *s)
+{
+	const struct sim_cfg *c = &s->cfg;
+
+	if (c->ge_p > 0) {
+		if (sim_rand(s) < (s->ge_bad ? c->ge_r : c->ge_p))
+			s->ge_bad = !s->ge_bad;
+		if (s->ge_bad)
+			return sim_rand(s) < c->ge_loss;
+	}
+	return c->loss > 0 && sim_rand(s) < c->loss;
+}
+
+/* Link rate at now, after the -B changes */
+static double sim_link_mbps(const struct sim *s, double now)
+{
+	double mbps = s->cfg.link_mbps;
+	int i;
+
+	for (i = 0; i + 1 < s->cfg.nrates; i += 2)
+		if (now >= s->cfg.rates[i] * 1e6)
+			mbps = s->cfg.rates[i + 1];
+	return mbps;
+}
+
+/* CoDel's dequeue decision (RFC 8289) for a packet leaving at now */
+static int sim_codel_drop(struct sim *s, double now, double sojourn_us)
+{
+	int ok = 0;
+
+	if (sojourn_us < CODEL_TARGET_US)
+		s->codel_above_us = 0;
+	else if (s->codel_above_us == 0)
+		s->codel_above_us = now + CODEL_INTERVAL_US;
+	else if (now >= s->codel_above_us)
+		ok = 1;
+
+	if (s->codel_dropping) {
+		if (!ok) {
+			s->codel_dropping = 0;
+			return 0;
+		}
+		if (now < s->codel_next_us)
+			return 0;
+		s->codel_count++;
+		s->codel_next_us += CODEL_INTERVAL_US / sqrt(s->codel_count);
+		return 1;
+	}
+	if (!ok)
+		return 0;
+	s->codel_dropping = 1;
+	s->codel_count = s->codel_count > 2 &&
+			 now - s->codel_next_us < 16 * CODEL_INTERVAL_US ?
+			 s->codel_count - 2 : 1;
+	s->codel_next_us = now + CODEL_INTERVAL_US / sqrt(s->codel_count);
+	return 1;
+}
+
+/* The competing flows back off, at most once per RTT. */
+static void sim_cross_loss(struct sim *s, double now)
+{
+	if (now - s->x_loss_us < s->cfg.rtt_ms * 1000)
+		return;
+	s->x_loss_us = now;
+	s->x_ss = 0;
+	s->x_wmax = s->x_cwnd;
+	s->x_cwnd *= CUBIC_BETA;
+	s->x_epoch_us = now;
+}
+
+/* Advance the competing flows to now. On a FIFO, what they sent since the
+ * last call joins the queue ahead of the sender; tx_us is a packet's
+ * transmission time at the full link rate.
+ */
+static void sim_cross(struct sim *s, double now, double tx_us)
+{
+	const struct sim_cfg *c = &s->cfg;
+	double rtt_us = c->rtt_ms * 1000, dt = now - s->x_us;
+	double backlog, before, t, k, share;
+
+	if (!c->cross || dt <= 0)
+		return;
+	backlog = c->aqm != SIM_FQ_CODEL && s->link_free_us > now ?
+		  s->link_free_us - now : 0;
+	if (s->x_ss) {
+		s->x_cwnd *= exp2(dt / (rtt_us + backlog));
+	} else {
+		t = (now - s->x_epoch_us) / 1e6;
+		k = cbrt(s->x_wmax * (1 - CUBIC_BETA) / CUBIC_C);
+		s->x_cwnd = CUBIC_C * (t - k) * (t - k) * (t - k) + s->x_wmax;
+		if (s->x_cwnd < 2)
+			s->x_cwnd = 2;
+	}
+
+	if (c->aqm == SIM_FQ_CODEL) {
+		/* Their own queues: CoDel drops once a window exceeds the
+		 * share's BDP by more than the target delay.
+		 */
+		share = (rtt_us + CODEL_TARGET_US) / (tx_us * (c->cross + 1));
+		if (s->x_cwnd > share)
+			sim_cross_loss(s, now);
+	} else {
+		/* Whatever does not fit in the queue is dropped. */
+		before = s->link_free_us > s->x_us ? s->link_free_us : s->x_us;
+		s->link_free_us = before + c->cross * s->x_cwnd * dt /
+				  (rtt_us + backlog) * tx_us;
+		if (s->link_free_us - now > c->queue * tx_us) {
+			s->link_free_us = now + c->queue * tx_us;
+			if (s->link_free_us < before)
+				s->link_free_us = before;
+			sim_cross_loss(s, now);
+		}
+	}
+	s->x_us = now;
+}
+
+/* Send one packet at now through the policer and the bottleneck. */
+static void sim_send(struct sim *s, double now)
+{
+	const struct sim_cfg *c = &s->cfg;
+	struct sim_pkt *p = &s->ring[s->tail++ % SIM_RING];
+	double rtt_us = c->rtt_ms * 1000;
+	double tx_us = c->mss * 8 / sim_link_mbps(s, now);
+	double arrive = now, start, t, tokens;
+
+	if (s->delivered == 0 && s->lost == 0 && s->sent == 0)
+		s->first_tx_us = s->delivered_us = now;
+	p->send_us = now;
+	p->delivered = s->delivered;
+	p->delivered_us = s->delivered_us;
+	p->first_tx_us = s->first_tx_us;
+	p->dropped = 0;
+	p->capped = s->capped;
+	s->sent++;
+	s->capped_sent += s->capped;
+
+	if (c->rate_mbps > 0 && c->window_ms > 0) {
+		/* A sliding window passes win_quota packets in any window_ms */
+		while (s->win_head < s->win_tail &&
+		       s->win_pass[s->win_head % s->win_quota] <= now - c->window_ms * 1000)
+			s->win_head++;
+		if (s->win_tail - s->win_head >= s->win_quota) {
+			p->dropped = 1;
+			if (s->first_drop_us < 0)
+				s->first_drop_us = now;
+		} else {
+			s->win_pass[s->win_tail++ % s->win_quota] = now;
+		}
+	} else if (c->rate_mbps > 0) {
+		/* A shaper sends the packet once it has the tokens, behind the
+		 * packets already queued; a policer drops it if it has none.
+		 */
+		t = now > s->token_us ? now : s->token_us;
+		tokens = s->tokens + (t - s->token_us) * c->rate_mbps / 8;
+		if (tokens > c->bucket_kb * 1000)
+			tokens = c->bucket_kb * 1000;
+		if (c->shape_kb <= 0) {
+			s->tokens = tokens;
+			s->token_us = t;
+			if (c->peak_mbps > 0) {
+				s->peak_tokens += (now - s->peak_us) * c->peak_mbps / 8;
+				if (s->peak_tokens > c->peak_kb * 1000)
+					s->peak_tokens = c->peak_kb * 1000;
+				s->peak_us = now;
+				if (s->peak_tokens < c->mss)
+					tokens = 0;
+				else if (tokens >= c->mss)
+					s->peak_tokens -= c->mss;
+			}
+		} else if (tokens < c->mss) {
+			t += (c->mss - tokens) * 8 / c->rate_mbps;
+			tokens = c->mss;
+		}
+		if (tokens < c->mss ||
+		    (t - now) * c->rate_mbps / 8 > c->shape_kb * 1000) {
+			p->dropped = 1;
+			if (s->first_drop_us < 0)
+				s->first_drop_us = now;
+		} else {
+			s->tokens = tokens - c->mss;
+			s->token_us = t;
+			arrive = t;
+		}
+	}
+	if (!p->dropped) {
+		sim_cross(s, arrive, tx_us);
+		if (c->aqm == SIM_FQ_CODEL)
+			tx_us *= c->cross + 1;
+		start = arrive > s->link_free_us ? arrive : s->link_free_us;
+		if (start - arrive > c->queue * tx_us) {
+			p->dropped = 1;
+		} else if (c->aqm != SIM_FIFO &&
+			   sim_codel_drop(s, start, start - arrive)) {
+			p->dropped = 1;
+			if (c->cross && c->aqm == SIM_CODEL)
+				sim_cross_loss(s, start);
+		} else {
+			s->link_free_us = start + tx_us;
+			p->dropped = sim_radio_loss(s);
+		}
+	}
+
+	/* Dropped packets are detected about an RTT later, in order. With -a
+	 * the ACKs of a period arrive together at its end, as behind an
+	 * aggregating LTE or Wi-Fi hop.
+	 */
+	p->event_us = p->dropped ? now + rtt_us : s->link_free_us + rtt_us;
+	if (c->aggr_ms > 0 && !p->dropped)
+		p->event_us = ceil(p->event_us / (c->aggr_ms * 1000)) *
+			      c->aggr_ms * 1000;
+	if (p->event_us < s->last_event_us)
+		p->event_us = s->last_event_us;
+	s->last_event_us = p->event_us;
+}
+
+static void sim_set_gains(struct sim *s)
+{
+	switch (s->mode) {
+	case BBR_STARTUP:
+		s->pacing_gain = BBR_HIGH_GAIN;
+		s->cwnd_gain = BBR_HIGH_GAIN;
+		break;
+	case BBR_DRAIN:
+		s->pacing_gain = 1 / BBR_HIGH_GAIN;
+		s->cwnd_gain = BBR_HIGH_GAIN;
+		break;
+	case BBR_PROBE_BW:
+		s->pacing_gain = bbr_pacing_gain[s->cycle_idx];
+		s->cwnd_gain = 2;
+		break;
+	}
+}
+
+/* bbr_update_model(), reduced to what the engine interacts with */
+static void sim_update_model(struct sim *s, double now, double bw, int round_start)
+{
+	uint32_t inflight = s->sent - s->delivered - s->lost;
+
+	if (round_start)
+		s->bw_round[s->round % BBR_BW_ROUNDS] = 0;
+	if (bw > s->bw_round[s->round % BBR_BW_ROUNDS])
+		s->bw_round[s->round % BBR_BW_ROUNDS] = bw;
+
+	if (s->mode == BBR_STARTUP && round_start) {
+		if (sim_max_bw(s) >= s->full_bw * 1.25) {
+			s->full_bw = sim_max_bw(s);
+			s->full_bw_cnt = 0;
+		} else if (++s->full_bw_cnt >= 3) {
+			s->mode = BBR_DRAIN;
+		}
+	}
+	if (s->mode == BBR_DRAIN && inflight <= sim_bdp(s, 1)) {
+		s->mode = BBR_PROBE_BW;
+		s->cycle_idx = 2;
+		s->cycle_us = now;
+	}
+	if (s->mode == BBR_PROBE_BW && now - s->cycle_us > s->min_rtt_us) {
+		s->cycle_idx = (s->cycle_idx + 1) % BBR_CYCLE_LEN;
+		s->cycle_us = now;
+	}
+	sim_set_gains(s);
+}
+
+static void sim_ack(struct sim *s, struct rtcp_flow *flow, const struct sim_pkt *p)
+{
+	const struct sim_cfg *c = &s->cfg;
+	double now = p->event_us;
+	double send_elapsed, ack_elapsed, interval, bw, cap, target;
+	struct rtcp_ack ack;
+	unsigned int ev;
+	int round_start = 0;
+
+	s->delivered++;
+	s->delivered_us = now;
+	s->rtt_sum_us += now - p->send_us;
+	if (now - p->send_us < s->min_rtt_us)
+		s->min_rtt_us = now - p->send_us;
+
+	send_elapsed = p->send_us - p->first_tx_us;
+	ack_elapsed = now - p->delivered_us;
+	interval = send_elapsed > ack_elapsed ? send_elapsed : ack_elapsed;
+	s->first_tx_us = p->send_us;
+	bw = interval > 0 ? (s->delivered - p->delivered) / interval : 0;
+
+	if (p->delivered >= s->next_round_delivered) {
+		s->next_round_delivered = s->delivered;
+		s->round++;
+		round_start = 1;
+	}
+	sim_update_model(s, now, bw, round_start);
+
+	memset(&ack, 0, sizeof(ack));
+	ack.now_us = (uint64_t)now;
+	ack.min_rtt_us = (uint32_t)s->min_rtt_us;
+	ack.delivered = s->delivered;
+	ack.lost = s->lost;
+	ack.acked = s->delivered;
+	ack.bytes_acked = (uint64_t)s->delivered * c->mss;
+	ack.prior_delivered = p->delivered;
+	ack.sample_delivered = s->delivered - p->delivered;
+	ack.interval_us = (int64_t)interval;
+	sim_capture_rec(RTCP_TRACE_ACK, &ack, c->mss);
+	ev = rtcp_flow_ack(flow, &ack);
+	if (ev & RTCP_FLOW_PROBE && !c->plain) {
+		s->mode = BBR_PROBE_BW;
+		s->cycle_idx = 0;
+		s->cycle_us = now;
+		sim_set_gains(s);
+	}
+
+	if (sim_max_bw(s) > 0)
+		s->pacing = s->pacing_gain * sim_max_bw(s) * 0.99;
+	cap = c->plain ? 0 : rtcp_flow_pacing_cap(flow, c->mss);
+	if (cap > 0 && (cap / c->mss / 1e6 < s->pacing ||
+			rtcp_flow_probing(flow)))
+		s->pacing = cap / c->mss / 1e6;
+	if (cap > 0)
+		s->capped_us += now - s->last_ack_us;
+	s->last_ack_us = now;
+	s->capped = cap > 0;
+
+	target = sim_bdp(s, s->cwnd_gain) + 3;
+	if (s->mode != BBR_STARTUP)
+		s->cwnd = s->cwnd + 1 < target ? s->cwnd + 1 : target;
+	else if (s->cwnd < target || s->delivered < 10)
+		s->cwnd += 1;
+	if (s->cwnd < 4)
+		s->cwnd = 4;
+
+	sim_capture_rec(RTCP_TRACE_ACK_END, &ack, c->mss);
+	rtcp_flow_ack_end(flow, &ack);
+}
+
+static int sim_run(const struct sim_cfg *cfg, struct sim_result *res)
+{
+	struct rtcp_estimate est;
+	struct rtcp_flow *flow;
+	double end_us = cfg->duration_s * 1e6;
+	double detect_us = -1;
+	struct sim *s;
+
+	s = calloc(1, sizeof(*s));
+	if (!s)
+		return -1;
+	s->ring = calloc(SIM_RING, sizeof(*s->ring));
+	flow = rtcp_flow_new(0);
+	if (!s->ring || !flow) {
+		free(s->ring);
+		free(s);
+		rtcp_flow_free(flow);
+		return -1;
+	}
+	s->cfg = *cfg;
+	s->tokens = cfg->bucket_kb * 1000 * cfg->fill;
+	s->peak_tokens = cfg->peak_kb * 1000;
+	if (cfg->window_ms > 0) {
+		s->win_quota = cfg->rate_mbps * cfg->window_ms * 125 / cfg->mss;
+		if (s->win_quota < 1)
+			s->win_quota = 1;
+		s->win_pass = calloc(s->win_quota, sizeof(*s->win_pass));
+		if (!s->win_pass) {
+			free(s->ring);
+			free(s);
+			rtcp_flow_free(flow);
+			return -1;
+		}
+	}
+	s->rand = 0x9e3779b97f4a7c15ULL ^ cfg->seed * 0xbf58476d1ce4e5b9ULL;
+	s->x_cwnd = 10;
+	s->x_ss = 1;
+	s->x_loss_us = -1e12;
+	if (sim_capture) {
+		struct rtcp_ack start = { .now_us = 0 };
+
+		sim_capture_flow++;
+		sim_capture_rec(RTCP_TRACE_INIT, &start, cfg->mss);
+	}
+	s->first_drop_us = -1;
+	s->min_rtt_us = 1e12;
+	s->cwnd = 10;
+	s->mode = BBR_STARTUP;
+	sim_set_gains(s);
+	s->pacing = s->cwnd * BBR_HIGH_GAIN / 1000;	/* nominal 1ms RTT */
+
+	for (;;) {
+		uint32_t inflight = s->sent - s->delivered - s->lost;
+		double next_ack = s->head < s->tail ?
+			s->ring[s->head % SIM_RING].event_us : 1e300;
+		double next_send = inflight < s->cwnd &&
+			s->tail - s->head < SIM_RING ? s->next_send_us : 1e300;
+
+		if (cfg->off_ms > 0 && next_send < 1e300) {
+			double period = (cfg->on_ms + cfg->off_ms) * 1000;
+			double phase = fmod(next_send, period);
+
+			if (phase >= cfg->on_ms * 1000)
+				next_send += period - phase;
+		}
+
+		if (next_send <= next_ack) {
+			if (next_send >= end_us)
+				break;
+			sim_send(s, next_send);
+			s->next_send_us = next_send + 1 / s->pacing;
+		} else {
+			const struct sim_pkt *p = &s->ring[s->head++ % SIM_RING];
+
+			if (next_ack >= end_us)
+				break;
+			if (p->dropped) {
+				s->lost++;
+				s->capped_lost += p->capped;
+			} else {
+				sim_ack(s, flow, p);
+				rtcp_flow_estimate(flow, cfg->mss, &est);
+				if (detect_us < 0 && est.classify == RTCP_FLOW_DETECTED)
+					detect_us = next_ack;
+			}
+			if (s->next_send_us < next_ack)
+				s->next_send_us = next_ack;
+		}
+	}
+
+	rtcp_flow_estimate(flow, cfg->mss, &est);
+	res->classify = est.classify;
+	res->model = est.model;
+	res->detect_s = detect_us >= 0 && s->first_drop_us >= 0 ?
+		(detect_us - s->first_drop_us) / 1e6 : -1;
+	res->b_err = res->r_err = 0;
+	if (cfg->rate_mbps > 0) {
+		res->b_err = est.bucket_bytes / (cfg->window_ms > 0 ?
+			s->win_quota * cfg->mss : cfg->bucket_kb * 1000) - 1;
+		res->r_err = est.rate_bps / (cfg->rate_mbps * 1e6 / 8) - 1;
+	}
+	res->goodput_mbps = (double)s->delivered * cfg->mss * 8 /
+			    (cfg->duration_s * 1e6);
+	res->loss = s->sent ? (double)s->lost / s->sent : 0;
+	res->rtt_ms = s->delivered ? s->rtt_sum_us / s->delivered / 1000 : 0;
+	res->capped_s = s->capped_us / 1e6;
+	res->capped_loss = s->capped_sent ?
+			   (double)s->capped_lost / s->capped_sent : 0;
+
+	rtcp_flow_free(flow);
+	free(s->win_pass);
+	free(s->ring);
+	free(s);
+	return 0;
+}
+
+/* Trace mode: "now_us min_rtt_us delivered lost acked bytes_acked
+ * prior_delivered sample_delivered interval_us app_limited" per line,
+ * '#' starts a comment.
+ */
+static int sim_trace(const char *path, unsigned int mss)
+{
+	struct rtcp_estimate est;
+	struct rtcp_flow *flow = NULL;
+	double detect_us = -1;
+	unsigned long n = 0;
+	char line[512];
+	FILE *f;
+
+	f = strcmp(path, "-") ? fopen(path, "r") : stdin;
+	if (!f) {
+		perror(path);
+		return 1;
+	}
+	while (fgets(line, sizeof(line), f)) {
+		unsigned long long now, bytes;
+		long long interval;
+		unsigned int min_rtt, delivered, lost, acked, prior, app;
+		int sample;
+		struct rtcp_ack ack;
+
+		if (line[0] == '#' || line[0] == '\n')
+			continue;
+		if (sscanf(line, "%llu %u %u %u %u %llu %u %d %lld %u", &now,
+			   &min_rtt, &delivered, &lost, &acked, &bytes, &prior,
+			   &sample, &interval, &app) != 10) {
+			fprintf(stderr, "%s: bad line %lu\n", path, n + 1);
+			break;
+		}
+		if (!flow && !(flow = rtcp_flow_new(now)))
+			break;
+		memset(&ack, 0, sizeof(ack));
+		ack.now_us = now;
+		ack.min_rtt_us = min_rtt;
+		ack.delivered = delivered;
+		ack.lost = lost;
+		ack.acked = acked;
+		ack.bytes_acked = bytes;
+		ack.prior_delivered = prior;
+		ack.sample_delivered = sample;
+		ack.interval_us = interval;
+		ack.app_limited = app;
+		rtcp_flow_ack(flow, &ack);
+		rtcp_flow_ack_end(flow, &ack);
+		rtcp_flow_estimate(flow, mss, &est);
+		if (detect_us < 0 && est.classify == RTCP_FLOW_DETECTED)
+			detect_us = now;
+		n++;
+	}
+	if (f != stdin)
+		fclose(f);
+	if (!flow)
+		return 1;
+
+	rtcp_flow_estimate(flow, mss, &est);
+	printf("%-8s %10s %8s %12s %12s\n", "acks", "detect_us", "classify",
+	       "B_bytes", "R_Bps");
+	printf("%-8lu %10.0f %8u %12llu %12llu\n", n, detect_us, est.classify,
+	       (unsigned long long)est.bucket_bytes,
+	       (unsigned long long)est.rate_bps);
+	rtcp_flow_free(flow);
+	return 0;
+}
+
+static int parse_list(const char *arg, double *out)
+{
+	char *dup = strdup(arg), *tok, *save;
+	int n = 0;
+
+	for (tok = strtok_r(dup, ",", &save); tok && n < SIM_LIST_MAX;
+	     tok = strtok_r(NULL, ",", &save))
+		out[n++] = atof(tok);
+	free(dup);
+	return n;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-r Mbit/s,..] [-b KB,..] [-f fill%%] [-W ms]\n"
+		"          [-D Mbit/s,KB] [-t ms,..] [-c Mbit/s] [-q pkts] [-S KB]\n"
+		"          [-l loss%%] [-G to_bad%%,to_good%%,loss%%]\n"
+		"          [-A fifo|codel|fq_codel] [-x flows] [-B s,Mbit/s,..] [-a ms]\n"
+		"          [-o on_ms,off_ms] [-s seed] [-n] [-d s] [-m mss]\n"
+		"          [-P param=value]... [-H] [-w capture]\n"
+		"       %s -T trace [-m mss] [-P param=value]...\n",
+		prog, prog);
+}
+
+int main(int argc, char **argv)
+{
+	double rates[SIM_LIST_MAX] = { 10 }, buckets[SIM_LIST_MAX] = { 1000 };
+	double rtts[SIM_LIST_MAX] = { 40 }, ge[SIM_LIST_MAX];
+	int nr = 1, nb = 1, nt = 1, header = 1, i, j, k, opt;
+	struct sim_cfg cfg = {
+		.link_mbps = 100, .queue = 1000, .duration_s = 60, .mss = 1448,
+		.fill = 1,
+	};
+	struct rtcp_params params;
+	const char *trace = NULL, *capture = NULL;
+
+	rtcp_get_params(&params);
+	while ((opt = getopt(argc, argv, "r:b:f:W:D:t:c:q:S:l:G:A:x:B:a:o:s:nd:m:P:T:Hw:")) != -1) {
+		switch (opt) {
+		case 'r': nr = parse_list(optarg, rates); break;
+		case 'b': nb = parse_list(optarg, buckets); break;
+		case 'f': cfg.fill = atof(optarg) / 100; break;
+		case 'W': cfg.window_ms = atof(optarg); break;
+		case 'D':
+			if (parse_list(optarg, ge) != 2) {
+				usage(argv[0]);
+				return 2;
+			}
+			cfg.peak_mbps = ge[0];
+			cfg.peak_kb = ge[1];
+			break;
+		case 't': nt = parse_list(optarg, rtts); break;
+		case 'c': cfg.link_mbps = atof(optarg); break;
+		case 'q': cfg.queue = atoi(optarg); break;
+		case 'S': cfg.shape_kb = atof(optarg); break;
+		case 'l': cfg.loss = atof(optarg) / 100; break;
+		case 'G':
+			if (parse_list(optarg, ge) != 3) {
+				usage(argv[0]);
+				return 2;
+			}
+			cfg.ge_p = ge[0] / 100;
+			cfg.ge_r = ge[1] / 100;
+			cfg.ge_loss = ge[2] / 100;
+			break;
+		case 'A':
+			if (!strcmp(optarg, "fifo")) {
+				cfg.aqm = SIM_FIFO;
+			} else if (!strcmp(optarg, "codel")) {
+				cfg.aqm = SIM_CODEL;
+			} else if (!strcmp(optarg, "fq_codel")) {
+				cfg.aqm = SIM_FQ_CODEL;
+			} else {
+				usage(argv[0]);
+				return 2;
+			}
+			break;
+		case 'x': cfg.cross = atoi(optarg); break;
+		case 'B': cfg.nrates = parse_list(optarg, cfg.rates); break;
+		case 'a': cfg.aggr_ms = atof(optarg); break;
+		case 'o':
+			if (parse_list(optarg, ge) != 2) {
+				usage(argv[0]);
+				return 2;
+			}
+			cfg.on_ms = ge[0];
+			cfg.off_ms = ge[1];
+			break;
+		case 's': cfg.seed = strtoul(optarg, NULL, 0); break;
+		case 'n': cfg.plain = 1; break;
+		case 'd': cfg.duration_s = atof(optarg); break;
+		case 'm': cfg.mss = atoi(optarg); break;
+		case 'T': trace = optarg; break;
+		case 'H': header = 0; break;
+		case 'w': capture = optarg; break;
+		case 'P':
+			if (rtcp_param_set(&params, optarg)) {
+				fprintf(stderr, "unknown parameter %s\n", optarg);
+				return 2;
+			}
+			break;
+		default:
+			usage(argv[0]);
+			return 2;
+		}
+	}
+	rtcp_set_params(&params);
+	if (trace)
+		return sim_trace(trace, cfg.mss);
+	if (capture && sim_capture_open(capture, &params))
+		return 1;
+
+	if (header)
+		printf("%8s %8s %6s %8s %8s %8s %8s %10s %7s %8s %8s %10s %6s\n",
+		       "rate", "bucket", "rtt", "classify", "detect_s", "B_err%",
+		       "R_err%", "goodput", "loss%", "rtt_ms", "capped_s",
+		       "cap_loss%", "model");
+	for (i = 0; i < nr; i++) {
+		for (j = 0; j < nb; j++) {
+			for (k = 0; k < nt; k++) {
+				struct sim_result res;
+
+				cfg.rate_mbps = rates[i];
+				cfg.bucket_kb = buckets[j];
+				cfg.rtt_ms = rtts[k];
+				if (sim_run(&cfg, &res)) {
+					fprintf(stderr, "out of memory\n");
+					return 1;
+				}
+				printf("%8g %8g %6g %8u %8.2f %8.1f %8.1f %10.2f %7.2f %8.1f %8.2f %10.2f %6u\n",
+				       cfg.rate_mbps, cfg.bucket_kb, cfg.rtt_ms,
+				       res.classify, res.detect_s, res.b_err * 100,
+				       res.r_err * 100, res.goodput_mbps,
+				       res.loss * 100, res.rtt_ms, res.capped_s,
+				       res.capped_loss * 100, res.model);
+			}
+		}
+	}
+	if (sim_capture)
+		fclose(sim_capture);
+	return 0;
+}
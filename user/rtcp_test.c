@@ -0,0 +1,150 @@
+/*
+ * R-TCP: userspace runner of the engine tests
+ *
+ * Runs the cases of rtcp_core_test.c, the same ones the KUnit suite of
+ * rtcp_test.c runs in the kernel, against the engine built with
+ * rtcp_shim.h. The KUnit calls they use are reduced here to checks that
+ * print the failing expression and fail the case; the exit status is 1
+ * if any case failed. "make check" runs it.
+ *
+ * The R-TCP module was designed and implemented by
+ * Shengtong Zhu, Yan Liu, Lingfeng Guo and Jack Y. B. Lee,
+ *  "R-TCP: A Framework to Optimize TCP Performance Over Rate-Limiting Networks", NSDI, 2026.
+ *
+ * Contact  : zs021@ie.cuhk.edu.hk
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <setjmp.h>
+#include <time.h>
+#include "rtcp_shim.h"
+#include "../rtcp_core.h"
+
+/* Same defaults as rtcp.c */
+static int probe_interval = 20;
+static int probe_per = 24;
+static int optimize_flag = 1;
+static int high_loss_disclassify = 2;
+static int monitor_peroid = 3;
+static int use_goodput = 1;
+static int exclude_RTO = 0;
+static int exclude_rwnd = 0;
+static int exclude_applimited = 0;
+static int window_ms = 200;
+static int window_kb = 0;
+
+#define rtcp_event(pmodrl, ev)	do { } while (0)
+#define rtcp_history(pmodrl, s)	do { } while (0)
+
+#define RTCP_CORE_API static __attribute__((unused))
+#include "../rtcp_core.c"
+
+/* KUnit, as far as the cases use it */
+#define GFP_KERNEL	0
+#define U64_MAX		(~0ULL)
+#define ARRAY_SIZE(a)	(sizeof(a) / sizeof((a)[0]))
+
+struct kunit {
+	const char *name;
+	void *mem[16];		/* kunit_kzalloc()ed, freed after the case */
+	int nmem;
+	int failed;
+	jmp_buf abort;		/* KUNIT_ASSERT_*() failures end the case */
+};
+
+static void *kunit_kzalloc(struct kunit *test, size_t size, int gfp)
+{
+	void *p;
+
+	(void)gfp;
+	if (test->nmem == ARRAY_SIZE(test->mem))
+		return NULL;
+	p = calloc(1, size);
+	if (p)
+		test->mem[test->nmem++] = p;
+	return p;
+}
+
+#define kunit_info(test, fmt, ...) \
+	printf("    # %s: " fmt, (test)->name, ##__VA_ARGS__)
+
+#define KUNIT_FAIL_AT(test, expr, fmt, ...) do {			\
+		fprintf(stderr, "    # %s: %s:%d: %s" fmt "\n",		\
+			(test)->name, __FILE__, __LINE__, expr, ##__VA_ARGS__); \
+		(test)->failed = 1;					\
+	} while (0)
+
+#define KUNIT_EXPECT_OP_MSG(test, a, op, b, fmt, ...) do {		\
+		long long __a = (long long)(a), __b = (long long)(b);	\
+		if (!(__a op __b))					\
+			KUNIT_FAIL_AT(test, #a " " #op " " #b,		\
+				      " (%lld vs %lld) " fmt, __a, __b,	\
+				      ##__VA_ARGS__);			\
+	} while (0)
+
+#define KUNIT_EXPECT_EQ_MSG(t, a, b, ...) KUNIT_EXPECT_OP_MSG(t, a, ==, b, __VA_ARGS__)
+#define KUNIT_EXPECT_NE_MSG(t, a, b, ...) KUNIT_EXPECT_OP_MSG(t, a, !=, b, __VA_ARGS__)
+#define KUNIT_EXPECT_LE_MSG(t, a, b, ...) KUNIT_EXPECT_OP_MSG(t, a, <=, b, __VA_ARGS__)
+#define KUNIT_EXPECT_EQ(t, a, b)	KUNIT_EXPECT_OP_MSG(t, a, ==, b, "")
+#define KUNIT_EXPECT_NE(t, a, b)	KUNIT_EXPECT_OP_MSG(t, a, !=, b, "")
+#define KUNIT_EXPECT_LE(t, a, b)	KUNIT_EXPECT_OP_MSG(t, a, <=, b, "")
+#define KUNIT_EXPECT_GT(t, a, b)	KUNIT_EXPECT_OP_MSG(t, a, >, b, "")
+#define KUNIT_EXPECT_GE(t, a, b)	KUNIT_EXPECT_OP_MSG(t, a, >=, b, "")
+#define KUNIT_EXPECT_TRUE(t, c)		KUNIT_EXPECT_OP_MSG(t, !!(c), ==, 1, "")
+#define KUNIT_EXPECT_FALSE(t, c)	KUNIT_EXPECT_OP_MSG(t, !!(c), ==, 0, "")
+#define KUNIT_ASSERT_EQ(test, a, b) do {				\
+		if ((a) != (b)) {					\
+			KUNIT_FAIL_AT(test, #a " == " #b, "");		\
+			longjmp((test)->abort, 1);			\
+		}							\
+	} while (0)
+#define KUNIT_ASSERT_NOT_NULL(test, p) do {				\
+		if (!(p)) {						\
+			KUNIT_FAIL_AT(test, #p " != NULL", "");		\
+			longjmp((test)->abort, 1);			\
+		}							\
+	} while (0)
+
+static u64 rtcp_test_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+#include "../rtcp_core_test.c"
+
+static const struct {
+	const char *name;
+	void (*run)(struct kunit *test);
+} cases[] = {
+	{ "curves",	rtcp_test_curves_case },
+	{ "wrap",	rtcp_test_wrap_case },
+	{ "comp_abs",	rtcp_test_comp_abs_case },
+	{ "young",	rtcp_test_young_case },
+	{ "shift",	rtcp_test_shift_case },
+	{ "state",	rtcp_test_state_case },
+	{ "cap_gain",	rtcp_test_cap_gain_case },
+	{ "bench",	rtcp_test_bench_case },
+};
+
+int main(void)
+{
+	int failed = 0;
+	size_t i;
+
+	printf("1..%zu\n", ARRAY_SIZE(cases));
+	for (i = 0; i < ARRAY_SIZE(cases); i++) {
+		struct kunit test = { .name = cases[i].name };
+
+		if (!setjmp(test.abort))
+			cases[i].run(&test);
+		while (test.nmem)
+			free(test.mem[--test.nmem]);
+		printf("%s %zu %s\n", test.failed ? "not ok" : "ok", i + 1,
+		       cases[i].name);
+		failed |= test.failed;
+	}
+	return failed;
+}
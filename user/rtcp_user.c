@@ -0,0 +1,299 @@
+/*
+ * R-TCP: userspace library
+ *
+ * See rtcp_user.h for the interface. The engine is rtcp_core.c, compiled
+ * here against rtcp_shim.h; this file maps struct rtcp_ack onto the engine's
+ * per-ACK sample and collects engine events for the caller.
+ *
+ * The R-TCP module was designed and implemented by
+ * Shengtong Zhu, Yan Liu, Lingfeng Guo and Jack Y. B. Lee,
+ *  "R-TCP: A Framework to Optimize TCP Performance Over Rate-Limiting Networks", NSDI, 2026.
+ *
+ * Contact  : zs021@ie.cuhk.edu.hk
+ */
+#include <stddef.h>
+#include <stdlib.h>
+#include "rtcp_shim.h"
+#include "rtcp_user.h"
+#include "../rtcp_core.h"
+#include "../rtcp_trace.h"
+#include "rtcp_grid.h"
+
+#define BBR_SCALE 8
+#define BBR_UNIT (1 << BBR_SCALE)
+
+/* Same defaults as rtcp.c */
+static struct rtcp_params rtcp_params = {
+	.probe_interval		= 20,
+	.probe_per		= 24,
+	.optimize_flag		= 1,
+	.monitor_peroid		= 3,
+	.high_loss_disclassify	= 2,
+	.use_goodput		= 1,
+	.exclude_RTO		= 0,
+	.exclude_rwnd		= 0,
+	.exclude_applimited	= 0,
+	.window_ms		= 200,
+	.window_kb		= 0,
+};
+static __thread struct rtcp_params rtcp_thread_params;
+static __thread bool rtcp_thread_params_set;
+
+void rtcp_get_params(struct rtcp_params *params)
+{
+	*params = rtcp_params;
+}
+
+void rtcp_set_params(const struct rtcp_params *params)
+{
+	rtcp_params = *params;
+}
+
+void rtcp_set_thread_params(const struct rtcp_params *params)
+{
+	if (params)
+		rtcp_thread_params = *params;
+	rtcp_thread_params_set = params != NULL;
+}
+
+int rtcp_param_set(struct rtcp_params *params, const char *arg)
+{
+	static const struct {
+		const char *name;
+		size_t off;
+	} names[] = {
+#define P(f) { #f, offsetof(struct rtcp_params, f) }
+		P(probe_interval), P(probe_per), P(optimize_flag),
+		P(monitor_peroid), P(high_loss_disclassify), P(use_goodput),
+		P(exclude_RTO), P(exclude_rwnd), P(exclude_applimited),
+		P(window_ms), P(window_kb),
+#undef P
+	};
+	const char *eq = strchr(arg, '=');
+	size_t i;
+
+	for (i = 0; eq && i < sizeof(names) / sizeof(names[0]); i++) {
+		if (strlen(names[i].name) == (size_t)(eq - arg) &&
+		    !strncmp(names[i].name, arg, eq - arg)) {
+			*(int *)((char *)params + names[i].off) = atoi(eq + 1);
+			return 0;
+		}
+	}
+	return -1;
+}
+
+/* The engine reads its parameters by name; these follow the calling
+ * thread's override, if any.
+ */
+#define rtcp_cur_params \
+	(rtcp_thread_params_set ? &rtcp_thread_params : &rtcp_params)
+#define probe_interval		(rtcp_cur_params->probe_interval)
+#define probe_per		(rtcp_cur_params->probe_per)
+#define optimize_flag		(rtcp_cur_params->optimize_flag)
+#define monitor_peroid		(rtcp_cur_params->monitor_peroid)
+#define high_loss_disclassify	(rtcp_cur_params->high_loss_disclassify)
+#define use_goodput		(rtcp_cur_params->use_goodput)
+#define exclude_RTO		(rtcp_cur_params->exclude_RTO)
+#define exclude_rwnd		(rtcp_cur_params->exclude_rwnd)
+#define exclude_applimited	(rtcp_cur_params->exclude_applimited)
+#define window_ms		(rtcp_cur_params->window_ms)
+#define window_kb		(rtcp_cur_params->window_kb)
+
+struct rtcp_flow {
+	struct PMODRL pmodrl;	/* first, see rtcp_event() */
+	unsigned int events;	/* RTCP_FLOW_* raised in rtcp_ack() */
+};
+
+#define rtcp_event(pmodrl, ev) \
+	(((struct rtcp_flow *)(pmodrl))->events |= 1U << (ev))
+#define rtcp_history(pmodrl, s)	do { } while (0)
+
+#define RTCP_CORE_API static __attribute__((unused))
+#include "../rtcp_core.c"
+
+_Static_assert(RTCP_FLOW_CLASSIFYING == 1U << RTCP_EV_CLASSIFYING &&
+	       RTCP_FLOW_PROBE == 1U << RTCP_EV_PROBE,
+	       "event masks follow enum rtcp_event");
+_Static_assert((int)RTCP_FLOW_BUCKET == RTCP_MODEL_BUCKET &&
+	       (int)RTCP_FLOW_DUAL == RTCP_MODEL_DUAL,
+	       "models follow enum rtcp_model");
+
+static void rtcp_flow_sample(const struct rtcp_ack *ack, struct rtcp_sample *s)
+{
+	memset(s, 0, sizeof(*s));
+	s->now_us = (u32)ack->now_us;
+	s->min_rtt_us = ack->min_rtt_us;
+	s->delivered = ack->delivered;
+	s->lost = ack->lost;
+	s->acked = ack->acked;
+	s->bytes_acked = ack->bytes_acked;
+	s->prior_delivered = ack->prior_delivered;
+	s->rs_delivered = ack->sample_delivered;
+	s->interval_us = ack->interval_us;
+	s->app_limited = ack->app_limited;
+	s->rwnd_limited = ack->rwnd_limited;
+	s->rto_exit = ack->rto_exit;
+}
+
+struct rtcp_flow *rtcp_flow_new(uint64_t now_us)
+{
+	struct rtcp_flow *flow = calloc(1, sizeof(*flow));
+
+	if (flow)
+		flow->pmodrl.bbr_start_us = (u32)now_us;
+	return flow;
+}
+
+void rtcp_flow_free(struct rtcp_flow *flow)
+{
+	free(flow);
+}
+
+void rtcp_flow_start(struct rtcp_flow *flow, const struct rtcp_ack *ack)
+{
+	struct rtcp_sample s;
+
+	rtcp_flow_sample(ack, &s);
+	rtcp_start(&flow->pmodrl, &s);
+}
+
+void rtcp_flow_restart_round(struct rtcp_flow *flow, uint32_t delivered)
+{
+	rtcp_restart_round(&flow->pmodrl, delivered);
+}
+
+unsigned int rtcp_flow_ack(struct rtcp_flow *flow, const struct rtcp_ack *ack)
+{
+	struct rtcp_sample s;
+	unsigned int events;
+
+	rtcp_flow_sample(ack, &s);
+	rtcp_ack(&flow->pmodrl, &s);
+	events = flow->events;
+	flow->events = 0;
+	return events;
+}
+
+void rtcp_flow_ack_end(struct rtcp_flow *flow, const struct rtcp_ack *ack)
+{
+	struct rtcp_sample s;
+
+	rtcp_flow_sample(ack, &s);
+	rtcp_ack_end(&flow->pmodrl, &s);
+}
+
+/* bbr_bw_to_pacing_rate_pmodrl() of rtcp_bbr.c, without sk_max_pacing_rate */
+uint64_t rtcp_flow_pacing_cap(const struct rtcp_flow *flow, uint32_t mss)
+{
+	const struct PMODRL *pmodrl = &flow->pmodrl;
+	u64 rate;
+
+	if (!rtcp_cap_active(pmodrl))
+		return 0;
+	rate = rtcp_R(pmodrl);
+	rate *= mss;
+	rate *= rtcp_cap_gain(pmodrl, BBR_UNIT);
+	rate >>= BBR_SCALE;
+	rate *= USEC_PER_SEC / 100 * 99;
+	return rate >> RTCP_BW_SCALE;
+}
+
+bool rtcp_flow_probing(const struct rtcp_flow *flow)
+{
+	return rtcp_probing(&flow->pmodrl);
+}
+
+bool rtcp_flow_capped(const struct rtcp_flow *flow)
+{
+	return rtcp_capped(&flow->pmodrl);
+}
+
+void rtcp_flow_estimate(const struct rtcp_flow *flow, uint32_t mss,
+			struct rtcp_estimate *est)
+{
+	const struct PMODRL *pmodrl = &flow->pmodrl;
+
+	est->classify = pmodrl->classify;
+	est->bucket_bytes = (rtcp_B(pmodrl) * mss) >> RTCP_BW_SCALE;
+	est->rate_bps = (rtcp_R(pmodrl) * mss * USEC_PER_SEC) >> RTCP_BW_SCALE;
+	est->capped = rtcp_cap_active(pmodrl);
+	est->model = pmodrl->model;
+}
+
+unsigned int rtcp_flow_replay(struct rtcp_flow *flow,
+			      const struct rtcp_trace_rec *rec)
+{
+	struct PMODRL *pmodrl = &flow->pmodrl;
+	struct rtcp_sample s;
+	unsigned int events;
+
+	if (rec->op == RTCP_TRACE_INIT) {
+		memset(flow, 0, sizeof(*flow));
+		pmodrl->bbr_start_us = rec->now_us;
+		return 0;
+	}
+
+	/* The host's writes to the engine state between calls */
+	pmodrl->probe_rtt_flag = !!(rec->flags & RTCP_TRACE_PROBE_RTT);
+	rtcp_trace_to_sample(rec, &s);
+	switch (rec->op) {
+	case RTCP_TRACE_START:
+		rtcp_start(pmodrl, &s);
+		break;
+	case RTCP_TRACE_RESTART:
+		rtcp_restart_round(pmodrl, rec->delivered);
+		break;
+	case RTCP_TRACE_ACK:
+		rtcp_ack(pmodrl, &s);
+		break;
+	case RTCP_TRACE_ACK_END:
+		rtcp_ack_end(pmodrl, &s);
+		break;
+	}
+	events = flow->events;
+	flow->events = 0;
+	return events;
+}
+
+void rtcp_flow_save(const struct rtcp_flow *flow, struct rtcp_state *st)
+{
+	rtcp_save(&flow->pmodrl, st);
+}
+
+/* Scalar reference for the batch grid kernels (rtcp_grid.h) */
+void rtcp_grid_ref_rates(struct rtcp_grid_batch *b, size_t from, size_t to)
+{
+	struct PMODRL pmodrl;
+	size_t j;
+	int i;
+
+	memset(&pmodrl, 0, sizeof(pmodrl));
+	for (j = from; j < to; j++) {
+		for (i = 0; i < RTCP_GRID; i++) {
+			pmodrl.B_arr[i] = b->B[i][j];
+			pmodrl.R_arr[i] = b->R[i][j];
+		}
+		pmodrl.bbr_start_us = b->start_us[j];
+		pmodrl.win_R[0] = pmodrl.win_R[1] = b->win[j];
+		b->young[j] = !rtcp_grid_rates(&pmodrl, b->delivered[j], b->now_us[j]);
+		for (i = 0; i < RTCP_GRID; i++)
+			b->R[i][j] = pmodrl.R_arr[i];
+	}
+}
+
+void rtcp_grid_ref_best(struct rtcp_grid_batch *b, size_t from, size_t to)
+{
+	struct PMODRL pmodrl;
+	size_t j;
+	int i;
+
+	memset(&pmodrl, 0, sizeof(pmodrl));
+	for (j = from; j < to; j++) {
+		for (i = 0; i < RTCP_GRID; i++) {
+			pmodrl.B_arr[i] = b->B[i][j];
+			pmodrl.R_arr[i] = b->R[i][j];
+		}
+		pmodrl.bbr_start_us = b->start_us[j];
+		b->best[j] = comp(&pmodrl, b->now_us[j]);
+	}
+}
@@ -0,0 +1,145 @@
+/*
+ * R-TCP: userspace library
+ *
+ * The R-TCP engine (token-bucket detection, (B, R) estimation and cap
+ * probing) built from the same source as the kernel module, for transports
+ * that run their congestion control in userspace, such as QUIC stacks.
+ *
+ * Per connection, the transport creates a struct rtcp_flow and, on every
+ * ACK frame:
+ *
+ *   1. fills a struct rtcp_ack from its delivery rate sampler,
+ *   2. calls rtcp_flow_ack() and reacts to the returned events,
+ *   3. computes its own pacing rate and clamps it to rtcp_flow_pacing_cap(),
+ *   4. calls rtcp_flow_ack_end().
+ *
+ * Counters are in packets, as in the kernel; they may wrap at 2^32. A flow is
+ * not thread safe; separate flows may be used from separate threads. The
+ * parameters are process-wide and should be set before flows are created;
+ * a thread may override them with rtcp_set_thread_params().
+ */
+#ifndef _RTCP_USER_H
+#define _RTCP_USER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct rtcp_flow;
+
+/* One ACK frame, with the fields of the kernel's tcp_sock and rate_sample
+ * that the engine reads.
+ */
+struct rtcp_ack {
+	uint64_t now_us;		/* monotonic clock */
+	uint32_t min_rtt_us;		/* transport's min RTT estimate */
+	uint32_t delivered;		/* packets delivered so far */
+	uint32_t lost;			/* packets declared lost so far */
+	uint32_t acked;			/* packets cumulatively acknowledged */
+	uint64_t bytes_acked;		/* bytes acknowledged so far */
+	uint32_t prior_delivered;	/* delivered when the acked packet was sent */
+	int32_t sample_delivered;	/* packets delivered in the rate sample */
+	int64_t interval_us;		/* rate sample interval, <= 0 if invalid */
+	bool app_limited;		/* rate sample is application limited */
+	bool rwnd_limited;		/* sender is blocked by flow control */
+	bool rto_exit;			/* just recovered from a timeout (PTO) */
+};
+
+/* Events returned by rtcp_flow_ack() */
+#define RTCP_FLOW_CLASSIFYING	(1U << 0)	/* drop your own policer model */
+#define RTCP_FLOW_PROBE		(1U << 1)	/* start probing for bandwidth */
+
+/* Detection state, see rtcp_flow_estimate() */
+enum rtcp_flow_class {
+	RTCP_FLOW_UNKNOWN = 0,		/* no rate limiting seen yet */
+	RTCP_FLOW_DETECTED = 1,		/* token-bucket policer detected */
+	RTCP_FLOW_DISABLED = 2,		/* policer ruled out */
+	/* 5..10: reset by one of the exclude_* parameters */
+};
+
+/* Policer model the estimate is for */
+enum rtcp_flow_model {
+	RTCP_FLOW_BUCKET = 0,		/* token bucket */
+	RTCP_FLOW_DUAL = 1,		/* token bucket behind a peak bucket */
+};
+
+struct rtcp_estimate {
+	unsigned int classify;		/* enum rtcp_flow_class */
+	uint64_t bucket_bytes;		/* estimated bucket size B */
+	uint64_t rate_bps;		/* estimated token rate R, bytes/s */
+	bool capped;			/* pacing is clamped to the rate */
+	unsigned int model;		/* enum rtcp_flow_model */
+};
+
+/* Engine parameters, the same as the rtcp module's; see the README. */
+struct rtcp_params {
+	int probe_interval;
+	int probe_per;
+	int optimize_flag;
+	int monitor_peroid;
+	int high_loss_disclassify;
+	int use_goodput;
+	int exclude_RTO;
+	int exclude_rwnd;
+	int exclude_applimited;
+	int window_ms;
+	int window_kb;
+};
+
+void rtcp_get_params(struct rtcp_params *params);
+void rtcp_set_params(const struct rtcp_params *params);
+/* Parameters for flows driven from the calling thread only, e.g. to replay
+ * the same flows under different settings in parallel; NULL returns the
+ * thread to the process-wide ones.
+ */
+void rtcp_set_thread_params(const struct rtcp_params *params);
+/* Set one parameter from "name=value"; returns -1 for an unknown name. */
+int rtcp_param_set(struct rtcp_params *params, const char *arg);
+
+struct rtcp_flow *rtcp_flow_new(uint64_t now_us);
+void rtcp_flow_free(struct rtcp_flow *flow);
+
+/* The transport restarts sending after idle. */
+void rtcp_flow_start(struct rtcp_flow *flow, const struct rtcp_ack *ack);
+/* The transport restarted its packet-timed round (recovery, RTT probing). */
+void rtcp_flow_restart_round(struct rtcp_flow *flow, uint32_t delivered);
+
+/* Feed one ACK; returns a mask of RTCP_FLOW_* events. */
+unsigned int rtcp_flow_ack(struct rtcp_flow *flow, const struct rtcp_ack *ack);
+/* Finish the ACK after the transport applied its pacing rate. */
+void rtcp_flow_ack_end(struct rtcp_flow *flow, const struct rtcp_ack *ack);
+
+/* Pacing rate cap in bytes/s for packets of mss bytes, or 0 for none. Like
+ * rtcp_bbr, the cap is 1% below the estimated token rate.
+ */
+uint64_t rtcp_flow_pacing_cap(const struct rtcp_flow *flow, uint32_t mss);
+/* A cap probe is running: pace at rtcp_flow_pacing_cap(), not below it. */
+bool rtcp_flow_probing(const struct rtcp_flow *flow);
+/* Detection is done: the transport should not run its own policer model. */
+bool rtcp_flow_capped(const struct rtcp_flow *flow);
+void rtcp_flow_estimate(const struct rtcp_flow *flow, uint32_t mss,
+			struct rtcp_estimate *est);
+
+/* Binary captures of the kernel module (../rtcp_trace.h, rtcp_replay). Feed
+ * one flow's records in order; RTCP_TRACE_INIT resets the flow. Returns a
+ * mask of RTCP_FLOW_* events.
+ */
+struct rtcp_trace_rec;
+unsigned int rtcp_flow_replay(struct rtcp_flow *flow,
+			      const struct rtcp_trace_rec *rec);
+
+/* The flow's engine state in the handover format of the kernel module
+ * (struct rtcp_state of ../rtcp_core.h), e.g. to compare two builds of the
+ * engine on the same capture.
+ */
+struct rtcp_state;
+void rtcp_flow_save(const struct rtcp_flow *flow, struct rtcp_state *st);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _RTCP_USER_H */